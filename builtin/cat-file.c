@@ -380,6 +380,38 @@ static void batch_write(struct batch_options *opt, const void *data, int len)
 		write_or_die(1, data, len);
 }
 
+/*
+ * Stream the object through batch_write(), so that it ends up in the
+ * stdio buffer with --buffer and is written out directly otherwise.
+ * Loose objects and objects stored undeltified in a pack are inflated
+ * chunk by chunk straight into our buffer; only deltified objects have
+ * to be reconstructed in memory as a whole.
+ */
+static void stream_object_or_die(struct batch_options *opt,
+				 struct expand_data *data)
+{
+	const struct object_id *oid = &data->oid;
+	struct odb_read_stream *st;
+	char buf[1024 * 64];
+	ssize_t readlen;
+
+	st = odb_read_stream_open_flags(the_repository->objects, oid, NULL,
+					ODB_READ_STREAM_PACKED_ANY_SIZE);
+	if (!st)
+		die("unable to stream %s to stdout", oid_to_hex(oid));
+	if (st->type != data->type)
+		die("object %s changed type!?", oid_to_hex(oid));
+	if (data->info.sizep && st->size != data->size)
+		die("object %s changed size!?", oid_to_hex(oid));
+
+	while ((readlen = odb_read_stream_read(st, buf, sizeof(buf))) > 0)
+		batch_write(opt, buf, readlen);
+	if (readlen < 0)
+		die("unable to stream %s to stdout", oid_to_hex(oid));
+
+	odb_read_stream_close(st);
+}
+
 static void print_object_or_die(struct batch_options *opt, struct expand_data *data)
 {
 	const struct object_id *oid = &data->oid;
@@ -387,8 +419,6 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 	assert(data->info.typep);
 
 	if (data->type == OBJ_BLOB) {
-		if (opt->buffer_output)
-			fflush(stdout);
 		if (opt->transform_mode) {
 			char *contents;
 			unsigned long size;
@@ -416,10 +446,11 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 			batch_write(opt, contents, size);
 			free(contents);
 		} else {
-			stream_blob(oid);
+			stream_object_or_die(opt, data);
 		}
-	}
-	else {
+	} else if (!use_mailmap) {
+		stream_object_or_die(opt, data);
+	} else {
 		enum object_type type;
 		unsigned long size;
 		void *contents;
@@ -495,8 +495,9 @@ static struct ref *get_ref_map(struct remote *remote,
 	/* opportunistically-updated references: */
 	struct ref *orefs = NULL, **oref_tail = &orefs;
 
-	struct hashmap existing_refs;
-	int existing_refs_populated = 0;
+	struct ref_read_request *existing_refs = NULL;
+	struct ref **peer_refs = NULL;
+	size_t existing_refs_nr = 0, existing_refs_alloc = 0, peer_refs_alloc = 0;
 
 	filter_prefetch_refspec(rs);
 	if (remote)
@@ -609,31 +610,38 @@ static struct ref *get_ref_map(struct remote *remote,
 
 	ref_map = ref_remove_duplicates(ref_map);
 
+	/*
+	 * Read the current values of the local refs we are about to update
+	 * in a single batch. Like iterating over our refs, which used to be
+	 * done here, this skips refs that do not point to a valid object.
+	 */
 	for (rm = ref_map; rm; rm = rm->next) {
-		if (rm->peer_ref) {
-			const char *refname = rm->peer_ref->name;
-			struct refname_hash_entry *peer_item;
-			unsigned int hash = strhash(refname);
-
-			if (!existing_refs_populated) {
-				refname_hash_init(&existing_refs);
-				refs_for_each_ref(get_main_ref_store(the_repository),
-						  add_one_refname,
-						  &existing_refs);
-				existing_refs_populated = 1;
-			}
+		if (!rm->peer_ref || !starts_with(rm->peer_ref->name, "refs/"))
+			continue;
+		ALLOC_GROW(existing_refs, existing_refs_nr + 1, existing_refs_alloc);
+		ALLOC_GROW(peer_refs, existing_refs_nr + 1, peer_refs_alloc);
+		existing_refs[existing_refs_nr].refname = rm->peer_ref->name;
+		peer_refs[existing_refs_nr++] = rm->peer_ref;
+	}
 
-			peer_item = hashmap_get_entry_from_hash(&existing_refs,
-						hash, refname,
-						struct refname_hash_entry, ent);
-			if (peer_item) {
-				struct object_id *old_oid = &peer_item->oid;
-				oidcpy(&rm->peer_ref->old_oid, old_oid);
-			}
+	refs_read_refs(get_main_ref_store(the_repository), existing_refs,
+		       existing_refs_nr, RESOLVE_REF_READING);
+
+	for (size_t j = 0; j < existing_refs_nr; j++) {
+		struct ref_read_request *req = &existing_refs[j];
+
+		if (req->result)
+			continue;
+		if (!odb_has_object(the_repository->objects, &req->oid,
+				    HAS_OBJECT_RECHECK_PACKED | HAS_OBJECT_FETCH_PROMISOR)) {
+			error(_("%s does not point to a valid object!"), req->refname);
+			continue;
 		}
+		oidcpy(&peer_refs[j]->old_oid, &req->oid);
 	}
-	if (existing_refs_populated)
-		hashmap_clear_and_free(&existing_refs, struct refname_hash_entry, ent);
+
+	free(existing_refs);
+	free(peer_refs);
 
 	return ref_map;
 }
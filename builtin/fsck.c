@@ -27,6 +27,8 @@
 #include "worktree.h"
 #include "pack-revindex.h"
 #include "pack-bitmap.h"
+#include "tree-cache.h"
+#include "thread-utils.h"
 
 #define REACHABLE 0x0001
 #define SEEN      0x0002
@@ -51,6 +53,7 @@ static int show_progress = -1;
 static int show_dangling = 1;
 static int name_objects;
 static int check_references = 1;
+static int nr_threads = 1;
 #define ERROR_OBJECT 01
 #define ERROR_REACHABLE 02
 #define ERROR_PACK 04
@@ -935,7 +938,8 @@ static char const * const fsck_usage[] = {
 	N_("git fsck [--tags] [--root] [--unreachable] [--cache] [--no-reflogs]\n"
 	   "         [--[no-]full] [--strict] [--verbose] [--lost-found]\n"
 	   "         [--[no-]dangling] [--[no-]progress] [--connectivity-only]\n"
-	   "         [--[no-]name-objects] [--[no-]references] [<object>...]"),
+	   "         [--[no-]name-objects] [--[no-]references] [--threads=<n>]\n"
+	   "         [<object>...]"),
 	NULL
 };
 
@@ -955,6 +959,8 @@ static struct option fsck_opts[] = {
 	OPT_BOOL(0, "progress", &show_progress, N_("show progress")),
 	OPT_BOOL(0, "name-objects", &name_objects, N_("show verbose names for reachable objects")),
 	OPT_BOOL(0, "references", &check_references, N_("check reference database consistency")),
+	OPT_INTEGER(0, "threads", &nr_threads,
+		    N_("use up to <n> threads to check packed objects")),
 	OPT_END(),
 };
 
@@ -980,6 +986,10 @@ int cmd_fsck(int argc,
 	fsck_obj_options.error_func = fsck_objects_error_func;
 	if (check_strict)
 		fsck_obj_options.strict = 1;
+	if (nr_threads < 0)
+		die(_("invalid number of threads specified (%d)"), nr_threads);
+	if (!nr_threads)
+		nr_threads = online_cpus();
 
 	if (show_progress == -1)
 		show_progress = isatty(2);
@@ -997,6 +1007,12 @@ int cmd_fsck(int argc,
 	repo_config(the_repository, git_fsck_config, &fsck_obj_options);
 	prepare_repo_settings(the_repository);
 
+	/*
+	 * Check the trees as they are stored in the object database, not
+	 * the copies in the tree cache; verify_tree_cache() checks those.
+	 */
+	the_repository->settings.core_tree_cache = 0;
+
 	if (check_references)
 		fsck_refs(the_repository);
 
@@ -1030,7 +1046,7 @@ int cmd_fsck(int argc,
 				/* verify gives error messages itself */
 				if (verify_pack(the_repository,
 						p, fsck_obj_buffer,
-						progress, count))
+						progress, count, nr_threads))
 					errors_found |= ERROR_PACK;
 				count += p->num_objects;
 			}
@@ -1110,6 +1126,9 @@ int cmd_fsck(int argc,
 	errors_found |= check_pack_rev_indexes(the_repository, show_progress);
 	if (verify_bitmap_files(the_repository))
 		errors_found |= ERROR_BITMAP;
+	/* the tree cache lives alongside the packs; report it with them */
+	if (verify_tree_cache(the_repository))
+		errors_found |= ERROR_PACK;
 
 	check_connectivity();
 
@@ -47,6 +47,7 @@
 #include "hook.h"
 #include "setup.h"
 #include "trace2.h"
+#include "tree-cache.h"
 #include "worktree.h"
 
 #define FAILED_RUN "failed to run %s"
@@ -1072,6 +1073,11 @@ int cmd_gc(int argc,
 					     !opts.quiet && !daemonized ? COMMIT_GRAPH_WRITE_PROGRESS : 0,
 					     NULL);
 
+	if (the_repository->settings.gc_write_tree_cache &&
+	    write_tree_cache(the_repository,
+			     !opts.quiet && !daemonized ? TREE_CACHE_WRITE_PROGRESS : 0))
+		error(_("failed to write tree-cache"));
+
 	if (opts.auto_flag && too_many_loose_objects(cfg.gc_auto_threshold))
 		warning(_("There are too many unreachable loose objects; "
 			"run 'git prune' to remove them."));
@@ -167,9 +167,15 @@ static struct thread_local_data *thread_data;
 static int nr_dispatched;
 static int threads_active;
 
+/*
+ * read_mutex guards the object database and the object hash against our
+ * own threads. While fix_unresolved_deltas() reads bases in the
+ * background, the object database also uses its own lock, which we
+ * have to take, too.
+ */
 static pthread_mutex_t read_mutex;
-#define read_lock()		lock_mutex(&read_mutex)
-#define read_unlock()		unlock_mutex(&read_mutex)
+#define read_lock()		do { lock_mutex(&read_mutex); obj_read_lock(); } while (0)
+#define read_unlock()		do { obj_read_unlock(); unlock_mutex(&read_mutex); } while (0)
 
 static pthread_mutex_t counter_mutex;
 #define counter_lock()		lock_mutex(&counter_mutex)
@@ -185,6 +191,34 @@ static pthread_mutex_t deepest_delta_mutex;
 
 static pthread_key_t key;
 
+/*
+ * With threads, the main thread only reads and inflates the objects in
+ * the first pass, since it has to go through the pack in order anyway.
+ * Hashing the objects and checking them in sha1_object() is left to a
+ * pool of workers.
+ */
+struct first_pass_job {
+	struct object_entry *obj;
+	void *data;
+};
+
+/* Inflated objects waiting for or being hashed, in bytes. */
+#define FIRST_PASS_MAX_QUEUED_BYTES (64 * 1024 * 1024)
+
+static struct {
+	int nr_threads;
+	pthread_t *threads;
+	pthread_mutex_t mutex;
+	/* Signalled when a job is queued, or when the queue is closed. */
+	pthread_cond_t work;
+	/* Signalled when a job is done. */
+	pthread_cond_t room;
+	struct first_pass_job *jobs;
+	size_t head, nr, alloc;
+	size_t bytes;
+	int closed;
+} first_pass;
+
 static inline void lock_mutex(pthread_mutex_t *mutex)
 {
 	if (threads_active)
@@ -480,18 +514,24 @@ static void *unpack_entry_data(off_t offset, unsigned long size,
 	char hdr[32];
 	int hdrlen;
 
-	if (!is_delta_type(type)) {
-		hdrlen = format_object_header(hdr, sizeof(hdr), type, size);
-		the_hash_algo->init_fn(&c);
-		git_hash_update(&c, hdr, hdrlen);
-	} else
-		oid = NULL;
 	if (type == OBJ_BLOB &&
 	    size > repo_settings_get_big_file_threshold(the_repository))
 		buf = fixed_buf;
 	else
 		buf = xmallocz(size);
 
+	/*
+	 * Objects that we keep in full are hashed by the first pass
+	 * workers, if there are any.
+	 */
+	if (is_delta_type(type) || (buf != fixed_buf && first_pass.nr_threads))
+		oid = NULL;
+	if (oid) {
+		hdrlen = format_object_header(hdr, sizeof(hdr), type, size);
+		the_hash_algo->init_fn(&c);
+		git_hash_update(&c, hdr, hdrlen);
+	}
+
 	memset(&stream, 0, sizeof(stream));
 	git_inflate_init(&stream);
 	stream.next_out = buf;
@@ -1241,6 +1281,98 @@ static void *threaded_second_pass(void *data)
 	return NULL;
 }
 
+/*
+ * Hash and check the non-delta objects queued by parse_pack_objects(),
+ * until the queue is closed and drained.
+ */
+static void *first_pass_thread(void *data UNUSED)
+{
+	while (1) {
+		struct first_pass_job job;
+
+		pthread_mutex_lock(&first_pass.mutex);
+		while (!first_pass.nr && !first_pass.closed)
+			pthread_cond_wait(&first_pass.work, &first_pass.mutex);
+		if (!first_pass.nr) {
+			pthread_mutex_unlock(&first_pass.mutex);
+			break;
+		}
+		job = first_pass.jobs[first_pass.head];
+		first_pass.head = (first_pass.head + 1) % first_pass.alloc;
+		first_pass.nr--;
+		pthread_mutex_unlock(&first_pass.mutex);
+
+		hash_object_file(the_hash_algo, job.data, job.obj->size,
+				 job.obj->type, &job.obj->idx.oid);
+		sha1_object(job.data, NULL, job.obj->size, job.obj->type,
+			    &job.obj->idx.oid);
+		free(job.data);
+
+		pthread_mutex_lock(&first_pass.mutex);
+		first_pass.bytes -= job.obj->size;
+		pthread_cond_signal(&first_pass.room);
+		pthread_mutex_unlock(&first_pass.mutex);
+	}
+
+	return NULL;
+}
+
+static void start_first_pass_threads(void)
+{
+	init_thread();
+	first_pass.alloc = st_mult(nr_threads, 64);
+	ALLOC_ARRAY(first_pass.jobs, first_pass.alloc);
+	pthread_mutex_init(&first_pass.mutex, NULL);
+	pthread_cond_init(&first_pass.work, NULL);
+	pthread_cond_init(&first_pass.room, NULL);
+
+	CALLOC_ARRAY(first_pass.threads, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&first_pass.threads[i], NULL,
+					 first_pass_thread, NULL);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+	first_pass.nr_threads = nr_threads;
+}
+
+static void queue_first_pass_job(struct object_entry *obj, void *data)
+{
+	pthread_mutex_lock(&first_pass.mutex);
+	while (first_pass.nr == first_pass.alloc ||
+	       (first_pass.bytes &&
+		first_pass.bytes + obj->size > FIRST_PASS_MAX_QUEUED_BYTES))
+		pthread_cond_wait(&first_pass.room, &first_pass.mutex);
+	first_pass.jobs[(first_pass.head + first_pass.nr) % first_pass.alloc] =
+		(struct first_pass_job) { .obj = obj, .data = data };
+	first_pass.nr++;
+	first_pass.bytes += obj->size;
+	pthread_cond_signal(&first_pass.work);
+	pthread_mutex_unlock(&first_pass.mutex);
+}
+
+static void finish_first_pass_threads(void)
+{
+	if (!first_pass.nr_threads)
+		return;
+
+	pthread_mutex_lock(&first_pass.mutex);
+	first_pass.closed = 1;
+	pthread_cond_broadcast(&first_pass.work);
+	pthread_mutex_unlock(&first_pass.mutex);
+
+	for (int i = 0; i < first_pass.nr_threads; i++)
+		pthread_join(first_pass.threads[i], NULL);
+
+	pthread_cond_destroy(&first_pass.room);
+	pthread_cond_destroy(&first_pass.work);
+	pthread_mutex_destroy(&first_pass.mutex);
+	FREE_AND_NULL(first_pass.threads);
+	FREE_AND_NULL(first_pass.jobs);
+	first_pass.nr_threads = 0;
+	cleanup_thread();
+}
+
 /*
  * First pass:
  * - find locations of all objects;
@@ -1261,6 +1393,8 @@ static void parse_pack_objects(unsigned char *hash)
 				progress_title ? progress_title :
 				from_stdin ? _("Receiving objects") : _("Indexing objects"),
 				nr_objects);
+	if (HAVE_THREADS && (nr_threads > 1 || getenv("GIT_FORCE_THREADS")))
+		start_first_pass_threads();
 	for (i = 0; i < nr_objects; i++) {
 		struct object_entry *obj = &objects[i];
 		void *data = unpack_raw_entry(obj, &ofs_delta->offset,
@@ -1280,6 +1414,9 @@ static void parse_pack_objects(unsigned char *hash)
 			/* large blobs, check later */
 			obj->real_type = OBJ_BAD;
 			nr_delays++;
+		} else if (first_pass.nr_threads) {
+			queue_first_pass_job(obj, data);
+			data = NULL;
 		} else
 			sha1_object(data, NULL, obj->size, obj->type,
 				    &obj->idx.oid);
@@ -1287,6 +1424,7 @@ static void parse_pack_objects(unsigned char *hash)
 		display_progress(progress, i+1);
 	}
 	objects[i].idx.offset = consumed_bytes;
+	finish_first_pass_threads();
 	stop_progress(&progress);
 
 	/* Check pack integrity */
@@ -1472,9 +1610,158 @@ static int delta_pos_compare(const void *_a, const void *_b)
 	return a->obj_no - b->obj_no;
 }
 
+/*
+ * With threads, fix_unresolved_deltas() reads the local bases of the
+ * thin pack in a pool of workers, in the order in which it is going to
+ * append them. Only the reading happens in the background; appending
+ * the bases and resolving their deltas still happens one base at a
+ * time.
+ */
+struct base_prefetch_slot {
+	const struct object_id *oid;
+	void *data;
+	unsigned long size;
+	enum object_type type;
+	unsigned done : 1;
+};
+
+/* Bases read but not yet taken by fix_unresolved_deltas(), in bytes. */
+#define BASE_PREFETCH_MAX_BYTES (64 * 1024 * 1024)
+
+static struct {
+	struct base_prefetch_slot *slots;
+	int nr;
+	/* The next slot to be read, and the first one not yet taken. */
+	int next, taken;
+	size_t bytes;
+	int nr_threads;
+	pthread_t *threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} base_prefetch;
+
+static void *base_prefetch_thread(void *data UNUSED)
+{
+	pthread_mutex_lock(&base_prefetch.mutex);
+	while (1) {
+		struct base_prefetch_slot *slot;
+		struct object_info oi = OBJECT_INFO_INIT;
+
+		/* Always read the slot that the main thread waits for. */
+		while (base_prefetch.next < base_prefetch.nr &&
+		       base_prefetch.next != base_prefetch.taken &&
+		       base_prefetch.bytes >= BASE_PREFETCH_MAX_BYTES)
+			pthread_cond_wait(&base_prefetch.cond, &base_prefetch.mutex);
+		if (base_prefetch.next >= base_prefetch.nr)
+			break;
+		slot = &base_prefetch.slots[base_prefetch.next++];
+		pthread_mutex_unlock(&base_prefetch.mutex);
+
+		/*
+		 * Leave fetching missing bases and reporting corrupt ones
+		 * to the main thread, which reads the base again if we
+		 * could not.
+		 */
+		oi.typep = &slot->type;
+		oi.sizep = &slot->size;
+		oi.contentp = &slot->data;
+		if (odb_read_object_info_extended(the_repository->objects,
+						  slot->oid, &oi,
+						  OBJECT_INFO_LOOKUP_REPLACE |
+						  OBJECT_INFO_SKIP_FETCH_OBJECT))
+			slot->data = NULL;
+
+		pthread_mutex_lock(&base_prefetch.mutex);
+		slot->done = 1;
+		if (slot->data)
+			base_prefetch.bytes += slot->size;
+		pthread_cond_broadcast(&base_prefetch.cond);
+	}
+	pthread_mutex_unlock(&base_prefetch.mutex);
+
+	return NULL;
+}
+
+/*
+ * Start reading the bases of the sorted deltas. Returns an array which
+ * maps each delta to the slot of its base, or -1 if an earlier delta
+ * has the same base.
+ */
+static int *start_base_prefetch(struct ref_delta_entry **sorted_by_pos)
+{
+	struct oidset seen = OIDSET_INIT;
+	int *slot_of;
+
+	ALLOC_ARRAY(slot_of, nr_ref_deltas);
+	CALLOC_ARRAY(base_prefetch.slots, nr_ref_deltas);
+	for (int i = 0; i < nr_ref_deltas; i++) {
+		if (oidset_insert(&seen, &sorted_by_pos[i]->oid)) {
+			slot_of[i] = -1;
+			continue;
+		}
+		slot_of[i] = base_prefetch.nr;
+		base_prefetch.slots[base_prefetch.nr++].oid = &sorted_by_pos[i]->oid;
+	}
+	oidset_clear(&seen);
+
+	enable_obj_read_lock();
+	pthread_mutex_init(&base_prefetch.mutex, NULL);
+	pthread_cond_init(&base_prefetch.cond, NULL);
+	base_prefetch.nr_threads = nr_threads < base_prefetch.nr ?
+				   nr_threads : base_prefetch.nr;
+	CALLOC_ARRAY(base_prefetch.threads, base_prefetch.nr_threads);
+	for (int i = 0; i < base_prefetch.nr_threads; i++) {
+		int ret = pthread_create(&base_prefetch.threads[i], NULL,
+					 base_prefetch_thread, NULL);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+
+	return slot_of;
+}
+
+static void *take_prefetched_base(int slot_nr, enum object_type *type,
+				  unsigned long *size)
+{
+	struct base_prefetch_slot *slot = &base_prefetch.slots[slot_nr];
+	void *data;
+
+	pthread_mutex_lock(&base_prefetch.mutex);
+	while (!slot->done)
+		pthread_cond_wait(&base_prefetch.cond, &base_prefetch.mutex);
+	data = slot->data;
+	*type = slot->type;
+	*size = slot->size;
+	if (data)
+		base_prefetch.bytes -= slot->size;
+	slot->data = NULL;
+	base_prefetch.taken = slot_nr + 1;
+	pthread_cond_broadcast(&base_prefetch.cond);
+	pthread_mutex_unlock(&base_prefetch.mutex);
+
+	return data;
+}
+
+static void finish_base_prefetch(void)
+{
+	for (int i = 0; i < base_prefetch.nr_threads; i++)
+		pthread_join(base_prefetch.threads[i], NULL);
+	for (int i = 0; i < base_prefetch.nr; i++)
+		free(base_prefetch.slots[i].data);
+
+	pthread_cond_destroy(&base_prefetch.cond);
+	pthread_mutex_destroy(&base_prefetch.mutex);
+	disable_obj_read_lock();
+	FREE_AND_NULL(base_prefetch.threads);
+	FREE_AND_NULL(base_prefetch.slots);
+	base_prefetch.nr = base_prefetch.next = base_prefetch.taken = 0;
+	base_prefetch.nr_threads = 0;
+}
+
 static void fix_unresolved_deltas(struct hashfile *f)
 {
 	struct ref_delta_entry **sorted_by_pos;
+	int *slot_of = NULL;
 	int i;
 
 	/*
@@ -1510,16 +1797,25 @@ static void fix_unresolved_deltas(struct hashfile *f)
 		oid_array_clear(&to_fetch);
 	}
 
+	if (HAVE_THREADS && nr_ref_deltas > 1 &&
+	    (nr_threads > 1 || getenv("GIT_FORCE_THREADS")))
+		slot_of = start_base_prefetch(sorted_by_pos);
+
 	for (i = 0; i < nr_ref_deltas; i++) {
 		struct ref_delta_entry *d = sorted_by_pos[i];
 		enum object_type type;
-		void *data;
+		void *data = NULL;
 		unsigned long size;
 
-		if (objects[d->obj_no].real_type != OBJ_REF_DELTA)
+		if (slot_of && slot_of[i] >= 0)
+			data = take_prefetched_base(slot_of[i], &type, &size);
+		if (objects[d->obj_no].real_type != OBJ_REF_DELTA) {
+			free(data);
 			continue;
-		data = odb_read_object(the_repository->objects, &d->oid,
-				       &type, &size);
+		}
+		if (!data)
+			data = odb_read_object(the_repository->objects, &d->oid,
+					       &type, &size);
 		if (!data)
 			continue;
 
@@ -1538,6 +1834,9 @@ static void fix_unresolved_deltas(struct hashfile *f)
 
 		display_progress(progress, nr_resolved_deltas);
 	}
+	if (slot_of)
+		finish_base_prefetch();
+	free(slot_of);
 	free(sorted_by_pos);
 }
 
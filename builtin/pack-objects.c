@@ -25,6 +25,7 @@
 #include "thread-utils.h"
 #include "pack-bitmap.h"
 #include "delta-islands.h"
+#include "delta-search-cache.h"
 #include "reachable.h"
 #include "oid-array.h"
 #include "strvec.h"
@@ -257,6 +258,9 @@ static int exclude_promisor_objects;
 static int exclude_promisor_objects_best_effort;
 
 static int use_delta_islands;
+static int use_delta_search_cache;
+static struct delta_search_cache *delta_search_cache;
+static uint32_t delta_search_cache_hits;
 
 static unsigned long delta_cache_size = 0;
 static unsigned long max_delta_cache_size = DEFAULT_DELTA_CACHE_SIZE;
@@ -2912,10 +2916,51 @@ static unsigned long free_unpacked(struct unpacked *n)
 	return freed_mem;
 }
 
+/*
+ * If the delta search cache has a base for the object in the window
+ * at 'idx', and that base is still in the window, try it first. When
+ * it gives us the same delta as it did the last time around, there is
+ * nothing to gain from searching the rest of the window.
+ *
+ * Returns 1 if the search can be skipped, and 0 otherwise. In either
+ * case, 'best_base' is updated if a delta was found.
+ */
+static int try_cached_delta(struct unpacked *array, int window, uint32_t idx,
+			    unsigned max_depth, unsigned long *mem_usage,
+			    int *best_base)
+{
+	struct unpacked *n = array + idx;
+	struct object_entry *base;
+	struct object_id base_oid;
+	uint32_t delta_size;
+	int j;
+
+	if (delta_search_cache_lookup(delta_search_cache, &n->entry->idx.oid,
+				      &base_oid, &delta_size))
+		return 0;
+	base = packlist_find(&to_pack, &base_oid);
+	if (!base)
+		return 0;
+
+	for (j = 1; j < window; j++) {
+		uint32_t other_idx = (idx + j) % window;
+		struct unpacked *m = array + other_idx;
+
+		if (m->entry != base)
+			continue;
+		if (try_delta(n, m, max_depth, mem_usage) <= 0)
+			return 0;
+		*best_base = other_idx;
+		return DELTA_SIZE(n->entry) == delta_size;
+	}
+
+	return 0;
+}
+
 static void find_deltas(struct object_entry **list, unsigned *list_size,
 			int window, int depth, unsigned *processed)
 {
-	uint32_t i, idx = 0, count = 0;
+	uint32_t i, idx = 0, count = 0, cache_hits = 0;
 	struct unpacked *array;
 	unsigned long mem_usage = 0;
 
@@ -2968,7 +3013,14 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 				goto next;
 		}
 
-		j = window;
+		if (delta_search_cache &&
+		    try_cached_delta(array, window, idx, max_depth,
+				     &mem_usage, &best_base)) {
+			cache_hits++;
+			j = 1; /* skip the search below */
+		} else {
+			j = window;
+		}
 		while (--j > 0) {
 			int ret;
 			uint32_t other_idx = idx + j;
@@ -3052,6 +3104,10 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 		free(array[i].data);
 	}
 	free(array);
+
+	progress_lock();
+	delta_search_cache_hits += cache_hits;
+	progress_unlock();
 }
 
 /*
@@ -3609,6 +3665,53 @@ static void prepare_pack(int window, int depth)
 			die(_("inconsistency with delta count"));
 	}
 	free(delta_list);
+
+	if (delta_search_cache)
+		trace2_data_intmax("pack-objects", the_repository,
+				   "delta-search-cache/hits",
+				   delta_search_cache_hits);
+}
+
+static int delta_search_cache_keep(const struct object_id *oid)
+{
+	return odb_has_object(the_repository->objects, oid, 0);
+}
+
+/*
+ * Record the deltas chosen for this pack in the delta search cache,
+ * keeping what the cache knew about objects that are not in it.
+ */
+static void write_delta_search_cache(void)
+{
+	struct delta_search_cache_entry *entries = NULL;
+	size_t nr = 0, alloc = 0;
+	uint32_t i;
+
+	for (i = 0; i < to_pack.nr_objects; i++) {
+		struct object_entry *entry = to_pack.objects + i;
+		struct object_entry *base = DELTA(entry);
+
+		if (!base || entry->preferred_base || base->preferred_base)
+			continue;
+
+		ALLOC_GROW(entries, nr + 1, alloc);
+		oidcpy(&entries[nr].oid, &entry->idx.oid);
+		oidcpy(&entries[nr].base, &base->idx.oid);
+		entries[nr].delta_size = DELTA_SIZE(entry);
+		nr++;
+	}
+
+	if (delta_search_cache) {
+		delta_search_cache_carry_over(delta_search_cache, &entries,
+					      &nr, &alloc,
+					      delta_search_cache_keep);
+		delta_search_cache_free(delta_search_cache);
+		delta_search_cache = NULL;
+	}
+
+	if (delta_search_cache_write(the_repository, entries, nr))
+		warning(_("unable to update the delta search cache"));
+	free(entries);
 }
 
 static int git_pack_config(const char *k, const char *v,
@@ -3630,6 +3733,10 @@ static int git_pack_config(const char *k, const char *v,
 		max_delta_cache_size = git_config_int(k, v, ctx->kvi);
 		return 0;
 	}
+	if (!strcmp(k, "pack.deltasearchcache")) {
+		use_delta_search_cache = git_config_bool(k, v);
+		return 0;
+	}
 	if (!strcmp(k, "pack.deltacachelimit")) {
 		cache_max_small_delta_size = git_config_int(k, v, ctx->kvi);
 		return 0;
@@ -3648,6 +3755,13 @@ static int git_pack_config(const char *k, const char *v,
 			write_bitmap_options &= ~BITMAP_OPT_LOOKUP_TABLE;
 	}
 
+	if (!strcmp(k, "pack.writebitmaproaring")) {
+		if (git_config_bool(k, v))
+			write_bitmap_options |= BITMAP_OPT_ROARING;
+		else
+			write_bitmap_options &= ~BITMAP_OPT_ROARING;
+	}
+
 	if (!strcmp(k, "pack.usebitmaps")) {
 		use_bitmap_index_default = git_config_bool(k, v);
 		return 0;
@@ -4975,6 +5089,8 @@ int cmd_pack_objects(int argc,
 			 N_("implies --missing=allow-any")),
 		OPT_BOOL(0, "delta-islands", &use_delta_islands,
 			 N_("respect islands during delta compression")),
+		OPT_BOOL(0, "delta-search-cache", &use_delta_search_cache,
+			 N_("reuse the results of earlier delta searches")),
 		OPT_STRING_LIST(0, "uri-protocol", &uri_protocols,
 				N_("protocol"),
 				N_("exclude any configured uploadpack.blobpackfileuri with this protocol")),
@@ -5242,6 +5358,8 @@ int cmd_pack_objects(int argc,
 	if (non_empty && !nr_result)
 		goto cleanup;
 	if (nr_result) {
+		if (use_delta_search_cache)
+			delta_search_cache = delta_search_cache_read(the_repository);
 		trace2_region_enter("pack-objects", "prepare-pack",
 				    the_repository);
 		prepare_pack(window, depth);
@@ -5254,6 +5372,9 @@ int cmd_pack_objects(int argc,
 	write_pack_file();
 	trace2_region_leave("pack-objects", "write-pack-file", the_repository);
 
+	if (use_delta_search_cache && !pack_to_stdout && nr_result)
+		write_delta_search_cache();
+
 	if (progress)
 		fprintf_ln(stderr,
 			   _("Total %"PRIu32" (delta %"PRIu32"),"
@@ -5271,6 +5392,7 @@ int cmd_pack_objects(int argc,
 	trace2_data_intmax("pack-objects", the_repository, "packs-reused", reuse_packfiles_used_nr);
 
 cleanup:
+	delta_search_cache_free(delta_search_cache);
 	clear_packing_data(&to_pack);
 	list_objects_filter_release(&filter_options);
 	string_list_clear(&keep_pack_list, 0);
@@ -29,6 +29,7 @@ static int use_delta_islands;
 static int run_update_server_info = 1;
 static char *packdir, *packtmp_name, *packtmp;
 static int midx_must_contain_cruft = 1;
+static int midx_incremental;
 
 static const char *const git_repack_usage[] = {
 	N_("git repack [-a] [-A] [-d] [-f] [-F] [-l] [-n] [-q] [-b] [-m]\n"
@@ -94,6 +95,10 @@ static int repack_config(const char *var, const char *value,
 		midx_must_contain_cruft = git_config_bool(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "repack.midxincremental")) {
+		midx_incremental = git_config_bool(var, value);
+		return 0;
+	}
 	return git_default_config(var, value, ctx, cb);
 }
 
@@ -267,6 +272,7 @@ int cmd_repack(int argc,
 	if (geometry.split_factor) {
 		if (pack_everything)
 			die(_("options '%s' and '%s' cannot be used together"), "--geometric", "-A/-a");
+		geometry.midx_incremental = write_midx && midx_incremental;
 		pack_geometry_init(&geometry, &existing, &po_args);
 		pack_geometry_split(&geometry);
 	}
@@ -368,6 +374,8 @@ int cmd_repack(int argc,
 			fprintf(in, "%s\n", pack_basename(geometry.pack[i]));
 		for (i = geometry.split; i < geometry.pack_nr; i++)
 			fprintf(in, "^%s\n", pack_basename(geometry.pack[i]));
+		for (i = 0; i < geometry.midx_pack_nr; i++)
+			fprintf(in, "^%s\n", pack_basename(geometry.midx_pack[i]));
 		fclose(in);
 	}
 
@@ -510,7 +518,9 @@ int cmd_repack(int argc,
 			.packdir = packdir,
 			.show_progress = show_progress,
 			.write_bitmaps = write_bitmaps > 0,
-			.midx_must_contain_cruft = midx_must_contain_cruft
+			.midx_must_contain_cruft = midx_must_contain_cruft,
+			.incremental = midx_incremental &&
+				!(pack_everything & ALL_INTO_ONE),
 		};
 
 		ret = write_midx_included_packs(&opts);
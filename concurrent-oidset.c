@@ -0,0 +1,130 @@
+#include "git-compat-util.h"
+#include "concurrent-oidset.h"
+#include "hash.h"
+
+/*
+ * Give every thread a few shards to itself on average, but stay within
+ * what the byte used to pick a shard can address.
+ */
+#define SHARDS_PER_THREAD 16
+#define MAX_SHARDS 256
+
+static struct concurrent_oidset_shard *shard_for(struct concurrent_oidset *set,
+						 const struct object_id *oid)
+{
+	/*
+	 * khash uses the first bytes of the object id as the hash, so pick
+	 * the shard by one that comes after those.
+	 */
+	return &set->shards[oid->hash[sizeof(unsigned int)] & set->shard_mask];
+}
+
+void concurrent_oidset_init(struct concurrent_oidset *set, int nr_threads,
+			    size_t initial_size)
+{
+	unsigned int nr = 1;
+
+	if (nr_threads <= 0)
+		nr_threads = online_cpus();
+	while (nr < MAX_SHARDS && nr < (unsigned int)nr_threads * SHARDS_PER_THREAD)
+		nr <<= 1;
+
+	CALLOC_ARRAY(set->shards, nr);
+	set->shard_mask = nr - 1;
+	for (unsigned int i = 0; i < nr; i++) {
+		pthread_mutex_init(&set->shards[i].mutex, NULL);
+		if (initial_size)
+			kh_resize_oid_pos(&set->shards[i].set, initial_size / nr + 1);
+	}
+}
+
+int concurrent_oidset_contains(struct concurrent_oidset *set,
+			       const struct object_id *oid)
+{
+	struct concurrent_oidset_shard *shard = shard_for(set, oid);
+	khiter_t pos;
+	int ret;
+
+	pthread_mutex_lock(&shard->mutex);
+	pos = kh_get_oid_pos(&shard->set, *oid);
+	ret = pos != kh_end(&shard->set);
+	pthread_mutex_unlock(&shard->mutex);
+
+	return ret;
+}
+
+int concurrent_oidset_insert(struct concurrent_oidset *set,
+			     const struct object_id *oid)
+{
+	struct concurrent_oidset_shard *shard = shard_for(set, oid);
+	khiter_t pos;
+	int added;
+
+	pthread_mutex_lock(&shard->mutex);
+	pos = kh_put_oid_pos(&shard->set, *oid, &added);
+	if (added)
+		kh_value(&shard->set, pos) = 0;
+	pthread_mutex_unlock(&shard->mutex);
+
+	return !added;
+}
+
+unsigned concurrent_oidset_get_flags(struct concurrent_oidset *set,
+				     const struct object_id *oid)
+{
+	struct concurrent_oidset_shard *shard = shard_for(set, oid);
+	unsigned flags = 0;
+	khiter_t pos;
+
+	pthread_mutex_lock(&shard->mutex);
+	pos = kh_get_oid_pos(&shard->set, *oid);
+	if (pos != kh_end(&shard->set))
+		flags = kh_value(&shard->set, pos);
+	pthread_mutex_unlock(&shard->mutex);
+
+	return flags;
+}
+
+unsigned concurrent_oidset_set_flags(struct concurrent_oidset *set,
+				     const struct object_id *oid,
+				     unsigned flags)
+{
+	struct concurrent_oidset_shard *shard = shard_for(set, oid);
+	unsigned old;
+	khiter_t pos;
+	int added;
+
+	pthread_mutex_lock(&shard->mutex);
+	pos = kh_put_oid_pos(&shard->set, *oid, &added);
+	old = added ? 0 : kh_value(&shard->set, pos);
+	kh_value(&shard->set, pos) = old | flags;
+	pthread_mutex_unlock(&shard->mutex);
+
+	return old;
+}
+
+size_t concurrent_oidset_size(struct concurrent_oidset *set)
+{
+	size_t nr = 0;
+
+	for (unsigned int i = 0; i <= set->shard_mask; i++) {
+		pthread_mutex_lock(&set->shards[i].mutex);
+		nr += kh_size(&set->shards[i].set);
+		pthread_mutex_unlock(&set->shards[i].mutex);
+	}
+
+	return nr;
+}
+
+void concurrent_oidset_clear(struct concurrent_oidset *set)
+{
+	if (!set->shards)
+		return;
+
+	for (unsigned int i = 0; i <= set->shard_mask; i++) {
+		kh_release_oid_pos(&set->shards[i].set);
+		pthread_mutex_destroy(&set->shards[i].mutex);
+	}
+	FREE_AND_NULL(set->shards);
+	set->shard_mask = 0;
+}
@@ -0,0 +1,98 @@
+#ifndef CONCURRENT_OIDSET_H
+#define CONCURRENT_OIDSET_H
+
+#include "khash.h"
+#include "thread-utils.h"
+
+/**
+ * A concurrent_oidset is a set of object ids that can be used from many
+ * threads at once, for example to keep track of the objects that a
+ * multi-threaded walk has already seen. Each object id can carry a word
+ * of flags, so that the set can also stand in for the flags of "struct
+ * object" in code that must not touch the object hash.
+ *
+ * The set is split into shards, each a khash table guarded by its own
+ * mutex. The shard is picked by a part of the object id that the hash
+ * table itself does not use, so that the tables stay well balanced.
+ * Threads only contend when they happen to access the same shard at the
+ * same time, which becomes rare as the number of shards grows.
+ *
+ * Unlike "struct oidset", the set must be initialized with
+ * concurrent_oidset_init() before use.
+ *
+ * There is deliberately no concurrent variant of the object hash of
+ * object.c. lookup_object() moves every entry it finds to the front of
+ * its probe sequence and create_object() rehashes the table in place
+ * as it grows, and the objects themselves come from per-repository
+ * allocators that are not thread-safe either. Making these safe would
+ * mean locking every object lookup, including in the single-threaded
+ * commands that make up most of the callers. Threaded walkers should
+ * instead keep their per-object marks in a concurrent_oidset, and leave
+ * creating and parsing "struct object"s to the main thread.
+ */
+
+struct concurrent_oidset_shard {
+	pthread_mutex_t mutex;
+	kh_oid_pos_t set;
+};
+
+struct concurrent_oidset {
+	struct concurrent_oidset_shard *shards;
+	unsigned int shard_mask;
+};
+
+/**
+ * Initialize the set for use by up to `nr_threads` threads. Passing 0
+ * picks a number of shards suitable for the number of CPUs.
+ *
+ * If `initial_size` is bigger than 0, then preallocate to allow inserting
+ * about that many elements without further allocations.
+ */
+void concurrent_oidset_init(struct concurrent_oidset *set, int nr_threads,
+			    size_t initial_size);
+
+/**
+ * Returns true iff `set` contains `oid`.
+ */
+int concurrent_oidset_contains(struct concurrent_oidset *set,
+			       const struct object_id *oid);
+
+/**
+ * Insert the oid into the set; a copy is made, so "oid" does not need
+ * to persist after this function is called.
+ *
+ * Returns 1 if the oid was already in the set, 0 otherwise. Of several
+ * threads inserting the same oid, exactly one sees 0.
+ */
+int concurrent_oidset_insert(struct concurrent_oidset *set,
+			     const struct object_id *oid);
+
+/**
+ * Return the flags of `oid`, or 0 if it is not in the set.
+ */
+unsigned concurrent_oidset_get_flags(struct concurrent_oidset *set,
+				     const struct object_id *oid);
+
+/**
+ * Add `flags` to the flags of `oid`, inserting it into the set first if
+ * needed. Returns the flags it had before, so that e.g. checking
+ * `!(concurrent_oidset_set_flags(set, oid, SEEN) & SEEN)` tells exactly
+ * one of several threads that it is the first to see `oid`.
+ */
+unsigned concurrent_oidset_set_flags(struct concurrent_oidset *set,
+				     const struct object_id *oid,
+				     unsigned flags);
+
+/**
+ * Returns the number of oids in the set. Only exact while no other
+ * thread modifies the set.
+ */
+size_t concurrent_oidset_size(struct concurrent_oidset *set);
+
+/**
+ * Remove all entries from the set, freeing any resources associated
+ * with it. Must not be called while other threads use the set.
+ */
+void concurrent_oidset_clear(struct concurrent_oidset *set);
+
+#endif /* CONCURRENT_OIDSET_H */
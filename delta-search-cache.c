@@ -0,0 +1,388 @@
+#include "git-compat-util.h"
+#include "chunk-format.h"
+#include "csum-file.h"
+#include "delta-search-cache.h"
+#include "gettext.h"
+#include "hash-lookup.h"
+#include "lockfile.h"
+#include "repository.h"
+#include "write-or-die.h"
+
+#define DELTA_SEARCH_CACHE_SIGNATURE 0x44534348 /* "DSCH" */
+#define DELTA_SEARCH_CACHE_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
+#define DELTA_SEARCH_CACHE_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
+#define DELTA_SEARCH_CACHE_CHUNKID_BASES 0x44424153 /* "DBAS" */
+#define DELTA_SEARCH_CACHE_CHUNKID_SIZES 0x4453495a /* "DSIZ" */
+
+#define DELTA_SEARCH_CACHE_VERSION 1
+#define DELTA_SEARCH_CACHE_HEADER_SIZE 8
+#define DELTA_SEARCH_CACHE_FANOUT_SIZE (4 * 256)
+
+struct delta_search_cache {
+	const unsigned char *data;
+	size_t data_len;
+
+	const struct git_hash_algo *hash_algo;
+	uint32_t num_entries;
+
+	const uint32_t *chunk_oid_fanout;
+	const unsigned char *chunk_oid_lookup;
+	const unsigned char *chunk_bases;
+	const unsigned char *chunk_sizes;
+};
+
+static char *get_delta_search_cache_filename(struct repository *r)
+{
+	return xstrfmt("%s/pack/delta-search-cache",
+		       repo_get_object_directory(r));
+}
+
+static size_t delta_search_cache_min_size(const struct git_hash_algo *algop)
+{
+	return DELTA_SEARCH_CACHE_HEADER_SIZE + 5 * CHUNK_TOC_ENTRY_SIZE +
+		DELTA_SEARCH_CACHE_FANOUT_SIZE + algop->rawsz;
+}
+
+static int delta_search_cache_read_oid_fanout(const unsigned char *chunk_start,
+					      size_t chunk_size, void *data)
+{
+	struct delta_search_cache *cache = data;
+	int i;
+
+	if (chunk_size != DELTA_SEARCH_CACHE_FANOUT_SIZE)
+		return error(_("delta search cache oid fanout chunk is wrong size"));
+	cache->chunk_oid_fanout = (const uint32_t *)chunk_start;
+	cache->num_entries = ntohl(cache->chunk_oid_fanout[255]);
+
+	for (i = 0; i < 255; i++) {
+		if (ntohl(cache->chunk_oid_fanout[i]) >
+		    ntohl(cache->chunk_oid_fanout[i + 1]))
+			return error(_("delta search cache fanout values out of order"));
+	}
+
+	return 0;
+}
+
+static int delta_search_cache_read_oid_lookup(const unsigned char *chunk_start,
+					      size_t chunk_size, void *data)
+{
+	struct delta_search_cache *cache = data;
+	if (chunk_size / cache->hash_algo->rawsz != cache->num_entries)
+		return error(_("delta search cache OID lookup chunk is the wrong size"));
+	cache->chunk_oid_lookup = chunk_start;
+	return 0;
+}
+
+static int delta_search_cache_read_bases(const unsigned char *chunk_start,
+					 size_t chunk_size, void *data)
+{
+	struct delta_search_cache *cache = data;
+	if (chunk_size / cache->hash_algo->rawsz != cache->num_entries)
+		return error(_("delta search cache bases chunk is the wrong size"));
+	cache->chunk_bases = chunk_start;
+	return 0;
+}
+
+static int delta_search_cache_read_sizes(const unsigned char *chunk_start,
+					 size_t chunk_size, void *data)
+{
+	struct delta_search_cache *cache = data;
+	if (chunk_size / sizeof(uint32_t) != cache->num_entries)
+		return error(_("delta search cache sizes chunk is the wrong size"));
+	cache->chunk_sizes = chunk_start;
+	return 0;
+}
+
+static struct delta_search_cache *parse_delta_search_cache(struct repository *r,
+							   const unsigned char *data,
+							   size_t data_len)
+{
+	struct delta_search_cache *cache;
+	struct chunkfile *cf = NULL;
+	unsigned char num_chunks;
+
+	if (data_len < delta_search_cache_min_size(r->hash_algo)) {
+		error(_("delta search cache file is too small"));
+		return NULL;
+	}
+	if (get_be32(data) != DELTA_SEARCH_CACHE_SIGNATURE) {
+		error(_("delta search cache signature %X does not match signature %X"),
+		      get_be32(data), DELTA_SEARCH_CACHE_SIGNATURE);
+		return NULL;
+	}
+	if (data[4] != DELTA_SEARCH_CACHE_VERSION) {
+		error(_("delta search cache version %X does not match version %X"),
+		      data[4], DELTA_SEARCH_CACHE_VERSION);
+		return NULL;
+	}
+	if (data[5] != oid_version(r->hash_algo)) {
+		error(_("delta search cache hash version %X does not match version %X"),
+		      data[5], oid_version(r->hash_algo));
+		return NULL;
+	}
+	num_chunks = data[6];
+
+	CALLOC_ARRAY(cache, 1);
+	cache->data = data;
+	cache->data_len = data_len;
+	cache->hash_algo = r->hash_algo;
+
+	cf = init_chunkfile(NULL);
+	if (read_table_of_contents(cf, data, data_len,
+				   DELTA_SEARCH_CACHE_HEADER_SIZE, num_chunks, 1))
+		goto cleanup;
+
+	if (read_chunk(cf, DELTA_SEARCH_CACHE_CHUNKID_OIDFANOUT,
+		       delta_search_cache_read_oid_fanout, cache)) {
+		error(_("delta search cache required OID fanout chunk missing or corrupted"));
+		goto cleanup;
+	}
+	if (read_chunk(cf, DELTA_SEARCH_CACHE_CHUNKID_OIDLOOKUP,
+		       delta_search_cache_read_oid_lookup, cache)) {
+		error(_("delta search cache required OID lookup chunk missing or corrupted"));
+		goto cleanup;
+	}
+	if (read_chunk(cf, DELTA_SEARCH_CACHE_CHUNKID_BASES,
+		       delta_search_cache_read_bases, cache)) {
+		error(_("delta search cache required bases chunk missing or corrupted"));
+		goto cleanup;
+	}
+	if (read_chunk(cf, DELTA_SEARCH_CACHE_CHUNKID_SIZES,
+		       delta_search_cache_read_sizes, cache)) {
+		error(_("delta search cache required sizes chunk missing or corrupted"));
+		goto cleanup;
+	}
+
+	free_chunkfile(cf);
+	return cache;
+
+cleanup:
+	free_chunkfile(cf);
+	free(cache);
+	return NULL;
+}
+
+struct delta_search_cache *delta_search_cache_read(struct repository *r)
+{
+	struct delta_search_cache *cache;
+	char *filename = get_delta_search_cache_filename(r);
+	struct stat st;
+	void *data;
+	size_t data_len;
+	int fd;
+
+	fd = git_open(filename);
+	free(filename);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	data_len = xsize_t(st.st_size);
+	if (data_len < delta_search_cache_min_size(r->hash_algo)) {
+		close(fd);
+		error(_("delta search cache file is too small"));
+		return NULL;
+	}
+	data = xmmap(NULL, data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	cache = parse_delta_search_cache(r, data, data_len);
+	if (!cache)
+		munmap(data, data_len);
+	return cache;
+}
+
+static void delta_search_cache_entry_at(struct delta_search_cache *cache,
+					uint32_t pos,
+					struct delta_search_cache_entry *e)
+{
+	size_t rawsz = cache->hash_algo->rawsz;
+
+	oidread(&e->oid, cache->chunk_oid_lookup + st_mult(pos, rawsz),
+		cache->hash_algo);
+	oidread(&e->base, cache->chunk_bases + st_mult(pos, rawsz),
+		cache->hash_algo);
+	e->delta_size = get_be32(cache->chunk_sizes +
+				 st_mult(pos, sizeof(uint32_t)));
+}
+
+int delta_search_cache_lookup(struct delta_search_cache *cache,
+			      const struct object_id *oid,
+			      struct object_id *base, uint32_t *delta_size)
+{
+	size_t rawsz = cache->hash_algo->rawsz;
+	uint32_t pos;
+
+	if (!bsearch_hash(oid->hash, cache->chunk_oid_fanout,
+			  cache->chunk_oid_lookup, rawsz, &pos))
+		return -1;
+
+	oidread(base, cache->chunk_bases + st_mult(pos, rawsz),
+		cache->hash_algo);
+	*delta_size = get_be32(cache->chunk_sizes +
+			       st_mult(pos, sizeof(uint32_t)));
+	return 0;
+}
+
+static int delta_search_cache_entry_cmp(const void *va, const void *vb)
+{
+	const struct delta_search_cache_entry *a = va, *b = vb;
+	return oidcmp(&a->oid, &b->oid);
+}
+
+void delta_search_cache_carry_over(struct delta_search_cache *cache,
+				   struct delta_search_cache_entry **entries,
+				   size_t *nr, size_t *alloc,
+				   int (*keep)(const struct object_id *oid))
+{
+	size_t new_nr = *nr, j = 0;
+	uint32_t i;
+
+	QSORT(*entries, new_nr, delta_search_cache_entry_cmp);
+
+	for (i = 0; i < cache->num_entries; i++) {
+		struct delta_search_cache_entry e;
+		int cmp = 1;
+
+		delta_search_cache_entry_at(cache, i, &e);
+		while (j < new_nr &&
+		       (cmp = oidcmp(&(*entries)[j].oid, &e.oid)) < 0)
+			j++;
+		if (j < new_nr && !cmp)
+			continue;
+		if (keep && !keep(&e.oid))
+			continue;
+
+		ALLOC_GROW(*entries, *nr + 1, *alloc);
+		(*entries)[(*nr)++] = e;
+	}
+}
+
+struct write_delta_search_cache_context {
+	struct delta_search_cache_entry *entries;
+	size_t entries_nr;
+};
+
+static int write_delta_search_cache_chunk_fanout(struct hashfile *f, void *data)
+{
+	struct write_delta_search_cache_context *ctx = data;
+	size_t i, count = 0;
+
+	for (i = 0; i < 256; i++) {
+		while (count < ctx->entries_nr &&
+		       ctx->entries[count].oid.hash[0] == i)
+			count++;
+		hashwrite_be32(f, count);
+	}
+
+	return 0;
+}
+
+static int write_delta_search_cache_chunk_oids(struct hashfile *f, void *data)
+{
+	struct write_delta_search_cache_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->entries_nr; i++)
+		hashwrite(f, ctx->entries[i].oid.hash, f->algop->rawsz);
+
+	return 0;
+}
+
+static int write_delta_search_cache_chunk_bases(struct hashfile *f, void *data)
+{
+	struct write_delta_search_cache_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->entries_nr; i++)
+		hashwrite(f, ctx->entries[i].base.hash, f->algop->rawsz);
+
+	return 0;
+}
+
+static int write_delta_search_cache_chunk_sizes(struct hashfile *f, void *data)
+{
+	struct write_delta_search_cache_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->entries_nr; i++)
+		hashwrite_be32(f, ctx->entries[i].delta_size);
+
+	return 0;
+}
+
+int delta_search_cache_write(struct repository *r,
+			     struct delta_search_cache_entry *entries,
+			     size_t nr)
+{
+	struct write_delta_search_cache_context ctx = {
+		.entries = entries,
+		.entries_nr = nr,
+	};
+	struct lock_file lk = LOCK_INIT;
+	struct chunkfile *cf;
+	struct hashfile *f;
+	char *filename;
+	int ret = 0;
+
+	if (nr > UINT32_MAX)
+		return error(_("too many entries for the delta search cache"));
+
+	QSORT(entries, nr, delta_search_cache_entry_cmp);
+
+	filename = get_delta_search_cache_filename(r);
+	if (hold_lock_file_for_update_mode(&lk, filename, 0, 0444) < 0) {
+		ret = error_errno(_("unable to create '%s.lock'"), filename);
+		goto cleanup;
+	}
+	f = hashfd(r->hash_algo, get_lock_file_fd(&lk), get_lock_file_path(&lk));
+
+	cf = init_chunkfile(f);
+	add_chunk(cf, DELTA_SEARCH_CACHE_CHUNKID_OIDFANOUT,
+		  DELTA_SEARCH_CACHE_FANOUT_SIZE,
+		  write_delta_search_cache_chunk_fanout);
+	add_chunk(cf, DELTA_SEARCH_CACHE_CHUNKID_OIDLOOKUP,
+		  st_mult(r->hash_algo->rawsz, nr),
+		  write_delta_search_cache_chunk_oids);
+	add_chunk(cf, DELTA_SEARCH_CACHE_CHUNKID_BASES,
+		  st_mult(r->hash_algo->rawsz, nr),
+		  write_delta_search_cache_chunk_bases);
+	add_chunk(cf, DELTA_SEARCH_CACHE_CHUNKID_SIZES,
+		  st_mult(sizeof(uint32_t), nr),
+		  write_delta_search_cache_chunk_sizes);
+
+	hashwrite_be32(f, DELTA_SEARCH_CACHE_SIGNATURE);
+	hashwrite_u8(f, DELTA_SEARCH_CACHE_VERSION);
+	hashwrite_u8(f, oid_version(r->hash_algo));
+	hashwrite_u8(f, get_num_chunks(cf));
+	hashwrite_u8(f, 0); /* unused padding byte */
+
+	ret = write_chunkfile(cf, &ctx);
+	free_chunkfile(cf);
+
+	if (ret) {
+		free_hashfile(f);
+		rollback_lock_file(&lk);
+		goto cleanup;
+	}
+
+	finalize_hashfile(f, NULL, FSYNC_COMPONENT_NONE,
+			  CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+	if (commit_lock_file(&lk) < 0)
+		ret = error_errno(_("could not write '%s'"), filename);
+
+cleanup:
+	free(filename);
+	return ret;
+}
+
+void delta_search_cache_free(struct delta_search_cache *cache)
+{
+	if (!cache)
+		return;
+	munmap((void *)cache->data, cache->data_len);
+	free(cache);
+}
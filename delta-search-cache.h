@@ -0,0 +1,61 @@
+#ifndef DELTA_SEARCH_CACHE_H
+#define DELTA_SEARCH_CACHE_H
+
+#include "hash.h"
+
+struct repository;
+
+/*
+ * The delta search cache is an optional file in the "pack" directory of
+ * the main object source, which remembers for each object that was
+ * stored as a delta by an earlier pack-objects which base it was
+ * deltified against, and how large the delta was. pack-objects uses it
+ * to try that base first, and to skip the rest of the delta search
+ * window when it still gives the same delta.
+ *
+ * The file is keyed by object ID and is only ever a hint: a delta is
+ * always computed and checked before it is used.
+ */
+struct delta_search_cache;
+
+struct delta_search_cache_entry {
+	struct object_id oid;
+	struct object_id base;
+	uint32_t delta_size;
+};
+
+/*
+ * Load the delta search cache of the repository. Returns NULL if there
+ * is none, or if it is corrupt (in which case an error is shown).
+ */
+struct delta_search_cache *delta_search_cache_read(struct repository *r);
+
+/*
+ * Look up the base and delta size recorded for `oid`. Returns 0 if
+ * found, and -1 otherwise. This is safe to call from multiple threads.
+ */
+int delta_search_cache_lookup(struct delta_search_cache *cache,
+			      const struct object_id *oid,
+			      struct object_id *base, uint32_t *delta_size);
+
+/*
+ * Append to `entries` those entries of `cache` for objects which are
+ * not in `entries` yet and for which `keep` (if given) returns true.
+ * This sorts `entries`.
+ */
+void delta_search_cache_carry_over(struct delta_search_cache *cache,
+				   struct delta_search_cache_entry **entries,
+				   size_t *nr, size_t *alloc,
+				   int (*keep)(const struct object_id *oid));
+
+/*
+ * Replace the cache of the given repository with the given entries,
+ * which are sorted in place. Returns 0 on success and -1 otherwise.
+ */
+int delta_search_cache_write(struct repository *r,
+			     struct delta_search_cache_entry *entries,
+			     size_t nr);
+
+void delta_search_cache_free(struct delta_search_cache *cache);
+
+#endif /* DELTA_SEARCH_CACHE_H */
@@ -19,9 +19,228 @@
 #include "git-compat-util.h"
 #include "ewok.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define EWAH_MASK(x) ((eword_t)1 << (x % BITS_IN_EWORD))
 #define EWAH_BLOCK(x) (x / BITS_IN_EWORD)
 
+/*
+ * Operations on arrays of uncompressed words. As in hex-ll.c, the vector
+ * kernels are chosen at compile time; SSE2 is available on every x86-64
+ * CPU, and AVX2 is used when building with e.g. -march=native. The
+ * scalar loops handle the remainder and other platforms.
+ */
+#if defined(__AVX2__)
+/* Count the bits in each 64-bit lane, looking up each nibble with a shuffle. */
+static inline __m256i popcount_epi64_avx2(__m256i v)
+{
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+						1, 2, 2, 3, 2, 3, 3, 4,
+						0, 1, 1, 2, 1, 2, 2, 3,
+						1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	__m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, nibble));
+	__m256i hi = _mm256_shuffle_epi8(lookup,
+					 _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+
+	return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+static inline size_t sum_epi64_avx2(__m256i v)
+{
+	uint64_t lanes[4];
+
+	_mm256_storeu_si256((__m256i *)lanes, v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+#if defined(__SSE2__)
+/*
+ * Count the bits in each 64-bit lane. SSE2 has no byte shuffle, so this
+ * is the same bit-twiddling as ewah_bit_popcount64(), two words at a
+ * time, with the final sum done by psadbw.
+ */
+static inline __m128i popcount_epi64_sse2(__m128i v)
+{
+	const __m128i m1 = _mm_set1_epi8(0x55);
+	const __m128i m2 = _mm_set1_epi8(0x33);
+	const __m128i m4 = _mm_set1_epi8(0x0f);
+
+	v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi16(v, 1), m1));
+	v = _mm_add_epi8(_mm_and_si128(v, m2),
+			 _mm_and_si128(_mm_srli_epi16(v, 2), m2));
+	v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi16(v, 4)), m4);
+	return _mm_sad_epu8(v, _mm_setzero_si128());
+}
+
+static inline size_t sum_epi64_sse2(__m128i v)
+{
+	uint64_t lanes[2];
+
+	_mm_storeu_si128((__m128i *)lanes, v);
+	return lanes[0] + lanes[1];
+}
+#endif
+
+static void words_or(eword_t *dst, const eword_t *src, size_t nr)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 4 <= nr; i += 4) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(a, b));
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 2 <= nr; i += 2) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(a, b));
+	}
+#endif
+	for (; i < nr; i++)
+		dst[i] |= src[i];
+}
+
+static void words_and_not(eword_t *dst, const eword_t *src, size_t nr)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 4 <= nr; i += 4) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_andnot_si256(b, a));
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 2 <= nr; i += 2) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_andnot_si128(b, a));
+	}
+#endif
+	for (; i < nr; i++)
+		dst[i] &= ~src[i];
+}
+
+/* Return 1 if any bit in 'a' is not set in 'b', 0 otherwise. */
+static int words_and_not_any(const eword_t *a, const eword_t *b, size_t nr)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 4 <= nr; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+		if (!_mm256_testc_si256(y, x))
+			return 1;
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 2 <= nr; i += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i extra = _mm_andnot_si128(y, x);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(extra, _mm_setzero_si128())) != 0xffff)
+			return 1;
+	}
+#endif
+	for (; i < nr; i++)
+		if (a[i] & ~b[i])
+			return 1;
+	return 0;
+}
+
+static int words_any(const eword_t *words, size_t nr)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 4 <= nr; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(words + i));
+		if (!_mm256_testz_si256(x, x))
+			return 1;
+	}
+#endif
+	for (; i < nr; i++)
+		if (words[i])
+			return 1;
+	return 0;
+}
+
+static size_t words_popcount(const eword_t *words, size_t nr)
+{
+	size_t i = 0, count = 0;
+
+#if defined(__AVX2__)
+	{
+		__m256i acc = _mm256_setzero_si256();
+
+		for (; i + 4 <= nr; i += 4) {
+			__m256i x = _mm256_loadu_si256((const __m256i *)(words + i));
+			acc = _mm256_add_epi64(acc, popcount_epi64_avx2(x));
+		}
+		count += sum_epi64_avx2(acc);
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		__m128i acc = _mm_setzero_si128();
+
+		for (; i + 2 <= nr; i += 2) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(words + i));
+			acc = _mm_add_epi64(acc, popcount_epi64_sse2(x));
+		}
+		count += sum_epi64_sse2(acc);
+	}
+#endif
+	for (; i < nr; i++)
+		count += ewah_bit_popcount64(words[i]);
+	return count;
+}
+
+static size_t words_and_popcount(const eword_t *a, const eword_t *b, size_t nr)
+{
+	size_t i = 0, count = 0;
+
+#if defined(__AVX2__)
+	{
+		__m256i acc = _mm256_setzero_si256();
+
+		for (; i + 4 <= nr; i += 4) {
+			__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+			__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+			acc = _mm256_add_epi64(acc,
+					       popcount_epi64_avx2(_mm256_and_si256(x, y)));
+		}
+		count += sum_epi64_avx2(acc);
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		__m128i acc = _mm_setzero_si128();
+
+		for (; i + 2 <= nr; i += 2) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+			__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+			acc = _mm_add_epi64(acc, popcount_epi64_sse2(_mm_and_si128(x, y)));
+		}
+		count += sum_epi64_sse2(acc);
+	}
+#endif
+	for (; i < nr; i++)
+		count += ewah_bit_popcount64(a[i] & b[i]);
+	return count;
+}
+
 struct bitmap *bitmap_word_alloc(size_t word_alloc)
 {
 	struct bitmap *bitmap = xmalloc(sizeof(struct bitmap));
@@ -102,15 +321,20 @@ struct ewah_bitmap *bitmap_to_ewah(struct bitmap *bitmap)
 struct bitmap *ewah_to_bitmap(struct ewah_bitmap *ewah)
 {
 	struct bitmap *bitmap = bitmap_new();
-	struct ewah_iterator it;
-	eword_t blowup;
+	struct ewah_run_iterator it;
+	struct ewah_run run;
 	size_t i = 0;
 
-	ewah_iterator_init(&it, ewah);
+	ewah_run_iterator_init(&it, ewah);
 
-	while (ewah_iterator_next(&blowup, &it)) {
-		ALLOC_GROW(bitmap->words, i + 1, bitmap->word_alloc);
-		bitmap->words[i++] = blowup;
+	while (ewah_run_iterator_next(&run, &it)) {
+		i = run.start + run.len;
+		ALLOC_GROW(bitmap->words, i, bitmap->word_alloc);
+		if (run.literals)
+			COPY_ARRAY(bitmap->words + run.start, run.literals, run.len);
+		else
+			memset(bitmap->words + run.start, run.fill ? 0xff : 0,
+			       st_mult(run.len, sizeof(eword_t)));
 	}
 
 	bitmap->word_alloc = i;
@@ -122,61 +346,50 @@ void bitmap_and_not(struct bitmap *self, struct bitmap *other)
 	const size_t count = (self->word_alloc < other->word_alloc) ?
 		self->word_alloc : other->word_alloc;
 
-	size_t i;
-
-	for (i = 0; i < count; ++i)
-		self->words[i] &= ~other->words[i];
+	words_and_not(self->words, other->words, count);
 }
 
 void bitmap_or(struct bitmap *self, const struct bitmap *other)
 {
-	size_t i;
-
 	bitmap_grow(self, other->word_alloc);
-	for (i = 0; i < other->word_alloc; i++)
-		self->words[i] |= other->words[i];
+	words_or(self->words, other->words, other->word_alloc);
 }
 
 int ewah_bitmap_is_subset(struct ewah_bitmap *self, struct bitmap *other)
 {
-	struct ewah_iterator it;
-	eword_t word;
-	size_t i;
-
-	ewah_iterator_init(&it, self);
-
-	for (i = 0; i < other->word_alloc; i++) {
-		if (!ewah_iterator_next(&word, &it)) {
-			/*
-			 * If we reached the end of `self`, and haven't
-			 * rejected `self` as a possible subset of
-			 * `other` yet, then we are done and `self` is
-			 * indeed a subset of `other`.
-			 */
-			return 1;
-		}
-		if (word & ~other->words[i]) {
-			/*
-			 * Otherwise, compare the next two pairs of
-			 * words. If the word from `self` has bit(s) not
-			 * in the word from `other`, `self` is not a
-			 * subset of `other`.
-			 */
-			return 0;
+	struct ewah_run_iterator it;
+	struct ewah_run run;
+
+	ewah_run_iterator_init(&it, self);
+
+	while (ewah_run_iterator_next(&run, &it)) {
+		/*
+		 * Split the run into the part that overlaps with `other`,
+		 * whose words must not have any bits that `other` lacks,
+		 * and the part beyond the end of `other`, which must be
+		 * empty.
+		 */
+		size_t common = 0;
+
+		if (run.start < other->word_alloc)
+			common = other->word_alloc - run.start;
+		if (common > run.len)
+			common = run.len;
+
+		if (run.literals) {
+			if (words_and_not_any(run.literals,
+					      other->words + run.start, common) ||
+			    words_any(run.literals + common, run.len - common))
+				return 0;
+		} else if (run.fill) {
+			if (common < run.len)
+				return 0;
+			for (size_t i = 0; i < common; i++)
+				if (~other->words[run.start + i])
+					return 0;
 		}
 	}
 
-	/*
-	 * If we got to this point, there may be zero or more words
-	 * remaining in `self`, with no remaining words left in `other`.
-	 * If there are any bits set in the remaining word(s) in `self`,
-	 * then `self` is not a subset of `other`.
-	 */
-	while (ewah_iterator_next(&word, &it))
-		if (word)
-			return 0;
-
-	/* `self` is definitely a subset of `other` */
 	return 1;
 }
 
@@ -184,9 +397,8 @@ void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 {
 	size_t original_size = self->word_alloc;
 	size_t other_final = (other->bit_size / BITS_IN_EWORD) + 1;
-	size_t i = 0;
-	struct ewah_iterator it;
-	eword_t word;
+	struct ewah_run_iterator it;
+	struct ewah_run run;
 
 	if (self->word_alloc < other_final) {
 		self->word_alloc = other_final;
@@ -195,43 +407,76 @@ void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 		              (self->word_alloc - original_size));
 	}
 
-	ewah_iterator_init(&it, other);
+	ewah_run_iterator_init(&it, other);
 
-	while (ewah_iterator_next(&word, &it))
-		self->words[i++] |= word;
+	while (ewah_run_iterator_next(&run, &it)) {
+		size_t len = run.len;
+
+		if (run.start >= self->word_alloc)
+			break;
+		if (len > self->word_alloc - run.start)
+			len = self->word_alloc - run.start;
+
+		if (run.literals)
+			words_or(self->words + run.start, run.literals, len);
+		else if (run.fill)
+			memset(self->words + run.start, 0xff,
+			       st_mult(len, sizeof(eword_t)));
+	}
 }
 
 size_t bitmap_popcount(struct bitmap *self)
 {
-	size_t i, count = 0;
+	return words_popcount(self->words, self->word_alloc);
+}
 
-	for (i = 0; i < self->word_alloc; ++i)
-		count += ewah_bit_popcount64(self->words[i]);
+size_t ewah_bitmap_popcount(struct ewah_bitmap *self)
+{
+	struct ewah_run_iterator it;
+	struct ewah_run run;
+	size_t count = 0;
+
+	ewah_run_iterator_init(&it, self);
+
+	while (ewah_run_iterator_next(&run, &it)) {
+		if (run.literals)
+			count += words_popcount(run.literals, run.len);
+		else if (run.fill)
+			count += st_mult(run.len, BITS_IN_EWORD);
+	}
 
 	return count;
 }
 
-size_t ewah_bitmap_popcount(struct ewah_bitmap *self)
+size_t ewah_bitmap_and_popcount(struct ewah_bitmap *self, struct bitmap *other)
 {
-	struct ewah_iterator it;
-	eword_t word;
+	struct ewah_run_iterator it;
+	struct ewah_run run;
 	size_t count = 0;
 
-	ewah_iterator_init(&it, self);
+	ewah_run_iterator_init(&it, self);
 
-	while (ewah_iterator_next(&word, &it))
-		count += ewah_bit_popcount64(word);
+	while (ewah_run_iterator_next(&run, &it)) {
+		size_t len = run.len;
+
+		if (run.start >= other->word_alloc)
+			break;
+		if (len > other->word_alloc - run.start)
+			len = other->word_alloc - run.start;
+
+		if (run.literals)
+			count += words_and_popcount(run.literals,
+						    other->words + run.start, len);
+		else if (run.fill)
+			count += words_popcount(other->words + run.start, len);
+	}
 
 	return count;
 }
 
 int bitmap_is_empty(struct bitmap *self)
 {
-	size_t i;
-	for (i = 0; i < self->word_alloc; i++)
-		if (self->words[i])
-			return 0;
-	return 1;
+	return !words_any(self->words, self->word_alloc);
 }
 
 int bitmap_equals(struct bitmap *self, struct bitmap *other)
@@ -281,23 +526,18 @@ int bitmap_equals_ewah(struct bitmap *self, struct ewah_bitmap *other)
 
 int bitmap_is_subset(struct bitmap *self, struct bitmap *other)
 {
-	size_t common_size, i;
+	size_t common_size;
 
 	if (self->word_alloc < other->word_alloc)
 		common_size = self->word_alloc;
 	else {
 		common_size = other->word_alloc;
-		for (i = common_size; i < self->word_alloc; i++) {
-			if (self->words[i])
-				return 1;
-		}
-	}
-
-	for (i = 0; i < common_size; i++) {
-		if (self->words[i] & ~other->words[i])
+		if (words_any(self->words + common_size,
+			      self->word_alloc - common_size))
 			return 1;
 	}
-	return 0;
+
+	return words_and_not_any(self->words, other->words, common_size);
 }
 
 void bitmap_free(struct bitmap *bitmap)
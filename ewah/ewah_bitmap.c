@@ -371,6 +371,55 @@ void ewah_iterator_init(struct ewah_iterator *it, struct ewah_bitmap *parent)
 		read_new_rlw(it);
 }
 
+void ewah_run_iterator_init(struct ewah_run_iterator *it,
+			    struct ewah_bitmap *parent)
+{
+	it->buffer = parent->buffer;
+	it->buffer_size = parent->buffer_size;
+	it->pointer = 0;
+	it->pos = 0;
+	it->literals = 0;
+}
+
+int ewah_run_iterator_next(struct ewah_run *run, struct ewah_run_iterator *it)
+{
+	while (1) {
+		const eword_t *word;
+		size_t running_len;
+
+		if (it->literals) {
+			run->start = it->pos;
+			run->len = it->literals;
+			run->literals = it->buffer + it->pointer;
+			run->fill = 0;
+
+			it->pointer += it->literals;
+			it->pos += it->literals;
+			it->literals = 0;
+			return 1;
+		}
+
+		if (it->pointer >= it->buffer_size)
+			return 0;
+
+		word = &it->buffer[it->pointer++];
+		running_len = rlw_get_running_len(word);
+		it->literals = rlw_get_literal_words(word);
+		if (it->literals > it->buffer_size - it->pointer)
+			it->literals = it->buffer_size - it->pointer;
+
+		if (running_len) {
+			run->start = it->pos;
+			run->len = running_len;
+			run->literals = NULL;
+			run->fill = rlw_get_run_bit(word) ? ~(eword_t)0 : 0;
+
+			it->pos += running_len;
+			return 1;
+		}
+	}
+}
+
 void ewah_or_iterator_init(struct ewah_or_iterator *it,
 			   struct ewah_bitmap **parents, size_t nr)
 {
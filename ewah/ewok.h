@@ -148,6 +148,41 @@ void ewah_iterator_init(struct ewah_iterator *it, struct ewah_bitmap *parent);
  */
 int ewah_iterator_next(eword_t *next, struct ewah_iterator *it);
 
+/**
+ * A stretch of words in the uncompressed form of an EWAH bitmap: either
+ * `len` copies of `fill` (all zeroes or all ones), or `len` literal
+ * words stored in the bitmap's buffer.
+ */
+struct ewah_run {
+	/* The index of the first word of the run. */
+	size_t start;
+	size_t len;
+	/* The literal words, or NULL for a run of `fill` words. */
+	const eword_t *literals;
+	eword_t fill;
+};
+
+struct ewah_run_iterator {
+	const eword_t *buffer;
+	size_t buffer_size;
+
+	size_t pointer;
+	size_t pos;
+	size_t literals;
+};
+
+/**
+ * Iterate over the bitmap one run at a time, rather than one word at a
+ * time like `ewah_iterator_next()`. This lets callers fill or skip
+ * whole runs at once and hand stretches of literal words to the bulk
+ * word operations.
+ *
+ * Return: true if a run was yielded, false if there are no runs left
+ */
+void ewah_run_iterator_init(struct ewah_run_iterator *it,
+			    struct ewah_bitmap *parent);
+int ewah_run_iterator_next(struct ewah_run *run, struct ewah_run_iterator *it);
+
 struct ewah_or_iterator {
 	struct ewah_iterator *its;
 	size_t nr;
@@ -209,6 +244,77 @@ void bitmap_or(struct bitmap *self, const struct bitmap *other);
 
 size_t bitmap_popcount(struct bitmap *self);
 size_t ewah_bitmap_popcount(struct ewah_bitmap *self);
+
+/*
+ * Count the bits that are set in both 'self' and 'other', considering
+ * only the words that 'other' has allocated.
+ */
+size_t ewah_bitmap_and_popcount(struct ewah_bitmap *self, struct bitmap *other);
 int bitmap_is_empty(struct bitmap *self);
 
+/**
+ * Roaring-style compressed bitmap.
+ *
+ * The bit positions are split into chunks of 2^16 bits, and each chunk
+ * that has any bits set is stored in a container of its own. Depending
+ * on the density of the chunk, the container holds the sorted positions
+ * of its bits, an uncompressed bitset, or a list of runs of consecutive
+ * bits, whichever is the smallest.
+ *
+ * Unlike an EWAH bitmap, which can only be decoded word by word from its
+ * beginning, each container can be combined with an uncompressed bitmap
+ * on its own, so that e.g. `bitmap_or_roaring()` works directly on the
+ * compressed form.
+ */
+enum roaring_container_type {
+	ROARING_ARRAY = 1,
+	ROARING_BITSET = 2,
+	ROARING_RUN = 3,
+};
+
+struct roaring_run {
+	/* The run covers the bits from `start` to `start + length`. */
+	uint16_t start;
+	uint16_t length;
+};
+
+struct roaring_container {
+	/* The chunk covered by this container, i.e. its positions >> 16. */
+	uint16_t key;
+	uint8_t type;
+	/* The number of values or runs for array and run containers. */
+	uint16_t nr;
+	union {
+		uint16_t *values;
+		eword_t *words;
+		struct roaring_run *runs;
+	} u;
+};
+
+struct roaring_bitmap {
+	struct roaring_container *containers;
+	size_t nr, alloc;
+};
+
+struct roaring_bitmap *roaring_new(void);
+void roaring_free(struct roaring_bitmap *self);
+
+struct roaring_bitmap *bitmap_to_roaring(struct bitmap *bitmap);
+struct roaring_bitmap *ewah_to_roaring(struct ewah_bitmap *ewah);
+struct ewah_bitmap *roaring_to_ewah(struct roaring_bitmap *self);
+
+/**
+ * Serialize the bitmap in network byte order; see the description of
+ * the roaring encoding in Documentation/technical/bitmap-format.adoc.
+ */
+int roaring_serialize_to(struct roaring_bitmap *self,
+			 int (*write_fun)(void *out, const void *buf, size_t len),
+			 void *out);
+ssize_t roaring_read_mmap(struct roaring_bitmap *self, const void *map, size_t len);
+
+struct roaring_bitmap *roaring_xor(struct roaring_bitmap *a,
+				   struct roaring_bitmap *b);
+void bitmap_or_roaring(struct bitmap *self, struct roaring_bitmap *other);
+size_t roaring_popcount(struct roaring_bitmap *self);
+
 #endif
@@ -0,0 +1,543 @@
+/**
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "git-compat-util.h"
+#include "ewok.h"
+
+#define ROARING_CHUNK_BITS 16
+#define ROARING_CHUNK_WORDS ((1 << ROARING_CHUNK_BITS) / BITS_IN_EWORD)
+#define ROARING_ARRAY_MAX 4096
+#define ROARING_RUN_MAX (ROARING_ARRAY_MAX / 2)
+
+#define ROARING_MASK(x) ((eword_t)1 << ((x) % BITS_IN_EWORD))
+#define ROARING_BLOCK(x) ((x) / BITS_IN_EWORD)
+
+struct roaring_bitmap *roaring_new(void)
+{
+	struct roaring_bitmap *self;
+	CALLOC_ARRAY(self, 1);
+	return self;
+}
+
+static void container_release(struct roaring_container *c)
+{
+	switch (c->type) {
+	case ROARING_ARRAY:
+		free(c->u.values);
+		break;
+	case ROARING_BITSET:
+		free(c->u.words);
+		break;
+	case ROARING_RUN:
+		free(c->u.runs);
+		break;
+	}
+}
+
+void roaring_free(struct roaring_bitmap *self)
+{
+	if (!self)
+		return;
+	for (size_t i = 0; i < self->nr; i++)
+		container_release(&self->containers[i]);
+	free(self->containers);
+	free(self);
+}
+
+static struct roaring_container *roaring_append(struct roaring_bitmap *self,
+						uint16_t key, uint8_t type)
+{
+	struct roaring_container *c;
+
+	ALLOC_GROW(self->containers, self->nr + 1, self->alloc);
+	c = &self->containers[self->nr++];
+	memset(c, 0, sizeof(*c));
+	c->key = key;
+	c->type = type;
+	return c;
+}
+
+enum container_op {
+	CONTAINER_OR,
+	CONTAINER_XOR,
+};
+
+static inline void apply_word(eword_t *dst, eword_t mask, enum container_op op)
+{
+	if (op == CONTAINER_OR)
+		*dst |= mask;
+	else
+		*dst ^= mask;
+}
+
+/*
+ * Apply the range of bits [start, end] (inclusive) to the words of a
+ * chunk, filling whole words at a time.
+ */
+static void apply_range(eword_t *words, uint32_t start, uint32_t end,
+			enum container_op op)
+{
+	size_t first = ROARING_BLOCK(start), last = ROARING_BLOCK(end);
+	eword_t first_mask = ~(eword_t)0 << (start % BITS_IN_EWORD);
+	eword_t last_mask = ~(eword_t)0 >> (BITS_IN_EWORD - 1 - end % BITS_IN_EWORD);
+
+	if (first == last) {
+		apply_word(&words[first], first_mask & last_mask, op);
+		return;
+	}
+
+	apply_word(&words[first], first_mask, op);
+	for (size_t i = first + 1; i < last; i++)
+		apply_word(&words[i], ~(eword_t)0, op);
+	apply_word(&words[last], last_mask, op);
+}
+
+/*
+ * Apply the bits of a container to the first `nr` words of its chunk in
+ * uncompressed form. The container must not have any bits set beyond
+ * those words.
+ */
+static void container_apply(const struct roaring_container *c,
+			    eword_t *words, size_t nr, enum container_op op)
+{
+	switch (c->type) {
+	case ROARING_ARRAY:
+		for (size_t i = 0; i < c->nr; i++)
+			apply_word(&words[ROARING_BLOCK(c->u.values[i])],
+				   ROARING_MASK(c->u.values[i]), op);
+		break;
+	case ROARING_BITSET:
+		/*
+		 * Keep this loop trivial so that the compiler can
+		 * vectorize it.
+		 */
+		if (op == CONTAINER_OR) {
+			for (size_t i = 0; i < nr; i++)
+				words[i] |= c->u.words[i];
+		} else {
+			for (size_t i = 0; i < nr; i++)
+				words[i] ^= c->u.words[i];
+		}
+		break;
+	case ROARING_RUN:
+		for (size_t i = 0; i < c->nr; i++)
+			apply_range(words, c->u.runs[i].start,
+				    (uint32_t)c->u.runs[i].start + c->u.runs[i].length,
+				    op);
+		break;
+	}
+}
+
+/*
+ * Return the number of words of its chunk that a container spans, i.e.,
+ * one more than the index of the word holding its highest bit.
+ */
+static size_t container_word_span(const struct roaring_container *c)
+{
+	switch (c->type) {
+	case ROARING_ARRAY:
+		return ROARING_BLOCK(c->u.values[c->nr - 1]) + 1;
+	case ROARING_BITSET:
+		for (size_t i = ROARING_CHUNK_WORDS; i > 0; i--)
+			if (c->u.words[i - 1])
+				return i;
+		return 0;
+	case ROARING_RUN: {
+		const struct roaring_run *run = &c->u.runs[c->nr - 1];
+		return ROARING_BLOCK((uint32_t)run->start + run->length) + 1;
+	}
+	}
+	return 0;
+}
+
+/*
+ * Append a container holding the bits of the given chunk in whichever
+ * encoding is the smallest. Nothing is appended if the chunk is empty.
+ */
+static void roaring_append_words(struct roaring_bitmap *self, uint16_t key,
+				 const eword_t *words, size_t nr)
+{
+	struct roaring_container *c;
+	size_t cardinality = 0, runs = 0;
+	size_t array_size, run_size, bitset_size = ROARING_CHUNK_WORDS * sizeof(eword_t);
+
+	for (size_t i = 0; i < nr; i++) {
+		eword_t carry = i ? words[i - 1] >> (BITS_IN_EWORD - 1) : 0;
+
+		cardinality += ewah_bit_popcount64(words[i]);
+		/* Count the bits that are set while their predecessor is not. */
+		runs += ewah_bit_popcount64(words[i] & ~((words[i] << 1) | carry));
+	}
+	if (!cardinality)
+		return;
+
+	array_size = cardinality * sizeof(uint16_t);
+	run_size = runs * sizeof(struct roaring_run);
+
+	if (run_size < bitset_size && run_size < array_size) {
+		size_t starts_nr = 0, ends_nr = 0;
+
+		c = roaring_append(self, key, ROARING_RUN);
+		ALLOC_ARRAY(c->u.runs, runs);
+		for (size_t i = 0; i < nr; i++) {
+			eword_t prev = i ? words[i - 1] >> (BITS_IN_EWORD - 1) : 0;
+			eword_t next = i + 1 < nr ? words[i + 1] << (BITS_IN_EWORD - 1) : 0;
+			eword_t starts = words[i] & ~((words[i] << 1) | prev);
+			eword_t ends = words[i] & ~((words[i] >> 1) | next);
+
+			/*
+			 * A run ending in this word starts in it or before,
+			 * so its start has been recorded by the time we get
+			 * to its end.
+			 */
+			for (; starts; starts &= starts - 1)
+				c->u.runs[starts_nr++].start =
+					i * BITS_IN_EWORD + ewah_bit_ctz64(starts);
+			for (; ends; ends &= ends - 1, ends_nr++)
+				c->u.runs[ends_nr].length =
+					i * BITS_IN_EWORD + ewah_bit_ctz64(ends) -
+					c->u.runs[ends_nr].start;
+		}
+		c->nr = starts_nr;
+	} else if (cardinality <= ROARING_ARRAY_MAX && array_size < bitset_size) {
+		size_t n = 0;
+
+		c = roaring_append(self, key, ROARING_ARRAY);
+		ALLOC_ARRAY(c->u.values, cardinality);
+		for (size_t i = 0; i < nr; i++) {
+			eword_t word = words[i];
+
+			while (word) {
+				c->u.values[n++] = i * BITS_IN_EWORD + ewah_bit_ctz64(word);
+				word &= word - 1;
+			}
+		}
+		c->nr = n;
+	} else {
+		c = roaring_append(self, key, ROARING_BITSET);
+		CALLOC_ARRAY(c->u.words, ROARING_CHUNK_WORDS);
+		COPY_ARRAY(c->u.words, words, nr);
+	}
+}
+
+struct roaring_bitmap *bitmap_to_roaring(struct bitmap *bitmap)
+{
+	struct roaring_bitmap *self = roaring_new();
+
+	for (size_t i = 0; i < bitmap->word_alloc; i += ROARING_CHUNK_WORDS) {
+		size_t nr = bitmap->word_alloc - i;
+
+		if (nr > ROARING_CHUNK_WORDS)
+			nr = ROARING_CHUNK_WORDS;
+		if (i / ROARING_CHUNK_WORDS > UINT16_MAX)
+			BUG("bitmap too large for roaring encoding");
+		roaring_append_words(self, i / ROARING_CHUNK_WORDS,
+				     bitmap->words + i, nr);
+	}
+
+	return self;
+}
+
+struct roaring_bitmap *ewah_to_roaring(struct ewah_bitmap *ewah)
+{
+	struct bitmap *bitmap = ewah_to_bitmap(ewah);
+	struct roaring_bitmap *self = bitmap_to_roaring(bitmap);
+
+	bitmap_free(bitmap);
+	return self;
+}
+
+struct ewah_bitmap *roaring_to_ewah(struct roaring_bitmap *self)
+{
+	struct bitmap *bitmap = bitmap_word_alloc(0);
+	struct ewah_bitmap *ewah;
+
+	bitmap_or_roaring(bitmap, self);
+	ewah = bitmap_to_ewah(bitmap);
+	bitmap_free(bitmap);
+	return ewah;
+}
+
+void bitmap_or_roaring(struct bitmap *self, struct roaring_bitmap *other)
+{
+	const struct roaring_container *last;
+	size_t other_final;
+
+	if (!other->nr)
+		return;
+
+	last = &other->containers[other->nr - 1];
+	other_final = (size_t)last->key * ROARING_CHUNK_WORDS +
+		container_word_span(last);
+	if (self->word_alloc < other_final) {
+		size_t original_size = self->word_alloc;
+
+		self->word_alloc = other_final;
+		REALLOC_ARRAY(self->words, self->word_alloc);
+		MEMZERO_ARRAY(self->words + original_size,
+			      self->word_alloc - original_size);
+	}
+
+	for (size_t i = 0; i < other->nr; i++) {
+		const struct roaring_container *c = &other->containers[i];
+		size_t base = (size_t)c->key * ROARING_CHUNK_WORDS;
+		size_t nr = self->word_alloc - base;
+
+		if (nr > ROARING_CHUNK_WORDS)
+			nr = ROARING_CHUNK_WORDS;
+		container_apply(c, self->words + base, nr, CONTAINER_OR);
+	}
+}
+
+static void roaring_append_copy(struct roaring_bitmap *self,
+				const struct roaring_container *c)
+{
+	struct roaring_container *copy = roaring_append(self, c->key, c->type);
+
+	copy->nr = c->nr;
+	switch (c->type) {
+	case ROARING_ARRAY:
+		DUP_ARRAY(copy->u.values, c->u.values, c->nr);
+		break;
+	case ROARING_BITSET:
+		DUP_ARRAY(copy->u.words, c->u.words, ROARING_CHUNK_WORDS);
+		break;
+	case ROARING_RUN:
+		DUP_ARRAY(copy->u.runs, c->u.runs, c->nr);
+		break;
+	}
+}
+
+struct roaring_bitmap *roaring_xor(struct roaring_bitmap *a,
+				   struct roaring_bitmap *b)
+{
+	struct roaring_bitmap *out = roaring_new();
+	eword_t words[ROARING_CHUNK_WORDS];
+	size_t i = 0, j = 0;
+
+	while (i < a->nr || j < b->nr) {
+		const struct roaring_container *ca = i < a->nr ? &a->containers[i] : NULL;
+		const struct roaring_container *cb = j < b->nr ? &b->containers[j] : NULL;
+
+		if (!cb || (ca && ca->key < cb->key)) {
+			roaring_append_copy(out, ca);
+			i++;
+		} else if (!ca || cb->key < ca->key) {
+			roaring_append_copy(out, cb);
+			j++;
+		} else {
+			memset(words, 0, sizeof(words));
+			container_apply(ca, words, ROARING_CHUNK_WORDS, CONTAINER_XOR);
+			container_apply(cb, words, ROARING_CHUNK_WORDS, CONTAINER_XOR);
+			roaring_append_words(out, ca->key, words, ROARING_CHUNK_WORDS);
+			i++;
+			j++;
+		}
+	}
+
+	return out;
+}
+
+size_t roaring_popcount(struct roaring_bitmap *self)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < self->nr; i++) {
+		const struct roaring_container *c = &self->containers[i];
+
+		switch (c->type) {
+		case ROARING_ARRAY:
+			count += c->nr;
+			break;
+		case ROARING_BITSET:
+			for (size_t j = 0; j < ROARING_CHUNK_WORDS; j++)
+				count += ewah_bit_popcount64(c->u.words[j]);
+			break;
+		case ROARING_RUN:
+			for (size_t j = 0; j < c->nr; j++)
+				count += (size_t)c->u.runs[j].length + 1;
+			break;
+		}
+	}
+
+	return count;
+}
+
+int roaring_serialize_to(struct roaring_bitmap *self,
+			 int (*write_fun)(void *, const void *, size_t),
+			 void *data)
+{
+	unsigned char header[sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint16_t)];
+	uint16_t values[ROARING_ARRAY_MAX];
+	eword_t dump[ROARING_CHUNK_WORDS];
+	uint32_t count;
+	size_t total = 0, header_len, len;
+
+	count = htonl(self->nr);
+	if (write_fun(data, &count, sizeof(count)) != sizeof(count))
+		return -1;
+	total += sizeof(count);
+
+	for (size_t i = 0; i < self->nr; i++) {
+		const struct roaring_container *c = &self->containers[i];
+
+		header[0] = c->key >> 8;
+		header[1] = c->key & 0xff;
+		header[2] = c->type;
+		header_len = 3;
+
+		switch (c->type) {
+		case ROARING_ARRAY:
+			header[header_len++] = c->nr >> 8;
+			header[header_len++] = c->nr & 0xff;
+			for (size_t j = 0; j < c->nr; j++)
+				values[j] = htons(c->u.values[j]);
+			len = c->nr * sizeof(uint16_t);
+			break;
+		case ROARING_BITSET:
+			for (size_t j = 0; j < ROARING_CHUNK_WORDS; j++)
+				dump[j] = htonll(c->u.words[j]);
+			len = sizeof(dump);
+			break;
+		case ROARING_RUN:
+			header[header_len++] = c->nr >> 8;
+			header[header_len++] = c->nr & 0xff;
+			for (size_t j = 0; j < c->nr; j++) {
+				values[2 * j] = htons(c->u.runs[j].start);
+				values[2 * j + 1] = htons(c->u.runs[j].length);
+			}
+			len = c->nr * sizeof(struct roaring_run);
+			break;
+		default:
+			BUG("unknown roaring container type %d", c->type);
+		}
+
+		if (write_fun(data, header, header_len) != (int)header_len)
+			return -1;
+		if (write_fun(data, c->type == ROARING_BITSET ?
+				    (void *)dump : (void *)values, len) != (int)len)
+			return -1;
+		total += header_len + len;
+	}
+
+	return total;
+}
+
+static ssize_t read_container(struct roaring_container *c,
+			      const uint8_t *ptr, size_t len)
+{
+	const uint8_t *start = ptr;
+	size_t nr = 0;
+
+	if (len < 3)
+		return error("corrupt roaring bitmap: eof before container header");
+	c->key = get_be16(ptr);
+	c->type = ptr[2];
+	ptr += 3;
+	len -= 3;
+
+	if (c->type == ROARING_ARRAY || c->type == ROARING_RUN) {
+		if (len < sizeof(uint16_t))
+			return error("corrupt roaring bitmap: eof before container size");
+		nr = get_be16(ptr);
+		ptr += sizeof(uint16_t);
+		len -= sizeof(uint16_t);
+		if (!nr)
+			return error("corrupt roaring bitmap: empty container");
+	}
+
+	switch (c->type) {
+	case ROARING_ARRAY:
+		if (nr > ROARING_ARRAY_MAX)
+			return error("corrupt roaring bitmap: array container too large");
+		if (len < nr * sizeof(uint16_t))
+			return error("corrupt roaring bitmap: eof in array container");
+		ALLOC_ARRAY(c->u.values, nr);
+		c->nr = nr;
+		for (size_t i = 0; i < nr; i++) {
+			c->u.values[i] = get_be16(ptr);
+			ptr += sizeof(uint16_t);
+			if (i && c->u.values[i] <= c->u.values[i - 1])
+				return error("corrupt roaring bitmap: unsorted array container");
+		}
+		break;
+	case ROARING_BITSET:
+		if (len < ROARING_CHUNK_WORDS * sizeof(eword_t))
+			return error("corrupt roaring bitmap: eof in bitset container");
+		ALLOC_ARRAY(c->u.words, ROARING_CHUNK_WORDS);
+		for (size_t i = 0; i < ROARING_CHUNK_WORDS; i++) {
+			c->u.words[i] = get_be64(ptr);
+			ptr += sizeof(eword_t);
+		}
+		break;
+	case ROARING_RUN:
+		if (nr > ROARING_RUN_MAX)
+			return error("corrupt roaring bitmap: run container too large");
+		if (len < nr * sizeof(struct roaring_run))
+			return error("corrupt roaring bitmap: eof in run container");
+		ALLOC_ARRAY(c->u.runs, nr);
+		c->nr = nr;
+		for (size_t i = 0; i < nr; i++) {
+			struct roaring_run *run = &c->u.runs[i];
+
+			run->start = get_be16(ptr);
+			run->length = get_be16(ptr + sizeof(uint16_t));
+			ptr += sizeof(struct roaring_run);
+			if ((uint32_t)run->start + run->length > UINT16_MAX ||
+			    (i && run->start <= (uint32_t)run[-1].start + run[-1].length))
+				return error("corrupt roaring bitmap: invalid run container");
+		}
+		break;
+	default:
+		return error("corrupt roaring bitmap: unknown container type %d",
+			     c->type);
+	}
+
+	return ptr - start;
+}
+
+ssize_t roaring_read_mmap(struct roaring_bitmap *self, const void *map, size_t len)
+{
+	const uint8_t *ptr = map;
+	uint32_t count;
+
+	if (len < sizeof(uint32_t))
+		return error("corrupt roaring bitmap: eof before container count");
+	count = get_be32(ptr);
+	ptr += sizeof(uint32_t);
+	len -= sizeof(uint32_t);
+
+	/* Each container takes at least five bytes. */
+	if (count > len / 5)
+		return error("corrupt roaring bitmap: container count too large");
+
+	ALLOC_ARRAY(self->containers, count);
+	self->alloc = count;
+	for (uint32_t i = 0; i < count; i++) {
+		struct roaring_container *c = &self->containers[i];
+		ssize_t ret;
+
+		memset(c, 0, sizeof(*c));
+		self->nr++;
+		ret = read_container(c, ptr, len);
+		if (ret < 0)
+			return ret;
+		if (i && c->key <= self->containers[i - 1].key)
+			return error("corrupt roaring bitmap: unsorted containers");
+		ptr += ret;
+		len -= ret;
+	}
+
+	return ptr - (const uint8_t *)map;
+}
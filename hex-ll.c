@@ -1,6 +1,12 @@
 #include "git-compat-util.h"
 #include "hex-ll.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 const signed char hexval_table[256] = {
 	 -1, -1, -1, -1, -1, -1, -1, -1,		/* 00-07 */
 	 -1, -1, -1, -1, -1, -1, -1, -1,		/* 08-0f */
@@ -47,3 +53,140 @@ int hex_to_bytes(unsigned char *binary, const char *hex, size_t len)
 	}
 	return 0;
 }
+
+#if defined(__SSE2__)
+/*
+ * Turn 16 ASCII characters into their nibble values. Returns non-zero
+ * if any of them is not a hexadecimal digit. This sticks to SSE2, which
+ * every x86-64 CPU has, and so cannot use a byte shuffle as a lookup
+ * table; range checks on signed bytes reject everything >= 0x80 for
+ * free.
+ */
+static inline int hex_nibbles_sse2(__m128i *out, const char *hex)
+{
+	__m128i c = _mm_loadu_si128((const __m128i *)hex);
+	__m128i l = _mm_or_si128(c, _mm_set1_epi8(0x20));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+				      _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+				      _mm_cmplt_epi8(l, _mm_set1_epi8('f' + 1)));
+
+	*out = _mm_or_si128(
+		_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+		_mm_and_si128(alpha, _mm_sub_epi8(l, _mm_set1_epi8('a' - 10))));
+	return _mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff;
+}
+
+/* Combine pairs of nibbles into 8 bytes, stored in the low half of 16-bit lanes. */
+static inline __m128i hex_pairs_sse2(__m128i nibbles)
+{
+	__m128i hi = _mm_and_si128(nibbles, _mm_set1_epi16(0x00ff));
+	__m128i lo = _mm_srli_epi16(nibbles, 8);
+	return _mm_or_si128(_mm_slli_epi16(hi, 4), lo);
+}
+
+static inline __m128i hex_digits_sse2(__m128i nibbles)
+{
+	__m128i alpha = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+	return _mm_add_epi8(nibbles,
+			    _mm_add_epi8(_mm_set1_epi8('0'),
+					 _mm_and_si128(alpha, _mm_set1_epi8('a' - '0' - 10))));
+}
+#endif
+
+int hex_to_bytes_full(unsigned char *binary, const char *hex, size_t len)
+{
+#if defined(__AVX2__)
+	for (; len >= 32; len -= 32, hex += 64, binary += 32) {
+		__m256i c = _mm256_loadu_si256((const __m256i *)hex);
+		__m256i d = _mm256_loadu_si256((const __m256i *)(hex + 32));
+		__m256i lc = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+		__m256i ld = _mm256_or_si256(d, _mm256_set1_epi8(0x20));
+		__m256i digit_c = _mm256_andnot_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('9')),
+						      _mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)));
+		__m256i digit_d = _mm256_andnot_si256(_mm256_cmpgt_epi8(d, _mm256_set1_epi8('9')),
+						      _mm256_cmpgt_epi8(d, _mm256_set1_epi8('0' - 1)));
+		__m256i alpha_c = _mm256_andnot_si256(_mm256_cmpgt_epi8(lc, _mm256_set1_epi8('f')),
+						      _mm256_cmpgt_epi8(lc, _mm256_set1_epi8('a' - 1)));
+		__m256i alpha_d = _mm256_andnot_si256(_mm256_cmpgt_epi8(ld, _mm256_set1_epi8('f')),
+						      _mm256_cmpgt_epi8(ld, _mm256_set1_epi8('a' - 1)));
+		__m256i valid = _mm256_and_si256(_mm256_or_si256(digit_c, alpha_c),
+						 _mm256_or_si256(digit_d, alpha_d));
+		__m256i nc, nd, out;
+
+		if ((unsigned int)_mm256_movemask_epi8(valid) != 0xffffffff)
+			return -1;
+
+		nc = _mm256_or_si256(
+			_mm256_and_si256(digit_c, _mm256_sub_epi8(c, _mm256_set1_epi8('0'))),
+			_mm256_and_si256(alpha_c, _mm256_sub_epi8(lc, _mm256_set1_epi8('a' - 10))));
+		nd = _mm256_or_si256(
+			_mm256_and_si256(digit_d, _mm256_sub_epi8(d, _mm256_set1_epi8('0'))),
+			_mm256_and_si256(alpha_d, _mm256_sub_epi8(ld, _mm256_set1_epi8('a' - 10))));
+		nc = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nc, _mm256_set1_epi16(0x00ff)), 4),
+				     _mm256_srli_epi16(nc, 8));
+		nd = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nd, _mm256_set1_epi16(0x00ff)), 4),
+				     _mm256_srli_epi16(nd, 8));
+
+		/* packus works per 128-bit lane; put the quadwords back in order */
+		out = _mm256_permute4x64_epi64(_mm256_packus_epi16(nc, nd), 0xd8);
+		_mm256_storeu_si256((__m256i *)binary, out);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; len >= 16; len -= 16, hex += 32, binary += 16) {
+		__m128i a, b;
+
+		if (hex_nibbles_sse2(&a, hex) | hex_nibbles_sse2(&b, hex + 16))
+			return -1;
+		_mm_storeu_si128((__m128i *)binary,
+				 _mm_packus_epi16(hex_pairs_sse2(a), hex_pairs_sse2(b)));
+	}
+#endif
+	return hex_to_bytes(binary, hex, len);
+}
+
+void bytes_to_hex(char *hex, const unsigned char *binary, size_t len)
+{
+	static const char digits[] = "0123456789abcdef";
+
+#if defined(__AVX2__)
+	for (; len >= 32; len -= 32, hex += 64, binary += 32) {
+		__m256i in = _mm256_loadu_si256((const __m256i *)binary);
+		__m256i mask = _mm256_set1_epi8(0x0f);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(in, 4), mask);
+		__m256i lo = _mm256_and_si256(in, mask);
+		__m256i adjust = _mm256_set1_epi8('a' - '0' - 10);
+		__m256i nine = _mm256_set1_epi8(9);
+		__m256i zero = _mm256_set1_epi8('0');
+		__m256i a, b;
+
+		hi = _mm256_add_epi8(hi, _mm256_add_epi8(zero,
+			_mm256_and_si256(_mm256_cmpgt_epi8(hi, nine), adjust)));
+		lo = _mm256_add_epi8(lo, _mm256_add_epi8(zero,
+			_mm256_and_si256(_mm256_cmpgt_epi8(lo, nine), adjust)));
+
+		/* unpack works per 128-bit lane; recombine the halves in order */
+		a = _mm256_unpacklo_epi8(hi, lo);
+		b = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i *)hex, _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *)(hex + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+#endif
+#if defined(__SSE2__)
+	for (; len >= 16; len -= 16, hex += 32, binary += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *)binary);
+		__m128i mask = _mm_set1_epi8(0x0f);
+		__m128i hi = hex_digits_sse2(_mm_and_si128(_mm_srli_epi16(in, 4), mask));
+		__m128i lo = hex_digits_sse2(_mm_and_si128(in, mask));
+
+		_mm_storeu_si128((__m128i *)hex, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(hex + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+#endif
+	for (; len; len--) {
+		unsigned int val = *binary++;
+		*hex++ = digits[val >> 4];
+		*hex++ = digits[val & 0xf];
+	}
+}
@@ -24,4 +24,18 @@ static inline int hex2chr(const char *s)
  */
 int hex_to_bytes(unsigned char *binary, const char *hex, size_t len);
 
+/*
+ * Like hex_to_bytes(), but all `2 * len` characters of `hex` must be
+ * readable, as they may be inspected before an invalid digit (including
+ * a NUL) is noticed. This allows decoding many digits at once with SIMD
+ * instructions where they are available.
+ */
+int hex_to_bytes_full(unsigned char *binary, const char *hex, size_t len);
+
+/*
+ * Write the `len` bytes from `binary` as `2 * len` lowercase hexadecimal
+ * digits to `hex`. The output is not NUL-terminated.
+ */
+void bytes_to_hex(char *hex, const unsigned char *binary, size_t len);
+
 #endif
@@ -77,12 +77,29 @@ int parse_oid_hex(const char *hex, struct object_id *oid, const char **end)
 	return parse_oid_hex_algop(hex, oid, end, the_hash_algo);
 }
 
-char *hash_to_hex_algop_r(char *buffer, const unsigned char *hash,
+size_t get_oids_hex_algop(const char *hex, size_t stride,
+			  struct object_id *oids, size_t nr,
 			  const struct git_hash_algo *algop)
 {
-	static const char hex[] = "0123456789abcdef";
-	char *buf = buffer;
+	if (!stride)
+		stride = algop->hexsz;
+
+	for (size_t i = 0; i < nr; i++, hex += stride) {
+		struct object_id *oid = &oids[i];
+
+		if (hex_to_bytes_full(oid->hash, hex, algop->rawsz))
+			return i;
+		oid_set_algo(oid, algop);
+		if (algop->rawsz != GIT_MAX_RAWSZ)
+			memset(oid->hash + algop->rawsz, 0,
+			       GIT_MAX_RAWSZ - algop->rawsz);
+	}
+	return nr;
+}
 
+char *hash_to_hex_algop_r(char *buffer, const unsigned char *hash,
+			  const struct git_hash_algo *algop)
+{
 	/*
 	 * Our struct object_id has been memset to 0, so default to printing
 	 * using the default hash.
@@ -90,12 +107,8 @@ char *hash_to_hex_algop_r(char *buffer, const unsigned char *hash,
 	if (algop == &hash_algos[0])
 		algop = the_hash_algo;
 
-	for (size_t i = 0; i < algop->rawsz; i++) {
-		unsigned int val = *hash++;
-		*buf++ = hex[val >> 4];
-		*buf++ = hex[val & 0xf];
-	}
-	*buf = '\0';
+	bytes_to_hex(buffer, hash, algop->rawsz);
+	buffer[algop->hexsz] = '\0';
 
 	return buffer;
 }
@@ -105,6 +118,19 @@ char *oid_to_hex_r(char *buffer, const struct object_id *oid)
 	return hash_to_hex_algop_r(buffer, oid->hash, &hash_algos[oid->algo]);
 }
 
+void oids_to_hex(char *hex, size_t stride,
+		 const struct object_id *oids, size_t nr)
+{
+	for (size_t i = 0; i < nr; i++) {
+		const struct git_hash_algo *algop = &hash_algos[oids[i].algo];
+
+		if (algop == &hash_algos[0])
+			algop = the_hash_algo;
+		bytes_to_hex(hex, oids[i].hash, algop->rawsz);
+		hex += stride ? stride : algop->hexsz;
+	}
+}
+
 char *hash_to_hex_algop(const unsigned char *hash, const struct git_hash_algo *algop)
 {
 	static int bufno;
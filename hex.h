@@ -52,6 +52,27 @@ int parse_oid_hex_algop(const char *hex, struct object_id *oid, const char **end
 int get_oid_hex_any(const char *hex, struct object_id *oid);
 int parse_oid_hex_any(const char *hex, struct object_id *oid, const char **end);
 
+/*
+ * Batch conversion between object IDs and hex, for callers that have
+ * many of them at hand. The hex form of the `i`-th object ID starts at
+ * `hex + i * stride`; `stride` must be at least `algop->hexsz` and any
+ * bytes in between are neither read nor written. A `stride` of 0 is
+ * taken to mean `algop->hexsz`.
+ *
+ * Unlike get_oid_hex_algop(), get_oids_hex_algop() does not stop at a
+ * NUL: all `hexsz` characters of every entry must be readable. It
+ * returns the number of object IDs parsed before the first one that is
+ * not valid hex, i.e. `nr` on success.
+ *
+ * oids_to_hex() writes `hexsz` characters per object ID, using the
+ * algorithm of each object ID, and no NUL terminator.
+ */
+size_t get_oids_hex_algop(const char *hex, size_t stride,
+			  struct object_id *oids, size_t nr,
+			  const struct git_hash_algo *algop);
+void oids_to_hex(char *hex, size_t stride,
+		 const struct object_id *oids, size_t nr);
+
 #ifdef USE_THE_REPOSITORY_VARIABLE
 
 /* Like get_oid_hex_algop, but for `the_hash_algo`. */
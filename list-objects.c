@@ -17,6 +17,9 @@
 #include "odb.h"
 #include "trace.h"
 #include "environment.h"
+#include "repository.h"
+#include "thread-utils.h"
+#include "tree-prefetch.h"
 
 struct traversal_context {
 	struct rev_info *revs;
@@ -24,6 +27,7 @@ struct traversal_context {
 	show_commit_fn show_commit;
 	void *show_data;
 	struct filter *filter;
+	struct tree_prefetch *prefetch;
 	int depth;
 };
 
@@ -32,7 +36,9 @@ static void show_commit(struct traversal_context *ctx,
 {
 	if (!ctx->show_commit)
 		return;
+	obj_read_lock();
 	ctx->show_commit(commit, ctx->show_data);
+	obj_read_unlock();
 }
 
 static void show_object(struct traversal_context *ctx,
@@ -41,11 +47,12 @@ static void show_object(struct traversal_context *ctx,
 {
 	if (!ctx->show_object)
 		return;
-	if (ctx->revs->unpacked && has_object_pack(ctx->revs->repo,
-						   &object->oid))
-		return;
 
-	ctx->show_object(object, name, ctx->show_data);
+	obj_read_lock();
+	if (!ctx->revs->unpacked ||
+	    !has_object_pack(ctx->revs->repo, &object->oid))
+		ctx->show_object(object, name, ctx->show_data);
+	obj_read_unlock();
 }
 
 static void process_blob(struct traversal_context *ctx,
@@ -73,11 +80,17 @@ static void process_blob(struct traversal_context *ctx,
 	 * may cause the actual filter to report an incomplete list
 	 * of missing objects.
 	 */
-	if (ctx->revs->exclude_promisor_objects &&
-	    !odb_has_object(the_repository->objects, &obj->oid,
-			    HAS_OBJECT_RECHECK_PACKED | HAS_OBJECT_FETCH_PROMISOR) &&
-	    is_promisor_object(ctx->revs->repo, &obj->oid))
-		return;
+	if (ctx->revs->exclude_promisor_objects) {
+		int skip;
+
+		obj_read_lock();
+		skip = !odb_has_object(the_repository->objects, &obj->oid,
+				       HAS_OBJECT_RECHECK_PACKED | HAS_OBJECT_FETCH_PROMISOR) &&
+		       is_promisor_object(ctx->revs->repo, &obj->oid);
+		obj_read_unlock();
+		if (skip)
+			return;
+	}
 
 	pathlen = path->len;
 	strbuf_addstr(path, name);
@@ -170,7 +183,21 @@ static void process_tree(struct traversal_context *ctx,
 	if (ctx->depth > max_allowed_tree_depth)
 		die("exceeded maximum allowed tree depth");
 
+	if (ctx->prefetch) {
+		unsigned long size;
+		void *buf = tree_prefetch_take(ctx->prefetch, &obj->oid, &size);
+
+		if (!buf)
+			;
+		else if (obj->parsed)
+			free(buf);
+		else
+			parse_tree_buffer(tree, buf, size);
+	}
+
+	obj_read_lock();
 	failed_parse = parse_tree_gently(tree, 1);
+	obj_read_unlock();
 	if (failed_parse) {
 		if (revs->ignore_missing_links)
 			return;
@@ -180,9 +207,15 @@ static void process_tree(struct traversal_context *ctx,
 		 * requested.  This may cause the actual filter to report
 		 * an incomplete list of missing objects.
 		 */
-		if (revs->exclude_promisor_objects &&
-		    is_promisor_object(revs->repo, &obj->oid))
-			return;
+		if (revs->exclude_promisor_objects) {
+			int skip;
+
+			obj_read_lock();
+			skip = is_promisor_object(revs->repo, &obj->oid);
+			obj_read_unlock();
+			if (skip)
+				return;
+		}
 
 		if (!revs->do_not_die_on_missing_objects)
 			die("bad tree object %s", oid_to_hex(&obj->oid));
@@ -380,8 +413,19 @@ static void do_traverse(struct traversal_context *ctx)
 	struct strbuf csp; /* callee's scratch pad */
 	strbuf_init(&csp, PATH_MAX);
 
-	while ((commit = get_revision(ctx->revs)) != NULL) {
+	while (1) {
 		enum list_objects_filter_result r;
+		struct tree *tree = NULL;
+
+		obj_read_lock();
+		commit = get_revision(ctx->revs);
+		if (commit && ctx->revs->tree_objects &&
+		    !(ctx->revs->do_not_die_on_missing_objects &&
+		      oidset_contains(&ctx->revs->missing_commits, &commit->object.oid)))
+			tree = repo_get_commit_tree(the_repository, commit);
+		obj_read_unlock();
+		if (!commit)
+			break;
 
 		r = list_objects_filter__filter_object(ctx->revs->repo,
 				LOFS_COMMIT, &commit->object,
@@ -396,10 +440,11 @@ static void do_traverse(struct traversal_context *ctx)
 		else if (ctx->revs->do_not_die_on_missing_objects &&
 			 oidset_contains(&ctx->revs->missing_commits, &commit->object.oid))
 			;
-		else if (repo_get_commit_tree(the_repository, commit)) {
-			struct tree *tree = repo_get_commit_tree(the_repository,
-								 commit);
+		else if (tree) {
 			tree->object.flags |= NOT_USER_GIVEN;
+			if (ctx->prefetch &&
+			    !(tree->object.flags & (UNINTERESTING | SEEN)))
+				tree_prefetch_add(ctx->prefetch, &tree->object.oid);
 			add_pending_tree(ctx->revs, tree);
 		} else if (commit->object.parsed) {
 			die(_("unable to load root tree for commit %s"),
@@ -423,6 +468,37 @@ static void do_traverse(struct traversal_context *ctx)
 	strbuf_release(&csp);
 }
 
+/*
+ * Reading trees ahead of the walk only pays off when the walk is going
+ * to look at (nearly) all of them, as when listing everything that is
+ * reachable for a clone.
+ */
+static int want_tree_prefetch(struct rev_info *revs)
+{
+	if (!HAVE_THREADS || !revs->tree_objects)
+		return 0;
+	if (revs->diffopt.pathspec.nr)
+		return 0;
+
+	switch (revs->filter.choice) {
+	case LOFC_DISABLED:
+	case LOFC_BLOB_NONE:
+	case LOFC_BLOB_LIMIT:
+	case LOFC_OBJECT_TYPE:
+		break;
+	default:
+		return 0;
+	}
+
+	/* Trees of excluded commits are never read by the walk. */
+	for (size_t i = 0; i < revs->cmdline.nr; i++)
+		if (revs->cmdline.rev[i].flags & UNINTERESTING)
+			return 0;
+
+	prepare_repo_settings(revs->repo);
+	return revs->repo->settings.object_walk_threads > 1;
+}
+
 void traverse_commit_list_filtered(
 	struct rev_info *revs,
 	show_commit_fn show_commit,
@@ -440,8 +516,13 @@ void traverse_commit_list_filtered(
 	if (revs->filter.choice)
 		ctx.filter = list_objects_filter__init(omitted, &revs->filter);
 
+	if (want_tree_prefetch(revs))
+		ctx.prefetch = tree_prefetch_start(revs->repo,
+						   revs->repo->settings.object_walk_threads);
+
 	do_traverse(&ctx);
 
+	tree_prefetch_finish(ctx.prefetch);
 	if (ctx.filter)
 		list_objects_filter__free(ctx.filter);
 }
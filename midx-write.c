@@ -14,6 +14,7 @@
 #include "pack-bitmap.h"
 #include "refs.h"
 #include "revision.h"
+#include "tag.h"
 #include "list-objects.h"
 #include "path.h"
 #include "pack-revindex.h"
@@ -784,6 +785,67 @@ static int read_refs_snapshot(const char *refs_snapshot,
 	return 0;
 }
 
+/*
+ * When writing an incremental layer, only commits in that layer can be
+ * selected for a bitmap, so there is no point in walking the history
+ * covered by the layers below it. Walk down from the tips, stopping at
+ * any commit that is already in the base MIDX, so that the cost of the
+ * walk is proportional to the size of the new layer rather than to the
+ * size of the whole history.
+ *
+ * Commits in this layer whose history crosses into the base are still
+ * bitmapped correctly, since fill_bitmap_commit() walks through the
+ * base when filling in their bitmaps; this only limits the candidates
+ * for selection.
+ *
+ * Like the revision walk, skip promisor objects when asked to, and do
+ * not walk past them.
+ */
+static void find_commits_above_base_midx(struct rev_info *revs,
+					 struct bitmap_commit_cb *cb)
+{
+	struct commit_list *stack = NULL;
+	struct multi_pack_index *base = cb->ctx->base_midx;
+
+	for (unsigned int i = 0; i < revs->pending.nr; i++) {
+		struct object *object = revs->pending.objects[i].item;
+		struct commit *commit;
+
+		object = deref_tag(revs->repo, object, NULL, 0);
+		if (!object || object->type != OBJ_COMMIT)
+			continue;
+		commit = (struct commit *)object;
+		if (commit->object.flags & SEEN)
+			continue;
+		commit->object.flags |= SEEN;
+		commit_list_insert(commit, &stack);
+	}
+
+	while (stack) {
+		struct commit *commit = pop_commit(&stack);
+		struct commit_list *parents;
+
+		if (midx_has_oid(base, &commit->object.oid))
+			continue;
+		if (revs->exclude_promisor_objects &&
+		    is_promisor_object(revs->repo, &commit->object.oid))
+			continue;
+		if (repo_parse_commit_gently(revs->repo, commit, 1) < 0)
+			continue;
+
+		bitmap_show_commit(commit, cb);
+
+		for (parents = commit->parents; parents; parents = parents->next) {
+			struct commit *parent = parents->item;
+
+			if (parent->object.flags & SEEN)
+				continue;
+			parent->object.flags |= SEEN;
+			commit_list_insert(parent, &stack);
+		}
+	}
+}
+
 static struct commit **find_commits_for_midx_bitmap(uint32_t *indexed_commits_nr_p,
 						    const char *refs_snapshot,
 						    struct write_midx_context *ctx)
@@ -819,10 +881,14 @@ static struct commit **find_commits_for_midx_bitmap(uint32_t *indexed_commits_nr
 	fetch_if_missing = 0;
 	revs.exclude_promisor_objects = 1;
 
-	if (prepare_revision_walk(&revs))
-		die(_("revision walk setup failed"));
+	if (ctx->incremental && ctx->base_midx) {
+		find_commits_above_base_midx(&revs, &cb);
+	} else {
+		if (prepare_revision_walk(&revs))
+			die(_("revision walk setup failed"));
 
-	traverse_commit_list(&revs, bitmap_show_commit, NULL, &cb);
+		traverse_commit_list(&revs, bitmap_show_commit, NULL, &cb);
+	}
 	if (indexed_commits_nr_p)
 		*indexed_commits_nr_p = cb.commits_nr;
 
@@ -861,6 +927,9 @@ static int write_midx_bitmap(struct write_midx_context *ctx,
 	if (flags & MIDX_WRITE_BITMAP_LOOKUP_TABLE)
 		options |= BITMAP_OPT_LOOKUP_TABLE;
 
+	if (flags & MIDX_WRITE_BITMAP_ROARING)
+		options |= BITMAP_OPT_ROARING;
+
 	/*
 	 * Build the MIDX-order index based on pdata.objects (which is already
 	 * in MIDX order; c.f., 'midx_pack_order_cmp()' for the definition of
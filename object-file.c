@@ -21,13 +21,16 @@
 #include "object-file.h"
 #include "odb.h"
 #include "odb/streaming.h"
+#include "oidset.h"
 #include "oidtree.h"
 #include "pack.h"
 #include "packfile.h"
 #include "path.h"
 #include "read-cache-ll.h"
+#include "repository.h"
 #include "setup.h"
 #include "tempfile.h"
+#include "thread-utils.h"
 #include "tmp-objdir.h"
 
 /* The maximum size for an object header. */
@@ -683,11 +686,14 @@ struct transaction_packfile {
 	uint32_t nr_written;
 };
 
+struct loose_write_pool;
+
 struct odb_transaction {
 	struct object_database *odb;
 
 	struct tmp_objdir *objdir;
 	struct transaction_packfile packfile;
+	struct loose_write_pool *writers;
 };
 
 static void prepare_loose_object_transaction(struct odb_transaction *transaction)
@@ -931,25 +937,27 @@ static int end_loose_object_common(struct odb_source *source,
 	return Z_OK;
 }
 
-static int write_loose_object(struct odb_source *source,
-			      const struct object_id *oid, char *hdr,
-			      int hdrlen, const void *buf, unsigned long len,
-			      time_t mtime, unsigned flags)
+/*
+ * Write the loose object file. This may run in one of the threads of a
+ * loose_write_pool, so it must not touch any state other than the
+ * object file itself; in particular, preparing the transaction is up
+ * to the caller.
+ */
+static int write_loose_object_file(struct odb_source *source,
+				   const struct object_id *oid, char *hdr,
+				   int hdrlen, const void *buf, unsigned long len,
+				   time_t mtime, unsigned flags,
+				   struct strbuf *tmp_file, struct strbuf *filename)
 {
 	int fd, ret;
 	unsigned char compressed[4096];
 	git_zstream stream;
 	struct git_hash_ctx c;
 	struct object_id parano_oid;
-	static struct strbuf tmp_file = STRBUF_INIT;
-	static struct strbuf filename = STRBUF_INIT;
 
-	if (batch_fsync_enabled(FSYNC_COMPONENT_LOOSE_OBJECT))
-		prepare_loose_object_transaction(source->odb->transaction);
+	odb_loose_path(source, filename, oid);
 
-	odb_loose_path(source, &filename, oid);
-
-	fd = start_loose_object_common(source, &tmp_file, filename.buf, flags,
+	fd = start_loose_object_common(source, tmp_file, filename->buf, flags,
 				       &stream, compressed, sizeof(compressed),
 				       &c, NULL, hdr, hdrlen);
 	if (fd < 0)
@@ -976,21 +984,281 @@ static int write_loose_object(struct odb_source *source,
 		die(_("confused by unstable object source data for %s"),
 		    oid_to_hex(oid));
 
-	close_loose_object(source, fd, tmp_file.buf);
+	close_loose_object(source, fd, tmp_file->buf);
 
 	if (mtime) {
 		struct utimbuf utb;
 		utb.actime = mtime;
 		utb.modtime = mtime;
-		if (utime(tmp_file.buf, &utb) < 0 &&
+		if (utime(tmp_file->buf, &utb) < 0 &&
 		    !(flags & WRITE_OBJECT_SILENT))
-			warning_errno(_("failed utime() on %s"), tmp_file.buf);
+			warning_errno(_("failed utime() on %s"), tmp_file->buf);
 	}
 
-	return finalize_object_file_flags(source->odb->repo, tmp_file.buf, filename.buf,
+	return finalize_object_file_flags(source->odb->repo, tmp_file->buf, filename->buf,
 					  FOF_SKIP_COLLISION_CHECK);
 }
 
+static int write_loose_object(struct odb_source *source,
+			      const struct object_id *oid, char *hdr,
+			      int hdrlen, const void *buf, unsigned long len,
+			      time_t mtime, unsigned flags)
+{
+	static struct strbuf tmp_file = STRBUF_INIT;
+	static struct strbuf filename = STRBUF_INIT;
+
+	if (batch_fsync_enabled(FSYNC_COMPONENT_LOOSE_OBJECT))
+		prepare_loose_object_transaction(source->odb->transaction);
+
+	return write_loose_object_file(source, oid, hdr, hdrlen, buf, len,
+				       mtime, flags, &tmp_file, &filename);
+}
+
+/*
+ * Within a transaction, loose objects can be compressed and written by
+ * a pool of threads. The object ID is still computed by the caller, so
+ * that it can be returned right away, but the caller then only has to
+ * copy the object data before moving on to the next object.
+ *
+ * Objects that are still queued are not visible on disk; readers that
+ * fail to find an object ask the pool to finish writing via
+ * object_file_transaction_wait_for_object().
+ */
+struct loose_write_job {
+	struct loose_write_job *next;
+	struct odb_source *source;
+	struct object_id oid;
+	char hdr[MAX_HEADER_LEN];
+	int hdrlen;
+	void *buf;
+	unsigned long len;
+	unsigned flags;
+};
+
+/* Limit on the amount of object data queued but not yet written. */
+#define LOOSE_WRITE_POOL_MAX_QUEUED (64 * 1024 * 1024)
+
+struct loose_write_pool {
+	pthread_t *threads;
+	int nr_threads;
+
+	pthread_mutex_t mutex;
+	/* Signalled when a job is queued or the pool shuts down. */
+	pthread_cond_t work;
+	/* Signalled when a job has been written. */
+	pthread_cond_t done;
+
+	struct loose_write_job *head, **tail;
+	unsigned int in_flight;
+	size_t in_flight_bytes;
+	int errors;
+	int shutdown;
+
+	/* Objects that were queued since the pool last ran dry. */
+	struct oidset pending;
+};
+
+static void *loose_write_thread(void *data)
+{
+	struct loose_write_pool *pool = data;
+	struct strbuf tmp_file = STRBUF_INIT;
+	struct strbuf filename = STRBUF_INIT;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (1) {
+		struct loose_write_job *job;
+		int ret;
+
+		while (!pool->head && !pool->shutdown)
+			pthread_cond_wait(&pool->work, &pool->mutex);
+		if (!pool->head)
+			break;
+
+		job = pool->head;
+		pool->head = job->next;
+		if (!pool->head)
+			pool->tail = &pool->head;
+		pthread_mutex_unlock(&pool->mutex);
+
+		ret = write_loose_object_file(job->source, &job->oid,
+					      job->hdr, job->hdrlen,
+					      job->buf, job->len, 0, job->flags,
+					      &tmp_file, &filename);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (ret)
+			pool->errors++;
+		pool->in_flight--;
+		pool->in_flight_bytes -= job->len;
+		pthread_cond_broadcast(&pool->done);
+
+		free(job->buf);
+		free(job);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	strbuf_release(&tmp_file);
+	strbuf_release(&filename);
+	return NULL;
+}
+
+static struct loose_write_pool *loose_write_pool_start(struct repository *r,
+							int nr_threads)
+{
+	struct loose_write_pool *pool;
+
+	CALLOC_ARRAY(pool, 1);
+	pool->tail = &pool->head;
+	oidset_init(&pool->pending, 0);
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	/*
+	 * The workers call adjust_shared_perm() when they create object
+	 * directories; make sure that it does not have to read the config.
+	 */
+	repo_settings_get_shared_repository(r);
+
+	ALLOC_ARRAY(pool->threads, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL,
+				   loose_write_thread, pool))
+			break;
+		pool->nr_threads++;
+	}
+	if (!pool->nr_threads)
+		warning(_("unable to start threads for writing loose objects"));
+
+	return pool;
+}
+
+static void loose_write_pool_queue(struct loose_write_pool *pool,
+				   struct odb_source *source,
+				   const struct object_id *oid,
+				   const char *hdr, int hdrlen,
+				   const void *buf, unsigned long len,
+				   unsigned flags)
+{
+	struct loose_write_job *job;
+
+	CALLOC_ARRAY(job, 1);
+	job->source = source;
+	oidcpy(&job->oid, oid);
+	memcpy(job->hdr, hdr, hdrlen);
+	job->hdrlen = hdrlen;
+	job->buf = xmemdupz(buf, len);
+	job->len = len;
+	job->flags = flags;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->in_flight &&
+	       pool->in_flight_bytes + len > LOOSE_WRITE_POOL_MAX_QUEUED)
+		pthread_cond_wait(&pool->done, &pool->mutex);
+
+	oidset_insert(&pool->pending, oid);
+	*pool->tail = job;
+	pool->tail = &job->next;
+	pool->in_flight++;
+	pool->in_flight_bytes += len;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static int loose_write_pool_has_pending(struct loose_write_pool *pool,
+					const struct object_id *oid)
+{
+	int ret;
+
+	pthread_mutex_lock(&pool->mutex);
+	ret = oidset_contains(&pool->pending, oid);
+	pthread_mutex_unlock(&pool->mutex);
+
+	return ret;
+}
+
+/* Wait until all queued objects have been written. */
+static void loose_write_pool_wait(struct loose_write_pool *pool)
+{
+	int errors;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->in_flight)
+		pthread_cond_wait(&pool->done, &pool->mutex);
+	errors = pool->errors;
+	pool->errors = 0;
+	oidset_clear(&pool->pending);
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (errors)
+		die(Q_("unable to write %d loose object",
+		       "unable to write %d loose objects", errors), errors);
+}
+
+static void loose_write_pool_finish(struct loose_write_pool *pool)
+{
+	loose_write_pool_wait(pool);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (int i = 0; i < pool->nr_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	oidset_clear(&pool->pending);
+	free(pool->threads);
+	free(pool);
+}
+
+/*
+ * Return the pool that should write the given object, or NULL if it
+ * is to be written right away.
+ */
+static struct loose_write_pool *loose_write_pool_for(struct odb_source *source,
+						     unsigned flags)
+{
+	struct odb_transaction *transaction = source->odb->transaction;
+	struct repository *r = source->odb->repo;
+
+	/*
+	 * Errors are only reported when the pool is drained, so callers
+	 * that want to handle them quietly have to write synchronously.
+	 * The same goes for repositories that need a compatibility
+	 * mapping for each object.
+	 */
+	if (!HAVE_THREADS || !transaction || (flags & WRITE_OBJECT_SILENT) ||
+	    r->compat_hash_algo)
+		return NULL;
+
+	if (!transaction->writers) {
+		prepare_repo_settings(r);
+		if (r->settings.loose_object_write_threads <= 1)
+			return NULL;
+		transaction->writers =
+			loose_write_pool_start(r, r->settings.loose_object_write_threads);
+	}
+	if (!transaction->writers->nr_threads)
+		return NULL;
+
+	return transaction->writers;
+}
+
+int object_file_transaction_wait_for_object(struct odb_transaction *transaction,
+					    const struct object_id *oid)
+{
+	if (!transaction->writers ||
+	    !loose_write_pool_has_pending(transaction->writers, oid))
+		return 0;
+
+	loose_write_pool_wait(transaction->writers);
+	return 1;
+}
+
 int odb_source_loose_freshen_object(struct odb_source *source,
 				    const struct object_id *oid)
 {
@@ -1115,6 +1383,7 @@ int odb_source_loose_write_object(struct odb_source *source,
 	const struct git_hash_algo *algo = source->odb->repo->hash_algo;
 	const struct git_hash_algo *compat = source->odb->repo->compat_hash_algo;
 	struct object_id compat_oid;
+	struct loose_write_pool *pool;
 	char hdr[MAX_HEADER_LEN];
 	int hdrlen = sizeof(hdr);
 
@@ -1138,6 +1407,18 @@ int odb_source_loose_write_object(struct odb_source *source,
 	 * it out into .git/objects/??/?{38} file.
 	 */
 	write_object_file_prepare(algo, buf, len, type, oid, hdr, &hdrlen);
+
+	pool = loose_write_pool_for(source, flags);
+	if (pool) {
+		if (loose_write_pool_has_pending(pool, oid) ||
+		    odb_freshen_object(source->odb, oid))
+			return 0;
+		if (batch_fsync_enabled(FSYNC_COMPONENT_LOOSE_OBJECT))
+			prepare_loose_object_transaction(source->odb->transaction);
+		loose_write_pool_queue(pool, source, oid, hdr, hdrlen, buf, len, flags);
+		return 0;
+	}
+
 	if (odb_freshen_object(source->odb, oid))
 		return 0;
 	if (write_loose_object(source, oid, hdr, hdrlen, buf, len, 0, flags))
@@ -1981,6 +2262,8 @@ void object_file_transaction_commit(struct odb_transaction *transaction)
 	 */
 	ASSERT(transaction == transaction->odb->transaction);
 
+	if (transaction->writers)
+		loose_write_pool_finish(transaction->writers);
 	flush_loose_object_transaction(transaction);
 	flush_packfile_transaction(transaction);
 	transaction->odb->transaction = NULL;
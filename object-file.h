@@ -214,4 +214,12 @@ struct odb_transaction *object_file_transaction_begin(struct odb_source *source)
  */
 void object_file_transaction_commit(struct odb_transaction *transaction);
 
+/*
+ * If the transaction is still writing the given object in the
+ * background, wait for all pending writes to finish and return 1 so
+ * that the caller can look again. Returns 0 otherwise.
+ */
+int object_file_transaction_wait_for_object(struct odb_transaction *transaction,
+					    const struct object_id *oid);
+
 #endif /* OBJECT_FILE_H */
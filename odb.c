@@ -26,6 +26,7 @@
 #include "submodule.h"
 #include "tmp-objdir.h"
 #include "trace2.h"
+#include "tree-cache.h"
 #include "write-or-die.h"
 
 KHASH_INIT(odb_path_map, const char * /* key: odb_path */,
@@ -708,6 +709,41 @@ static int do_oid_object_info_extended(struct object_database *odb,
 		return 0;
 	}
 
+	/*
+	 * The tree cache only knows about contents, so it can only answer
+	 * requests that do not ask about how the object is stored. It may
+	 * also still hold trees that have since been pruned, so we only
+	 * take the contents from it after looking up the object where it
+	 * is stored, which is cheap when we do not have to inflate it.
+	 */
+	if (oi->contentp && !oi->disk_sizep && !oi->delta_base_oid) {
+		struct tree_cache *tc = prepare_tree_cache(odb->repo);
+		unsigned long size;
+		void *content;
+
+		if (tc && (content = tree_cache_read(tc, real, &size))) {
+			struct object_info stored_oi = *oi;
+			enum object_type type;
+
+			stored_oi.contentp = NULL;
+			if (!stored_oi.typep)
+				stored_oi.typep = &type;
+
+			if (do_oid_object_info_extended(odb, real, &stored_oi,
+							flags & ~OBJECT_INFO_LOOKUP_REPLACE)) {
+				free(content);
+				return -1;
+			}
+			if (*stored_oi.typep == OBJ_TREE) {
+				oi->whence = stored_oi.whence;
+				oi->u = stored_oi.u;
+				*oi->contentp = content;
+				return 0;
+			}
+			free(content);
+		}
+	}
+
 	odb_prepare_alternates(odb);
 
 	while (1) {
@@ -721,6 +757,11 @@ static int do_oid_object_info_extended(struct object_database *odb,
 			if (!odb_source_loose_read_object_info(source, real, oi, flags))
 				return 0;
 
+		/* We may still be writing it out in the background. */
+		if (odb->transaction &&
+		    object_file_transaction_wait_for_object(odb->transaction, real))
+			continue;
+
 		/* Not a loose object; someone else may have just packed it. */
 		if (!(flags & OBJECT_INFO_QUICK)) {
 			odb_reprepare(odb->repo->objects);
@@ -1095,6 +1136,7 @@ void odb_close(struct object_database *o)
 	}
 
 	close_commit_graph(o);
+	close_tree_cache(o);
 }
 
 static void odb_free_sources(struct object_database *o)
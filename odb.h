@@ -128,6 +128,9 @@ struct object_database {
 	struct commit_graph *commit_graph;
 	unsigned commit_graph_attempted : 1; /* if loading has been attempted */
 
+	struct tree_cache *tree_cache;
+	unsigned tree_cache_attempted : 1; /* if loading has been attempted */
+
 	/* Should only be accessed directly by packfile.c and midx.c. */
 	struct packfile_store *packfiles;
 
@@ -181,11 +181,13 @@ static int open_istream_incore(struct odb_read_stream **out,
 
 static int istream_source(struct odb_read_stream **out,
 			  struct object_database *odb,
-			  const struct object_id *oid)
+			  const struct object_id *oid,
+			  unsigned flags)
 {
 	struct odb_source *source;
 
-	if (!packfile_store_read_object_stream(out, odb->packfiles, oid))
+	if (!packfile_store_read_object_stream(out, odb->packfiles, oid,
+					       flags & ODB_READ_STREAM_PACKED_ANY_SIZE))
 		return 0;
 
 	odb_prepare_alternates(odb);
@@ -215,10 +217,18 @@ ssize_t odb_read_stream_read(struct odb_read_stream *st, void *buf, size_t sz)
 struct odb_read_stream *odb_read_stream_open(struct object_database *odb,
 					     const struct object_id *oid,
 					     struct stream_filter *filter)
+{
+	return odb_read_stream_open_flags(odb, oid, filter, 0);
+}
+
+struct odb_read_stream *odb_read_stream_open_flags(struct object_database *odb,
+						   const struct object_id *oid,
+						   struct stream_filter *filter,
+						   unsigned flags)
 {
 	struct odb_read_stream *st;
 	const struct object_id *real = lookup_replace_object(odb->repo, oid);
-	int ret = istream_source(&st, odb, real);
+	int ret = istream_source(&st, odb, real, flags);
 
 	if (ret)
 		return NULL;
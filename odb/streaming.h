@@ -34,6 +34,26 @@ struct odb_read_stream *odb_read_stream_open(struct object_database *odb,
 					     const struct object_id *oid,
 					     struct stream_filter *filter);
 
+enum odb_read_stream_flags {
+	/*
+	 * Objects stored undeltified in a packfile are normally only
+	 * streamed when they are larger than core.bigFileThreshold, and are
+	 * read into memory as a whole otherwise. Stream them regardless of
+	 * their size; this saves a copy of the object for callers that
+	 * consume the whole stream in one go anyway.
+	 */
+	ODB_READ_STREAM_PACKED_ANY_SIZE = (1 << 0),
+};
+
+/*
+ * Like odb_read_stream_open(), but takes a combination of
+ * `enum odb_read_stream_flags`.
+ */
+struct odb_read_stream *odb_read_stream_open_flags(struct object_database *odb,
+						   const struct object_id *oid,
+						   struct stream_filter *filter,
+						   unsigned flags);
+
 /*
  * Close the given read stream and release all resources associated with it.
  * Returns 0 on success, a negative error code otherwise.
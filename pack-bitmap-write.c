@@ -27,6 +27,9 @@
 #include "strmap.h"
 #include "midx.h"
 #include "pack-revindex.h"
+#include "replace-object.h"
+#include "repo-settings.h"
+#include "thread-utils.h"
 
 struct bitmapped_commit {
 	struct commit *commit;
@@ -302,6 +305,7 @@ struct bb_commit {
 		 maximal:1,
 		 pseudo_merge:1;
 	unsigned idx; /* within selected array */
+	unsigned pending; /* commits whose bitmaps are yet to be added */
 };
 
 static void clear_bb_commit(struct bb_commit *commit)
@@ -460,10 +464,13 @@ static void bitmap_builder_clear(struct bitmap_builder *bb)
 
 static int fill_bitmap_tree(struct bitmap_writer *writer,
 			    struct bitmap *bitmap,
-			    struct tree *tree)
+			    const struct object_id *oid)
 {
-	int found;
+	int found, ret = 0;
 	uint32_t pos;
+	enum object_type type;
+	unsigned long size;
+	void *buffer;
 	struct tree_desc desc;
 	struct name_entry entry;
 
@@ -471,29 +478,36 @@ static int fill_bitmap_tree(struct bitmap_writer *writer,
 	 * If our bit is already set, then there is nothing to do. Both this
 	 * tree and all of its children will be set.
 	 */
-	pos = find_object_pos(writer, &tree->object.oid, &found);
+	pos = find_object_pos(writer, oid, &found);
 	if (!found)
 		return -1;
 	if (bitmap_get(bitmap, pos))
 		return 0;
 	bitmap_set(bitmap, pos);
 
-	if (parse_tree(tree) < 0)
-		die("unable to load tree object %s",
-		    oid_to_hex(&tree->object.oid));
-	init_tree_desc(&desc, &tree->object.oid, tree->buffer, tree->size);
+	/*
+	 * Read the tree without going through the parsed object table,
+	 * which cannot be used by the threads of build_bitmaps_threaded().
+	 */
+	buffer = odb_read_object(writer->repo->objects, oid, &type, &size);
+	if (!buffer || type != OBJ_TREE)
+		die("unable to load tree object %s", oid_to_hex(oid));
+	init_tree_desc(&desc, oid, buffer, size);
 
 	while (tree_entry(&desc, &entry)) {
 		switch (object_type(entry.mode)) {
 		case OBJ_TREE:
-			if (fill_bitmap_tree(writer, bitmap,
-					     lookup_tree(writer->repo, &entry.oid)) < 0)
-				return -1;
+			if (fill_bitmap_tree(writer, bitmap, &entry.oid) < 0) {
+				ret = -1;
+				goto out;
+			}
 			break;
 		case OBJ_BLOB:
 			pos = find_object_pos(writer, &entry.oid, &found);
-			if (!found)
-				return -1;
+			if (!found) {
+				ret = -1;
+				goto out;
+			}
 			bitmap_set(bitmap, pos);
 			break;
 		default:
@@ -502,8 +516,9 @@ static int fill_bitmap_tree(struct bitmap_writer *writer,
 		}
 	}
 
-	free_tree_buffer(tree);
-	return 0;
+out:
+	free(buffer);
+	return ret;
 }
 
 static int reused_bitmaps_nr;
@@ -517,11 +532,17 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 			      struct bitmap_index *old_bitmap,
 			      const uint32_t *mapping)
 {
-	int found;
+	int found, ret = 0;
 	uint32_t pos;
 	if (!ent->bitmap)
 		ent->bitmap = bitmap_new();
 
+	/*
+	 * The commit walk uses parsed commits and the old bitmap index,
+	 * neither of which is thread-safe. Only the tree walk below runs
+	 * in parallel when building bitmaps with multiple threads.
+	 */
+	obj_read_lock();
 	prio_queue_put(queue, commit);
 
 	while (queue->nr) {
@@ -559,8 +580,10 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 		 */
 		if (!(c->object.flags & BITMAP_PSEUDO_MERGE)) {
 			pos = find_object_pos(writer, &c->object.oid, &found);
-			if (!found)
-				return -1;
+			if (!found) {
+				ret = -1;
+				break;
+			}
 			bitmap_set(ent->bitmap, pos);
 			prio_queue_put(tree_queue,
 				       repo_get_commit_tree(writer->repo, c));
@@ -569,18 +592,26 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 		for (p = c->parents; p; p = p->next) {
 			pos = find_object_pos(writer, &p->item->object.oid,
 					      &found);
-			if (!found)
-				return -1;
+			if (!found) {
+				ret = -1;
+				break;
+			}
 			if (!bitmap_get(ent->bitmap, pos)) {
 				bitmap_set(ent->bitmap, pos);
 				prio_queue_put(queue, p->item);
 			}
 		}
+		if (ret < 0)
+			break;
 	}
+	obj_read_unlock();
+	if (ret < 0)
+		return ret;
 
 	while (tree_queue->nr) {
-		if (fill_bitmap_tree(writer, ent->bitmap,
-				     prio_queue_get(tree_queue)) < 0)
+		struct tree *tree = prio_queue_get(tree_queue);
+
+		if (fill_bitmap_tree(writer, ent->bitmap, &tree->object.oid) < 0)
 			return -1;
 	}
 	return 0;
@@ -605,15 +636,212 @@ static void store_selected(struct bitmap_writer *writer,
 	kh_value(writer->bitmaps, hash_pos) = stored;
 }
 
-int bitmap_writer_build(struct bitmap_writer *writer)
+struct bitmap_build_state {
+	struct bitmap_writer *writer;
+	struct bitmap_builder *bb;
+	struct bitmap_index *old_bitmap;
+	const uint32_t *mapping;
+	int nr_stored; /* for progress */
+
+	/*
+	 * The members below are only used when building with multiple
+	 * threads, and are protected by "mutex".
+	 */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct commit **ready;
+	size_t ready_nr, ready_alloc;
+	size_t remaining;
+	int failed;
+};
+
+/*
+ * Add the bitmap of "ent" to those of the maximal commits that descend
+ * from it, handing it over to the first one that has no bitmap yet.
+ * With multiple threads, a commit becomes ready to be built once all
+ * the commits it descends from have been added to its bitmap.
+ */
+static void pass_bitmap_to_children(struct bitmap_build_state *state,
+				    struct bb_commit *ent, int threaded)
 {
-	struct bitmap_builder bb;
+	struct commit *child;
+	int reused = 0;
+
+	while ((child = pop_commit(&ent->reverse_edges))) {
+		struct bb_commit *child_ent =
+			bb_data_at(&state->bb->data, child);
+
+		if (child_ent->bitmap)
+			bitmap_or(child_ent->bitmap, ent->bitmap);
+		else if (reused)
+			child_ent->bitmap = bitmap_dup(ent->bitmap);
+		else {
+			child_ent->bitmap = ent->bitmap;
+			reused = 1;
+		}
+
+		if (threaded && !--child_ent->pending) {
+			ALLOC_GROW(state->ready, state->ready_nr + 1,
+				   state->ready_alloc);
+			state->ready[state->ready_nr++] = child;
+		}
+	}
+	if (!reused)
+		bitmap_free(ent->bitmap);
+	ent->bitmap = NULL;
+}
+
+static void *build_bitmaps_thread(void *data)
+{
+	struct bitmap_build_state *state = data;
+	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
+	struct prio_queue tree_queue = { NULL };
+
+	pthread_mutex_lock(&state->mutex);
+	for (;;) {
+		struct commit *commit;
+		struct bb_commit *ent;
+		int ret;
+
+		while (!state->ready_nr && state->remaining && !state->failed)
+			pthread_cond_wait(&state->cond, &state->mutex);
+		if (!state->remaining || state->failed)
+			break;
+
+		commit = state->ready[--state->ready_nr];
+		ent = bb_data_at(&state->bb->data, commit);
+		pthread_mutex_unlock(&state->mutex);
+
+		ret = fill_bitmap_commit(state->writer, ent, commit, &queue,
+					 &tree_queue, state->old_bitmap,
+					 state->mapping);
+		if (!ret && ent->selected)
+			store_selected(state->writer, ent, commit);
+
+		pthread_mutex_lock(&state->mutex);
+		if (ret < 0) {
+			state->failed = 1;
+			pthread_cond_broadcast(&state->cond);
+			break;
+		}
+		if (ent->selected)
+			display_progress(state->writer->progress,
+					 ++state->nr_stored);
+		pass_bitmap_to_children(state, ent, 1);
+		state->remaining--;
+		pthread_cond_broadcast(&state->cond);
+	}
+	pthread_mutex_unlock(&state->mutex);
+
+	clear_prio_queue(&queue);
+	clear_prio_queue(&tree_queue);
+	return NULL;
+}
+
+/*
+ * Build the bitmaps of the maximal commits in parallel. A commit can be
+ * built as soon as the bitmaps of all the maximal commits it descends
+ * from have been passed on to it, so independent parts of the history
+ * are walked at the same time. Each commit ends up with the same bitmap
+ * regardless of the order in which this happens.
+ */
+static int build_bitmaps_threaded(struct bitmap_build_state *state,
+				  int nr_threads)
+{
+	struct bitmap_builder *bb = state->bb;
+	pthread_t *threads;
 	size_t i;
-	int nr_stored = 0; /* for progress */
+
+	for (i = 0; i < bb->commits_nr; i++) {
+		struct bb_commit *ent = bb_data_at(&bb->data, bb->commits[i]);
+		struct commit_list *c;
+
+		for (c = ent->reverse_edges; c; c = c->next)
+			bb_data_at(&bb->data, c->item)->pending++;
+	}
+	/*
+	 * Queue the commits without any dependencies such that they are
+	 * taken in the same order as in the single-threaded walk.
+	 */
+	for (i = 0; i < bb->commits_nr; i++) {
+		if (bb_data_at(&bb->data, bb->commits[i])->pending)
+			continue;
+		ALLOC_GROW(state->ready, state->ready_nr + 1, state->ready_alloc);
+		state->ready[state->ready_nr++] = bb->commits[i];
+	}
+	state->remaining = bb->commits_nr;
+
+	/*
+	 * Make sure that the threads do not race to lazily set up any
+	 * repository state.
+	 */
+	if (replace_refs_enabled(state->writer->repo))
+		prepare_replace_object(state->writer->repo);
+	odb_prepare_alternates(state->writer->repo->objects);
+
+	pthread_mutex_init(&state->mutex, NULL);
+	pthread_cond_init(&state->cond, NULL);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&threads[i], NULL,
+					 build_bitmaps_thread, state);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->mutex);
+	free(threads);
+	free(state->ready);
+
+	return state->failed ? -1 : 0;
+}
+
+static int build_bitmaps(struct bitmap_build_state *state)
+{
+	struct bitmap_builder *bb = state->bb;
 	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
 	struct prio_queue tree_queue = { NULL };
+	int ret = 0;
+	size_t i;
+
+	for (i = bb->commits_nr; i > 0; i--) {
+		struct commit *commit = bb->commits[i-1];
+		struct bb_commit *ent = bb_data_at(&bb->data, commit);
+
+		if (fill_bitmap_commit(state->writer, ent, commit, &queue,
+				       &tree_queue, state->old_bitmap,
+				       state->mapping) < 0) {
+			ret = -1;
+			break;
+		}
+
+		if (ent->selected) {
+			store_selected(state->writer, ent, commit);
+			display_progress(state->writer->progress,
+					 ++state->nr_stored);
+		}
+
+		pass_bitmap_to_children(state, ent, 0);
+	}
+	clear_prio_queue(&queue);
+	clear_prio_queue(&tree_queue);
+
+	return ret;
+}
+
+int bitmap_writer_build(struct bitmap_writer *writer)
+{
+	struct bitmap_builder bb;
+	struct bitmap_build_state state = { 0 };
 	struct bitmap_index *old_bitmap;
 	uint32_t *mapping = NULL;
+	int nr_threads;
 	int closed = 1; /* until proven otherwise */
 
 	if (writer->show_progress)
@@ -630,43 +858,28 @@ int bitmap_writer_build(struct bitmap_writer *writer)
 		mapping = NULL;
 
 	bitmap_builder_init(&bb, writer, old_bitmap);
-	for (i = bb.commits_nr; i > 0; i--) {
-		struct commit *commit = bb.commits[i-1];
-		struct bb_commit *ent = bb_data_at(&bb.data, commit);
-		struct commit *child;
-		int reused = 0;
-
-		if (fill_bitmap_commit(writer, ent, commit, &queue, &tree_queue,
-				       old_bitmap, mapping) < 0) {
-			closed = 0;
-			break;
-		}
 
-		if (ent->selected) {
-			store_selected(writer, ent, commit);
-			nr_stored++;
-			display_progress(writer->progress, nr_stored);
-		}
-
-		while ((child = pop_commit(&ent->reverse_edges))) {
-			struct bb_commit *child_ent =
-				bb_data_at(&bb.data, child);
+	state.writer = writer;
+	state.bb = &bb;
+	state.old_bitmap = old_bitmap;
+	state.mapping = mapping;
+
+	prepare_repo_settings(writer->repo);
+	nr_threads = writer->repo->settings.bitmap_write_threads;
+	if (!HAVE_THREADS)
+		nr_threads = 1;
+	else if (nr_threads > bb.commits_nr)
+		nr_threads = bb.commits_nr;
+	trace2_data_intmax("pack-bitmap-write", writer->repo,
+			   "building_bitmaps_threads", nr_threads);
 
-			if (child_ent->bitmap)
-				bitmap_or(child_ent->bitmap, ent->bitmap);
-			else if (reused)
-				child_ent->bitmap = bitmap_dup(ent->bitmap);
-			else {
-				child_ent->bitmap = ent->bitmap;
-				reused = 1;
-			}
-		}
-		if (!reused)
-			bitmap_free(ent->bitmap);
-		ent->bitmap = NULL;
+	if (nr_threads > 1) {
+		if (build_bitmaps_threaded(&state, nr_threads) < 0)
+			closed = 0;
+	} else if (build_bitmaps(&state) < 0) {
+		closed = 0;
 	}
-	clear_prio_queue(&queue);
-	clear_prio_queue(&tree_queue);
+
 	bitmap_builder_clear(&bb);
 	free_bitmap_index(old_bitmap);
 	free(mapping);
@@ -795,6 +1008,15 @@ static inline void dump_bitmap(struct hashfile *f, struct ewah_bitmap *bitmap)
 		die("Failed to write bitmap index");
 }
 
+static void dump_bitmap_roaring(struct hashfile *f, struct ewah_bitmap *bitmap)
+{
+	struct roaring_bitmap *roaring = ewah_to_roaring(bitmap);
+
+	if (roaring_serialize_to(roaring, hashwrite_ewah_helper, f) < 0)
+		die("Failed to write bitmap index");
+	roaring_free(roaring);
+}
+
 static const struct object_id *oid_access(size_t pos, const void *table)
 {
 	const struct pack_idx_entry * const *index = table;
@@ -802,7 +1024,8 @@ static const struct object_id *oid_access(size_t pos, const void *table)
 }
 
 static void write_selected_commits_v1(struct bitmap_writer *writer,
-				      struct hashfile *f, off_t *offsets)
+				      struct hashfile *f, off_t *offsets,
+				      uint16_t options)
 {
 	int i;
 
@@ -819,7 +1042,10 @@ static void write_selected_commits_v1(struct bitmap_writer *writer,
 		hashwrite_u8(f, stored->xor_offset);
 		hashwrite_u8(f, stored->flags);
 
-		dump_bitmap(f, stored->write_as);
+		if (options & BITMAP_OPT_ROARING)
+			dump_bitmap_roaring(f, stored->write_as);
+		else
+			dump_bitmap(f, stored->write_as);
 	}
 }
 
@@ -1043,7 +1269,7 @@ void bitmap_writer_finish(struct bitmap_writer *writer,
 			  const char *filename,
 			  uint16_t options)
 {
-	static uint16_t default_version = 1;
+	uint16_t version = 1;
 	static uint16_t flags = BITMAP_OPT_FULL_DAG;
 	struct strbuf tmp_file = STRBUF_INIT;
 	struct hashfile *f;
@@ -1057,11 +1283,21 @@ void bitmap_writer_finish(struct bitmap_writer *writer,
 
 	if (writer->pseudo_merges_nr)
 		options |= BITMAP_OPT_PSEUDO_MERGES;
+	if (git_env_bool(GIT_TEST_PACK_WRITE_BITMAP_ROARING, 0))
+		options |= BITMAP_OPT_ROARING;
+
+	/*
+	 * Older readers ignore options they do not know about, but would
+	 * misinterpret roaring bitmaps as EWAH ones. Bump the version so
+	 * that they reject the file instead.
+	 */
+	if (options & BITMAP_OPT_ROARING)
+		version = 2;
 
 	f = hashfd(writer->repo->hash_algo, fd, tmp_file.buf);
 
 	memcpy(header.magic, BITMAP_IDX_SIGNATURE, sizeof(BITMAP_IDX_SIGNATURE));
-	header.version = htons(default_version);
+	header.version = htons(version);
 	header.options = htons(flags | options);
 	header.entry_count = htonl(bitmap_writer_nr_selected_commits(writer));
 	hashcpy(header.checksum, writer->pack_checksum, writer->repo->hash_algo);
@@ -1092,7 +1328,7 @@ void bitmap_writer_finish(struct bitmap_writer *writer,
 		stored->commit_pos = commit_pos + base_objects;
 	}
 
-	write_selected_commits_v1(writer, f, offsets);
+	write_selected_commits_v1(writer, f, offsets, options);
 
 	if (options & BITMAP_OPT_PSEUDO_MERGES)
 		write_pseudo_merges(writer, f);
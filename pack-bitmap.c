@@ -30,6 +30,12 @@
 struct stored_bitmap {
 	struct object_id oid;
 	struct ewah_bitmap *root;
+	/*
+	 * The bitmap in roaring encoding, if the index stores it that way.
+	 * In that case, 'root' is only filled in when a caller asks for the
+	 * bitmap in EWAH form.
+	 */
+	struct roaring_bitmap *roaring;
 	struct stored_bitmap *xor;
 	size_t map_pos;
 	int flags;
@@ -141,6 +147,9 @@ struct bitmap_index {
 
 	/* Version of the bitmap index */
 	unsigned int version;
+
+	/* Whether the bitmaps of commits use the roaring encoding */
+	unsigned roaring : 1;
 };
 
 static int pseudo_merges_satisfied_nr;
@@ -150,11 +159,33 @@ static int existing_bitmaps_misses_nr;
 static int roots_with_bitmaps_nr;
 static int roots_without_bitmaps_nr;
 
+static struct roaring_bitmap *lookup_stored_roaring(struct stored_bitmap *st)
+{
+	struct roaring_bitmap *composed;
+
+	if (!st->xor)
+		return st->roaring;
+
+	composed = roaring_xor(st->roaring, lookup_stored_roaring(st->xor));
+
+	roaring_free(st->roaring);
+	st->roaring = composed;
+	st->xor = NULL;
+
+	return composed;
+}
+
 static struct ewah_bitmap *lookup_stored_bitmap(struct stored_bitmap *st)
 {
 	struct ewah_bitmap *parent;
 	struct ewah_bitmap *composed;
 
+	if (st->roaring) {
+		if (!st->root)
+			st->root = roaring_to_ewah(lookup_stored_roaring(st));
+		return st->root;
+	}
+
 	if (!st->xor)
 		return st->root;
 
@@ -197,6 +228,43 @@ static struct ewah_bitmap *read_bitmap_1(struct bitmap_index *index)
 	return read_bitmap(index->map, index->map_size, &index->map_pos);
 }
 
+static struct roaring_bitmap *read_roaring_1(struct bitmap_index *index)
+{
+	struct roaring_bitmap *b = roaring_new();
+
+	ssize_t bitmap_size = roaring_read_mmap(b, index->map + index->map_pos,
+						index->map_size - index->map_pos);
+
+	if (bitmap_size < 0) {
+		error(_("failed to load bitmap index (corrupted?)"));
+		roaring_free(b);
+		return NULL;
+	}
+
+	index->map_pos += bitmap_size;
+
+	return b;
+}
+
+/*
+ * Read the bitmap of a commit entry in whichever encoding the index
+ * uses. Exactly one of 'ewah' and 'roaring' is filled in on success.
+ */
+static int read_commit_bitmap_1(struct bitmap_index *index,
+				struct ewah_bitmap **ewah,
+				struct roaring_bitmap **roaring)
+{
+	*ewah = NULL;
+	*roaring = NULL;
+
+	if (index->roaring)
+		*roaring = read_roaring_1(index);
+	else
+		*ewah = read_bitmap_1(index);
+
+	return *ewah || *roaring ? 0 : -1;
+}
+
 static uint32_t bitmap_num_objects_total(struct bitmap_index *index)
 {
 	if (index->midx) {
@@ -256,7 +324,7 @@ static int load_bitmap_header(struct bitmap_index *index)
 		return error(_("corrupted bitmap index file (wrong header)"));
 
 	index->version = ntohs(header->version);
-	if (index->version != 1)
+	if (index->version != 1 && index->version != 2)
 		return error(_("unsupported version '%d' for bitmap index file"), index->version);
 
 	/* Parse known bitmap format options */
@@ -269,6 +337,12 @@ static int load_bitmap_header(struct bitmap_index *index)
 			BUG("unsupported options for bitmap index file "
 				"(Git requires BITMAP_OPT_FULL_DAG)");
 
+		if (!!(flags & BITMAP_OPT_ROARING) != (index->version == 2))
+			return error(_("corrupted bitmap index file (roaring "
+				       "encoding does not match version %d)"),
+				     index->version);
+		index->roaring = !!(flags & BITMAP_OPT_ROARING);
+
 		if (flags & BITMAP_OPT_HASH_CACHE) {
 			if (cache_size > index_end - index->map - header_size)
 				return error(_("corrupted bitmap index file (too short to fit hash cache)"));
@@ -335,6 +409,7 @@ static int load_bitmap_header(struct bitmap_index *index)
 
 static struct stored_bitmap *store_bitmap(struct bitmap_index *index,
 					  struct ewah_bitmap *root,
+					  struct roaring_bitmap *roaring,
 					  const struct object_id *oid,
 					  struct stored_bitmap *xor_with,
 					  int flags, size_t map_pos)
@@ -346,6 +421,7 @@ static struct stored_bitmap *store_bitmap(struct bitmap_index *index,
 	stored = xmalloc(sizeof(struct stored_bitmap));
 	stored->map_pos = map_pos;
 	stored->root = root;
+	stored->roaring = roaring;
 	stored->xor = xor_with;
 	stored->flags = flags;
 	oidcpy(&stored->oid, oid);
@@ -397,6 +473,7 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 	for (i = 0; i < index->entry_count; ++i) {
 		int xor_offset, flags;
 		struct ewah_bitmap *bitmap = NULL;
+		struct roaring_bitmap *roaring = NULL;
 		struct stored_bitmap *xor_bitmap = NULL;
 		uint32_t commit_idx_pos;
 		struct object_id oid;
@@ -424,13 +501,12 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 				return error(_("invalid XOR offset in bitmap pack index"));
 		}
 
-		bitmap = read_bitmap_1(index);
-		if (!bitmap)
+		if (read_commit_bitmap_1(index, &bitmap, &roaring) < 0)
 			return -1;
 
 		recent_bitmaps[i % MAX_XOR_OFFSET] =
-			store_bitmap(index, bitmap, &oid, xor_bitmap, flags,
-				     entry_map_pos);
+			store_bitmap(index, bitmap, roaring, &oid, xor_bitmap,
+				     flags, entry_map_pos);
 	}
 
 	return 0;
@@ -889,6 +965,7 @@ static struct stored_bitmap *lazy_bitmap_for_commit(struct bitmap_index *bitmap_
 	struct bitmap_lookup_table_triplet triplet;
 	struct object_id *oid = &commit->object.oid;
 	struct ewah_bitmap *bitmap;
+	struct roaring_bitmap *roaring;
 	struct stored_bitmap *xor_bitmap = NULL;
 	const int bitmap_header_size = 6;
 	static struct bitmap_lookup_table_xor_item *xor_items = NULL;
@@ -960,13 +1037,13 @@ static struct stored_bitmap *lazy_bitmap_for_commit(struct bitmap_index *bitmap_
 		entry_map_pos = bitmap_git->map_pos;
 		bitmap_git->map_pos += sizeof(uint32_t) + sizeof(uint8_t);
 		xor_flags = read_u8(bitmap_git->map, &bitmap_git->map_pos);
-		bitmap = read_bitmap_1(bitmap_git);
 
-		if (!bitmap)
+		if (read_commit_bitmap_1(bitmap_git, &bitmap, &roaring) < 0)
 			goto corrupt;
 
-		xor_bitmap = store_bitmap(bitmap_git, bitmap, &xor_item->oid,
-					  xor_bitmap, xor_flags, entry_map_pos);
+		xor_bitmap = store_bitmap(bitmap_git, bitmap, roaring,
+					  &xor_item->oid, xor_bitmap, xor_flags,
+					  entry_map_pos);
 		xor_items_nr--;
 	}
 
@@ -1003,13 +1080,12 @@ static struct stored_bitmap *lazy_bitmap_for_commit(struct bitmap_index *bitmap_
 	entry_map_pos = bitmap_git->map_pos;
 	bitmap_git->map_pos += sizeof(uint32_t) + sizeof(uint8_t);
 	flags = read_u8(bitmap_git->map, &bitmap_git->map_pos);
-	bitmap = read_bitmap_1(bitmap_git);
 
-	if (!bitmap)
+	if (read_commit_bitmap_1(bitmap_git, &bitmap, &roaring) < 0)
 		goto corrupt;
 
-	return store_bitmap(bitmap_git, bitmap, oid, xor_bitmap, flags,
-			    entry_map_pos);
+	return store_bitmap(bitmap_git, bitmap, roaring, oid, xor_bitmap,
+			    flags, entry_map_pos);
 
 corrupt:
 	free(xor_items);
@@ -1017,9 +1093,9 @@ static struct stored_bitmap *lazy_bitmap_for_commit(struct bitmap_index *bitmap_
 	return NULL;
 }
 
-static struct ewah_bitmap *find_bitmap_for_commit(struct bitmap_index *bitmap_git,
-						  struct commit *commit,
-						  struct bitmap_index **found)
+static struct stored_bitmap *find_stored_bitmap_for_commit(struct bitmap_index *bitmap_git,
+							   struct commit *commit,
+							   struct bitmap_index **found)
 {
 	khiter_t hash_pos;
 	if (!bitmap_git)
@@ -1029,22 +1105,43 @@ static struct ewah_bitmap *find_bitmap_for_commit(struct bitmap_index *bitmap_gi
 	if (hash_pos >= kh_end(bitmap_git->bitmaps)) {
 		struct stored_bitmap *bitmap = NULL;
 		if (!bitmap_git->table_lookup)
-			return find_bitmap_for_commit(bitmap_git->base, commit,
-						      found);
+			return find_stored_bitmap_for_commit(bitmap_git->base,
+							     commit, found);
 
 		/* this is a fairly hot codepath - no trace2_region please */
 		/* NEEDSWORK: cache misses aren't recorded */
 		bitmap = lazy_bitmap_for_commit(bitmap_git, commit);
 		if (!bitmap)
-			return find_bitmap_for_commit(bitmap_git->base, commit,
-						      found);
+			return find_stored_bitmap_for_commit(bitmap_git->base,
+							     commit, found);
 		if (found)
 			*found = bitmap_git;
-		return lookup_stored_bitmap(bitmap);
+		return bitmap;
 	}
 	if (found)
 		*found = bitmap_git;
-	return lookup_stored_bitmap(kh_value(bitmap_git->bitmaps, hash_pos));
+	return kh_value(bitmap_git->bitmaps, hash_pos);
+}
+
+static struct ewah_bitmap *find_bitmap_for_commit(struct bitmap_index *bitmap_git,
+						  struct commit *commit,
+						  struct bitmap_index **found)
+{
+	struct stored_bitmap *st = find_stored_bitmap_for_commit(bitmap_git,
+								 commit, found);
+	return st ? lookup_stored_bitmap(st) : NULL;
+}
+
+/*
+ * OR the bitmap of a commit into 'base'. Roaring bitmaps are applied
+ * directly from their containers, without inflating them to EWAH first.
+ */
+static void bitmap_or_stored(struct bitmap *base, struct stored_bitmap *st)
+{
+	if (st->roaring)
+		bitmap_or_roaring(base, lookup_stored_roaring(st));
+	else
+		bitmap_or_ewah(base, lookup_stored_bitmap(st));
 }
 
 struct ewah_bitmap *bitmap_for_commit(struct bitmap_index *bitmap_git,
@@ -1182,7 +1279,7 @@ static int add_to_include_set(struct bitmap_index *bitmap_git,
 			      struct commit *commit,
 			      int bitmap_pos)
 {
-	struct ewah_bitmap *partial;
+	struct stored_bitmap *partial;
 
 	if (data->seen && bitmap_get(data->seen, bitmap_pos))
 		return 0;
@@ -1190,11 +1287,11 @@ static int add_to_include_set(struct bitmap_index *bitmap_git,
 	if (bitmap_get(data->base, bitmap_pos))
 		return 0;
 
-	partial = bitmap_for_commit(bitmap_git, commit);
+	partial = find_stored_bitmap_for_commit(bitmap_git, commit, NULL);
 	if (partial) {
 		existing_bitmaps_hits_nr++;
 
-		bitmap_or_ewah(data->base, partial);
+		bitmap_or_stored(data->base, partial);
 		return 0;
 	}
 
@@ -1253,7 +1350,8 @@ static int add_commit_to_bitmap(struct bitmap_index *bitmap_git,
 				struct bitmap **base,
 				struct commit *commit)
 {
-	struct ewah_bitmap *or_with = bitmap_for_commit(bitmap_git, commit);
+	struct stored_bitmap *or_with = find_stored_bitmap_for_commit(bitmap_git,
+								      commit, NULL);
 
 	if (!or_with) {
 		existing_bitmaps_misses_nr++;
@@ -1262,10 +1360,14 @@ static int add_commit_to_bitmap(struct bitmap_index *bitmap_git,
 
 	existing_bitmaps_hits_nr++;
 
-	if (!*base)
-		*base = ewah_to_bitmap(or_with);
-	else
-		bitmap_or_ewah(*base, or_with);
+	if (!*base) {
+		if (!or_with->roaring) {
+			*base = ewah_to_bitmap(lookup_stored_bitmap(or_with));
+			return 1;
+		}
+		*base = bitmap_word_alloc(0);
+	}
+	bitmap_or_stored(*base, or_with);
 
 	return 1;
 }
@@ -2615,18 +2717,34 @@ static uint32_t count_object_type(struct bitmap_index *bitmap_git,
 {
 	struct bitmap *objects = bitmap_git->result;
 	struct eindex *eindex = &bitmap_git->ext_index;
+	struct ewah_bitmap **type_bitmaps;
 
 	uint32_t i = 0, count = 0;
-	struct ewah_or_iterator it;
-	eword_t filter;
-
-	init_type_iterator(&it, bitmap_git, type);
 
-	while (i < objects->word_alloc && ewah_or_iterator_next(&filter, &it)) {
-		eword_t word = objects->words[i++] & filter;
-		count += ewah_bit_popcount64(word);
+	switch (type) {
+	case OBJ_COMMIT:
+		type_bitmaps = bitmap_git->commits_all;
+		break;
+	case OBJ_TREE:
+		type_bitmaps = bitmap_git->trees_all;
+		break;
+	case OBJ_BLOB:
+		type_bitmaps = bitmap_git->blobs_all;
+		break;
+	case OBJ_TAG:
+		type_bitmaps = bitmap_git->tags_all;
+		break;
+	default:
+		BUG("object type %d not stored by bitmap type index", type);
 	}
 
+	/*
+	 * Each layer's type bitmap only covers the objects of that layer,
+	 * so they are disjoint and can be counted one at a time.
+	 */
+	for (i = 0; i <= bitmap_git->base_nr; i++)
+		count += ewah_bitmap_and_popcount(type_bitmaps[i], objects);
+
 	for (i = 0; i < eindex->count; ++i) {
 		if (eindex->objects[i]->type == type &&
 		    bitmap_get(objects,
@@ -2634,8 +2752,6 @@ static uint32_t count_object_type(struct bitmap_index *bitmap_git,
 			count++;
 	}
 
-	ewah_or_iterator_release(&it);
-
 	return count;
 }
 
@@ -3172,6 +3288,7 @@ void free_bitmap_index(struct bitmap_index *b)
 		struct stored_bitmap *sb;
 		kh_foreach_value(b->bitmaps, sb, {
 			ewah_pool_free(sb->root);
+			roaring_free(sb->roaring);
 			free(sb);
 		});
 	}
@@ -38,6 +38,7 @@ enum pack_bitmap_opts {
 	BITMAP_OPT_HASH_CACHE = 0x4,
 	BITMAP_OPT_LOOKUP_TABLE = 0x10,
 	BITMAP_OPT_PSEUDO_MERGES = 0x20,
+	BITMAP_OPT_ROARING = 0x40,
 };
 
 enum pack_bitmap_flags {
@@ -101,6 +102,8 @@ int for_each_bitmapped_object(struct bitmap_index *bitmap_git,
 
 #define GIT_TEST_PACK_USE_BITMAP_BOUNDARY_TRAVERSAL \
 	"GIT_TEST_PACK_USE_BITMAP_BOUNDARY_TRAVERSAL"
+#define GIT_TEST_PACK_WRITE_BITMAP_ROARING \
+	"GIT_TEST_PACK_WRITE_BITMAP_ROARING"
 
 struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 					 int filter_provided_objects);
@@ -2,6 +2,7 @@
 
 #include "git-compat-util.h"
 #include "environment.h"
+#include "gettext.h"
 #include "hex.h"
 #include "repository.h"
 #include "pack.h"
@@ -9,6 +10,7 @@
 #include "packfile.h"
 #include "object-file.h"
 #include "odb.h"
+#include "thread-utils.h"
 
 struct idx_entry {
 	off_t                offset;
@@ -48,11 +50,291 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 	return data_crc != ntohl(*index_crc);
 }
 
+struct verify_result {
+	void *data;
+	unsigned long size;
+	enum object_type type;
+	unsigned crc_mismatch : 1,
+		 unpack_failed : 1,
+		 corrupt : 1,
+		 done : 1;
+};
+
+/*
+ * Unpack the i-th entry and check it against its object ID, recording
+ * the outcome in "res". Errors are only reported by report_entry(), so
+ * that this can run in any thread.
+ */
+static void check_entry(struct repository *r, struct packed_git *p,
+			struct pack_window **w_curs, struct idx_entry *entries,
+			uint32_t i, struct verify_result *res)
+{
+	struct object_id oid;
+	off_t curpos;
+	int data_valid;
+
+	obj_read_lock();
+	if (nth_packed_object_id(&oid, p, entries[i].nr) < 0)
+		BUG("unable to get oid of object %lu from %s",
+		    (unsigned long)entries[i].nr, p->pack_name);
+
+	if (p->index_version > 1) {
+		off_t offset = entries[i].offset;
+		off_t len = entries[i+1].offset - offset;
+		unsigned int nr = entries[i].nr;
+		if (check_pack_crc(p, w_curs, offset, len, nr))
+			res->crc_mismatch = 1;
+	}
+
+	curpos = entries[i].offset;
+	res->type = unpack_object_header(p, w_curs, &curpos, &res->size);
+	unuse_pack(w_curs);
+
+	if (res->type == OBJ_BLOB &&
+	    repo_settings_get_big_file_threshold(r) <= res->size) {
+		/*
+		 * Let stream_object_signature() check it with
+		 * the streaming interface; no point slurping
+		 * the data in-core only to discard.
+		 */
+		res->data = NULL;
+		data_valid = 0;
+	} else {
+		res->data = unpack_entry(r, p, entries[i].offset,
+					 &res->type, &res->size);
+		data_valid = 1;
+	}
+
+	if (data_valid && !res->data)
+		res->unpack_failed = 1;
+	else if (!res->data && stream_object_signature(r, &oid) < 0)
+		res->corrupt = 1;
+	obj_read_unlock();
+
+	if (res->data && check_object_signature(r, &oid, res->data, res->size,
+						res->type) < 0)
+		res->corrupt = 1;
+}
+
+/*
+ * Report the outcome of check_entry() for the i-th entry and hand the
+ * object to the callback. Frees the data of the entry.
+ */
+static int report_entry(struct packed_git *p, struct idx_entry *entries,
+			uint32_t i, struct verify_result *res, verify_fn fn)
+{
+	struct object_id oid;
+	int err = 0;
+
+	if (nth_packed_object_id(&oid, p, entries[i].nr) < 0)
+		BUG("unable to get oid of object %lu from %s",
+		    (unsigned long)entries[i].nr, p->pack_name);
+
+	if (res->crc_mismatch)
+		err = error("index CRC mismatch for object %s "
+			    "from %s at offset %"PRIuMAX"",
+			    oid_to_hex(&oid),
+			    p->pack_name, (uintmax_t)entries[i].offset);
+
+	if (res->unpack_failed)
+		err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
+			    oid_to_hex(&oid), p->pack_name,
+			    (uintmax_t)entries[i].offset);
+	else if (res->corrupt)
+		err = error("packed %s from %s is corrupt",
+			    oid_to_hex(&oid), p->pack_name);
+	else if (fn) {
+		int eaten = 0;
+		err |= fn(&oid, res->type, res->size, res->data, &eaten);
+		if (eaten)
+			res->data = NULL;
+	}
+	FREE_AND_NULL(res->data);
+
+	return err;
+}
+
+static int verify_entries(struct repository *r, struct packed_git *p,
+			  struct pack_window **w_curs,
+			  struct idx_entry *entries, uint32_t nr_objects,
+			  verify_fn fn, struct progress *progress,
+			  uint32_t base_count)
+{
+	uint32_t i;
+	int err = 0;
+
+	for (i = 0; i < nr_objects; i++) {
+		struct verify_result res = { 0 };
+
+		check_entry(r, p, w_curs, entries, i, &res);
+		err |= report_entry(p, entries, i, &res, fn);
+		if (((base_count + i) & 1023) == 0)
+			display_progress(progress, base_count + i);
+	}
+	display_progress(progress, base_count + i);
+
+	return err;
+}
+
+/*
+ * Objects that have been checked by the workers but not yet reported,
+ * be it by number or by size, before the workers wait for the main
+ * thread to catch up.
+ */
+#define VERIFY_MAX_AHEAD 4096
+#define VERIFY_MAX_AHEAD_BYTES (256 * 1024 * 1024)
+
+struct verify_pool {
+	struct repository *r;
+	struct packed_git *p;
+	struct idx_entry *entries;
+	struct verify_result *results;
+	uint32_t nr;
+
+	pthread_mutex_t mutex;
+	/* Signalled when the main thread has reported an entry. */
+	pthread_cond_t room;
+	/* Signalled when a worker has checked an entry. */
+	pthread_cond_t checked;
+	uint32_t next;
+	uint32_t reported;
+	size_t bytes;
+};
+
+static int verify_pool_has_room(struct verify_pool *pool)
+{
+	/* Always allow the entry the main thread waits for. */
+	if (pool->next == pool->reported)
+		return 1;
+	return pool->next - pool->reported < VERIFY_MAX_AHEAD &&
+	       pool->bytes < VERIFY_MAX_AHEAD_BYTES;
+}
+
+static void *verify_thread(void *data)
+{
+	struct verify_pool *pool = data;
+	struct pack_window *w_curs = NULL;
+
+	while (1) {
+		struct verify_result *res;
+		uint32_t i;
+
+		pthread_mutex_lock(&pool->mutex);
+		while (pool->next < pool->nr && !verify_pool_has_room(pool))
+			pthread_cond_wait(&pool->room, &pool->mutex);
+		if (pool->next >= pool->nr) {
+			pthread_mutex_unlock(&pool->mutex);
+			break;
+		}
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		res = &pool->results[i];
+		check_entry(pool->r, pool->p, &w_curs, pool->entries, i, res);
+
+		pthread_mutex_lock(&pool->mutex);
+		res->done = 1;
+		if (res->data)
+			pool->bytes += res->size;
+		pthread_cond_signal(&pool->checked);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	obj_read_lock();
+	unuse_pack(&w_curs);
+	obj_read_unlock();
+	return NULL;
+}
+
+/*
+ * Like verify_entries(), but unpack and hash the objects in a pool of
+ * worker threads. The main thread reports the results and calls "fn"
+ * in pack order, so the output is the same as without threads.
+ */
+static int verify_entries_threaded(struct repository *r, struct packed_git *p,
+				   struct idx_entry *entries, uint32_t nr_objects,
+				   verify_fn fn, struct progress *progress,
+				   uint32_t base_count, int nr_threads)
+{
+	struct verify_pool pool = {
+		.r = r,
+		.p = p,
+		.entries = entries,
+		.nr = nr_objects,
+	};
+	pthread_t *threads;
+	int nr_started = 0;
+	uint32_t i;
+	int err = 0;
+
+	if (nr_threads > nr_objects)
+		nr_threads = nr_objects;
+
+	CALLOC_ARRAY(pool.results, nr_objects);
+	pthread_mutex_init(&pool.mutex, NULL);
+	pthread_cond_init(&pool.room, NULL);
+	pthread_cond_init(&pool.checked, NULL);
+	enable_obj_read_lock();
+
+	/* Make sure the workers do not race to set up shared state. */
+	repo_settings_get_big_file_threshold(r);
+
+	CALLOC_ARRAY(threads, nr_threads);
+	for (; nr_started < nr_threads; nr_started++) {
+		if (pthread_create(&threads[nr_started], NULL,
+				   verify_thread, &pool)) {
+			warning(_("unable to create thread: %s"), strerror(errno));
+			break;
+		}
+	}
+	if (!nr_started)
+		die(_("unable to create threads for verifying %s"),
+		    p->pack_name);
+
+	for (i = 0; i < nr_objects; i++) {
+		struct verify_result *res = &pool.results[i];
+		unsigned long size;
+
+		pthread_mutex_lock(&pool.mutex);
+		while (!res->done)
+			pthread_cond_wait(&pool.checked, &pool.mutex);
+		size = res->data ? res->size : 0;
+		pthread_mutex_unlock(&pool.mutex);
+
+		obj_read_lock();
+		err |= report_entry(p, entries, i, res, fn);
+		obj_read_unlock();
+
+		pthread_mutex_lock(&pool.mutex);
+		pool.reported = i + 1;
+		pool.bytes -= size;
+		pthread_cond_broadcast(&pool.room);
+		pthread_mutex_unlock(&pool.mutex);
+
+		if (((base_count + i) & 1023) == 0)
+			display_progress(progress, base_count + i);
+	}
+	display_progress(progress, base_count + i);
+
+	for (int j = 0; j < nr_started; j++)
+		pthread_join(threads[j], NULL);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&pool.checked);
+	pthread_cond_destroy(&pool.room);
+	pthread_mutex_destroy(&pool.mutex);
+	free(pool.results);
+	free(threads);
+
+	return err;
+}
+
 static int verify_packfile(struct repository *r,
 			   struct packed_git *p,
 			   struct pack_window **w_curs,
 			   verify_fn fn,
-			   struct progress *progress, uint32_t base_count)
+			   struct progress *progress, uint32_t base_count,
+			   int nr_threads)
 
 {
 	off_t index_size = p->index_size;
@@ -103,70 +385,12 @@ static int verify_packfile(struct repository *r,
 	}
 	QSORT(entries, nr_objects, compare_entries);
 
-	for (i = 0; i < nr_objects; i++) {
-		void *data;
-		struct object_id oid;
-		enum object_type type;
-		unsigned long size;
-		off_t curpos;
-		int data_valid;
-
-		if (nth_packed_object_id(&oid, p, entries[i].nr) < 0)
-			BUG("unable to get oid of object %lu from %s",
-			    (unsigned long)entries[i].nr, p->pack_name);
-
-		if (p->index_version > 1) {
-			off_t offset = entries[i].offset;
-			off_t len = entries[i+1].offset - offset;
-			unsigned int nr = entries[i].nr;
-			if (check_pack_crc(p, w_curs, offset, len, nr))
-				err = error("index CRC mismatch for object %s "
-					    "from %s at offset %"PRIuMAX"",
-					    oid_to_hex(&oid),
-					    p->pack_name, (uintmax_t)offset);
-		}
-
-		curpos = entries[i].offset;
-		type = unpack_object_header(p, w_curs, &curpos, &size);
-		unuse_pack(w_curs);
-
-		if (type == OBJ_BLOB &&
-		    repo_settings_get_big_file_threshold(r) <= size) {
-			/*
-			 * Let stream_object_signature() check it with
-			 * the streaming interface; no point slurping
-			 * the data in-core only to discard.
-			 */
-			data = NULL;
-			data_valid = 0;
-		} else {
-			data = unpack_entry(r, p, entries[i].offset, &type, &size);
-			data_valid = 1;
-		}
-
-		if (data_valid && !data)
-			err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
-				    oid_to_hex(&oid), p->pack_name,
-				    (uintmax_t)entries[i].offset);
-		else if (data && check_object_signature(r, &oid, data, size,
-							type) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (!data && stream_object_signature(r, &oid) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (fn) {
-			int eaten = 0;
-			err |= fn(&oid, type, size, data, &eaten);
-			if (eaten)
-				data = NULL;
-		}
-		if (((base_count + i) & 1023) == 0)
-			display_progress(progress, base_count + i);
-		free(data);
-
-	}
-	display_progress(progress, base_count + i);
+	if (HAVE_THREADS && nr_threads > 1 && nr_objects > 1)
+		err |= verify_entries_threaded(r, p, entries, nr_objects, fn,
+					       progress, base_count, nr_threads);
+	else
+		err |= verify_entries(r, p, w_curs, entries, nr_objects, fn,
+				      progress, base_count);
 	free(entries);
 
 	return err;
@@ -187,7 +411,7 @@ int verify_pack_index(struct packed_git *p)
 }
 
 int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn,
-		struct progress *progress, uint32_t base_count)
+		struct progress *progress, uint32_t base_count, int nr_threads)
 {
 	int err = 0;
 	struct pack_window *w_curs = NULL;
@@ -196,7 +420,8 @@ int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn,
 	if (!p->index_data)
 		return -1;
 
-	err |= verify_packfile(r, p, &w_curs, fn, progress, base_count);
+	err |= verify_packfile(r, p, &w_curs, fn, progress, base_count,
+			       nr_threads);
 	unuse_pack(&w_curs);
 
 	return err;
@@ -5,6 +5,7 @@
 #include "parse-options.h"
 #include "refs.h"
 #include "revision.h"
+#include "setup.h"
 
 int pack_refs_core(int argc,
 		   const char **argv,
@@ -22,12 +23,14 @@ int pack_refs_core(int argc,
 	struct string_list option_excluded_refs = STRING_LIST_INIT_NODUP;
 	struct string_list_item *item;
 	int pack_all = 0;
+	int detach = 0;
 	int ret;
 
 	struct option opts[] = {
 		OPT_BOOL(0, "all",   &pack_all, N_("pack everything")),
 		OPT_BIT(0, "prune", &optimize_opts.flags, N_("prune loose refs (default)"), REFS_OPTIMIZE_PRUNE),
 		OPT_BIT(0, "auto", &optimize_opts.flags, N_("auto-pack refs as needed"), REFS_OPTIMIZE_AUTO),
+		OPT_BOOL(0, "detach", &detach, N_("pack refs in the background")),
 		OPT_STRING_LIST(0, "include", optimize_opts.includes, N_("pattern"),
 			N_("references to include")),
 		OPT_STRING_LIST(0, "exclude", &option_excluded_refs, N_("pattern"),
@@ -47,6 +50,10 @@ int pack_refs_core(int argc,
 	if (!optimize_opts.includes->nr)
 		string_list_append(optimize_opts.includes, "refs/tags/*");
 
+	/* Failure to daemonize is ok, we'll continue in foreground. */
+	if (detach)
+		daemonize();
+
 	ret = refs_optimize(get_main_ref_store(repo), &optimize_opts);
 
 	clear_ref_exclusions(&excludes);
@@ -9,7 +9,7 @@ struct repository;
  * must be prepended by the caller.
  */
 #define PACK_REFS_OPTS \
-	"[--all] [--no-prune] [--auto] [--include <pattern>] [--exclude <pattern>]"
+	"[--all] [--no-prune] [--auto] [--detach] [--include <pattern>] [--exclude <pattern>]"
 
 /*
  * The core logic for pack-refs and its clones.
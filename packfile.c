@@ -16,6 +16,7 @@
 #include "object.h"
 #include "tag.h"
 #include "trace.h"
+#include "trace2.h"
 #include "tree-walk.h"
 #include "tree.h"
 #include "object-file.h"
@@ -26,6 +27,7 @@
 #include "pack-revindex.h"
 #include "promisor-remote.h"
 #include "pack-mtimes.h"
+#include "thread-utils.h"
 
 char *odb_pack_name(struct repository *r, struct strbuf *buf,
 		    const unsigned char *hash, const char *ext)
@@ -999,7 +1001,9 @@ static void prepare_pack(const char *full_name, size_t full_name_len,
 		return;
 
 	if (!strcmp(file_name, "multi-pack-index") ||
-	    !strcmp(file_name, "multi-pack-index.d"))
+	    !strcmp(file_name, "multi-pack-index.d") ||
+	    !strcmp(file_name, "tree-cache") ||
+	    !strcmp(file_name, "delta-search-cache"))
 		return;
 	if (starts_with(file_name, "multi-pack-index") &&
 	    (ends_with(file_name, ".bitmap") || ends_with(file_name, ".rev")))
@@ -1423,7 +1427,21 @@ static enum object_type packed_to_object_type(struct repository *r,
 static struct hashmap delta_base_cache;
 static size_t delta_base_cached;
 
+/*
+ * With the "lru" policy, all entries live on the "lru" list. The
+ * "segmented" policy moves entries that were hit at least once to the
+ * "protected" list, which may hold up to DELTA_BASE_PROTECTED_SHARE of
+ * the cache; eviction drains the probationary "lru" list first. Bases
+ * which would take up more than DELTA_BASE_PROTECTED_MAX_SHARE of the
+ * cache on their own are never protected, so that a single huge base
+ * cannot push out many small hot ones.
+ */
 static LIST_HEAD(delta_base_cache_lru);
+static LIST_HEAD(delta_base_cache_protected);
+static size_t delta_base_protected;
+
+#define DELTA_BASE_PROTECTED_SHARE(limit) ((limit) / 5 * 4)
+#define DELTA_BASE_PROTECTED_MAX_SHARE(limit) ((limit) / 8)
 
 struct delta_base_cache_key {
 	struct packed_git *p;
@@ -1437,6 +1455,7 @@ struct delta_base_cache_entry {
 	void *data;
 	unsigned long size;
 	enum object_type type;
+	unsigned protected : 1;
 };
 
 static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
@@ -1502,9 +1521,49 @@ static void detach_delta_base_cache_entry(struct delta_base_cache_entry *ent)
 	hashmap_remove(&delta_base_cache, &ent->ent, &ent->key);
 	list_del(&ent->lru);
 	delta_base_cached -= ent->size;
+	if (ent->protected)
+		delta_base_protected -= ent->size;
 	free(ent);
 }
 
+/*
+ * Mark "ent" as recently used. Under the "segmented" policy, this moves
+ * it to the protected list, demoting the least recently used protected
+ * entries back to the probationary list if that overflows.
+ */
+static void touch_delta_base_cache_entry(struct repository *r,
+					 struct delta_base_cache_entry *ent)
+{
+	size_t limit = r->settings.delta_base_cache_limit;
+
+	list_del(&ent->lru);
+
+	if (r->settings.delta_base_cache_policy != DELTA_BASE_CACHE_SEGMENTED ||
+	    ent->size > DELTA_BASE_PROTECTED_MAX_SHARE(limit)) {
+		if (ent->protected)
+			list_add_tail(&ent->lru, &delta_base_cache_protected);
+		else
+			list_add_tail(&ent->lru, &delta_base_cache_lru);
+		return;
+	}
+
+	if (!ent->protected) {
+		ent->protected = 1;
+		delta_base_protected += ent->size;
+	}
+	list_add_tail(&ent->lru, &delta_base_cache_protected);
+
+	while (delta_base_protected > DELTA_BASE_PROTECTED_SHARE(limit)) {
+		struct delta_base_cache_entry *f =
+			list_first_entry(&delta_base_cache_protected,
+					 struct delta_base_cache_entry, lru);
+		list_del(&f->lru);
+		f->protected = 0;
+		delta_base_protected -= f->size;
+		list_add_tail(&f->lru, &delta_base_cache_lru);
+	}
+}
+
 static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
 				   off_t base_offset, unsigned long *base_size,
 				   enum object_type *type)
@@ -1515,6 +1574,10 @@ static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
 	if (!ent)
 		return unpack_entry(r, p, base_offset, type, base_size);
 
+	trace2_counter_add(TRACE2_COUNTER_ID_DELTA_BASE_CACHE_HITS, 1);
+	prepare_repo_settings(p->repo);
+	touch_delta_base_cache_entry(p->repo, ent);
+
 	if (type)
 		*type = ent->type;
 	if (base_size)
@@ -1536,15 +1599,39 @@ void clear_delta_base_cache(void)
 			list_entry(lru, struct delta_base_cache_entry, lru);
 		release_delta_base_cache(entry);
 	}
+	list_for_each_safe(lru, tmp, &delta_base_cache_protected) {
+		struct delta_base_cache_entry *entry =
+			list_entry(lru, struct delta_base_cache_entry, lru);
+		release_delta_base_cache(entry);
+	}
 }
 
+static void prune_delta_base_cache(struct list_head *list,
+				   unsigned long delta_base_cache_limit)
+{
+	struct list_head *lru, *tmp;
+
+	list_for_each_safe(lru, tmp, list) {
+		struct delta_base_cache_entry *f =
+			list_entry(lru, struct delta_base_cache_entry, lru);
+		if (delta_base_cached <= delta_base_cache_limit)
+			break;
+		trace2_counter_add(TRACE2_COUNTER_ID_DELTA_BASE_CACHE_EVICTIONS, 1);
+		release_delta_base_cache(f);
+	}
+}
+
+/*
+ * Add "base" to the cache, which takes ownership of it. If "hit" is
+ * set, the base was taken out of the cache by unpack_entry() and is
+ * now being put back, which counts as a use of the entry.
+ */
 static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 				 void *base, unsigned long base_size,
 				 unsigned long delta_base_cache_limit,
-				 enum object_type type)
+				 enum object_type type, int hit)
 {
 	struct delta_base_cache_entry *ent;
-	struct list_head *lru, *tmp;
 
 	/*
 	 * Check required to avoid redundant entries when more than one thread
@@ -1558,13 +1645,8 @@ static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 
 	delta_base_cached += base_size;
 
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
-		struct delta_base_cache_entry *f =
-			list_entry(lru, struct delta_base_cache_entry, lru);
-		if (delta_base_cached <= delta_base_cache_limit)
-			break;
-		release_delta_base_cache(f);
-	}
+	prune_delta_base_cache(&delta_base_cache_lru, delta_base_cache_limit);
+	prune_delta_base_cache(&delta_base_cache_protected, delta_base_cache_limit);
 
 	ent = xmalloc(sizeof(*ent));
 	ent->key.p = p;
@@ -1572,7 +1654,10 @@ static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	ent->type = type;
 	ent->data = base;
 	ent->size = base_size;
+	ent->protected = 0;
 	list_add_tail(&ent->lru, &delta_base_cache_lru);
+	if (hit)
+		touch_delta_base_cache_entry(p->repo, ent);
 
 	if (!delta_base_cache.cmpfn)
 		hashmap_init(&delta_base_cache, delta_base_cache_hash_cmp, NULL, 0);
@@ -1723,8 +1808,144 @@ struct unpack_entry_stack_ent {
 	off_t obj_offset;
 	off_t curpos;
 	unsigned long size;
+	void *delta_data;
+};
+
+/*
+ * Do not bother starting threads for chains shorter than this; the
+ * thread setup would cost more than inflating a few small deltas.
+ */
+#define UNPACK_ENTRY_PARALLEL_MIN_DEPTH 8
+
+struct inflate_delta_job {
+	struct pack_window *w_curs;
+	const unsigned char *in;
+	unsigned long avail_in;
+	unsigned long size;
+	void **out;
+};
+
+struct inflate_delta_data {
+	pthread_t thread;
+	struct inflate_delta_job *jobs;
+	int nr;
+	int *next;
+	pthread_mutex_t *mutex;
 };
 
+/*
+ * Inflate a single delta from a pinned pack window. Unlike
+ * unpack_compressed_entry(), we do not call use_pack() here: the whole
+ * stream must fit into the window we were handed, otherwise we give up
+ * and let the serial path in unpack_entry() deal with it.
+ */
+static void *inflate_delta_job(struct inflate_delta_job *job)
+{
+	git_zstream stream;
+	unsigned char *buffer;
+	int st;
+
+	buffer = xmallocz_gently(job->size);
+	if (!buffer)
+		return NULL;
+	memset(&stream, 0, sizeof(stream));
+	stream.next_in = (unsigned char *)job->in;
+	stream.avail_in = job->avail_in;
+	stream.next_out = buffer;
+	stream.avail_out = job->size + 1;
+
+	git_inflate_init(&stream);
+	st = git_inflate(&stream, Z_FINISH);
+	git_inflate_end(&stream);
+	if (st != Z_STREAM_END || stream.total_out != job->size) {
+		free(buffer);
+		return NULL;
+	}
+	buffer[job->size] = '\0';
+	return buffer;
+}
+
+static void *inflate_delta_thread(void *_data)
+{
+	struct inflate_delta_data *data = _data;
+
+	for (;;) {
+		int i;
+
+		pthread_mutex_lock(data->mutex);
+		i = (*data->next)++;
+		pthread_mutex_unlock(data->mutex);
+		if (i >= data->nr)
+			break;
+		*data->jobs[i].out = inflate_delta_job(&data->jobs[i]);
+	}
+	return NULL;
+}
+
+/*
+ * Inflate all of the deltas on the stack in parallel, leaving the
+ * results in each entry's "delta_data". The inflation of each delta is
+ * independent of the others; only applying them has to happen in
+ * order. Entries we could not inflate here are left NULL and will be
+ * retried serially by the caller, which also takes care of reporting
+ * any errors.
+ *
+ * Must be called with the obj_read_lock held (if enabled). The lock is
+ * dropped while the workers run, with every window they read from
+ * pinned through its own cursor.
+ */
+static void inflate_delta_chain(struct packed_git *p,
+				struct unpack_entry_stack_ent *delta_stack,
+				int delta_stack_nr, int nr_threads)
+{
+	struct inflate_delta_job *jobs;
+	struct inflate_delta_data *data;
+	pthread_mutex_t mutex;
+	int i, next = 0;
+
+	CALLOC_ARRAY(jobs, delta_stack_nr);
+	for (i = 0; i < delta_stack_nr; i++) {
+		jobs[i].in = use_pack(p, &jobs[i].w_curs,
+				      delta_stack[i].curpos, &jobs[i].avail_in);
+		jobs[i].size = delta_stack[i].size;
+		jobs[i].out = &delta_stack[i].delta_data;
+	}
+
+	if (nr_threads > delta_stack_nr)
+		nr_threads = delta_stack_nr;
+
+	pthread_mutex_init(&mutex, NULL);
+	CALLOC_ARRAY(data, nr_threads);
+
+	obj_read_unlock();
+	for (i = 0; i < nr_threads; i++) {
+		data[i].jobs = jobs;
+		data[i].nr = delta_stack_nr;
+		data[i].next = &next;
+		data[i].mutex = &mutex;
+		/* the calling thread takes a share of the work, too */
+		if (!i)
+			continue;
+		if (pthread_create(&data[i].thread, NULL,
+				   inflate_delta_thread, &data[i])) {
+			warning(_("unable to create delta inflation thread"));
+			nr_threads = i;
+			break;
+		}
+	}
+	inflate_delta_thread(&data[0]);
+	for (i = 1; i < nr_threads; i++)
+		pthread_join(data[i].thread, NULL);
+	obj_read_lock();
+
+	for (i = 0; i < delta_stack_nr; i++)
+		unuse_pack(&jobs[i].w_curs);
+
+	pthread_mutex_destroy(&mutex);
+	free(data);
+	free(jobs);
+}
+
 void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		   enum object_type *final_type, unsigned long *final_size)
 {
@@ -1750,6 +1971,7 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		ent = get_delta_base_cache_entry(p, curpos);
 		if (ent) {
+			trace2_counter_add(TRACE2_COUNTER_ID_DELTA_BASE_CACHE_HITS, 1);
 			type = ent->type;
 			data = ent->data;
 			size = ent->size;
@@ -1757,6 +1979,7 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 			base_from_cache = 1;
 			break;
 		}
+		trace2_counter_add(TRACE2_COUNTER_ID_DELTA_BASE_CACHE_MISSES, 1);
 
 		if (do_check_packed_object_crc && p->index_version > 1) {
 			uint32_t pack_pos, index_pos;
@@ -1810,6 +2033,7 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		delta_stack[i].obj_offset = obj_offset;
 		delta_stack[i].curpos = curpos;
 		delta_stack[i].size = size;
+		delta_stack[i].delta_data = NULL;
 
 		curpos = obj_offset = base_offset;
 	}
@@ -1834,6 +2058,16 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		      type, (uintmax_t)obj_offset, p->pack_name);
 	}
 
+	/*
+	 * PHASE 2.5: inflate the deltas of a long chain in parallel; only
+	 * their application below has to be serialized.
+	 */
+	if (HAVE_THREADS && data &&
+	    p->repo->settings.delta_chain_threads > 1 &&
+	    delta_stack_nr >= UNPACK_ENTRY_PARALLEL_MIN_DEPTH)
+		inflate_delta_chain(p, delta_stack, delta_stack_nr,
+				    p->repo->settings.delta_chain_threads);
+
 	/* PHASE 3: apply deltas in order */
 
 	/* invariants:
@@ -1884,11 +2118,16 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		obj_offset = delta_stack[i].obj_offset;
 		curpos = delta_stack[i].curpos;
 		delta_size = delta_stack[i].size;
+		delta_data = delta_stack[i].delta_data;
 
-		if (!base)
+		if (!base) {
+			free(delta_data);
 			continue;
+		}
 
-		delta_data = unpack_compressed_entry(p, &w_curs, curpos, delta_size);
+		if (!delta_data)
+			delta_data = unpack_compressed_entry(p, &w_curs, curpos,
+							     delta_size);
 
 		if (!delta_data) {
 			error("failed to unpack compressed delta "
@@ -1923,7 +2162,8 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		if (!external_base)
 			add_delta_base_cache(p, base_obj_offset, base, base_size,
 					     p->repo->settings.delta_base_cache_limit,
-					     type);
+					     type, base_from_cache);
+		base_from_cache = 0;
 
 		free(delta_data);
 		free(external_base);
@@ -2522,7 +2762,8 @@ static int close_istream_pack_non_delta(struct odb_read_stream *_st)
 
 int packfile_store_read_object_stream(struct odb_read_stream **out,
 				      struct packfile_store *store,
-				      const struct object_id *oid)
+				      const struct object_id *oid,
+				      int any_size)
 {
 	struct odb_packed_read_stream *stream;
 	struct pack_window *window = NULL;
@@ -2532,9 +2773,15 @@ int packfile_store_read_object_stream(struct odb_read_stream **out,
 
 	oi.sizep = &size;
 
+	/*
+	 * Objects found in the delta base cache do not report where they
+	 * are stored, but are cheap to read in-core anyway.
+	 */
 	if (packfile_store_read_object_info(store, oid, &oi, 0) ||
+	    oi.whence != OI_PACKED ||
 	    oi.u.packed.is_delta ||
-	    repo_settings_get_big_file_threshold(store->odb->repo) >= size)
+	    (!any_size &&
+	     repo_settings_get_big_file_threshold(store->odb->repo) >= size))
 		return -1;
 
 	in_pack_type = unpack_object_header(oi.u.packed.pack,
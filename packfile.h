@@ -178,9 +178,15 @@ void packfile_store_add_pack(struct packfile_store *store,
 	for (struct packfile_list_entry *e = packfile_store_get_packs(repo->objects->packfiles); \
 	     ((p) = (e ? e->pack : NULL)); e = e->next)
 
+/*
+ * Open a stream for an object that is stored undeltified in one of the
+ * packs. Unless `any_size` is set, this is only done for objects larger
+ * than core.bigFileThreshold. Returns 0 on success, -1 otherwise.
+ */
 int packfile_store_read_object_stream(struct odb_read_stream **out,
 				      struct packfile_store *store,
-				      const struct object_id *oid);
+				      const struct object_id *oid,
+				      int any_size);
 
 /*
  * Try to read the object identified by its ID from the object store and
@@ -33,6 +33,8 @@
 #include "commit-reach.h"
 #include "worktree.h"
 #include "hashmap.h"
+#include "replace-object.h"
+#include "thread-utils.h"
 
 static struct ref_msg {
 	const char *gone;
@@ -83,6 +85,20 @@ struct ref_trailer_buf {
 	struct strbuf kvsepbuf;
 };
 
+/*
+ * An object read by a worker thread of prefetch_ref_values() so that
+ * populate_value() does not have to read it itself.
+ */
+struct prefetched_object {
+	struct object_id oid;
+	enum object_type type;
+	unsigned long size;
+	off_t disk_size;
+	struct object_id delta_base_oid;
+	void *content;
+	unsigned valid : 1;
+};
+
 static struct expand_data {
 	struct object_id oid;
 	enum object_type type;
@@ -93,6 +109,12 @@ static struct expand_data {
 
 	struct object *maybe_object;
 	struct object_info info;
+
+	/*
+	 * The object as read ahead of time, if any. It is only used if it
+	 * has the same object ID as `oid`.
+	 */
+	struct prefetched_object *prefetched;
 } oi, oi_deref;
 
 struct ref_to_worktree_entry {
@@ -2375,8 +2397,20 @@ static int get_object(struct ref_array_item *ref, int deref,
 		oi->info.typep = &oi->type;
 	}
 
-	if (odb_read_object_info_extended(the_repository->objects, &oi->oid, &oi->info,
-					  OBJECT_INFO_LOOKUP_REPLACE)) {
+	if (oi->prefetched && oi->prefetched->valid &&
+	    oideq(&oi->prefetched->oid, &oi->oid)) {
+		struct prefetched_object *p = oi->prefetched;
+
+		oi->type = p->type;
+		oi->size = p->size;
+		oi->disk_size = p->disk_size;
+		oidcpy(&oi->delta_base_oid, &p->delta_base_oid);
+		/* The content is ours now. */
+		oi->content = p->content;
+		p->content = NULL;
+		p->valid = 0;
+	} else if (odb_read_object_info_extended(the_repository->objects, &oi->oid,
+						 &oi->info, OBJECT_INFO_LOOKUP_REPLACE)) {
 		ret = strbuf_addf_ret(err, -1, _("missing object %s for %s"),
 				      oid_to_hex(&oi->oid), ref->refname);
 		goto out;
@@ -3485,53 +3519,84 @@ static int memcasecmp(const void *vs1, const void *vs2, size_t n)
 	return 0;
 }
 
-static int cmp_ref_sorting(struct ref_sorting *s, struct ref_array_item *a, struct ref_array_item *b)
+/*
+ * The values of a ref that it is sorted by, extracted once before
+ * sorting so that comparisons do not have to look them up again.
+ */
+struct ref_sort_key {
+	const char *s;
+	ssize_t s_size;
+	size_t len;
+	uintmax_t value;
+	struct version_key version;
+};
+
+struct ref_sort_entry {
+	struct ref_array_item *item;
+	struct ref_sort_key *keys; /* one per sorting criterion */
+};
+
+static void init_ref_sort_keys(struct ref_sorting *sorting,
+			       struct ref_array_item *item,
+			       struct ref_sort_key *keys)
+{
+	struct strbuf err = STRBUF_INIT;
+
+	for (; sorting; sorting = sorting->next, keys++) {
+		struct atom_value *v;
+
+		if (get_ref_atom_value(item, sorting->atom, &v, &err))
+			die("%s", err.buf);
+
+		keys->s = v->s;
+		keys->s_size = v->s_size;
+		keys->len = v->s_size < 0 ? strlen(v->s) : v->s_size;
+		keys->value = v->value;
+		if (sorting->sort_flags & REF_SORTING_VERSION)
+			version_key_init(&keys->version, v->s);
+	}
+
+	strbuf_release(&err);
+}
+
+static int cmp_ref_sorting(struct ref_sorting *s,
+			   struct ref_array_item *a, struct ref_sort_key *ka,
+			   struct ref_array_item *b, struct ref_sort_key *kb)
 {
-	struct atom_value *va, *vb;
 	int cmp;
 	int cmp_detached_head = 0;
 	cmp_type cmp_type = used_atom[s->atom].type;
-	struct strbuf err = STRBUF_INIT;
 
-	if (get_ref_atom_value(a, s->atom, &va, &err))
-		die("%s", err.buf);
-	if (get_ref_atom_value(b, s->atom, &vb, &err))
-		die("%s", err.buf);
-	strbuf_release(&err);
 	if (s->sort_flags & REF_SORTING_DETACHED_HEAD_FIRST &&
 	    ((a->kind | b->kind) & FILTER_REFS_DETACHED_HEAD)) {
 		cmp = compare_detached_head(a, b);
 		cmp_detached_head = 1;
 	} else if (s->sort_flags & REF_SORTING_VERSION) {
-		cmp = versioncmp(va->s, vb->s);
+		cmp = versioncmp_key(&ka->version, &kb->version);
 	} else if (cmp_type == FIELD_STR) {
-		if (va->s_size < 0 && vb->s_size < 0) {
+		if (ka->s_size < 0 && kb->s_size < 0) {
 			int (*cmp_fn)(const char *, const char *);
 			cmp_fn = s->sort_flags & REF_SORTING_ICASE
 				? strcasecmp : strcmp;
-			cmp = cmp_fn(va->s, vb->s);
+			cmp = cmp_fn(ka->s, kb->s);
 		} else {
-			size_t a_size = va->s_size < 0 ?
-					strlen(va->s) : va->s_size;
-			size_t b_size = vb->s_size < 0 ?
-					strlen(vb->s) : vb->s_size;
 			int (*cmp_fn)(const void *, const void *, size_t);
 			cmp_fn = s->sort_flags & REF_SORTING_ICASE
 				? memcasecmp : memcmp;
 
-			cmp = cmp_fn(va->s, vb->s, b_size > a_size ?
-				     a_size : b_size);
+			cmp = cmp_fn(ka->s, kb->s, kb->len > ka->len ?
+				     ka->len : kb->len);
 			if (!cmp) {
-				if (a_size > b_size)
+				if (ka->len > kb->len)
 					cmp = 1;
-				else if (a_size < b_size)
+				else if (ka->len < kb->len)
 					cmp = -1;
 			}
 		}
 	} else {
-		if (va->value < vb->value)
+		if (ka->value < kb->value)
 			cmp = -1;
-		else if (va->value == vb->value)
+		else if (ka->value == kb->value)
 			cmp = 0;
 		else
 			cmp = 1;
@@ -3543,19 +3608,21 @@ static int cmp_ref_sorting(struct ref_sorting *s, struct ref_array_item *a, stru
 
 static int compare_refs(const void *a_, const void *b_, void *ref_sorting)
 {
-	struct ref_array_item *a = *((struct ref_array_item **)a_);
-	struct ref_array_item *b = *((struct ref_array_item **)b_);
+	const struct ref_sort_entry *a = a_;
+	const struct ref_sort_entry *b = b_;
 	struct ref_sorting *s;
+	size_t i;
 
-	for (s = ref_sorting; s; s = s->next) {
-		int cmp = cmp_ref_sorting(s, a, b);
+	for (s = ref_sorting, i = 0; s; s = s->next, i++) {
+		int cmp = cmp_ref_sorting(s, a->item, &a->keys[i],
+					  b->item, &b->keys[i]);
 		if (cmp)
 			return cmp;
 	}
 	s = ref_sorting;
 	return s && s->sort_flags & REF_SORTING_ICASE ?
-		strcasecmp(a->refname, b->refname) :
-		strcmp(a->refname, b->refname);
+		strcasecmp(a->item->refname, b->item->refname) :
+		strcmp(a->item->refname, b->item->refname);
 }
 
 void ref_sorting_set_sort_flags_all(struct ref_sorting *sorting,
@@ -3569,10 +3636,233 @@ void ref_sorting_set_sort_flags_all(struct ref_sorting *sorting,
 	}
 }
 
+/*
+ * Sorting by anything but the refname populates the values of all refs,
+ * which reads their objects one by one. With many refs this is dominated
+ * by inflating objects, so we read them ahead of time with a pool of
+ * threads in windows of REF_PREFETCH_WINDOW refs. The objects are then
+ * parsed and their values populated by the main thread, because parsing
+ * objects is not thread-safe.
+ */
+#define REF_PREFETCH_MIN_REFS 256
+#define REF_PREFETCH_WINDOW 4096
+
+struct ref_prefetch_slot {
+	struct prefetched_object obj;
+	struct prefetched_object deref;
+};
+
+struct ref_prefetch_thread {
+	pthread_t thread;
+	struct ref_array_item **items;
+	struct ref_prefetch_slot *slots;
+	size_t nr, offset, stride;
+};
+
+static void prefetch_object(struct prefetched_object *p,
+			    const struct object_id *oid,
+			    const struct object_info *want)
+{
+	struct object_info info = OBJECT_INFO_INIT;
+
+	info.typep = &p->type;
+	info.sizep = &p->size;
+	if (want->disk_sizep)
+		info.disk_sizep = &p->disk_size;
+	if (want->delta_base_oid)
+		info.delta_base_oid = &p->delta_base_oid;
+	if (want->contentp)
+		info.contentp = &p->content;
+
+	oidcpy(&p->oid, oid);
+	p->valid = !odb_read_object_info_extended(the_repository->objects, oid,
+						  &info, OBJECT_INFO_LOOKUP_REPLACE);
+}
+
+/*
+ * Find out which object the tag in `buf` points to without parsing it
+ * into a "struct tag", which would not be thread-safe.
+ */
+static int parse_tagged_object(const char *buf, struct object_id *oid,
+			       enum object_type *type)
+{
+	const char *p, *eol;
+
+	if (!skip_prefix(buf, "object ", &p) ||
+	    parse_oid_hex(p, oid, &p) || *p++ != '\n' ||
+	    !skip_prefix(p, "type ", &p) ||
+	    !(eol = strchr(p, '\n')))
+		return -1;
+	*type = type_from_string_gently(p, eol - p, 1);
+	return *type < 0 ? -1 : 0;
+}
+
+static void prefetch_ref_objects(struct ref_array_item *ref,
+				 struct ref_prefetch_slot *slot)
+{
+	struct object_id deref_oid;
+	enum object_type deref_type = OBJ_NONE;
+
+	prefetch_object(&slot->obj, &ref->objectname, &oi.info);
+	if (!need_tagged || !slot->obj.valid || slot->obj.type != OBJ_TAG)
+		return;
+
+	/*
+	 * Tags of tags need to be peeled recursively, which we leave to
+	 * populate_value().
+	 */
+	if (!is_null_oid(&ref->peeled_oid))
+		oidcpy(&deref_oid, &ref->peeled_oid);
+	else if (parse_tagged_object(slot->obj.content, &deref_oid, &deref_type) ||
+		 deref_type == OBJ_TAG)
+		return;
+
+	prefetch_object(&slot->deref, &deref_oid, &oi_deref.info);
+
+	/* Let populate_value() complain about tags lying about their type. */
+	if (slot->deref.valid && deref_type != OBJ_NONE &&
+	    slot->deref.type != deref_type) {
+		FREE_AND_NULL(slot->deref.content);
+		slot->deref.valid = 0;
+	}
+}
+
+static void *prefetch_ref_objects_thread(void *data)
+{
+	struct ref_prefetch_thread *t = data;
+
+	for (size_t i = t->offset; i < t->nr; i += t->stride)
+		prefetch_ref_objects(t->items[i], &t->slots[i]);
+	return NULL;
+}
+
+static int ref_prefetch_threads(struct ref_array *array)
+{
+	int nr_threads;
+
+	if (!HAVE_THREADS)
+		return 1;
+
+	nr_threads = git_env_ulong("GIT_TEST_REF_FILTER_THREADS", 0);
+	if (nr_threads)
+		return nr_threads;
+
+	if (array->nr < REF_PREFETCH_MIN_REFS)
+		return 1;
+	return online_cpus();
+}
+
+static void prefetch_ref_values(struct ref_array *array)
+{
+	struct object_info empty = OBJECT_INFO_INIT;
+	struct ref_prefetch_thread *threads;
+	struct ref_prefetch_slot *slots;
+	struct strbuf err = STRBUF_INIT;
+	int nr_threads = ref_prefetch_threads(array);
+
+	if (nr_threads < 2)
+		return;
+
+	/* This mirrors what populate_value() wants to read. */
+	if (need_tagged)
+		oi.info.contentp = &oi.content;
+	if (!memcmp(&oi.info, &empty, sizeof(empty)))
+		return;
+
+	/*
+	 * Make sure that the worker threads do not race to lazily set up
+	 * any repository state.
+	 */
+	if (replace_refs_enabled(the_repository))
+		prepare_replace_object(the_repository);
+	odb_prepare_alternates(the_repository->objects);
+
+	CALLOC_ARRAY(threads, nr_threads);
+	CALLOC_ARRAY(slots, REF_PREFETCH_WINDOW);
+
+	for (size_t start = 0; start < array->nr; start += REF_PREFETCH_WINDOW) {
+		size_t nr = array->nr - start;
+
+		if (nr > REF_PREFETCH_WINDOW)
+			nr = REF_PREFETCH_WINDOW;
+
+		enable_obj_read_lock();
+		for (int i = 0; i < nr_threads; i++) {
+			struct ref_prefetch_thread *t = &threads[i];
+			int ret;
+
+			t->items = array->items + start;
+			t->slots = slots;
+			t->nr = nr;
+			t->offset = i;
+			t->stride = nr_threads;
+
+			ret = pthread_create(&t->thread, NULL,
+					     prefetch_ref_objects_thread, t);
+			if (ret)
+				die(_("unable to create thread: %s"), strerror(ret));
+		}
+		for (int i = 0; i < nr_threads; i++)
+			pthread_join(threads[i].thread, NULL);
+		disable_obj_read_lock();
+
+		for (size_t i = 0; i < nr; i++) {
+			struct ref_array_item *ref = array->items[start + i];
+
+			if (!ref->value) {
+				oi.prefetched = &slots[i].obj;
+				oi_deref.prefetched = &slots[i].deref;
+				if (populate_value(ref, &err))
+					die("%s", err.buf);
+				fill_missing_values(ref->value);
+			}
+
+			free(slots[i].obj.content);
+			free(slots[i].deref.content);
+		}
+		oi.prefetched = oi_deref.prefetched = NULL;
+
+		memset(slots, 0, st_mult(sizeof(*slots), nr));
+	}
+
+	free(threads);
+	free(slots);
+	strbuf_release(&err);
+}
+
 void ref_array_sort(struct ref_sorting *sorting, struct ref_array *array)
 {
-	if (sorting)
-		QSORT_S(array->items, array->nr, compare_refs, sorting);
+	struct ref_sort_entry *entries;
+	struct ref_sort_key *keys;
+	struct ref_sorting *s;
+	size_t nr_keys = 0;
+
+	if (!sorting)
+		return;
+	prefetch_ref_values(array);
+
+	/*
+	 * Extract the sort keys of all refs up front instead of looking
+	 * them up on every comparison.
+	 */
+	for (s = sorting; s; s = s->next)
+		nr_keys++;
+	ALLOC_ARRAY(entries, array->nr);
+	CALLOC_ARRAY(keys, st_mult(array->nr, nr_keys));
+	for (int i = 0; i < array->nr; i++) {
+		entries[i].item = array->items[i];
+		entries[i].keys = keys + st_mult(i, nr_keys);
+		init_ref_sort_keys(sorting, entries[i].item, entries[i].keys);
+	}
+
+	QSORT_S(entries, array->nr, compare_refs, sorting);
+
+	for (int i = 0; i < array->nr; i++)
+		array->items[i] = entries[i].item;
+	for (size_t i = 0; i < st_mult(array->nr, nr_keys); i++)
+		version_key_release(&keys[i].version);
+	free(entries);
+	free(keys);
 }
 
 static void append_literal(const char *cp, const char *ep, struct ref_formatting_state *state)
@@ -2025,6 +2025,12 @@ int refs_read_raw_ref(struct ref_store *ref_store, const char *refname,
 					   type, failure_errno);
 }
 
+void refs_read_raw_refs(struct ref_store *ref_store,
+			struct raw_ref_read *reads, size_t nr)
+{
+	ref_store->be->read_raw_refs(ref_store, reads, nr);
+}
+
 int refs_read_symbolic_ref(struct ref_store *ref_store, const char *refname,
 			   struct strbuf *referent)
 {
@@ -2120,6 +2126,85 @@ const char *refs_resolve_ref_unsafe(struct ref_store *refs,
 	return NULL;
 }
 
+static int ref_read_request_cmp(const void *a_, const void *b_)
+{
+	const struct ref_read_request *a = *(const struct ref_read_request **)a_;
+	const struct ref_read_request *b = *(const struct ref_read_request **)b_;
+	return strcmp(a->refname, b->refname);
+}
+
+void refs_read_refs(struct ref_store *refs, struct ref_read_request *requests,
+		    size_t nr, int resolve_flags)
+{
+	struct ref_read_request **sorted;
+	struct raw_ref_read *reads;
+	size_t sorted_nr = 0;
+
+	ALLOC_ARRAY(sorted, nr);
+	for (size_t i = 0; i < nr; i++) {
+		struct ref_read_request *req = &requests[i];
+
+		/*
+		 * Pseudorefs and references with bad names need the special
+		 * treatment of refs_resolve_ref_unsafe().
+		 */
+		if (is_pseudo_ref(req->refname) ||
+		    check_refname_format(req->refname, REFNAME_ALLOW_ONELEVEL)) {
+			req->result = refs_read_ref_full(refs, req->refname,
+							 resolve_flags,
+							 &req->oid, &req->flags);
+			continue;
+		}
+
+		sorted[sorted_nr++] = req;
+	}
+	QSORT(sorted, sorted_nr, ref_read_request_cmp);
+
+	CALLOC_ARRAY(reads, sorted_nr);
+	for (size_t i = 0; i < sorted_nr; i++) {
+		reads[i].refname = sorted[i]->refname;
+		strbuf_init(&reads[i].referent, 0);
+	}
+
+	refs_read_raw_refs(refs, reads, sorted_nr);
+
+	for (size_t i = 0; i < sorted_nr; i++) {
+		struct ref_read_request *req = sorted[i];
+		struct raw_ref_read *read = &reads[i];
+
+		if (!read->result && (read->type & REF_ISSYMREF)) {
+			/* Symbolic refs are rare; resolve them one by one. */
+			req->result = refs_read_ref_full(refs, req->refname,
+							 resolve_flags,
+							 &req->oid, &req->flags);
+		} else if (!read->result) {
+			oidcpy(&req->oid, &read->oid);
+			req->flags = read->type;
+			req->result = 0;
+		} else {
+			req->flags = read->type;
+			req->result = -1;
+
+			/*
+			 * As in refs_resolve_ref_unsafe(), a missing ref is
+			 * fine unless we are reading.
+			 */
+			if (!(resolve_flags & RESOLVE_REF_READING) &&
+			    (read->failure_errno == ENOENT ||
+			     read->failure_errno == EISDIR ||
+			     read->failure_errno == ENOTDIR)) {
+				oidclr(&req->oid, refs->repo->hash_algo);
+				req->result = 0;
+			}
+		}
+
+		strbuf_release(&read->referent);
+	}
+
+	free(reads);
+	free(sorted);
+}
+
 /* backend functions */
 int ref_store_create_on_disk(struct ref_store *refs, int flags, struct strbuf *err)
 {
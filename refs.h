@@ -102,6 +102,25 @@ int refs_read_ref_full(struct ref_store *refs, const char *refname,
 
 int refs_read_ref(struct ref_store *refs, const char *refname, struct object_id *oid);
 
+struct ref_read_request {
+	/* The name of the reference to read. */
+	const char *refname;
+	/* The results, as for refs_read_ref_full(). */
+	struct object_id oid;
+	int flags;
+	int result;
+};
+
+/*
+ * Read many references at once, with the same results as calling
+ * refs_read_ref_full() with `resolve_flags` for each of the `nr`
+ * requests, which may come in any order. This is considerably cheaper
+ * than reading the references one by one when there are many of them,
+ * as the backends only need a single pass over their data.
+ */
+void refs_read_refs(struct ref_store *refs, struct ref_read_request *requests,
+		    size_t nr, int resolve_flags);
+
 #define NOT_A_SYMREF -2
 
 /*
@@ -248,6 +248,30 @@ static int debug_read_raw_ref(struct ref_store *ref_store, const char *refname,
 	return res;
 }
 
+static void debug_read_raw_refs(struct ref_store *ref_store,
+				struct raw_ref_read *reads, size_t nr)
+{
+	struct debug_ref_store *drefs = (struct debug_ref_store *)ref_store;
+
+	for (size_t i = 0; i < nr; i++)
+		oidcpy(&reads[i].oid, null_oid(ref_store->repo->hash_algo));
+	drefs->refs->be->read_raw_refs(drefs->refs, reads, nr);
+
+	for (size_t i = 0; i < nr; i++) {
+		struct raw_ref_read *read = &reads[i];
+
+		if (read->result == 0)
+			trace_printf_key(&trace_refs, "read_raw_refs: %s: %s (=> %s) type %x: %d\n",
+					 read->refname, oid_to_hex(&read->oid),
+					 read->referent.buf, read->type, read->result);
+		else
+			trace_printf_key(&trace_refs,
+					 "read_raw_refs: %s: %d (errno %d)\n",
+					 read->refname, read->result,
+					 read->failure_errno);
+	}
+}
+
 static int debug_read_symbolic_ref(struct ref_store *ref_store, const char *refname,
 				   struct strbuf *referent)
 {
@@ -459,6 +483,7 @@ struct ref_storage_be refs_be_debug = {
 	.iterator_begin = debug_ref_iterator_begin,
 	.read_raw_ref = debug_read_raw_ref,
 	.read_symbolic_ref = debug_read_symbolic_ref,
+	.read_raw_refs = debug_read_raw_refs,
 
 	.reflog_iterator_begin = debug_reflog_iterator_begin,
 	.for_each_reflog_ent = debug_for_each_reflog_ent,
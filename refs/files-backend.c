@@ -15,6 +15,7 @@
 #include "refs-internal.h"
 #include "ref-cache.h"
 #include "packed-backend.h"
+#include "loose-snapshot.h"
 #include "../ident.h"
 #include "../iterator.h"
 #include "../dir-iterator.h"
@@ -87,8 +88,10 @@ struct files_ref_store {
 	char *gitcommondir;
 	enum log_refs_config log_all_ref_updates;
 	int prefer_symlink_refs;
+	int use_loose_snapshot;
 
 	struct ref_cache *loose;
+	struct loose_snapshot *loose_snapshot;
 
 	struct ref_store *packed_ref_store;
 };
@@ -121,6 +124,7 @@ static struct ref_store *files_ref_store_init(struct repository *repo,
 		packed_ref_store_init(repo, refs->gitcommondir, flags);
 	refs->log_all_ref_updates = repo_settings_get_log_all_ref_updates(repo);
 	repo_config_get_bool(repo, "core.prefersymlinkrefs", &refs->prefer_symlink_refs);
+	repo_config_get_bool(repo, "core.looserefscache", &refs->use_loose_snapshot);
 
 	chdir_notify_reparent("files-backend $GIT_DIR", &refs->base.gitdir);
 	chdir_notify_reparent("files-backend $GIT_COMMONDIR",
@@ -171,6 +175,7 @@ static void files_ref_store_release(struct ref_store *ref_store)
 {
 	struct files_ref_store *refs = files_downcast(ref_store, 0, "release");
 	free_ref_cache(refs->loose);
+	loose_snapshot_free(refs->loose_snapshot);
 	free(refs->gitcommondir);
 	ref_store_release(refs->packed_ref_store);
 	free(refs->packed_ref_store);
@@ -256,21 +261,25 @@ static void add_per_worktree_entries_to_dir(struct ref_dir *dir, const char *dir
 	}
 }
 
-static void loose_fill_ref_dir_regular_file(struct files_ref_store *refs,
-					    const char *refname,
-					    struct ref_dir *dir)
+/*
+ * Read the loose reference refname into dir. Returns the flags of the
+ * reference and stores its object ID in oid.
+ */
+static int loose_fill_ref_dir_regular_file(struct files_ref_store *refs,
+					   const char *refname,
+					   struct ref_dir *dir,
+					   struct object_id *oid)
 {
-	struct object_id oid;
 	int flag;
 	const char *referent = refs_resolve_ref_unsafe(&refs->base,
 						       refname,
 						       RESOLVE_REF_READING,
-						       &oid, &flag);
+						       oid, &flag);
 
 	if (!referent) {
-		oidclr(&oid, refs->base.repo->hash_algo);
+		oidclr(oid, refs->base.repo->hash_algo);
 		flag |= REF_ISBROKEN;
-	} else if (is_null_oid(&oid)) {
+	} else if (is_null_oid(oid)) {
 		/*
 		 * It is so astronomically unlikely
 		 * that null_oid is the OID of an
@@ -285,14 +294,104 @@ static void loose_fill_ref_dir_regular_file(struct files_ref_store *refs,
 	if (check_refname_format(refname, REFNAME_ALLOW_ONELEVEL)) {
 		if (!refname_is_safe(refname))
 			die("loose refname is dangerous: %s", refname);
-		oidclr(&oid, refs->base.repo->hash_algo);
+		oidclr(oid, refs->base.repo->hash_algo);
 		flag |= REF_BAD_NAME | REF_ISBROKEN;
 	}
 
 	if (!(flag & REF_ISSYMREF))
 		referent = NULL;
 
-	add_entry_to_dir(dir, create_ref_entry(refname, referent, &oid, flag));
+	add_entry_to_dir(dir, create_ref_entry(refname, referent, oid, flag));
+	return flag;
+}
+
+/*
+ * Return the snapshot of loose references if "core.looseRefsCache" is
+ * enabled, reading it on first use.
+ */
+static struct loose_snapshot *get_loose_snapshot(struct files_ref_store *refs)
+{
+	if (!refs->use_loose_snapshot)
+		return NULL;
+	if (!refs->loose_snapshot) {
+		struct strbuf path = STRBUF_INIT;
+
+		strbuf_addf(&path, "%s/loose-refs-cache", refs->base.gitdir);
+		refs->loose_snapshot = loose_snapshot_read(path.buf,
+							   refs->base.repo->hash_algo);
+		strbuf_release(&path);
+	}
+	return refs->loose_snapshot;
+}
+
+/*
+ * Read the regular file at path as loose reference refname into dir,
+ * and record it in the snapshot. Only references that are neither
+ * symbolic nor broken are recorded by value, because resolving any
+ * other reference depends on more than the contents of its own file.
+ */
+static void loose_fill_ref_dir_recorded_file(struct files_ref_store *refs,
+					     const char *refname,
+					     const char *path,
+					     struct ref_dir *dir,
+					     struct loose_snapshot_entry *entry,
+					     struct loose_snapshot_dir *sdir,
+					     time_t now)
+{
+	struct object_id oid;
+	struct stat st;
+	int lstat_ok = !lstat(path, &st) && S_ISREG(st.st_mode);
+	int flag = loose_fill_ref_dir_regular_file(refs, refname, dir, &oid);
+	int cacheable = lstat_ok && !flag;
+
+	if (entry)
+		loose_snapshot_update(refs->loose_snapshot, entry,
+				      cacheable ? &oid : NULL, &st, now);
+	else
+		loose_snapshot_add(refs->loose_snapshot, sdir,
+				   refname + strlen(sdir->dirname),
+				   cacheable ? &oid : NULL, &st, now);
+}
+
+/*
+ * Fill dir from a snapshot of the directory that is known to still be
+ * current. References whose files have changed are read again.
+ */
+static void loose_fill_ref_dir_from_snapshot(struct files_ref_store *refs,
+					     struct ref_dir *dir,
+					     const char *dirname,
+					     struct strbuf *path,
+					     struct loose_snapshot_dir *sdir,
+					     time_t now)
+{
+	struct strbuf refname = STRBUF_INIT;
+	size_t pathlen = path->len;
+
+	strbuf_addstr(&refname, dirname);
+
+	for (size_t i = 0; i < sdir->entries_nr; i++) {
+		struct loose_snapshot_entry *entry = &sdir->entries[i];
+		struct stat st;
+
+		strbuf_addstr(&refname, entry->name);
+		strbuf_addstr(path, entry->name);
+
+		if (ends_with(entry->name, "/"))
+			add_entry_to_dir(dir, create_dir_entry(dir->cache, refname.buf,
+							       refname.len));
+		else if (entry->has_oid && !lstat(path->buf, &st) &&
+			 S_ISREG(st.st_mode) && !match_stat_data(&entry->sd, &st))
+			add_entry_to_dir(dir, create_ref_entry(refname.buf, NULL,
+							       &entry->oid, 0));
+		else
+			loose_fill_ref_dir_recorded_file(refs, refname.buf, path->buf,
+							 dir, entry, sdir, now);
+
+		strbuf_setlen(&refname, strlen(dirname));
+		strbuf_setlen(path, pathlen);
+	}
+
+	strbuf_release(&refname);
 }
 
 /*
@@ -305,14 +404,34 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 {
 	struct files_ref_store *refs =
 		files_downcast(ref_store, REF_STORE_READ, "fill_ref_dir");
+	struct loose_snapshot *snapshot = get_loose_snapshot(refs);
+	struct loose_snapshot_dir *sdir = NULL;
 	DIR *d;
 	struct dirent *de;
 	int dirnamelen = strlen(dirname);
 	struct strbuf refname;
 	struct strbuf path = STRBUF_INIT;
+	time_t now = 0;
 
 	files_ref_path(refs, &path, dirname);
 
+	if (snapshot) {
+		struct stat st;
+
+		now = time(NULL);
+		if (!stat(path.buf, &st)) {
+			sdir = loose_snapshot_lookup(snapshot, dirname, &st);
+			if (sdir) {
+				loose_fill_ref_dir_from_snapshot(refs, dir, dirname,
+								 &path, sdir, now);
+				strbuf_release(&path);
+				add_per_worktree_entries_to_dir(dir, dirname);
+				return;
+			}
+			sdir = loose_snapshot_begin_dir(snapshot, dirname, &st, now);
+		}
+	}
+
 	d = opendir(path.buf);
 	if (!d) {
 		strbuf_release(&path);
@@ -337,8 +456,24 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 			add_entry_to_dir(dir,
 					 create_dir_entry(dir->cache, refname.buf,
 							  refname.len));
+			if (sdir)
+				loose_snapshot_add(snapshot, sdir,
+						   refname.buf + dirnamelen,
+						   NULL, NULL, now);
 		} else if (dtype == DT_REG) {
-			loose_fill_ref_dir_regular_file(refs, refname.buf, dir);
+			if (sdir) {
+				size_t pathlen = path.len;
+
+				strbuf_addstr(&path, de->d_name);
+				loose_fill_ref_dir_recorded_file(refs, refname.buf,
+								 path.buf, dir,
+								 NULL, sdir, now);
+				strbuf_setlen(&path, pathlen);
+			} else {
+				struct object_id oid;
+				loose_fill_ref_dir_regular_file(refs, refname.buf,
+								dir, &oid);
+			}
 		}
 		strbuf_setlen(&refname, dirnamelen);
 	}
@@ -407,7 +542,8 @@ struct fill_root_ref_data {
 static int fill_root_ref(const char *refname, void *cb_data)
 {
 	struct fill_root_ref_data *data = cb_data;
-	loose_fill_ref_dir_regular_file(data->refs, refname, data->dir);
+	struct object_id oid;
+	loose_fill_ref_dir_regular_file(data->refs, refname, data->dir, &oid);
 	return 0;
 }
 
@@ -597,6 +733,61 @@ static int files_read_raw_ref(struct ref_store *ref_store, const char *refname,
 	return read_ref_internal(ref_store, refname, oid, referent, type, failure_errno, 0);
 }
 
+static void files_read_raw_refs(struct ref_store *ref_store,
+				struct raw_ref_read *reads, size_t nr)
+{
+	struct files_ref_store *refs =
+		files_downcast(ref_store, REF_STORE_READ, "read_raw_refs");
+	struct raw_ref_read *packed_reads = NULL;
+	size_t *packed_index = NULL;
+	size_t packed_nr = 0, packed_alloc = 0, packed_index_alloc = 0;
+
+	/*
+	 * Read the loose references first. Those that do not exist are
+	 * then looked up in the packed-refs in a single batch, which
+	 * remains sorted.
+	 */
+	for (size_t i = 0; i < nr; i++) {
+		struct raw_ref_read *read = &reads[i];
+
+		read->result = read_ref_internal(ref_store, read->refname,
+						 &read->oid, &read->referent,
+						 &read->type,
+						 &read->failure_errno, 1);
+		if (read->result &&
+		    (read->failure_errno == ENOENT ||
+		     read->failure_errno == EISDIR)) {
+			ALLOC_GROW(packed_reads, packed_nr + 1, packed_alloc);
+			ALLOC_GROW(packed_index, packed_nr + 1, packed_index_alloc);
+			packed_index[packed_nr] = i;
+			packed_reads[packed_nr].refname = read->refname;
+			strbuf_init(&packed_reads[packed_nr].referent, 0);
+			packed_nr++;
+		}
+	}
+
+	if (!packed_nr)
+		return;
+
+	refs_read_raw_refs(refs->packed_ref_store, packed_reads, packed_nr);
+
+	for (size_t i = 0; i < packed_nr; i++) {
+		struct raw_ref_read *read = &reads[packed_index[i]];
+		struct raw_ref_read *packed = &packed_reads[i];
+
+		if (!packed->result) {
+			oidcpy(&read->oid, &packed->oid);
+			read->type = packed->type;
+			read->failure_errno = 0;
+			read->result = 0;
+		}
+		strbuf_release(&packed->referent);
+	}
+
+	free(packed_reads);
+	free(packed_index);
+}
+
 static int files_read_symbolic_ref(struct ref_store *ref_store, const char *refname,
 				   struct strbuf *referent)
 {
@@ -1042,6 +1233,9 @@ static struct ref_iterator *files_ref_iterator_begin(
 	loose_iter = cache_ref_iterator_begin(get_loose_ref_cache(refs, flags),
 					      prefix, ref_store->repo, 1);
 
+	/* Priming has read all directories we need, so save what we learned. */
+	loose_snapshot_write(refs->loose_snapshot);
+
 	/*
 	 * The packed-refs file might contain broken references, for
 	 * example an old version of a reference that points at an
@@ -1389,11 +1583,18 @@ static int should_pack_refs(struct files_ref_store *refs,
 	size_t packed_size;
 	size_t refcount = 0;
 	size_t limit;
+	bool required;
 	int ret;
 
 	if (!(opts->flags & REFS_OPTIMIZE_AUTO))
 		return 1;
 
+	/* Fold a packed-refs overlay back into the packed-refs file: */
+	if (refs_optimize_required(refs->packed_ref_store, opts, &required) < 0)
+		die("cannot determine whether packed-refs need to be optimized");
+	if (required)
+		return 1;
+
 	ret = packed_refs_size(refs->packed_ref_store, &packed_size);
 	if (ret < 0)
 		die("cannot determine packed-refs size");
@@ -1504,6 +1705,9 @@ static int files_optimize(struct ref_store *ref_store,
 
 	ref_transaction_free(transaction);
 
+	if (refs_optimize(refs->packed_ref_store, opts))
+		die("unable to optimize packed-refs");
+
 	packed_refs_unlock(refs->packed_ref_store);
 
 	prune_refs(refs, &refs_to_prune);
@@ -3999,6 +4203,7 @@ struct ref_storage_be refs_be_files = {
 	.iterator_begin = files_ref_iterator_begin,
 	.read_raw_ref = files_read_raw_ref,
 	.read_symbolic_ref = files_read_symbolic_ref,
+	.read_raw_refs = files_read_raw_refs,
 
 	.reflog_iterator_begin = files_reflog_iterator_begin,
 	.for_each_reflog_ent = files_for_each_reflog_ent,
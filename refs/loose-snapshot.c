@@ -0,0 +1,339 @@
+#include "../git-compat-util.h"
+#include "../hex.h"
+#include "../lockfile.h"
+#include "../strbuf.h"
+#include "../strmap.h"
+#include "loose-snapshot.h"
+
+/*
+ * The snapshot file is a text file starting with LOOSE_SNAPSHOT_HEADER,
+ * followed by one block per directory:
+ *
+ *   d <stat data> <dirname>
+ *   s <name of subdirectory, ending with '/'>
+ *   f <name of a reference that is not recorded by value>
+ *   r <object ID> <stat data> <name of a regular reference>
+ *
+ * where <stat data> is the ctime (seconds and nanoseconds), mtime
+ * (ditto), device, inode, uid, gid and size, separated by spaces.
+ */
+#define LOOSE_SNAPSHOT_HEADER "# loose-refs snapshot v1\n"
+
+struct loose_snapshot {
+	char *path;
+	const struct git_hash_algo *algop;
+	struct strmap dirs;
+	int dirty;
+};
+
+static void clear_dir_entries(struct loose_snapshot_dir *dir)
+{
+	for (size_t i = 0; i < dir->entries_nr; i++)
+		free(dir->entries[i].name);
+	FREE_AND_NULL(dir->entries);
+	dir->entries_nr = dir->entries_alloc = 0;
+}
+
+static void free_dir(struct loose_snapshot_dir *dir)
+{
+	if (!dir)
+		return;
+	clear_dir_entries(dir);
+	free(dir->dirname);
+	free(dir);
+}
+
+static void clear_dirs(struct loose_snapshot *snapshot)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(&snapshot->dirs, &iter, e)
+		free_dir(e->value);
+	strmap_clear(&snapshot->dirs, 0);
+}
+
+static struct loose_snapshot_entry *append_entry(struct loose_snapshot_dir *dir,
+						 const char *name)
+{
+	struct loose_snapshot_entry *entry;
+
+	ALLOC_GROW(dir->entries, dir->entries_nr + 1, dir->entries_alloc);
+	entry = &dir->entries[dir->entries_nr++];
+	memset(entry, 0, sizeof(*entry));
+	entry->name = xstrdup(name);
+	return entry;
+}
+
+static int parse_stat_data(const char *p, struct stat_data *sd,
+			   const char **end)
+{
+	unsigned long v[9];
+	char *e;
+
+	for (size_t i = 0; i < ARRAY_SIZE(v); i++) {
+		if (*p != ' ')
+			return -1;
+		errno = 0;
+		v[i] = strtoul(p + 1, &e, 10);
+		if (errno || e == p + 1)
+			return -1;
+		p = e;
+	}
+	if (*p++ != ' ')
+		return -1;
+
+	sd->sd_ctime.sec = v[0];
+	sd->sd_ctime.nsec = v[1];
+	sd->sd_mtime.sec = v[2];
+	sd->sd_mtime.nsec = v[3];
+	sd->sd_dev = v[4];
+	sd->sd_ino = v[5];
+	sd->sd_uid = v[6];
+	sd->sd_gid = v[7];
+	sd->sd_size = v[8];
+	*end = p;
+	return 0;
+}
+
+static int parse_snapshot(struct loose_snapshot *snapshot, char *buf)
+{
+	struct loose_snapshot_dir *dir = NULL;
+	char *line, *eol;
+
+	if (!skip_prefix(buf, LOOSE_SNAPSHOT_HEADER, (const char **)&line))
+		return -1;
+
+	for (; *line; line = eol + 1) {
+		struct loose_snapshot_entry *entry;
+		const char *p;
+
+		eol = strchrnul(line, '\n');
+		if (!*eol)
+			return -1;
+		*eol = '\0';
+
+		switch (*line) {
+		case 'd':
+			CALLOC_ARRAY(dir, 1);
+			if (parse_stat_data(line + 1, &dir->sd, &p) || !*p) {
+				free(dir);
+				return -1;
+			}
+			dir->dirname = xstrdup(p);
+			free_dir(strmap_put(&snapshot->dirs, dir->dirname, dir));
+			break;
+		case 's':
+		case 'f':
+			if (!dir || line[1] != ' ' || !line[2])
+				return -1;
+			append_entry(dir, line + 2);
+			break;
+		case 'r': {
+			struct object_id oid;
+			struct stat_data sd;
+
+			if (!dir || line[1] != ' ' ||
+			    parse_oid_hex_algop(line + 2, &oid, &p, snapshot->algop) ||
+			    parse_stat_data(p, &sd, &p) || !*p)
+				return -1;
+			entry = append_entry(dir, p);
+			entry->has_oid = 1;
+			oidcpy(&entry->oid, &oid);
+			entry->sd = sd;
+			break;
+		}
+		default:
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+struct loose_snapshot *loose_snapshot_read(const char *path,
+					   const struct git_hash_algo *algop)
+{
+	struct loose_snapshot *snapshot;
+	struct strbuf buf = STRBUF_INIT;
+
+	CALLOC_ARRAY(snapshot, 1);
+	snapshot->path = xstrdup(path);
+	snapshot->algop = algop;
+	strmap_init(&snapshot->dirs);
+
+	if (strbuf_read_file(&buf, path, 0) >= 0 &&
+	    parse_snapshot(snapshot, buf.buf) < 0) {
+		/* Start afresh, overwriting the corrupt file. */
+		clear_dirs(snapshot);
+		strmap_init(&snapshot->dirs);
+		snapshot->dirty = 1;
+	}
+
+	strbuf_release(&buf);
+	return snapshot;
+}
+
+static void write_stat_data(FILE *out, const struct stat_data *sd)
+{
+	fprintf(out, " %u %u %u %u %u %u %u %u %u ",
+		sd->sd_ctime.sec, sd->sd_ctime.nsec,
+		sd->sd_mtime.sec, sd->sd_mtime.nsec,
+		sd->sd_dev, sd->sd_ino, sd->sd_uid, sd->sd_gid,
+		sd->sd_size);
+}
+
+static int dir_cmp(const void *a_, const void *b_)
+{
+	const struct loose_snapshot_dir *a = *(const struct loose_snapshot_dir **)a_;
+	const struct loose_snapshot_dir *b = *(const struct loose_snapshot_dir **)b_;
+	return strcmp(a->dirname, b->dirname);
+}
+
+void loose_snapshot_write(struct loose_snapshot *snapshot)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct loose_snapshot_dir **dirs;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	size_t nr = 0;
+	FILE *out;
+
+	if (!snapshot || !snapshot->dirty)
+		return;
+
+	/*
+	 * Another process may be writing the snapshot right now. There is
+	 * no point in waiting for it.
+	 */
+	if (hold_lock_file_for_update(&lock, snapshot->path, 0) < 0)
+		return;
+	out = fdopen_lock_file(&lock, "w");
+	if (!out)
+		goto fail;
+
+	ALLOC_ARRAY(dirs, strmap_get_size(&snapshot->dirs));
+	strmap_for_each_entry(&snapshot->dirs, &iter, e)
+		dirs[nr++] = e->value;
+	QSORT(dirs, nr, dir_cmp);
+
+	fputs(LOOSE_SNAPSHOT_HEADER, out);
+	for (size_t i = 0; i < nr; i++) {
+		struct loose_snapshot_dir *dir = dirs[i];
+
+		fputc('d', out);
+		write_stat_data(out, &dir->sd);
+		fprintf(out, "%s\n", dir->dirname);
+
+		for (size_t j = 0; j < dir->entries_nr; j++) {
+			struct loose_snapshot_entry *entry = &dir->entries[j];
+
+			if (entry->has_oid) {
+				fprintf(out, "r %s", oid_to_hex(&entry->oid));
+				write_stat_data(out, &entry->sd);
+				fprintf(out, "%s\n", entry->name);
+			} else if (ends_with(entry->name, "/")) {
+				fprintf(out, "s %s\n", entry->name);
+			} else {
+				fprintf(out, "f %s\n", entry->name);
+			}
+		}
+	}
+	free(dirs);
+
+	if (commit_lock_file(&lock) < 0)
+		goto fail;
+	snapshot->dirty = 0;
+	return;
+
+fail:
+	rollback_lock_file(&lock);
+}
+
+void loose_snapshot_free(struct loose_snapshot *snapshot)
+{
+	if (!snapshot)
+		return;
+	clear_dirs(snapshot);
+	free(snapshot->path);
+	free(snapshot);
+}
+
+/*
+ * Whether the file or directory might be modified again without its
+ * stat data changing, because the resolution of its timestamps is too
+ * coarse. We leave a second of slack so that filesystems whose
+ * timestamps lag behind the system clock are covered, too. The ctime
+ * is checked as well because the mtime may have been set explicitly.
+ */
+static int is_racy(struct stat *st, time_t now)
+{
+	time_t changed = st->st_mtime > st->st_ctime ? st->st_mtime : st->st_ctime;
+	return changed + 1 >= now;
+}
+
+struct loose_snapshot_dir *loose_snapshot_lookup(struct loose_snapshot *snapshot,
+						 const char *dirname,
+						 struct stat *st)
+{
+	struct loose_snapshot_dir *dir = strmap_get(&snapshot->dirs, dirname);
+
+	if (!dir || match_stat_data(&dir->sd, st))
+		return NULL;
+	return dir;
+}
+
+struct loose_snapshot_dir *loose_snapshot_begin_dir(struct loose_snapshot *snapshot,
+						    const char *dirname,
+						    struct stat *st, time_t now)
+{
+	struct loose_snapshot_dir *dir;
+
+	if (is_racy(st, now)) {
+		dir = strmap_get(&snapshot->dirs, dirname);
+		if (dir) {
+			free_dir(dir);
+			strmap_remove(&snapshot->dirs, dirname, 0);
+			snapshot->dirty = 1;
+		}
+		return NULL;
+	}
+
+	dir = strmap_get(&snapshot->dirs, dirname);
+	if (dir) {
+		clear_dir_entries(dir);
+	} else {
+		CALLOC_ARRAY(dir, 1);
+		dir->dirname = xstrdup(dirname);
+		strmap_put(&snapshot->dirs, dir->dirname, dir);
+	}
+	fill_stat_data(&dir->sd, st);
+	snapshot->dirty = 1;
+	return dir;
+}
+
+void loose_snapshot_update(struct loose_snapshot *snapshot,
+			   struct loose_snapshot_entry *entry,
+			   const struct object_id *oid, struct stat *st,
+			   time_t now)
+{
+	int had_oid = entry->has_oid;
+
+	entry->has_oid = oid && st && !is_racy(st, now);
+	if (entry->has_oid) {
+		oidcpy(&entry->oid, oid);
+		fill_stat_data(&entry->sd, st);
+	}
+
+	if (entry->has_oid || had_oid)
+		snapshot->dirty = 1;
+}
+
+void loose_snapshot_add(struct loose_snapshot *snapshot,
+			struct loose_snapshot_dir *dir, const char *name,
+			const struct object_id *oid, struct stat *st,
+			time_t now)
+{
+	loose_snapshot_update(snapshot, append_entry(dir, name), oid, st, now);
+	snapshot->dirty = 1;
+}
@@ -0,0 +1,98 @@
+#ifndef REFS_LOOSE_SNAPSHOT_H
+#define REFS_LOOSE_SNAPSHOT_H
+
+#include "../hash.h"
+#include "../statinfo.h"
+
+/*
+ * A snapshot of the loose references of a "files" ref store, persisted
+ * across processes so that iterating over loose references does not
+ * have to read every directory and every reference file again.
+ *
+ * The snapshot records the stat data of each directory it has seen
+ * along with the names of its entries, and the stat data and object ID
+ * of each regular reference. Nothing is trusted blindly: a directory is
+ * only reused if it still has the recorded stat data, which means that
+ * no entries have been added, removed or renamed, and a reference is
+ * only reused if its file still has the recorded stat data. Entries
+ * that were modified too recently to tell reliably whether they
+ * changed again are not recorded.
+ *
+ * Symbolic and broken references are recorded by name only, as their
+ * values have to be resolved again every time.
+ */
+struct loose_snapshot;
+
+struct loose_snapshot_entry {
+	/* Relative to the directory; subdirectories end with a slash. */
+	char *name;
+	/* Whether `oid` and `sd` are valid. */
+	unsigned has_oid : 1;
+	struct object_id oid;
+	struct stat_data sd;
+};
+
+struct loose_snapshot_dir {
+	char *dirname;
+	struct stat_data sd;
+
+	struct loose_snapshot_entry *entries;
+	size_t entries_nr, entries_alloc;
+};
+
+/*
+ * Read the snapshot stored at `path`. A missing or corrupt file yields
+ * an empty snapshot.
+ */
+struct loose_snapshot *loose_snapshot_read(const char *path,
+					   const struct git_hash_algo *algop);
+
+/*
+ * Write the snapshot back to its file if it has changed since it was
+ * read. Failing to do so is not an error, as the snapshot is only a
+ * cache; in that case the snapshot is simply written by a later
+ * process.
+ */
+void loose_snapshot_write(struct loose_snapshot *snapshot);
+
+void loose_snapshot_free(struct loose_snapshot *snapshot);
+
+/*
+ * Return the recorded entries of directory `dirname`, but only if `st`
+ * is the result of stat'ing it and matches the recorded stat data.
+ */
+struct loose_snapshot_dir *loose_snapshot_lookup(struct loose_snapshot *snapshot,
+						 const char *dirname,
+						 struct stat *st);
+
+/*
+ * Start recording directory `dirname`, replacing whatever was recorded
+ * for it before. `st` is the result of stat'ing the directory before
+ * reading it and `now` the current time as obtained before that. Returns
+ * NULL if the directory was modified too recently to be recorded.
+ */
+struct loose_snapshot_dir *loose_snapshot_begin_dir(struct loose_snapshot *snapshot,
+						    const char *dirname,
+						    struct stat *st, time_t now);
+
+/*
+ * Record an entry of a directory. Pass `oid` and `st` for a regular
+ * reference whose file had the stat data `st` before `oid` was read
+ * from it, NULL otherwise.
+ */
+void loose_snapshot_add(struct loose_snapshot *snapshot,
+			struct loose_snapshot_dir *dir, const char *name,
+			const struct object_id *oid, struct stat *st,
+			time_t now);
+
+/*
+ * Update an entry of a directory returned by loose_snapshot_lookup()
+ * after its reference had to be read again. Arguments are as for
+ * loose_snapshot_add().
+ */
+void loose_snapshot_update(struct loose_snapshot *snapshot,
+			   struct loose_snapshot_entry *entry,
+			   const struct object_id *oid, struct stat *st,
+			   time_t now);
+
+#endif /* REFS_LOOSE_SNAPSHOT_H */
@@ -51,6 +51,46 @@ static enum mmap_strategy mmap_strategy = MMAP_OK;
 
 struct packed_ref_store;
 
+/*
+ * Version 2 of the `packed-refs` format is a binary format that can be
+ * used as-is after mapping it into memory: references are looked up by
+ * a binary search through a table of fixed-width record offsets, and
+ * object IDs are stored in binary form. Its layout is:
+ *
+ *   HEADER:
+ *     4-byte signature "PREF"
+ *     4-byte version number (2)
+ *     4-byte hash function identifier (see `git_hash_algo::format_id`)
+ *     4 bytes reserved, written as zero
+ *
+ *   RECORDS, one per reference and sorted by refname:
+ *     1-byte flags; if `PACKED_REFS_V2_PEELED` is set, the object ID is
+ *       followed by the peeled object ID
+ *     object ID
+ *     peeled object ID, if any
+ *     NUL-terminated refname
+ *
+ *   OFFSETS:
+ *     4-byte offset of each record from the start of the file, in the
+ *     same order as the records
+ *
+ *   TRAILER:
+ *     8-byte offset of the offset table from the start of the file
+ *     checksum of all of the above
+ *
+ * All numbers are in network byte order. The file is always fully
+ * peeled, i.e. a reference without a peeled value cannot be peeled.
+ *
+ * Older versions of Git cannot read this format, which is why it is only
+ * written if the `packedRefsVersion` extension asks for it. It is read
+ * regardless of the extension, though, so that `git pack-refs` can
+ * convert the file back after the extension has been disabled.
+ */
+#define PACKED_REFS_V2_SIGNATURE 0x50524546 /* "PREF" */
+#define PACKED_REFS_V2_HEADER_SIZE 16
+#define PACKED_REFS_V2_OFFSET_SIZE 4
+#define PACKED_REFS_V2_PEELED 0x1
+
 /*
  * A `snapshot` represents one snapshot of a `packed-refs` file.
  *
@@ -81,6 +121,9 @@ struct snapshot {
 	/* Is the `packed-refs` file currently mmapped? */
 	int mmapped;
 
+	/* Is this a snapshot of the `packed-refs.overlay` file? */
+	int is_overlay;
+
 	/*
 	 * The contents of the `packed-refs` file:
 	 *
@@ -95,9 +138,17 @@ struct snapshot {
 	 * heap-allocated memory containing the contents, sorted. If
 	 * there were no contents (e.g., because the file didn't
 	 * exist), `buf`, `start`, and `eof` are all NULL.
+	 *
+	 * For files in version 2 of the format, `buf` always points at
+	 * the whole file, and `start` and `eof` delimit its offset table
+	 * instead. The positions of records that the functions below take
+	 * and return then point into the offset table, too.
 	 */
 	char *buf, *start, *eof;
 
+	/* The format version of the file, 1 or 2. */
+	int version;
+
 	/*
 	 * What is the peeled state of the `packed-refs` file that
 	 * this snapshot represents? (This is usually determined from
@@ -119,6 +170,15 @@ struct snapshot {
 	 * replaced since we read it.
 	 */
 	struct stat_validity validity;
+
+	/*
+	 * If the repository uses the "packedRefsOverlay" extension, a
+	 * snapshot of the `packed-refs.overlay` file that was read
+	 * together with this one; otherwise, NULL. Its records take
+	 * precedence over the ones in this snapshot, and a record with
+	 * a null object ID marks the reference as deleted.
+	 */
+	struct snapshot *overlay;
 };
 
 /*
@@ -144,6 +204,16 @@ struct packed_ref_store {
 	/* The path of the "packed-refs" file: */
 	char *path;
 
+	/*
+	 * The path of the "packed-refs.overlay" file, and whether it is
+	 * in use (see `extensions.packedRefsOverlay`):
+	 */
+	char *overlay_path;
+	int use_overlay;
+
+	/* The format version in which to write the "packed-refs" file: */
+	int version;
+
 	/*
 	 * A snapshot of the values read from the `packed-refs` file,
 	 * if it might still be current; otherwise, NULL.
@@ -162,6 +232,12 @@ struct packed_ref_store {
 	 * `packed_ref_store`) must not be freed.
 	 */
 	struct tempfile *tempfile;
+
+	/*
+	 * Temporary file used when writing new contents to the
+	 * "packed-refs.overlay" file.
+	 */
+	struct tempfile *overlay_tempfile;
 };
 
 /*
@@ -172,6 +248,30 @@ static void acquire_snapshot(struct snapshot *snapshot)
 	snapshot->referrers++;
 }
 
+static const char *snapshot_path(const struct snapshot *snapshot)
+{
+	return snapshot->is_overlay ?
+		snapshot->refs->overlay_path : snapshot->refs->path;
+}
+
+static size_t packed_refs_v2_trailer_size(const struct snapshot *snapshot)
+{
+	return 8 + snapshot->refs->base.repo->hash_algo->rawsz;
+}
+
+/*
+ * Return the size of the buffer in `snapshot`. For version 2 of the
+ * format, it extends past `eof` by the trailer.
+ */
+static size_t snapshot_buffer_size(const struct snapshot *snapshot)
+{
+	size_t size = snapshot->eof - snapshot->buf;
+
+	if (snapshot->version == 2)
+		size += packed_refs_v2_trailer_size(snapshot);
+	return size;
+}
+
 /*
  * If the buffer in `snapshot` is active, then either munmap the
  * memory and close the file, or free the memory. Then set the buffer
@@ -180,9 +280,9 @@ static void acquire_snapshot(struct snapshot *snapshot)
 static void clear_snapshot_buffer(struct snapshot *snapshot)
 {
 	if (snapshot->mmapped) {
-		if (munmap(snapshot->buf, snapshot->eof - snapshot->buf))
+		if (munmap(snapshot->buf, snapshot_buffer_size(snapshot)))
 			die_errno("error ummapping packed-refs file %s",
-				  snapshot->refs->path);
+				  snapshot_path(snapshot));
 		snapshot->mmapped = 0;
 	} else {
 		free(snapshot->buf);
@@ -197,6 +297,8 @@ static void clear_snapshot_buffer(struct snapshot *snapshot)
 static int release_snapshot(struct snapshot *snapshot)
 {
 	if (!--snapshot->referrers) {
+		if (snapshot->overlay)
+			release_snapshot(snapshot->overlay);
 		stat_validity_clear(&snapshot->validity);
 		clear_snapshot_buffer(snapshot);
 		free(snapshot);
@@ -225,6 +327,11 @@ struct ref_store *packed_ref_store_init(struct repository *repo,
 	strbuf_addf(&sb, "%s/packed-refs", gitdir);
 	refs->path = strbuf_detach(&sb, NULL);
 	chdir_notify_reparent("packed-refs", &refs->path);
+
+	refs->use_overlay = repo->repository_format_packed_refs_overlay;
+	refs->version = repo->repository_format_packed_refs_version == 2 ? 2 : 1;
+	refs->overlay_path = xstrfmt("%s/packed-refs.overlay", gitdir);
+	chdir_notify_reparent("packed-refs overlay", &refs->overlay_path);
 	return ref_store;
 }
 
@@ -269,7 +376,9 @@ static void packed_ref_store_release(struct ref_store *ref_store)
 	clear_snapshot(refs);
 	rollback_lock_file(&refs->lock);
 	delete_tempfile(&refs->tempfile);
+	delete_tempfile(&refs->overlay_tempfile);
 	free(refs->path);
+	free(refs->overlay_path);
 }
 
 static NORETURN void die_unterminated_line(const char *path,
@@ -300,6 +409,69 @@ struct snapshot_record {
 	size_t len;
 };
 
+/*
+ * Return the record of a version 2 snapshot whose entry in the offset
+ * table is at `pos`. Die unless the record lies within the records
+ * section. That section ends with a NUL byte (see `read_snapshot_v2()`),
+ * so the refname of the record is terminated within the buffer, too.
+ */
+static const unsigned char *v2_record(const struct snapshot *snapshot,
+				      const char *pos)
+{
+	size_t rawsz = snapshot->refs->base.repo->hash_algo->rawsz;
+	size_t records_end = snapshot->start - snapshot->buf;
+	uint32_t off = get_be32(pos);
+	const unsigned char *rec = (const unsigned char *)snapshot->buf + off;
+
+	if (off < PACKED_REFS_V2_HEADER_SIZE ||
+	    off + 1 + rawsz >= records_end ||
+	    ((rec[0] & PACKED_REFS_V2_PEELED) && off + 1 + 2 * rawsz >= records_end))
+		die("invalid record offset %"PRIu32" in %s",
+		    off, snapshot_path(snapshot));
+	return rec;
+}
+
+static const char *v2_record_refname(const struct snapshot *snapshot,
+				     const unsigned char *rec)
+{
+	size_t rawsz = snapshot->refs->base.repo->hash_algo->rawsz;
+
+	if (rec[0] & PACKED_REFS_V2_PEELED)
+		rawsz *= 2;
+	return (const char *)rec + 1 + rawsz;
+}
+
+/*
+ * Return the refname of the record at `pos` in `snapshot`. It is
+ * terminated by `record_terminator()` rather than necessarily by NUL.
+ */
+static const char *record_refname(const struct snapshot *snapshot,
+				  const char *pos)
+{
+	if (snapshot->version == 2)
+		return v2_record_refname(snapshot, v2_record(snapshot, pos));
+	return pos + snapshot_hexsz(snapshot) + 1;
+}
+
+static char record_terminator(const struct snapshot *snapshot)
+{
+	return snapshot->version == 2 ? '\0' : '\n';
+}
+
+/*
+ * Read the object ID of the record at `pos` in `snapshot` into `oid`.
+ */
+static void read_record_oid(const struct snapshot *snapshot, const char *pos,
+			    struct object_id *oid)
+{
+	const struct git_hash_algo *algo = snapshot->refs->base.repo->hash_algo;
+
+	if (snapshot->version == 2)
+		oidread(oid, v2_record(snapshot, pos) + 1, algo);
+	else if (get_oid_hex_algop(pos, oid, algo))
+		die_invalid_line(snapshot_path(snapshot), pos, snapshot->eof - pos);
+}
+
 
 static int cmp_packed_refname(const char *r1, const char *r2)
 {
@@ -335,11 +507,12 @@ static int cmp_packed_ref_records(const void *v1, const void *v2,
 static int cmp_record_to_refname(const char *rec, const char *refname,
 				 int start, const struct snapshot *snapshot)
 {
-	const char *r1 = rec + snapshot_hexsz(snapshot) + 1;
+	const char *r1 = record_refname(snapshot, rec);
 	const char *r2 = refname;
+	char end = record_terminator(snapshot);
 
 	while (1) {
-		if (*r1 == '\n')
+		if (*r1 == end)
 			return *r2 ? -1 : 0;
 		if (!*r2)
 			return start ? 1 : -1;
@@ -350,6 +523,32 @@ static int cmp_record_to_refname(const char *rec, const char *refname,
 	}
 }
 
+/*
+ * Compare the refnames of the record at `rec1` in `snapshot1` and of the
+ * one at `rec2` in `snapshot2`, which may use different format versions.
+ */
+static int cmp_snapshot_records(const struct snapshot *snapshot1,
+				const char *rec1,
+				const struct snapshot *snapshot2,
+				const char *rec2)
+{
+	const char *r1 = record_refname(snapshot1, rec1);
+	const char *r2 = record_refname(snapshot2, rec2);
+	char end1 = record_terminator(snapshot1);
+	char end2 = record_terminator(snapshot2);
+
+	while (1) {
+		if (*r1 == end1)
+			return *r2 == end2 ? 0 : -1;
+		if (*r2 == end2)
+			return 1;
+		if (*r1 != *r2)
+			return (unsigned char)*r1 < (unsigned char)*r2 ? -1 : +1;
+		r1++;
+		r2++;
+	}
+}
+
 /*
  * `snapshot->buf` is not known to be sorted. Check whether it is, and
  * if not, sort it into new memory and munmap/free the old storage.
@@ -383,7 +582,7 @@ static void sort_snapshot(struct snapshot *snapshot)
 			/* The safety check should prevent this. */
 			BUG("unterminated line found in packed-refs");
 		if (eol - pos < snapshot_hexsz(snapshot) + 2)
-			die_invalid_line(snapshot->refs->path,
+			die_invalid_line(snapshot_path(snapshot),
 					 pos, eof - pos);
 		eol++;
 		if (eol < eof && *eol == '^') {
@@ -466,6 +665,18 @@ static const char *find_end_of_record(const char *p, const char *end)
 	return p;
 }
 
+/*
+ * Return the position of the record following the one at `pos` in
+ * `snapshot`, or `end` if there is none before it.
+ */
+static const char *next_record_position(const struct snapshot *snapshot,
+					const char *pos, const char *end)
+{
+	if (snapshot->version == 2)
+		return pos + PACKED_REFS_V2_OFFSET_SIZE;
+	return find_end_of_record(pos, end);
+}
+
 /*
  * We want to be able to compare mmapped reference records quickly,
  * without totally parsing them. We can do so because the records are
@@ -496,7 +707,7 @@ static void verify_buffer_safe(struct snapshot *snapshot)
 	last_line = find_start_of_record(start, eof - 1);
 	if (*(eof - 1) != '\n' ||
 	    eof - last_line < snapshot_hexsz(snapshot) + 2)
-		die_invalid_line(snapshot->refs->path,
+		die_invalid_line(snapshot_path(snapshot),
 				 last_line, eof - last_line);
 }
 
@@ -530,7 +741,7 @@ static int allocate_snapshot_buffer(struct snapshot *snapshot, int fd, struct st
 		snapshot->buf = xmalloc(size);
 		bytes_read = read_in_full(fd, snapshot->buf, size);
 		if (bytes_read < 0 || bytes_read != size)
-			die_errno("couldn't read %s", snapshot->refs->path);
+			die_errno("couldn't read %s", snapshot_path(snapshot));
 		snapshot->mmapped = 0;
 	} else {
 		snapshot->buf = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
@@ -555,7 +766,7 @@ static int load_contents(struct snapshot *snapshot)
 	int ret;
 	int fd;
 
-	fd = open(snapshot->refs->path, O_RDONLY);
+	fd = open(snapshot_path(snapshot), O_RDONLY);
 	if (fd < 0) {
 		if (errno == ENOENT) {
 			/*
@@ -567,14 +778,14 @@ static int load_contents(struct snapshot *snapshot)
 			 */
 			return 0;
 		} else {
-			die_errno("couldn't read %s", snapshot->refs->path);
+			die_errno("couldn't read %s", snapshot_path(snapshot));
 		}
 	}
 
 	stat_validity_update(&snapshot->validity, fd);
 
 	if (fstat(fd, &st) < 0)
-		die_errno("couldn't stat %s", snapshot->refs->path);
+		die_errno("couldn't stat %s", snapshot_path(snapshot));
 
 	ret = allocate_snapshot_buffer(snapshot, fd, &st);
 
@@ -582,7 +793,38 @@ static int load_contents(struct snapshot *snapshot)
 	return ret;
 }
 
+/*
+ * The version 2 counterpart of `find_reference_location_1()`, which is
+ * a plain binary search through the offset table.
+ */
+static const char *find_reference_location_v2(struct snapshot *snapshot,
+					      const char *from,
+					      const char *refname, int mustexist,
+					      int start)
+{
+	size_t lo = (from - snapshot->start) / PACKED_REFS_V2_OFFSET_SIZE;
+	size_t hi = (snapshot->eof - snapshot->start) / PACKED_REFS_V2_OFFSET_SIZE;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const char *rec = snapshot->start + mid * PACKED_REFS_V2_OFFSET_SIZE;
+		int cmp = cmp_record_to_refname(rec, refname, start, snapshot);
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else if (cmp > 0)
+			hi = mid;
+		else
+			return rec;
+	}
+
+	if (mustexist)
+		return NULL;
+	return snapshot->start + lo * PACKED_REFS_V2_OFFSET_SIZE;
+}
+
 static const char *find_reference_location_1(struct snapshot *snapshot,
+					     const char *from,
 					     const char *refname, int mustexist,
 					     int start)
 {
@@ -600,7 +842,7 @@ static const char *find_reference_location_1(struct snapshot *snapshot,
 	 * preceding records all have reference names that come
 	 * *before* `refname`.
 	 */
-	const char *lo = snapshot->start;
+	const char *lo = from;
 
 	/*
 	 * A pointer to a the first character of a record whose
@@ -608,6 +850,10 @@ static const char *find_reference_location_1(struct snapshot *snapshot,
 	 */
 	const char *hi = snapshot->eof;
 
+	if (snapshot->version == 2)
+		return find_reference_location_v2(snapshot, from, refname,
+						  mustexist, start);
+
 	while (lo != hi) {
 		const char *mid, *rec;
 		int cmp;
@@ -647,7 +893,8 @@ static const char *find_reference_location_1(struct snapshot *snapshot,
 static const char *find_reference_location(struct snapshot *snapshot,
 					   const char *refname, int mustexist)
 {
-	return find_reference_location_1(snapshot, refname, mustexist, 1);
+	return find_reference_location_1(snapshot, snapshot->start, refname,
+					 mustexist, 1);
 }
 
 /*
@@ -662,13 +909,87 @@ static const char *find_reference_location_end(struct snapshot *snapshot,
 					       const char *refname,
 					       int mustexist)
 {
-	return find_reference_location_1(snapshot, refname, mustexist, 0);
+	return find_reference_location_1(snapshot, snapshot->start, refname,
+					 mustexist, 0);
+}
+
+/*
+ * Like `find_reference_location()` with `mustexist` unset, but only
+ * consider the records starting at `from`, which must be the start of
+ * a record (or `snapshot->eof`) that is preceded only by records for
+ * references that come before `refname`. This allows looking up a
+ * sorted list of references in a single pass through the snapshot.
+ */
+static const char *find_reference_location_from(struct snapshot *snapshot,
+						const char *from,
+						const char *refname)
+{
+	/* Neighbouring references are often looked up together. */
+	if (from == snapshot->eof ||
+	    cmp_record_to_refname(from, refname, 1, snapshot) >= 0)
+		return from;
+	return find_reference_location_1(snapshot, from, refname, 0, 1);
+}
+
+/*
+ * Set up `snapshot`, whose buffer holds a file in version 2 of the
+ * format. Only the header and the trailer are checked here, so that
+ * loading the file does not take time proportional to its size. The
+ * records are checked as they are accessed (see `v2_record()`).
+ */
+static void read_snapshot_v2(struct snapshot *snapshot)
+{
+	const struct git_hash_algo *algo = snapshot->refs->base.repo->hash_algo;
+	const char *path = snapshot_path(snapshot);
+	size_t trailer_size = packed_refs_v2_trailer_size(snapshot);
+	size_t size = snapshot->eof - snapshot->buf;
+	uint32_t version;
+	uint64_t table;
+
+	if (size < PACKED_REFS_V2_HEADER_SIZE + trailer_size)
+		die("packed-refs file %s is truncated", path);
+
+	version = get_be32(snapshot->buf + 4);
+	if (version != 2)
+		die("packed-refs file %s has unsupported version %"PRIu32,
+		    path, version);
+	if (get_be32(snapshot->buf + 8) != algo->format_id)
+		die("packed-refs file %s uses a different hash algorithm", path);
+
+	/*
+	 * The records section must end with the NUL byte terminating the
+	 * last refname; see `v2_record()`.
+	 */
+	table = get_be64(snapshot->eof - trailer_size);
+	if (table < PACKED_REFS_V2_HEADER_SIZE ||
+	    table > size - trailer_size ||
+	    (size - trailer_size - table) % PACKED_REFS_V2_OFFSET_SIZE ||
+	    (table > PACKED_REFS_V2_HEADER_SIZE && snapshot->buf[table - 1]))
+		die("packed-refs file %s has an invalid offset table", path);
+
+	if (mmap_strategy != MMAP_OK && snapshot->mmapped) {
+		/*
+		 * We don't want to leave the file mmapped, so we are
+		 * forced to make a copy now:
+		 */
+		char *buf_copy = xmalloc(size);
+
+		memcpy(buf_copy, snapshot->buf, size);
+		clear_snapshot_buffer(snapshot);
+		snapshot->buf = buf_copy;
+	}
+
+	snapshot->version = 2;
+	snapshot->peeled = PEELED_FULLY;
+	snapshot->start = snapshot->buf + table;
+	snapshot->eof = snapshot->buf + size - trailer_size;
 }
 
 /*
- * Create a newly-allocated `snapshot` of the `packed-refs` file in
- * its current state and return it. The return value will already have
- * its reference count incremented.
+ * Create a newly-allocated `snapshot` of the `packed-refs` file (or of
+ * the `packed-refs.overlay` file if `is_overlay` is set) in its current
+ * state and return it. The return value will already have its
+ * reference count incremented.
  *
  * A comment line of the form "# pack-refs with: " may contain zero or
  * more traits. We interpret the traits as follows:
@@ -697,19 +1018,31 @@ static const char *find_reference_location_end(struct snapshot *snapshot,
  *   `sorted`:
  *
  *      The references in this file are known to be sorted by refname.
+ *
+ * Files in version 2 of the format have no such header line and are
+ * always sorted and fully peeled.
  */
-static struct snapshot *create_snapshot(struct packed_ref_store *refs)
+static struct snapshot *read_snapshot(struct packed_ref_store *refs,
+				      int is_overlay)
 {
 	struct snapshot *snapshot = xcalloc(1, sizeof(*snapshot));
 	int sorted = 0;
 
 	snapshot->refs = refs;
+	snapshot->is_overlay = is_overlay;
 	acquire_snapshot(snapshot);
 	snapshot->peeled = PEELED_NONE;
+	snapshot->version = 1;
 
 	if (!load_contents(snapshot))
 		return snapshot;
 
+	if (snapshot->eof - snapshot->buf >= 4 &&
+	    get_be32(snapshot->buf) == PACKED_REFS_V2_SIGNATURE) {
+		read_snapshot_v2(snapshot);
+		return snapshot;
+	}
+
 	/* If the file has a header line, process it: */
 	if (snapshot->buf < snapshot->eof && *snapshot->buf == '#') {
 		char *tmp, *p, *eol;
@@ -718,14 +1051,14 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 		eol = memchr(snapshot->buf, '\n',
 			     snapshot->eof - snapshot->buf);
 		if (!eol)
-			die_unterminated_line(refs->path,
+			die_unterminated_line(snapshot_path(snapshot),
 					      snapshot->buf,
 					      snapshot->eof - snapshot->buf);
 
 		tmp = xmemdupz(snapshot->buf, eol - snapshot->buf);
 
 		if (!skip_prefix(tmp, "# pack-refs with: ", (const char **)&p))
-			die_invalid_line(refs->path,
+			die_invalid_line(snapshot_path(snapshot),
 					 snapshot->buf,
 					 snapshot->eof - snapshot->buf);
 
@@ -777,14 +1110,51 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 	return snapshot;
 }
 
+/*
+ * Create a newly-allocated `snapshot` of the `packed-refs` file and,
+ * if it is in use, of the `packed-refs.overlay` file.
+ *
+ * A transaction that folds the overlay into `packed-refs` replaces the
+ * overlay before it replaces `packed-refs`, and removes it only
+ * afterwards (see `packed_transaction_finish()`). By reading the
+ * overlay first and retrying if it has changed by the time we are done
+ * reading `packed-refs`, we never combine an overlay with a
+ * `packed-refs` file whose changes it does not include.
+ */
+static struct snapshot *create_snapshot(struct packed_ref_store *refs)
+{
+	struct snapshot *snapshot, *overlay;
+
+	if (!refs->use_overlay)
+		return read_snapshot(refs, 0);
+
+	while (1) {
+		overlay = read_snapshot(refs, 1);
+		snapshot = read_snapshot(refs, 0);
+		if (stat_validity_check(&overlay->validity, refs->overlay_path))
+			break;
+		release_snapshot(overlay);
+		release_snapshot(snapshot);
+	}
+
+	snapshot->overlay = overlay;
+	return snapshot;
+}
+
 /*
  * Check that `refs->snapshot` (if present) still reflects the
- * contents of the `packed-refs` file. If not, clear the snapshot.
+ * contents of the `packed-refs` file and of its overlay. If not, clear
+ * the snapshot.
  */
 static void validate_snapshot(struct packed_ref_store *refs)
 {
-	if (refs->snapshot &&
-	    !stat_validity_check(&refs->snapshot->validity, refs->path))
+	struct snapshot *snapshot = refs->snapshot;
+
+	if (snapshot &&
+	    (!stat_validity_check(&snapshot->validity, refs->path) ||
+	     (snapshot->overlay &&
+	      !stat_validity_check(&snapshot->overlay->validity,
+				   refs->overlay_path))))
 		clear_snapshot(refs);
 }
 
@@ -815,11 +1185,17 @@ static int packed_read_raw_ref(struct ref_store *ref_store, const char *refname,
 	struct packed_ref_store *refs =
 		packed_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
 	struct snapshot *snapshot = get_snapshot(refs);
-	const char *rec;
+	const char *rec = NULL;
 
 	*type = 0;
 
-	rec = find_reference_location(snapshot, refname, 1);
+	/* A record in the overlay takes precedence: */
+	if (snapshot->overlay)
+		rec = find_reference_location(snapshot->overlay, refname, 1);
+	if (rec)
+		snapshot = snapshot->overlay;
+	else
+		rec = find_reference_location(snapshot, refname, 1);
 
 	if (!rec) {
 		/* refname is not a packed reference. */
@@ -827,13 +1203,74 @@ static int packed_read_raw_ref(struct ref_store *ref_store, const char *refname,
 		return -1;
 	}
 
-	if (get_oid_hex_algop(rec, oid, ref_store->repo->hash_algo))
-		die_invalid_line(refs->path, rec, snapshot->eof - rec);
+	read_record_oid(snapshot, rec, oid);
+
+	if (is_null_oid(oid)) {
+		/* refname has been deleted in the overlay. */
+		*failure_errno = ENOENT;
+		return -1;
+	}
 
 	*type = REF_ISPACKED;
 	return 0;
 }
 
+static void packed_read_raw_refs(struct ref_store *ref_store,
+				 struct raw_ref_read *reads, size_t nr)
+{
+	struct packed_ref_store *refs =
+		packed_downcast(ref_store, REF_STORE_READ, "read_raw_refs");
+	struct snapshot *snapshot = get_snapshot(refs);
+	struct snapshot *overlay = snapshot->overlay;
+	const char *pos = snapshot->start;
+	const char *overlay_pos = overlay ? overlay->start : NULL;
+
+	for (size_t i = 0; i < nr; i++) {
+		struct raw_ref_read *read = &reads[i];
+		struct snapshot *found = NULL;
+		const char *rec = NULL;
+
+		read->type = 0;
+		read->failure_errno = 0;
+
+		/* A record in the overlay takes precedence: */
+		if (overlay) {
+			overlay_pos = find_reference_location_from(overlay,
+								   overlay_pos,
+								   read->refname);
+			if (overlay_pos != overlay->eof &&
+			    !cmp_record_to_refname(overlay_pos, read->refname,
+						   1, overlay)) {
+				found = overlay;
+				rec = overlay_pos;
+			}
+		}
+
+		pos = find_reference_location_from(snapshot, pos, read->refname);
+		if (!found && pos != snapshot->eof &&
+		    !cmp_record_to_refname(pos, read->refname, 1, snapshot)) {
+			found = snapshot;
+			rec = pos;
+		}
+
+		if (found)
+			read_record_oid(found, rec, &read->oid);
+
+		if (!found || is_null_oid(&read->oid)) {
+			/*
+			 * refname is not a packed reference, or has been
+			 * deleted in the overlay.
+			 */
+			read->failure_errno = ENOENT;
+			read->result = -1;
+			continue;
+		}
+
+		read->type = REF_ISPACKED;
+		read->result = 0;
+	}
+}
+
 /*
  * This value is set in `base.flags` if the peeled value of the
  * current reference is known. In that case, `peeled` contains the
@@ -858,6 +1295,9 @@ struct packed_ref_iterator {
 	/* The end of the part of the buffer that will be iterated over: */
 	const char *eof;
 
+	/* The same for the snapshot's overlay, if any: */
+	const char *overlay_pos, *overlay_eof;
+
 	struct jump_list_entry {
 		const char *start;
 		const char *end;
@@ -874,57 +1314,89 @@ struct packed_ref_iterator {
 };
 
 /*
- * Move the iterator to the next record in the snapshot. Adjust the fields in
- * `iter` and return `ITER_OK` or `ITER_DONE`. This function does not free the
- * iterator in the case of `ITER_DONE`.
+ * Parse the object ID, refname and peeled value, if any, of the record
+ * at `*pos` in a version 1 `snapshot` into the scratch fields of `iter`
+ * and advance `*pos` past it. Return whether there is a peeled value.
  */
-static int next_record(struct packed_ref_iterator *iter)
+static int parse_record_v1(struct packed_ref_iterator *iter,
+			   struct snapshot *snapshot,
+			   const char **pos, const char *eof)
 {
 	const char *p, *eol;
 
-	memset(&iter->base.ref, 0, sizeof(iter->base.ref));
-	strbuf_reset(&iter->refname_buf);
+	p = *pos;
 
 	/*
-	 * If iter->pos is contained within a skipped region, jump past
-	 * it.
-	 *
-	 * Note that each skipped region is considered at most once,
-	 * since they are ordered based on their starting position.
+	 * The length check guarantees that the whole object ID can be
+	 * read, which lets us use the bulk decoder.
 	 */
-	while (iter->jump_cur < iter->jump_nr) {
-		struct jump_list_entry *curr = &iter->jump[iter->jump_cur];
-		if (iter->pos < curr->start)
-			break; /* not to the next jump yet */
+	if (eof - p < snapshot_hexsz(snapshot) + 2 ||
+	    get_oids_hex_algop(p, 0, &iter->oid, 1, iter->repo->hash_algo) != 1 ||
+	    !isspace(p[snapshot_hexsz(snapshot)]))
+		die_invalid_line(snapshot_path(snapshot),
+				 *pos, eof - *pos);
 
-		iter->jump_cur++;
-		if (iter->pos < curr->end) {
-			iter->pos = curr->end;
-			trace2_counter_add(TRACE2_COUNTER_ID_PACKED_REFS_JUMPS, 1);
-			/* jumps are coalesced, so only one jump is necessary */
-			break;
-		}
+	p += snapshot_hexsz(snapshot) + 1;
+
+	eol = memchr(p, '\n', eof - p);
+	if (!eol)
+		die_unterminated_line(snapshot_path(snapshot),
+				      *pos, eof - *pos);
+
+	strbuf_add(&iter->refname_buf, p, eol - p);
+
+	*pos = eol + 1;
+
+	if (*pos < eof && **pos == '^') {
+		p = *pos + 1;
+		if (eof - p < snapshot_hexsz(snapshot) + 1 ||
+		    get_oids_hex_algop(p, 0, &iter->peeled, 1, iter->repo->hash_algo) != 1 ||
+		    p[snapshot_hexsz(snapshot)] != '\n')
+			die_invalid_line(snapshot_path(snapshot),
+					 *pos, eof - *pos);
+		*pos = p + snapshot_hexsz(snapshot) + 1;
+		return 1;
 	}
 
-	if (iter->pos == iter->eof)
-		return ITER_DONE;
+	return 0;
+}
 
-	iter->base.ref.flags = REF_ISPACKED;
-	p = iter->pos;
+/*
+ * The version 2 counterpart of `parse_record_v1()`.
+ */
+static int parse_record_v2(struct packed_ref_iterator *iter,
+			   struct snapshot *snapshot, const char **pos)
+{
+	const unsigned char *rec = v2_record(snapshot, *pos);
+	size_t rawsz = iter->repo->hash_algo->rawsz;
 
-	if (iter->eof - p < snapshot_hexsz(iter->snapshot) + 2 ||
-	    parse_oid_hex_algop(p, &iter->oid, &p, iter->repo->hash_algo) ||
-	    !isspace(*p++))
-		die_invalid_line(iter->snapshot->refs->path,
-				 iter->pos, iter->eof - iter->pos);
-	iter->base.ref.oid = &iter->oid;
+	oidread(&iter->oid, rec + 1, iter->repo->hash_algo);
+	if (rec[0] & PACKED_REFS_V2_PEELED)
+		oidread(&iter->peeled, rec + 1 + rawsz, iter->repo->hash_algo);
+	strbuf_addstr(&iter->refname_buf, v2_record_refname(snapshot, rec));
 
-	eol = memchr(p, '\n', iter->eof - p);
-	if (!eol)
-		die_unterminated_line(iter->snapshot->refs->path,
-				      iter->pos, iter->eof - iter->pos);
+	*pos += PACKED_REFS_V2_OFFSET_SIZE;
+	return rec[0] & PACKED_REFS_V2_PEELED;
+}
 
-	strbuf_add(&iter->refname_buf, p, eol - p);
+/*
+ * Parse the record at `*pos` in `snapshot`, which must end before
+ * `eof`, into the scratch fields of `iter` and advance `*pos` past it.
+ */
+static void parse_record(struct packed_ref_iterator *iter,
+			 struct snapshot *snapshot,
+			 const char **pos, const char *eof)
+{
+	int has_peeled;
+
+	iter->base.ref.flags = REF_ISPACKED;
+
+	if (snapshot->version == 2)
+		has_peeled = parse_record_v2(iter, snapshot, pos);
+	else
+		has_peeled = parse_record_v1(iter, snapshot, pos, eof);
+
+	iter->base.ref.oid = &iter->oid;
 	iter->base.ref.name = iter->refname_buf.buf;
 
 	if (refname_contains_nul(&iter->refname_buf))
@@ -937,22 +1409,12 @@ static int next_record(struct packed_ref_iterator *iter)
 		oidclr(&iter->oid, iter->repo->hash_algo);
 		iter->base.ref.flags |= REF_BAD_NAME | REF_ISBROKEN;
 	}
-	if (iter->snapshot->peeled == PEELED_FULLY ||
-	    (iter->snapshot->peeled == PEELED_TAGS &&
+	if (snapshot->peeled == PEELED_FULLY ||
+	    (snapshot->peeled == PEELED_TAGS &&
 	     starts_with(iter->base.ref.name, "refs/tags/")))
 		iter->base.ref.flags |= REF_KNOWS_PEELED;
 
-	iter->pos = eol + 1;
-
-	if (iter->pos < iter->eof && *iter->pos == '^') {
-		p = iter->pos + 1;
-		if (iter->eof - p < snapshot_hexsz(iter->snapshot) + 1 ||
-		    parse_oid_hex_algop(p, &iter->peeled, &p, iter->repo->hash_algo) ||
-		    *p++ != '\n')
-			die_invalid_line(iter->snapshot->refs->path,
-					 iter->pos, iter->eof - iter->pos);
-		iter->pos = p;
-
+	if (has_peeled) {
 		/*
 		 * Regardless of what the file header said, we
 		 * definitely know the value of *this* reference. But
@@ -968,6 +1430,72 @@ static int next_record(struct packed_ref_iterator *iter)
 	} else {
 		oidclr(&iter->peeled, iter->repo->hash_algo);
 	}
+}
+
+/*
+ * Move the iterator to the next record in the snapshot, merging in the
+ * records of its overlay, if any. Adjust the fields in `iter` and
+ * return `ITER_OK` or `ITER_DONE`. This function does not free the
+ * iterator in the case of `ITER_DONE`.
+ */
+static int next_record(struct packed_ref_iterator *iter)
+{
+	struct snapshot *overlay = iter->snapshot->overlay;
+	int cmp;
+
+again:
+	memset(&iter->base.ref, 0, sizeof(iter->base.ref));
+	strbuf_reset(&iter->refname_buf);
+
+	/*
+	 * If iter->pos is contained within a skipped region, jump past
+	 * it.
+	 *
+	 * Note that each skipped region is considered at most once,
+	 * since they are ordered based on their starting position.
+	 */
+	while (iter->jump_cur < iter->jump_nr) {
+		struct jump_list_entry *curr = &iter->jump[iter->jump_cur];
+		if (iter->pos < curr->start)
+			break; /* not to the next jump yet */
+
+		iter->jump_cur++;
+		if (iter->pos < curr->end) {
+			iter->pos = curr->end;
+			trace2_counter_add(TRACE2_COUNTER_ID_PACKED_REFS_JUMPS, 1);
+			/* jumps are coalesced, so only one jump is necessary */
+			break;
+		}
+	}
+
+	if (!overlay || iter->overlay_pos == iter->overlay_eof) {
+		if (iter->pos == iter->eof)
+			return ITER_DONE;
+		cmp = 1;
+	} else if (iter->pos == iter->eof) {
+		cmp = -1;
+	} else {
+		cmp = cmp_snapshot_records(overlay, iter->overlay_pos,
+					   iter->snapshot, iter->pos);
+	}
+
+	if (cmp > 0) {
+		parse_record(iter, iter->snapshot, &iter->pos, iter->eof);
+		return ITER_OK;
+	}
+
+	/*
+	 * The overlay record either comes first or replaces the one
+	 * in `packed-refs`, which we skip in that case.
+	 */
+	if (!cmp)
+		iter->pos = next_record_position(iter->snapshot, iter->pos,
+						 iter->eof);
+	parse_record(iter, overlay, &iter->overlay_pos, iter->overlay_eof);
+
+	/* A null object ID marks a deleted reference: */
+	if (!(iter->base.ref.flags & REF_ISBROKEN) && is_null_oid(&iter->oid))
+		goto again;
 
 	return ITER_OK;
 }
@@ -1011,6 +1539,7 @@ static int packed_ref_iterator_seek(struct ref_iterator *ref_iterator,
 {
 	struct packed_ref_iterator *iter =
 		(struct packed_ref_iterator *)ref_iterator;
+	struct snapshot *overlay = iter->snapshot->overlay;
 	const char *start;
 
 	if (refname && *refname)
@@ -1027,6 +1556,14 @@ static int packed_ref_iterator_seek(struct ref_iterator *ref_iterator,
 	iter->pos = start;
 	iter->eof = iter->snapshot->eof;
 
+	if (overlay) {
+		if (refname && *refname)
+			iter->overlay_pos = find_reference_location(overlay, refname, 0);
+		else
+			iter->overlay_pos = overlay->start;
+		iter->overlay_eof = overlay->eof;
+	}
+
 	return 0;
 }
 
@@ -1319,19 +1856,142 @@ int packed_refs_size(struct ref_store *ref_store,
 static const char PACKED_REFS_HEADER[] =
 	"# pack-refs with: peeled fully-peeled sorted \n";
 
-static int packed_ref_store_create_on_disk(struct ref_store *ref_store UNUSED,
-					   int flags UNUSED,
-					   struct strbuf *err UNUSED)
-{
-	/* Nothing to do. */
-	return 0;
-}
-
-static int packed_ref_store_remove_on_disk(struct ref_store *ref_store,
+/*
+ * Writes a `packed-refs` file in either version of the format. The
+ * references must be added in sorted order.
+ */
+struct packed_refs_writer {
+	FILE *out;
+	int version;
+	const struct git_hash_algo *algo;
+
+	/*
+	 * For version 2, the checksum of and the number of bytes written
+	 * so far, as well as the offsets of the records:
+	 */
+	struct git_hash_ctx ctx;
+	uint64_t size;
+	uint32_t *offsets;
+	size_t offsets_nr, offsets_alloc;
+};
+
+static int packed_refs_writer_write(struct packed_refs_writer *w,
+				    const void *data, size_t len)
+{
+	if (fwrite(data, 1, len, w->out) != len)
+		return -1;
+	git_hash_update(&w->ctx, data, len);
+	w->size += len;
+	return 0;
+}
+
+/*
+ * Start writing a `packed-refs` file to `out`. On error, return a
+ * nonzero value and leave errno set.
+ */
+static int packed_refs_writer_start(struct packed_refs_writer *w, FILE *out,
+				    int version,
+				    const struct git_hash_algo *algo)
+{
+	unsigned char header[PACKED_REFS_V2_HEADER_SIZE] = { 0 };
+
+	memset(w, 0, sizeof(*w));
+	w->out = out;
+	w->version = version;
+	w->algo = algo;
+
+	if (version != 2)
+		return fprintf(out, "%s", PACKED_REFS_HEADER) < 0 ? -1 : 0;
+
+	algo->init_fn(&w->ctx);
+	put_be32(header, PACKED_REFS_V2_SIGNATURE);
+	put_be32(header + 4, 2);
+	put_be32(header + 8, algo->format_id);
+	return packed_refs_writer_write(w, header, sizeof(header));
+}
+
+/*
+ * Write an entry for the specified refname, like `write_packed_entry()`
+ * does for version 1 of the format.
+ */
+static int packed_refs_writer_add(struct packed_refs_writer *w,
+				  const char *refname,
+				  const struct object_id *oid,
+				  const struct object_id *peeled)
+{
+	unsigned char flags = peeled ? PACKED_REFS_V2_PEELED : 0;
+
+	if (w->version != 2)
+		return write_packed_entry(w->out, refname, oid, peeled);
+
+	if (w->size > UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+	}
+	ALLOC_GROW(w->offsets, w->offsets_nr + 1, w->offsets_alloc);
+	w->offsets[w->offsets_nr++] = w->size;
+
+	if (packed_refs_writer_write(w, &flags, 1) ||
+	    packed_refs_writer_write(w, oid->hash, w->algo->rawsz) ||
+	    (peeled && packed_refs_writer_write(w, peeled->hash, w->algo->rawsz)) ||
+	    packed_refs_writer_write(w, refname, strlen(refname) + 1))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Write out everything that follows the records. The file still needs
+ * to be flushed by the caller.
+ */
+static int packed_refs_writer_finish(struct packed_refs_writer *w)
+{
+	unsigned char buf[GIT_MAX_RAWSZ];
+	uint64_t table = w->size;
+
+	if (w->version != 2)
+		return 0;
+
+	for (size_t i = 0; i < w->offsets_nr; i++) {
+		put_be32(buf, w->offsets[i]);
+		if (packed_refs_writer_write(w, buf, PACKED_REFS_V2_OFFSET_SIZE))
+			return -1;
+	}
+
+	put_be64(buf, table);
+	if (packed_refs_writer_write(w, buf, 8))
+		return -1;
+
+	git_hash_final(buf, &w->ctx);
+	if (fwrite(buf, 1, w->algo->rawsz, w->out) != w->algo->rawsz)
+		return -1;
+
+	return 0;
+}
+
+static void packed_refs_writer_release(struct packed_refs_writer *w)
+{
+	free(w->offsets);
+}
+
+static int packed_ref_store_create_on_disk(struct ref_store *ref_store UNUSED,
+					   int flags UNUSED,
+					   struct strbuf *err UNUSED)
+{
+	/* Nothing to do. */
+	return 0;
+}
+
+static int packed_ref_store_remove_on_disk(struct ref_store *ref_store,
 					   struct strbuf *err)
 {
 	struct packed_ref_store *refs = packed_downcast(ref_store, 0, "remove");
 
+	if (remove_path(refs->overlay_path) < 0) {
+		strbuf_addstr(err, "could not delete packed-refs overlay");
+		return -1;
+	}
+
 	if (remove_path(refs->path) < 0) {
 		strbuf_addstr(err, "could not delete packed-refs");
 		return -1;
@@ -1340,6 +2000,43 @@ static int packed_ref_store_remove_on_disk(struct ref_store *ref_store,
 	return 0;
 }
 
+/*
+ * Check the old value that `update` expects, if any, against `oid`,
+ * the current value of the reference (NULL if it doesn't exist). On
+ * mismatch, write an error message to `err` and return the error.
+ */
+static enum ref_transaction_error check_old_value(struct ref_update *update,
+						  const struct object_id *oid,
+						  struct strbuf *err)
+{
+	if (!(update->flags & REF_HAVE_OLD))
+		return 0;
+
+	if (!oid) {
+		if (!is_null_oid(&update->old_oid)) {
+			strbuf_addf(err, "cannot update ref '%s': "
+				    "reference is missing but expected %s",
+				    update->refname,
+				    oid_to_hex(&update->old_oid));
+			return REF_TRANSACTION_ERROR_NONEXISTENT_REF;
+		}
+	} else if (is_null_oid(&update->old_oid)) {
+		strbuf_addf(err, "cannot update ref '%s': "
+			    "reference already exists",
+			    update->refname);
+		return REF_TRANSACTION_ERROR_CREATE_EXISTS;
+	} else if (!oideq(&update->old_oid, oid)) {
+		strbuf_addf(err, "cannot update ref '%s': "
+			    "is at %s but expected %s",
+			    update->refname,
+			    oid_to_hex(oid),
+			    oid_to_hex(&update->old_oid));
+		return REF_TRANSACTION_ERROR_INCORRECT_OLD_VALUE;
+	}
+
+	return 0;
+}
+
 /*
  * Write the packed refs from the current snapshot to the packed-refs
  * tempfile, incorporating any changes from `updates`. `updates` must
@@ -1357,6 +2054,7 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 	enum ref_transaction_error ret = REF_TRANSACTION_ERROR_GENERIC;
 	struct string_list *updates = &transaction->refnames;
 	struct ref_iterator *iter = NULL;
+	struct packed_refs_writer writer = { 0 };
 	size_t i;
 	int ok;
 	FILE *out;
@@ -1390,7 +2088,8 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 		goto error;
 	}
 
-	if (fprintf(out, "%s", PACKED_REFS_HEADER) < 0)
+	if (packed_refs_writer_start(&writer, out, refs->version,
+				     refs->base.repo->hash_algo))
 		goto write_error;
 
 	/*
@@ -1424,44 +2123,29 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 				cmp = strcmp(iter->ref.name, update->refname);
 		}
 
-		if (!cmp) {
+		if (cmp >= 0) {
 			/*
-			 * There is both an old value and an update
-			 * for this reference. Check the old value if
+			 * There is an update for this reference, and
+			 * maybe an old value. Check the old value if
 			 * necessary:
 			 */
-			if ((update->flags & REF_HAVE_OLD)) {
-				if (is_null_oid(&update->old_oid)) {
-					strbuf_addf(err, "cannot update ref '%s': "
-						    "reference already exists",
-						    update->refname);
-					ret = REF_TRANSACTION_ERROR_CREATE_EXISTS;
-
-					if (ref_transaction_maybe_set_rejected(transaction, i, ret)) {
-						strbuf_reset(err);
-						ret = 0;
-						continue;
-					}
-
-					goto error;
-				} else if (!oideq(&update->old_oid, iter->ref.oid)) {
-					strbuf_addf(err, "cannot update ref '%s': "
-						    "is at %s but expected %s",
-						    update->refname,
-						    oid_to_hex(iter->ref.oid),
-						    oid_to_hex(&update->old_oid));
-					ret = REF_TRANSACTION_ERROR_INCORRECT_OLD_VALUE;
-
-					if (ref_transaction_maybe_set_rejected(transaction, i, ret)) {
-						strbuf_reset(err);
-						ret = 0;
-						continue;
-					}
-
-					goto error;
+			enum ref_transaction_error check =
+				check_old_value(update, cmp ? NULL : iter->ref.oid, err);
+
+			if (check) {
+				ret = check;
+
+				if (ref_transaction_maybe_set_rejected(transaction, i, ret)) {
+					strbuf_reset(err);
+					ret = 0;
+					continue;
 				}
+
+				goto error;
 			}
+		}
 
+		if (!cmp) {
 			/* Now figure out what to use for the new value: */
 			if ((update->flags & REF_HAVE_NEW)) {
 				/*
@@ -1482,34 +2166,12 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 				i++;
 				cmp = -1;
 			}
-		} else if (cmp > 0) {
-			/*
-			 * There is no old value but there is an
-			 * update for this reference. Make sure that
-			 * the update didn't expect an existing value:
-			 */
-			if ((update->flags & REF_HAVE_OLD) &&
-			    !is_null_oid(&update->old_oid)) {
-				strbuf_addf(err, "cannot update ref '%s': "
-					    "reference is missing but expected %s",
-					    update->refname,
-					    oid_to_hex(&update->old_oid));
-				ret = REF_TRANSACTION_ERROR_NONEXISTENT_REF;
-
-				if (ref_transaction_maybe_set_rejected(transaction, i, ret)) {
-					strbuf_reset(err);
-					ret = 0;
-					continue;
-				}
-
-				goto error;
-			}
 		}
 
 		if (cmp < 0) {
 			/* Pass the old reference through. */
-			if (write_packed_entry(out, iter->ref.name,
-					       iter->ref.oid, iter->ref.peeled_oid))
+			if (packed_refs_writer_add(&writer, iter->ref.name,
+						   iter->ref.oid, iter->ref.peeled_oid))
 				goto write_error;
 
 			if ((ok = ref_iterator_advance(iter)) != ITER_OK) {
@@ -1530,9 +2192,9 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 			int peel_error = peel_object(refs->base.repo, &update->new_oid,
 						     &peeled, PEEL_OBJECT_VERIFY_TAGGED_OBJECT_TYPE);
 
-			if (write_packed_entry(out, update->refname,
-					       &update->new_oid,
-					       peel_error ? NULL : &peeled))
+			if (packed_refs_writer_add(&writer, update->refname,
+						   &update->new_oid,
+						   peel_error ? NULL : &peeled))
 				goto write_error;
 
 			i++;
@@ -1545,6 +2207,9 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 		goto error;
 	}
 
+	if (packed_refs_writer_finish(&writer))
+		goto write_error;
+
 	if (fflush(out) ||
 	    fsync_component(FSYNC_COMPONENT_REFERENCE, get_tempfile_fd(refs->tempfile)) ||
 	    close_tempfile_gently(refs->tempfile)) {
@@ -1552,10 +2217,12 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 			    get_tempfile_path(refs->tempfile),
 			    strerror(errno));
 		strbuf_release(&sb);
+		packed_refs_writer_release(&writer);
 		delete_tempfile(&refs->tempfile);
 		return REF_TRANSACTION_ERROR_GENERIC;
 	}
 
+	packed_refs_writer_release(&writer);
 	return 0;
 
 write_error:
@@ -1565,10 +2232,230 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 
 error:
 	ref_iterator_free(iter);
+	packed_refs_writer_release(&writer);
 	delete_tempfile(&refs->tempfile);
 	return ret;
 }
 
+/*
+ * Write the overlay of the current snapshot to the overlay tempfile,
+ * incorporating any changes from `updates`. The semantics are the same
+ * as for `write_with_updates()`, except that only the changes relative
+ * to `packed-refs` are written. This costs time proportional to the
+ * size of the overlay and the number of updates, not to the number of
+ * packed references.
+ */
+static enum ref_transaction_error write_overlay_with_updates(struct packed_ref_store *refs,
+							     struct ref_transaction *transaction,
+							     struct strbuf *err)
+{
+	enum ref_transaction_error ret = REF_TRANSACTION_ERROR_GENERIC;
+	const struct git_hash_algo *algo = refs->base.repo->hash_algo;
+	struct string_list *updates = &transaction->refnames;
+	struct snapshot *snapshot = get_snapshot(refs);
+	struct snapshot *overlay = snapshot->overlay;
+	const char *pos = overlay->start, *eof = overlay->eof;
+	struct strbuf sb = STRBUF_INIT;
+	size_t i = 0;
+	FILE *out;
+
+	if (!is_lock_file_locked(&refs->lock))
+		BUG("write_overlay_with_updates() called while unlocked");
+
+	strbuf_addf(&sb, "%s.new", refs->overlay_path);
+	refs->overlay_tempfile = create_tempfile(sb.buf);
+	if (!refs->overlay_tempfile) {
+		strbuf_addf(err, "unable to create file %s: %s",
+			    sb.buf, strerror(errno));
+		strbuf_release(&sb);
+		return REF_TRANSACTION_ERROR_GENERIC;
+	}
+	strbuf_release(&sb);
+
+	out = fdopen_tempfile(refs->overlay_tempfile, "w");
+	if (!out) {
+		strbuf_addf(err, "unable to fdopen packed-refs overlay tempfile: %s",
+			    strerror(errno));
+		goto error;
+	}
+
+	if (fprintf(out, "%s", PACKED_REFS_HEADER) < 0)
+		goto write_error;
+
+	while (pos < eof || i < updates->nr) {
+		struct ref_update *update = NULL;
+		enum ref_transaction_error check;
+		struct snapshot *source;
+		struct object_id oid;
+		const char *rec, *packed_rec;
+		int cmp;
+
+		if (i >= updates->nr) {
+			cmp = -1;
+		} else {
+			update = updates->items[i].util;
+
+			if (pos >= eof)
+				cmp = +1;
+			else
+				cmp = cmp_record_to_refname(pos, update->refname,
+							    1, overlay);
+		}
+
+		if (cmp < 0) {
+			/* Pass the old overlay record through. */
+			const char *end = find_end_of_record(pos, eof);
+
+			if (fwrite(pos, 1, end - pos, out) != end - pos)
+				goto write_error;
+			pos = end;
+			continue;
+		}
+
+		/* Look up the current value of the reference: */
+		packed_rec = find_reference_location(snapshot, update->refname, 1);
+		if (cmp) {
+			source = snapshot;
+			rec = packed_rec;
+		} else {
+			source = overlay;
+			rec = pos;
+		}
+		if (rec)
+			read_record_oid(source, rec, &oid);
+
+		check = check_old_value(update,
+					rec && !is_null_oid(&oid) ? &oid : NULL,
+					err);
+		if (check) {
+			ret = check;
+
+			if (ref_transaction_maybe_set_rejected(transaction, i, ret)) {
+				strbuf_reset(err);
+				ret = 0;
+				continue;
+			}
+
+			goto error;
+		}
+
+		if (!(update->flags & REF_HAVE_NEW)) {
+			/*
+			 * The update doesn't actually want to change
+			 * anything; any old overlay record is passed
+			 * through in the next round.
+			 */
+			i++;
+			continue;
+		}
+
+		if (!cmp)
+			pos = find_end_of_record(pos, eof);
+
+		if (is_null_oid(&update->new_oid)) {
+			/*
+			 * Only references that exist in `packed-refs`
+			 * need to be marked as deleted:
+			 */
+			if (packed_rec &&
+			    write_packed_entry(out, update->refname,
+					       null_oid(algo), NULL))
+				goto write_error;
+		} else {
+			struct object_id peeled;
+			int peel_error = peel_object(refs->base.repo, &update->new_oid,
+						     &peeled, PEEL_OBJECT_VERIFY_TAGGED_OBJECT_TYPE);
+
+			if (write_packed_entry(out, update->refname,
+					       &update->new_oid,
+					       peel_error ? NULL : &peeled))
+				goto write_error;
+		}
+
+		i++;
+	}
+
+	if (fflush(out) ||
+	    fsync_component(FSYNC_COMPONENT_REFERENCE, get_tempfile_fd(refs->overlay_tempfile)) ||
+	    close_tempfile_gently(refs->overlay_tempfile)) {
+		strbuf_addf(err, "error closing file %s: %s",
+			    get_tempfile_path(refs->overlay_tempfile),
+			    strerror(errno));
+		delete_tempfile(&refs->overlay_tempfile);
+		return REF_TRANSACTION_ERROR_GENERIC;
+	}
+
+	return 0;
+
+write_error:
+	strbuf_addf(err, "error writing to %s: %s",
+		    get_tempfile_path(refs->overlay_tempfile), strerror(errno));
+	ret = REF_TRANSACTION_ERROR_GENERIC;
+
+error:
+	delete_tempfile(&refs->overlay_tempfile);
+	return ret;
+}
+
+/*
+ * Return true if `snapshot` has an overlay with any records in it.
+ */
+static int snapshot_has_overlay(struct snapshot *snapshot)
+{
+	return snapshot->overlay &&
+		snapshot->overlay->start != snapshot->overlay->eof;
+}
+
+/*
+ * Return true if `packed-refs` should be rewritten, either to fold its
+ * overlay into it or to convert it to the format version we write.
+ */
+static int packed_refs_need_rewrite(struct packed_ref_store *refs)
+{
+	struct snapshot *snapshot = get_snapshot(refs);
+
+	return snapshot_has_overlay(snapshot) ||
+		(snapshot->buf && snapshot->version != refs->version);
+}
+
+/*
+ * A transaction is recorded in the overlay only as long as that stays
+ * below this fraction of the size of `packed-refs`. Otherwise, it
+ * rewrites `packed-refs`, which folds the overlay back into it. This
+ * bounds the extra work readers have to do for merging the overlay,
+ * and amortizes the cost of rewriting `packed-refs` over many
+ * transactions.
+ */
+#define PACKED_REFS_OVERLAY_RATIO 16
+
+static int want_overlay_write(struct packed_ref_store *refs,
+			      struct ref_transaction *transaction)
+{
+	struct snapshot *snapshot = get_snapshot(refs);
+	size_t size = 0, packed_size, i;
+
+	/*
+	 * Transactions without updates are executed for the side
+	 * effect of rewriting `packed-refs`.
+	 */
+	if (!snapshot->overlay || !transaction->refnames.nr ||
+	    snapshot->start == snapshot->eof)
+		return 0;
+
+	if (snapshot_has_overlay(snapshot))
+		size += snapshot->overlay->eof - snapshot->overlay->start;
+	for (i = 0; i < transaction->refnames.nr; i++)
+		size += 2 * snapshot_hexsz(snapshot) + 4 +
+			strlen(transaction->refnames.items[i].string);
+
+	if (snapshot->version == 2)
+		packed_size = snapshot_buffer_size(snapshot);
+	else
+		packed_size = snapshot->eof - snapshot->start;
+
+	return size <= packed_size / PACKED_REFS_OVERLAY_RATIO;
+}
+
 int is_packed_transaction_needed(struct ref_store *ref_store,
 				 struct ref_transaction *transaction)
 {
@@ -1677,6 +2564,8 @@ static void packed_transaction_cleanup(struct packed_ref_store *refs,
 	if (data) {
 		if (is_tempfile_active(refs->tempfile))
 			delete_tempfile(&refs->tempfile);
+		if (is_tempfile_active(refs->overlay_tempfile))
+			delete_tempfile(&refs->overlay_tempfile);
 
 		if (data->own_lock && is_lock_file_locked(&refs->lock)) {
 			packed_refs_unlock(&refs->base);
@@ -1720,7 +2609,20 @@ static int packed_transaction_prepare(struct ref_store *ref_store,
 		data->own_lock = 1;
 	}
 
-	ret = write_with_updates(refs, transaction, err);
+	if (want_overlay_write(refs, transaction)) {
+		ret = write_overlay_with_updates(refs, transaction, err);
+	} else {
+		ret = write_with_updates(refs, transaction, err);
+
+		/*
+		 * The new `packed-refs` file includes the overlay, which
+		 * is removed once it is in place. Until then, readers may
+		 * still combine the overlay with either version of
+		 * `packed-refs`, so it has to include our updates, too.
+		 */
+		if (!ret && snapshot_has_overlay(get_snapshot(refs)))
+			ret = write_overlay_with_updates(refs, transaction, err);
+	}
 	if (ret)
 		goto failure;
 
@@ -1754,15 +2656,44 @@ static int packed_transaction_finish(struct ref_store *ref_store,
 			REF_STORE_READ | REF_STORE_WRITE | REF_STORE_ODB,
 			"ref_transaction_finish");
 	int ret = REF_TRANSACTION_ERROR_GENERIC;
-	char *packed_refs_path;
+	int wrote_overlay = 0;
+	char *packed_refs_path = NULL;
 
 	clear_snapshot(refs);
 
-	packed_refs_path = get_locked_file_path(&refs->lock);
-	if (rename_tempfile(&refs->tempfile, packed_refs_path)) {
-		strbuf_addf(err, "error replacing %s: %s",
-			    refs->path, strerror(errno));
-		goto cleanup;
+	/*
+	 * The overlay has to be replaced before `packed-refs` and may
+	 * only be removed after it; see `create_snapshot()`.
+	 */
+	if (is_tempfile_active(refs->overlay_tempfile)) {
+		if (rename_tempfile(&refs->overlay_tempfile, refs->overlay_path)) {
+			strbuf_addf(err, "error replacing %s: %s",
+				    refs->overlay_path, strerror(errno));
+			goto cleanup;
+		}
+		wrote_overlay = 1;
+	}
+
+	if (is_tempfile_active(refs->tempfile)) {
+		packed_refs_path = get_locked_file_path(&refs->lock);
+		if (rename_tempfile(&refs->tempfile, packed_refs_path)) {
+			/*
+			 * If the overlay has been replaced, it already
+			 * records the whole transaction.
+			 */
+			if (wrote_overlay) {
+				warning_errno(_("unable to fold overlay into %s"),
+					      refs->path);
+				ret = 0;
+				goto cleanup;
+			}
+			strbuf_addf(err, "error replacing %s: %s",
+				    refs->path, strerror(errno));
+			goto cleanup;
+		}
+
+		if (refs->use_overlay)
+			unlink_or_warn(refs->overlay_path);
 	}
 
 	ret = 0;
@@ -1773,25 +2704,51 @@ static int packed_transaction_finish(struct ref_store *ref_store,
 	return ret;
 }
 
-static int packed_optimize(struct ref_store *ref_store UNUSED,
+static int packed_optimize(struct ref_store *ref_store,
 			   struct refs_optimize_opts *opts UNUSED)
 {
+	struct packed_ref_store *refs = packed_downcast(
+			ref_store, REF_STORE_READ | REF_STORE_WRITE | REF_STORE_ODB,
+			"optimize");
+	struct ref_transaction *transaction;
+	struct strbuf err = STRBUF_INIT;
+	int ret = 0;
+
 	/*
 	 * Packed refs are already packed. It might be that loose refs
 	 * are packed *into* a packed refs store, but that is done by
 	 * updating the packed references via a transaction.
+	 *
+	 * All that is left to do is to fold the overlay, if any, into
+	 * `packed-refs` and to convert it to the format version we write.
+	 * A transaction without updates does exactly that, as it always
+	 * rewrites `packed-refs`.
 	 */
-	return 0;
+	if (!packed_refs_need_rewrite(refs))
+		return 0;
+
+	transaction = ref_store_transaction_begin(ref_store, 0, &err);
+	if (!transaction || ref_transaction_commit(transaction, &err))
+		ret = error(_("unable to rewrite packed-refs: %s"), err.buf);
+
+	ref_transaction_free(transaction);
+	strbuf_release(&err);
+	return ret;
 }
 
-static int packed_optimize_required(struct ref_store *ref_store UNUSED,
+static int packed_optimize_required(struct ref_store *ref_store,
 				    struct refs_optimize_opts *opts UNUSED,
 				    bool *required)
 {
+	struct packed_ref_store *refs = packed_downcast(ref_store, REF_STORE_READ,
+							"optimize_required");
+
 	/*
-	 * Packed refs are already optimized.
+	 * Packed refs are already optimized, except for an overlay
+	 * that has not been folded into them yet, or if they are not in
+	 * the format version we write.
 	 */
-	*required = false;
+	*required = packed_refs_need_rewrite(refs);
 	return 0;
 }
 
@@ -2057,6 +3014,97 @@ static int packed_fsck_ref_content(struct fsck_options *o,
 	return ret;
 }
 
+/*
+ * Check a `packed-refs` file in version 2 of the format: its header,
+ * checksum and offset table, and that its records are valid and sorted.
+ */
+static int packed_fsck_v2(struct fsck_options *o,
+			  struct ref_store *ref_store,
+			  const char *buf, size_t size)
+{
+	const struct git_hash_algo *algo = ref_store->repo->hash_algo;
+	size_t trailer_size = 8 + algo->rawsz;
+	struct strbuf packed_entry = STRBUF_INIT;
+	struct fsck_ref_report report = { 0 };
+	struct strbuf refname = STRBUF_INIT;
+	struct strbuf prev = STRBUF_INIT;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	struct git_hash_ctx ctx;
+	uint64_t table, pos;
+	int ret = 0;
+
+	report.path = "packed-refs.header";
+	if (size < PACKED_REFS_V2_HEADER_SIZE + trailer_size ||
+	    get_be32(buf + 4) != 2 ||
+	    get_be32(buf + 8) != algo->format_id)
+		return fsck_report_ref(o, &report,
+				       FSCK_MSG_BAD_PACKED_REF_HEADER,
+				       "unsupported version or hash algorithm");
+
+	algo->init_fn(&ctx);
+	git_hash_update(&ctx, buf, size - algo->rawsz);
+	git_hash_final(hash, &ctx);
+	if (!hasheq(hash, (const unsigned char *)buf + size - algo->rawsz, algo))
+		return fsck_report_ref(o, &report,
+				       FSCK_MSG_BAD_PACKED_REF_HEADER,
+				       "checksum mismatch");
+
+	table = get_be64(buf + size - trailer_size);
+	if (table < PACKED_REFS_V2_HEADER_SIZE ||
+	    table > size - trailer_size ||
+	    (size - trailer_size - table) % PACKED_REFS_V2_OFFSET_SIZE ||
+	    (table > PACKED_REFS_V2_HEADER_SIZE && buf[table - 1]))
+		return fsck_report_ref(o, &report,
+				       FSCK_MSG_BAD_PACKED_REF_HEADER,
+				       "invalid offset table");
+
+	for (pos = table; pos < size - trailer_size; pos += PACKED_REFS_V2_OFFSET_SIZE) {
+		uint32_t off = get_be32(buf + pos);
+		const char *name, *end;
+
+		strbuf_reset(&packed_entry);
+		strbuf_addf(&packed_entry, "packed-refs entry %"PRIuMAX,
+			    (uintmax_t)(pos - table) / PACKED_REFS_V2_OFFSET_SIZE + 1);
+		report.path = packed_entry.buf;
+
+		if (off < PACKED_REFS_V2_HEADER_SIZE ||
+		    off + 1 + algo->rawsz >= table ||
+		    ((buf[off] & PACKED_REFS_V2_PEELED) &&
+		     off + 1 + 2 * algo->rawsz >= table)) {
+			ret |= fsck_report_ref(o, &report,
+					       FSCK_MSG_BAD_PACKED_REF_ENTRY,
+					       "record offset %"PRIu32" is out of bounds",
+					       off);
+			continue;
+		}
+
+		name = buf + off + 1 + algo->rawsz;
+		if (buf[off] & PACKED_REFS_V2_PEELED)
+			name += algo->rawsz;
+		end = memchr(name, '\0', buf + table - name);
+
+		strbuf_reset(&refname);
+		strbuf_add(&refname, name, end - name);
+		if (check_refname_format(refname.buf, 0))
+			ret |= fsck_report_ref(o, &report,
+					       FSCK_MSG_BAD_REF_NAME,
+					       "has bad refname '%s'", refname.buf);
+
+		if (pos > table && strcmp(prev.buf, refname.buf) >= 0)
+			ret |= fsck_report_ref(o, &report,
+					       FSCK_MSG_PACKED_REF_UNSORTED,
+					       "refname '%s' is less than previous refname '%s'",
+					       refname.buf, prev.buf);
+
+		strbuf_swap(&prev, &refname);
+	}
+
+	strbuf_release(&packed_entry);
+	strbuf_release(&refname);
+	strbuf_release(&prev);
+	return ret;
+}
+
 static int packed_fsck(struct ref_store *ref_store,
 		       struct fsck_options *o,
 		       struct worktree *wt)
@@ -2116,6 +3164,13 @@ static int packed_fsck(struct ref_store *ref_store,
 		goto cleanup;
 	}
 
+	if (snapshot.eof - snapshot.buf >= 4 &&
+	    get_be32(snapshot.buf) == PACKED_REFS_V2_SIGNATURE) {
+		ret = packed_fsck_v2(o, ref_store, snapshot.buf,
+				     snapshot.eof - snapshot.buf);
+		goto cleanup;
+	}
+
 	ret = packed_fsck_ref_content(o, ref_store, &sorted, snapshot.start,
 				      snapshot.eof);
 	if (!ret && sorted)
@@ -2149,6 +3204,7 @@ struct ref_storage_be refs_be_packed = {
 	.iterator_begin = packed_ref_iterator_begin,
 	.read_raw_ref = packed_read_raw_ref,
 	.read_symbolic_ref = NULL,
+	.read_raw_refs = packed_read_raw_refs,
 
 	.reflog_iterator_begin = packed_reflog_iterator_begin,
 	.for_each_reflog_ent = NULL,
@@ -3,6 +3,7 @@
 
 #include "refs.h"
 #include "iterator.h"
+#include "strbuf.h"
 #include "string-list.h"
 
 struct fsck_options;
@@ -148,6 +149,30 @@ int refs_read_raw_ref(struct ref_store *ref_store, const char *refname,
 		      struct object_id *oid, struct strbuf *referent,
 		      unsigned int *type, int *failure_errno);
 
+/*
+ * A request to read a single reference as part of a batch passed to
+ * `read_raw_refs_fn`. `refname` is the input; the other members are
+ * filled in like the respective arguments of `read_raw_ref_fn`, with
+ * `result` holding its return value. `referent` must have been
+ * initialized by the caller.
+ */
+struct raw_ref_read {
+	const char *refname;
+	struct object_id oid;
+	struct strbuf referent;
+	unsigned int type;
+	int failure_errno;
+	int result;
+};
+
+/*
+ * Read the references in `reads`, which must be sorted by refname and
+ * must not include pseudorefs, with the semantics of
+ * `refs_read_raw_ref()`.
+ */
+void refs_read_raw_refs(struct ref_store *ref_store,
+			struct raw_ref_read *reads, size_t nr);
+
 /*
  * Mark a given update as rejected with a given reason.
  */
@@ -538,6 +563,15 @@ typedef int read_raw_ref_fn(struct ref_store *ref_store, const char *refname,
 typedef int read_symbolic_ref_fn(struct ref_store *ref_store, const char *refname,
 				 struct strbuf *referent);
 
+/*
+ * Read many references at once, with the same semantics as calling
+ * `read_raw_ref_fn` for each of them. `reads` must be sorted by
+ * refname. This allows backends to find all of them in a single pass
+ * over their data instead of searching for each reference anew.
+ */
+typedef void read_raw_refs_fn(struct ref_store *ref_store,
+			      struct raw_ref_read *reads, size_t nr);
+
 typedef int fsck_fn(struct ref_store *ref_store,
 		    struct fsck_options *o,
 		    struct worktree *wt);
@@ -566,6 +600,7 @@ struct ref_storage_be {
 	 * behaviour.
 	 */
 	read_symbolic_ref_fn *read_symbolic_ref;
+	read_raw_refs_fn *read_raw_refs;
 
 	reflog_iterator_begin_fn *reflog_iterator_begin;
 	for_each_reflog_ent_fn *for_each_reflog_ent;
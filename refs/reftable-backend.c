@@ -22,8 +22,10 @@
 #include "../reftable/reftable-record.h"
 #include "../reftable/reftable-stack.h"
 #include "../repo-settings.h"
+#include "../run-command.h"
 #include "../setup.h"
 #include "../strmap.h"
+#include "../thread-utils.h"
 #include "../trace2.h"
 #include "../write-or-die.h"
 #include "parse.h"
@@ -63,6 +65,38 @@ static void reftable_backend_release(struct reftable_backend *be)
 	reftable_iterator_destroy(&be->it);
 }
 
+static void reftable_backend_ref_value(struct reftable_backend *be,
+				      struct reftable_ref_record *ref,
+				      struct object_id *oid,
+				      struct strbuf *referent,
+				      unsigned int *type)
+{
+	if (ref->value_type == REFTABLE_REF_SYMREF) {
+		strbuf_reset(referent);
+		strbuf_addstr(referent, ref->value.symref);
+		*type |= REF_ISSYMREF;
+	} else if (reftable_ref_record_val1(ref)) {
+		unsigned int hash_id;
+
+		switch (reftable_stack_hash_id(be->stack)) {
+		case REFTABLE_HASH_SHA1:
+			hash_id = GIT_HASH_SHA1;
+			break;
+		case REFTABLE_HASH_SHA256:
+			hash_id = GIT_HASH_SHA256;
+			break;
+		default:
+			BUG("unhandled hash ID %d", reftable_stack_hash_id(be->stack));
+		}
+
+		oidread(oid, reftable_ref_record_val1(ref),
+			&hash_algos[hash_id]);
+	} else {
+		/* We got a tombstone, which should not happen. */
+		BUG("unhandled reference value type %d", ref->value_type);
+	}
+}
+
 static int reftable_backend_read_ref(struct reftable_backend *be,
 				     const char *refname,
 				     struct object_id *oid,
@@ -91,30 +125,7 @@ static int reftable_backend_read_ref(struct reftable_backend *be,
 		goto done;
 	}
 
-	if (ref.value_type == REFTABLE_REF_SYMREF) {
-		strbuf_reset(referent);
-		strbuf_addstr(referent, ref.value.symref);
-		*type |= REF_ISSYMREF;
-	} else if (reftable_ref_record_val1(&ref)) {
-		unsigned int hash_id;
-
-		switch (reftable_stack_hash_id(be->stack)) {
-		case REFTABLE_HASH_SHA1:
-			hash_id = GIT_HASH_SHA1;
-			break;
-		case REFTABLE_HASH_SHA256:
-			hash_id = GIT_HASH_SHA256;
-			break;
-		default:
-			BUG("unhandled hash ID %d", reftable_stack_hash_id(be->stack));
-		}
-
-		oidread(oid, reftable_ref_record_val1(&ref),
-			&hash_algos[hash_id]);
-	} else {
-		/* We got a tombstone, which should not happen. */
-		BUG("unhandled reference value type %d", ref.value_type);
-	}
+	reftable_backend_ref_value(be, &ref, oid, referent, type);
 
 done:
 	assert(ret != REFTABLE_API_ERROR);
@@ -144,9 +155,32 @@ struct reftable_ref_store {
 
 	unsigned int store_flags;
 	enum log_refs_config log_all_ref_updates;
+	int auto_compact_detach;
+	unsigned int iterator_threads;
 	int err;
 };
 
+/*
+ * Compact the stack in a detached git-pack-refs(1) process so that the writer
+ * does not have to wait for it. The compacting process only takes the lock of
+ * "tables.list" to swap in the compacted table, so it does not block
+ * concurrent writers either.
+ */
+static int reftable_be_auto_compact_detached(void *payload)
+{
+	struct reftable_ref_store *refs = payload;
+	struct child_process cmd = CHILD_PROCESS_INIT;
+
+	cmd.git_cmd = 1;
+	cmd.no_stdin = 1;
+	cmd.no_stdout = 1;
+	cmd.no_stderr = 1;
+	prepare_other_repo_env(&cmd.env, refs->base.gitdir);
+	strvec_pushl(&cmd.args, "pack-refs", "--auto", "--detach", NULL);
+
+	return run_command(&cmd);
+}
+
 /*
  * Downcast ref_store to reftable_ref_store. Die if ref_store is not a
  * reftable_ref_store. required_flags is compared with ref_store's store_flags
@@ -344,6 +378,8 @@ static int reftable_be_config(const char *var, const char *value,
 		if (lock_timeout < 0 && lock_timeout != -1)
 			die("reftable lock timeout does not support negative values other than -1");
 		opts->lock_timeout_ms = lock_timeout;
+	} else if (!strcmp(var, "reftable.blockcachesize")) {
+		opts->block_cache_size = git_config_ulong(var, value, ctx->kvi);
 	}
 
 	return 0;
@@ -359,7 +395,9 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 					  unsigned int store_flags)
 {
 	struct reftable_ref_store *refs = xcalloc(1, sizeof(*refs));
+	struct reftable_write_options detached_opts;
 	struct strbuf path = STRBUF_INIT;
+	int iterator_threads;
 	int is_worktree;
 	mode_t mask;
 
@@ -385,9 +423,17 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 	refs->write_options.disable_auto_compact =
 		!git_env_bool("GIT_TEST_REFTABLE_AUTOCOMPACTION", 1);
 	refs->write_options.lock_timeout_ms = 100;
+	refs->write_options.block_cache_size = 4 * 1024 * 1024;
 	refs->write_options.fsync = reftable_be_fsync;
 
 	repo_config(the_repository, reftable_be_config, &refs->write_options);
+	repo_config_get_bool(the_repository, "reftable.autocompactdetach",
+			     &refs->auto_compact_detach);
+	if (!repo_config_get_int(the_repository, "reftable.iteratorthreads",
+				 &iterator_threads) && iterator_threads >= 0)
+		refs->iterator_threads = iterator_threads ? iterator_threads : online_cpus();
+	else
+		refs->iterator_threads = 1;
 
 	/*
 	 * It is somewhat unfortunate that we have to mirror the default block
@@ -399,6 +445,18 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 	if (!refs->write_options.block_size)
 		refs->write_options.block_size = 4096;
 
+	/*
+	 * git-pack-refs(1) compacts the worktree stack if there is one, and the
+	 * main stack otherwise. This is the only stack that we can thus hand
+	 * over to a detached process for auto-compaction, all other stacks are
+	 * compacted synchronously.
+	 */
+	detached_opts = refs->write_options;
+	if (refs->auto_compact_detach) {
+		detached_opts.on_auto_compact = reftable_be_auto_compact_detached;
+		detached_opts.on_auto_compact_payload = refs;
+	}
+
 	/*
 	 * Set up the main reftable stack that is hosted in GIT_COMMON_DIR.
 	 * This stack contains both the shared and the main worktree refs.
@@ -413,7 +471,7 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 	}
 	strbuf_addstr(&path, "/reftable");
 	refs->err = reftable_backend_init(&refs->main_backend, path.buf,
-					  &refs->write_options);
+					  is_worktree ? &refs->write_options : &detached_opts);
 	if (refs->err)
 		goto done;
 
@@ -430,7 +488,7 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 		strbuf_addf(&path, "%s/reftable", gitdir);
 
 		refs->err = reftable_backend_init(&refs->worktree_backend, path.buf,
-						  &refs->write_options);
+						  &detached_opts);
 		if (refs->err)
 			goto done;
 	}
@@ -544,7 +602,9 @@ static int reftable_be_remove_on_disk(struct ref_store *ref_store,
 struct reftable_ref_iterator {
 	struct ref_iterator base;
 	struct reftable_ref_store *refs;
+	struct reftable_stack *stack;
 	struct reftable_iterator iter;
+	int parallel;
 	struct reftable_ref_record ref;
 	struct object_id oid;
 	struct object_id peeled_oid;
@@ -725,6 +785,25 @@ static int reftable_ref_iterator_advance(struct ref_iterator *ref_iterator)
 	return ITER_OK;
 }
 
+/*
+ * Merging the tables in parallel speeds up listing all references after the
+ * seeked-to reference, but is wasteful when we only look at the references
+ * matching a prefix as the parallel iterator reads ahead.
+ */
+static int reftable_ref_iterator_init(struct reftable_ref_iterator *iter,
+				      int parallel)
+{
+	if (iter->iter.ops && iter->parallel == parallel)
+		return 0;
+
+	reftable_iterator_destroy(&iter->iter);
+	iter->parallel = parallel;
+	if (parallel)
+		return reftable_stack_init_parallel_ref_iterator(iter->stack, &iter->iter,
+								 iter->refs->iterator_threads);
+	return reftable_stack_init_ref_iterator(iter->stack, &iter->iter);
+}
+
 static int reftable_ref_iterator_seek(struct ref_iterator *ref_iterator,
 				      const char *refname, unsigned int flags)
 {
@@ -739,6 +818,12 @@ static int reftable_ref_iterator_seek(struct ref_iterator *ref_iterator,
 		iter->prefix = xstrdup_or_null(refname);
 		iter->prefix_len = refname ? strlen(refname) : 0;
 	}
+
+	iter->err = reftable_ref_iterator_init(iter, iter->refs->iterator_threads > 1 &&
+					       !iter->prefix_len);
+	if (iter->err)
+		return iter->err;
+
 	iter->err = reftable_iterator_seek_ref(&iter->iter, refname);
 
 	return iter->err;
@@ -821,6 +906,7 @@ static struct reftable_ref_iterator *ref_iterator_for_stack(struct reftable_ref_
 	iter->base.ref.oid = &iter->oid;
 	iter->flags = flags;
 	iter->refs = refs;
+	iter->stack = stack;
 	iter->exclude_patterns = filter_exclude_patterns(exclude_patterns);
 
 	ret = refs->err;
@@ -831,10 +917,6 @@ static struct reftable_ref_iterator *ref_iterator_for_stack(struct reftable_ref_
 	if (ret)
 		goto done;
 
-	ret = reftable_stack_init_ref_iterator(stack, &iter->iter);
-	if (ret)
-		goto done;
-
 	ret = reftable_ref_iterator_seek(&iter->base, prefix,
 					 REF_ITERATOR_SEEK_SET_PREFIX);
 	if (ret)
@@ -909,6 +991,122 @@ static int reftable_be_read_raw_ref(struct ref_store *ref_store,
 	return 0;
 }
 
+/*
+ * The number of records that reading a batch of references steps over
+ * to get from one of them to the next before seeking instead.
+ */
+#define READ_REFS_MAX_STEPS 16
+
+static void reftable_be_read_raw_refs(struct ref_store *ref_store,
+				      struct raw_ref_read *reads, size_t nr)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_READ, "read_raw_refs");
+	struct reftable_backend **reloaded = NULL;
+	size_t reloaded_nr = 0, reloaded_alloc = 0;
+	struct reftable_ref_record ref = {0};
+	/*
+	 * The backend whose iterator has last been used, the name it has
+	 * been positioned at and whether `ref` holds the first record
+	 * at or after that name.
+	 */
+	struct reftable_backend *cur_be = NULL;
+	const char *cur_refname = NULL;
+	int have_ref = 0;
+
+	for (size_t i = 0; i < nr; i++) {
+		struct raw_ref_read *read = &reads[i];
+		struct reftable_backend *be;
+		const char *refname;
+		int ret, seek = 1, is_reloaded = 0;
+
+		read->type = 0;
+		read->failure_errno = 0;
+
+		if (refs->err < 0) {
+			read->result = refs->err;
+			continue;
+		}
+
+		ret = backend_for(&be, refs, read->refname, &refname, 0);
+		if (ret)
+			goto fail;
+
+		/* Reload each stack only once per batch. */
+		for (size_t j = 0; j < reloaded_nr; j++) {
+			if (reloaded[j] == be) {
+				is_reloaded = 1;
+				break;
+			}
+		}
+		if (!is_reloaded) {
+			ret = reftable_stack_reload(be->stack);
+			if (ret)
+				goto fail;
+			ALLOC_GROW(reloaded, reloaded_nr + 1, reloaded_alloc);
+			reloaded[reloaded_nr++] = be;
+		}
+
+		/*
+		 * As the batch is sorted, the reference we are looking for is
+		 * usually close to the previous one, so we may be able to get
+		 * there by stepping over a few records instead of seeking.
+		 */
+		if (cur_be == be && strcmp(cur_refname, refname) <= 0) {
+			for (int steps = 0;
+			     have_ref && strcmp(ref.refname, refname) < 0 &&
+			     steps < READ_REFS_MAX_STEPS;
+			     steps++) {
+				ret = reftable_iterator_next_ref(&be->it, &ref);
+				if (ret < 0)
+					goto fail;
+				have_ref = !ret;
+			}
+			seek = have_ref && strcmp(ref.refname, refname) < 0;
+		}
+
+		if (seek) {
+			cur_be = NULL;
+			if (!be->it.ops) {
+				ret = reftable_stack_init_ref_iterator(be->stack,
+								       &be->it);
+				if (ret)
+					goto fail;
+			}
+
+			ret = reftable_iterator_seek_ref(&be->it, refname);
+			if (ret)
+				goto fail;
+
+			ret = reftable_iterator_next_ref(&be->it, &ref);
+			if (ret < 0)
+				goto fail;
+			have_ref = !ret;
+			cur_be = be;
+		}
+		cur_refname = refname;
+
+		if (!have_ref || strcmp(ref.refname, refname)) {
+			read->failure_errno = ENOENT;
+			read->result = -1;
+			continue;
+		}
+
+		reftable_backend_ref_value(be, &ref, &read->oid,
+					   &read->referent, &read->type);
+		read->result = 0;
+		continue;
+
+fail:
+		assert(ret != REFTABLE_API_ERROR);
+		cur_be = NULL;
+		read->result = ret;
+	}
+
+	reftable_ref_record_release(&ref);
+	free(reloaded);
+}
+
 static int reftable_be_read_symbolic_ref(struct ref_store *ref_store,
 					 const char *refname,
 					 struct strbuf *referent)
@@ -2787,6 +2985,7 @@ struct ref_storage_be refs_be_reftable = {
 	.iterator_begin = reftable_be_iterator_begin,
 	.read_raw_ref = reftable_be_read_raw_ref,
 	.read_symbolic_ref = reftable_be_read_symbolic_ref,
+	.read_raw_refs = reftable_be_read_raw_refs,
 
 	.reflog_iterator_begin = reftable_be_reflog_iterator_begin,
 	.for_each_reflog_ent = reftable_be_for_each_reflog_ent,
@@ -400,46 +400,100 @@ void block_iter_seek_start(struct block_iter *it)
 	it->next_off = it->block->header_off + 4;
 }
 
-struct restart_needle_less_args {
-	int error;
-	struct reftable_buf needle;
-	const struct reftable_block *block;
-};
+/*
+ * Return the length of the common prefix of `a` and `b`, comparing a word
+ * at a time for as long as the two agree.
+ */
+static size_t common_prefix_len(const unsigned char *a, const unsigned char *b,
+				size_t len)
+{
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t x, y;
+		memcpy(&x, a + i, sizeof(x));
+		memcpy(&y, b + i, sizeof(y));
+		if (x != y)
+			break;
+	}
+	while (i < len && a[i] == b[i])
+		i++;
+
+	return i;
+}
 
-static int restart_needle_less(size_t idx, void *_args)
+/*
+ * Check whether the key of the record at restart point `idx` is smaller
+ * than or equal to `want`. Returns 1 if so, 0 if not and -1 if the record
+ * is corrupt.
+ */
+static int restart_key_le(const struct reftable_block *block, size_t idx,
+			  const struct reftable_buf *want)
 {
-	struct restart_needle_less_args *args = _args;
-	uint32_t off = block_restart_offset(args->block, idx);
+	uint32_t off = block_restart_offset(block, idx);
 	struct string_view in = {
-		.buf = args->block->block_data.data + off,
-		.len = args->block->restart_off - off,
+		.buf = block->block_data.data + off,
+		.len = block->restart_off - off,
 	};
 	uint64_t prefix_len, suffix_len;
 	uint8_t extra;
+	size_t len;
 	int n;
 
 	/*
 	 * Records at restart points are stored without prefix compression, so
-	 * there is no need to fully decode the record key here. This removes
-	 * the need for allocating memory.
+	 * we can compare their key in place without decoding it first.
 	 */
 	n = reftable_decode_keylen(in, &prefix_len, &suffix_len, &extra);
-	if (n < 0 || prefix_len) {
-		args->error = 1;
+	if (n < 0 || prefix_len)
 		return -1;
-	}
 
 	string_view_consume(&in, n);
-	if (suffix_len > in.len) {
-		args->error = 1;
+	if (suffix_len > in.len)
 		return -1;
-	}
 
-	n = memcmp(args->needle.buf, in.buf,
-		   args->needle.len < suffix_len ? args->needle.len : suffix_len);
+	len = want->len < suffix_len ? want->len : suffix_len;
+	n = memcmp(in.buf, want->buf, len);
 	if (n)
 		return n < 0;
-	return args->needle.len < suffix_len;
+	return suffix_len <= want->len;
+}
+
+/*
+ * Find the first restart point whose key is greater than `want`, which is
+ * the number of restart points whose key is smaller or equal to it. The
+ * restart table is an array of fixed-size offsets, so the search does not
+ * need any indirection. It halves the range unconditionally and only
+ * moves its base depending on the comparison so that the loop itself does
+ * not branch on the outcome of comparisons. Returns -1 on corrupt blocks.
+ */
+static int restart_search(const struct reftable_block *block,
+			  const struct reftable_buf *want, size_t *out)
+{
+	size_t base = 0, len = block->restart_count;
+	int le;
+
+	if (!len) {
+		*out = 0;
+		return 0;
+	}
+
+	while (len > 1) {
+		size_t half = len / 2;
+
+		le = restart_key_le(block, base + half, want);
+		if (le < 0)
+			return -1;
+		base += le * half;
+		len -= half;
+	}
+
+	le = restart_key_le(block, base, want);
+	if (le < 0)
+		return -1;
+
+	*out = base + le;
+	return 0;
 }
 
 int block_iter_next(struct block_iter *it, struct reftable_record *rec)
@@ -487,13 +541,12 @@ void block_iter_close(struct block_iter *it)
 
 int block_iter_seek_key(struct block_iter *it, struct reftable_buf *want)
 {
-	struct restart_needle_less_args args = {
-		.needle = *want,
-		.block = it->block,
-	};
+	const struct reftable_block *block = it->block;
 	struct reftable_record rec;
-	int err = 0;
+	size_t prev_len = 0, common = 0;
+	uint32_t off;
 	size_t i;
+	int err = 0;
 
 	/*
 	 * Perform a binary search over the block's restart points, which
@@ -507,8 +560,11 @@ int block_iter_seek_key(struct block_iter *it, struct reftable_buf *want)
 	 * restart point. While that works alright, we would end up scanning
 	 * too many record.
 	 */
-	i = binsearch(it->block->restart_count, &restart_needle_less, &args);
-	if (args.error) {
+	err = reftable_record_init(&rec, reftable_block_type(block));
+	if (err < 0)
+		return err;
+
+	if (restart_search(block, want, &i) < 0) {
 		err = REFTABLE_FORMAT_ERROR;
 		goto done;
 	}
@@ -532,57 +588,99 @@ int block_iter_seek_key(struct block_iter *it, struct reftable_buf *want)
 	 *     starting from the preceding restart point.
 	 */
 	if (i > 0)
-		it->next_off = block_restart_offset(it->block, i - 1);
+		off = block_restart_offset(block, i - 1);
 	else
-		it->next_off = it->block->header_off + 4;
-
-	err = reftable_record_init(&rec, reftable_block_type(it->block));
-	if (err < 0)
-		goto done;
+		off = block->header_off + 4;
 
 	/*
-	 * We're looking for the last entry less than the wanted key so that
-	 * the next call to `block_reader_next()` would yield the wanted
-	 * record. We thus don't want to position our iterator at the sought
-	 * after record, but one before. To do so, we have to go one entry too
-	 * far and then back up.
+	 * We're looking for the first record whose key is greater or equal to
+	 * the wanted key, and position the iterator right at it so that the
+	 * next call to `block_iter_next()` yields it.
+	 *
+	 * Keys are prefix-compressed, so we only ever compare the suffix of
+	 * each record that is not known to be shared with `want` already, and
+	 * skip over the values of smaller records without decoding them. To
+	 * do so we track the length of the common prefix of the preceding key
+	 * and `want`. As the preceding key is smaller than `want`, it differs
+	 * from `want` right after that common prefix. So if a key shares a
+	 * longer prefix than that with its predecessor, it is smaller than
+	 * `want`, too, and we need not even look at its suffix.
 	 */
-	while (1) {
-		size_t prev_off = it->next_off;
-
-		err = block_iter_next(it, &rec);
-		if (err < 0)
+	while (off < block->restart_off) {
+		struct string_view in = {
+			.buf = block->block_data.data + off,
+			.len = block->restart_off - off,
+		};
+		uint64_t prefix_len, suffix_len;
+		const unsigned char *suffix;
+		uint8_t extra;
+		int n;
+
+		n = reftable_decode_keylen(in, &prefix_len, &suffix_len, &extra);
+		if (n < 0 || prefix_len > prev_len) {
+			err = REFTABLE_FORMAT_ERROR;
 			goto done;
-		if (err > 0) {
-			it->next_off = prev_off;
-			err = 0;
+		}
+		string_view_consume(&in, n);
+		if (suffix_len > in.len || !(prefix_len + suffix_len)) {
+			err = REFTABLE_FORMAT_ERROR;
 			goto done;
 		}
+		suffix = in.buf;
+		string_view_consume(&in, suffix_len);
+
+		if (prefix_len <= common) {
+			size_t want_rest = want->len - prefix_len;
+			size_t len = suffix_len < want_rest ? suffix_len : want_rest;
+			size_t match = 0;
+
+			if (len)
+				match = common_prefix_len(suffix,
+							  (unsigned char *)want->buf + prefix_len,
+							  len);
+
+			if (match == len ? suffix_len >= want_rest :
+			    suffix[match] > (unsigned char)want->buf[prefix_len + match]) {
+				/*
+				 * This is the first key that is greater or
+				 * equal to `want`. It shares its first
+				 * `prefix_len` bytes with `want`, so we can
+				 * materialize it without having decoded any
+				 * of the preceding keys.
+				 */
+				reftable_buf_reset(&it->last_key);
+				if (prefix_len)
+					err = reftable_buf_add(&it->last_key, want->buf,
+							       prefix_len);
+				if (!err)
+					err = reftable_buf_add(&it->last_key, suffix,
+							       suffix_len);
+				if (err < 0)
+					goto done;
+				break;
+			}
 
-		err = reftable_record_key(&rec, &it->last_key);
-		if (err < 0)
-			goto done;
+			common = prefix_len + match;
+		}
 
-		/*
-		 * Check whether the current key is greater or equal to the
-		 * sought-after key. In case it is greater we know that the
-		 * record does not exist in the block and can thus abort early.
-		 * In case it is equal to the sought-after key we have found
-		 * the desired record.
-		 *
-		 * Note that we store the next record's key record directly in
-		 * `last_key` without restoring the key of the preceding record
-		 * in case we need to go one record back. This is safe to do as
-		 * `block_iter_next()` would return the ref whose key is equal
-		 * to `last_key` now, and naturally all keys share a prefix
-		 * with themselves.
-		 */
-		if (reftable_buf_cmp(&it->last_key, want) >= 0) {
-			it->next_off = prev_off;
+		n = reftable_record_skip(&rec, extra, in, block->hash_size);
+		if (n < 0) {
+			err = REFTABLE_FORMAT_ERROR;
 			goto done;
 		}
+		string_view_consume(&in, n);
+
+		prev_len = prefix_len + suffix_len;
+		off = in.buf - block->block_data.data;
 	}
 
+	/*
+	 * If we have exhausted the block, the iterator is positioned at its
+	 * end and the next call to `block_iter_next()` signals so.
+	 */
+	it->next_off = off;
+	err = 0;
+
 done:
 	reftable_record_release(&rec);
 	return err;
@@ -0,0 +1,259 @@
+#include "blockcache.h"
+
+#include "basics.h"
+#include "reftable-constants.h"
+#include "reftable-error.h"
+#include "table.h"
+
+struct reftable_block_cache {
+	size_t max_bytes;
+	uint64_t refcount;
+
+	struct block_cache_entry **buckets;
+	size_t buckets_len;
+
+	/*
+	 * Unpinned entries in least-recently-used order. Pinned entries are
+	 * not on the list and thus can never be evicted.
+	 */
+	struct block_cache_entry *lru_head, *lru_tail;
+
+	/* Inflate state reused across all log blocks we decode. */
+	struct z_stream_s *zstream;
+
+	struct reftable_block_cache_stats stats;
+};
+
+#define BLOCK_CACHE_INITIAL_BUCKETS 64
+
+int block_cache_new(struct reftable_block_cache **out, size_t max_bytes)
+{
+	struct reftable_block_cache *cache;
+
+	REFTABLE_CALLOC_ARRAY(cache, 1);
+	if (!cache)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+
+	cache->buckets_len = BLOCK_CACHE_INITIAL_BUCKETS;
+	REFTABLE_CALLOC_ARRAY(cache->buckets, cache->buckets_len);
+	if (!cache->buckets) {
+		reftable_free(cache);
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	}
+	cache->max_bytes = max_bytes;
+	cache->refcount = 1;
+
+	*out = cache;
+	return 0;
+}
+
+static size_t block_cache_hash(struct reftable_table *t, uint64_t off)
+{
+	uint64_t h = (uint64_t)(uintptr_t)t ^ off;
+	h *= 0x9e3779b97f4a7c15ULL;
+	return h >> 32;
+}
+
+static struct block_cache_entry **block_cache_bucket(struct reftable_block_cache *cache,
+						     struct reftable_table *t,
+						     uint64_t off)
+{
+	return &cache->buckets[block_cache_hash(t, off) & (cache->buckets_len - 1)];
+}
+
+static void lru_unlink(struct reftable_block_cache *cache,
+		       struct block_cache_entry *e)
+{
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		cache->lru_head = e->lru_next;
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		cache->lru_tail = e->lru_prev;
+	e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_append(struct reftable_block_cache *cache,
+		       struct block_cache_entry *e)
+{
+	e->lru_prev = cache->lru_tail;
+	e->lru_next = NULL;
+	if (cache->lru_tail)
+		cache->lru_tail->lru_next = e;
+	else
+		cache->lru_head = e;
+	cache->lru_tail = e;
+}
+
+static void block_cache_remove(struct reftable_block_cache *cache,
+			       struct block_cache_entry *e)
+{
+	struct block_cache_entry **p = block_cache_bucket(cache, e->table, e->off);
+
+	while (*p != e)
+		p = &(*p)->bucket_next;
+	*p = e->bucket_next;
+
+	if (!e->pins)
+		lru_unlink(cache, e);
+
+	cache->stats.bytes -= e->size;
+	cache->stats.entries--;
+	reftable_block_release(&e->block);
+	reftable_free(e);
+}
+
+static void block_cache_shrink(struct reftable_block_cache *cache)
+{
+	while (cache->stats.bytes > cache->max_bytes && cache->lru_head) {
+		block_cache_remove(cache, cache->lru_head);
+		cache->stats.evictions++;
+	}
+}
+
+static void block_cache_grow(struct reftable_block_cache *cache)
+{
+	struct block_cache_entry **old = cache->buckets;
+	size_t old_len = cache->buckets_len;
+	struct block_cache_entry **buckets;
+
+	REFTABLE_CALLOC_ARRAY(buckets, old_len * 2);
+	if (!buckets)
+		return; /* Longer chains are not fatal. */
+	cache->buckets = buckets;
+	cache->buckets_len = old_len * 2;
+
+	for (size_t i = 0; i < old_len; i++) {
+		struct block_cache_entry *e = old[i], *next;
+
+		for (; e; e = next) {
+			struct block_cache_entry **p =
+				block_cache_bucket(cache, e->table, e->off);
+			next = e->bucket_next;
+			e->bucket_next = *p;
+			*p = e;
+		}
+	}
+
+	reftable_free(old);
+}
+
+int block_cache_get(struct reftable_block_cache *cache,
+		    struct reftable_table *t, uint64_t off, uint8_t want_typ,
+		    struct block_cache_entry **out)
+{
+	struct block_cache_entry **bucket = block_cache_bucket(cache, t, off);
+	struct block_cache_entry *e;
+	int err;
+
+	for (e = *bucket; e; e = e->bucket_next)
+		if (e->table == t && e->off == off)
+			break;
+
+	if (e) {
+		cache->stats.hits++;
+		if (!e->pins++)
+			lru_unlink(cache, e);
+	} else {
+		REFTABLE_CALLOC_ARRAY(e, 1);
+		if (!e)
+			return REFTABLE_OUT_OF_MEMORY_ERROR;
+
+		/*
+		 * Lend our inflate state to the block and take it back
+		 * afterwards so that cached log blocks do not each hold on
+		 * to their own. Note that the block frees it on error.
+		 */
+		e->block.zstream = cache->zstream;
+		err = table_init_block(t, &e->block, off, REFTABLE_BLOCK_TYPE_ANY);
+		cache->zstream = e->block.zstream;
+		e->block.zstream = NULL;
+		if (err) {
+			reftable_block_release(&e->block);
+			reftable_free(e);
+			return err;
+		}
+
+		cache->stats.misses++;
+		e->table = t;
+		e->off = off;
+		e->pins = 1;
+		e->size = sizeof(*e) + e->block.block_data.len;
+		e->bucket_next = *bucket;
+		*bucket = e;
+
+		cache->stats.bytes += e->size;
+		cache->stats.entries++;
+		if (cache->stats.entries > cache->buckets_len)
+			block_cache_grow(cache);
+		block_cache_shrink(cache);
+	}
+
+	if (want_typ != REFTABLE_BLOCK_TYPE_ANY &&
+	    e->block.block_type != want_typ) {
+		block_cache_put(cache, e);
+		return 1;
+	}
+
+	*out = e;
+	return 0;
+}
+
+void block_cache_put(struct reftable_block_cache *cache,
+		     struct block_cache_entry *e)
+{
+	if (--e->pins)
+		return;
+	lru_append(cache, e);
+	block_cache_shrink(cache);
+}
+
+void block_cache_evict_table(struct reftable_block_cache *cache,
+			     struct reftable_table *t)
+{
+	for (size_t i = 0; i < cache->buckets_len; i++) {
+		struct block_cache_entry *e = cache->buckets[i], *next;
+
+		for (; e; e = next) {
+			next = e->bucket_next;
+			if (e->table == t)
+				block_cache_remove(cache, e);
+		}
+	}
+}
+
+struct reftable_block_cache_stats *
+block_cache_stats(struct reftable_block_cache *cache)
+{
+	return &cache->stats;
+}
+
+void block_cache_incref(struct reftable_block_cache *cache)
+{
+	cache->refcount++;
+}
+
+void block_cache_decref(struct reftable_block_cache *cache)
+{
+	if (!cache || --cache->refcount)
+		return;
+
+	for (size_t i = 0; i < cache->buckets_len; i++) {
+		struct block_cache_entry *e = cache->buckets[i], *next;
+
+		for (; e; e = next) {
+			next = e->bucket_next;
+			reftable_block_release(&e->block);
+			reftable_free(e);
+		}
+	}
+
+	if (cache->zstream) {
+		inflateEnd(cache->zstream);
+		reftable_free(cache->zstream);
+	}
+	reftable_free(cache->buckets);
+	reftable_free(cache);
+}
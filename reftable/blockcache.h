@@ -0,0 +1,70 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "system.h"
+#include "reftable-block.h"
+#include "reftable-stack.h"
+#include "reftable-table.h"
+
+/*
+ * The block cache keeps decoded blocks around so that iterators seeking
+ * into the same table over and over again do not have to re-read and,
+ * in the case of log blocks, re-inflate them. It is shared by all tables
+ * of a stack and bounded by the number of bytes held by cached blocks.
+ *
+ * Entries are keyed by the table and the offset of the block in it. A
+ * table drops its entries when it is destroyed, so the key never refers
+ * to a stale table.
+ */
+struct reftable_block_cache;
+
+struct block_cache_entry {
+	struct reftable_table *table;
+	uint64_t off;
+	struct reftable_block block;
+
+	/* Bytes charged against the budget of the cache. */
+	size_t size;
+	/* Number of iterators currently using the block. */
+	size_t pins;
+
+	struct block_cache_entry *bucket_next;
+	struct block_cache_entry *lru_prev, *lru_next;
+};
+
+/*
+ * Create a new block cache that holds at most `max_bytes` of decoded
+ * blocks, not counting blocks that are in use. The cache starts with a
+ * refcount of 1.
+ */
+int block_cache_new(struct reftable_block_cache **out, size_t max_bytes);
+
+void block_cache_incref(struct reftable_block_cache *cache);
+void block_cache_decref(struct reftable_block_cache *cache);
+
+/*
+ * Look up the block at offset `off` of table `t`, reading and decoding
+ * it on a cache miss. On success, the entry is pinned and must be
+ * released with `block_cache_put()`. Returns 1 if there is no block at
+ * the given offset or if its type does not match `want_typ`, and a
+ * negative error code on error.
+ */
+int block_cache_get(struct reftable_block_cache *cache,
+		    struct reftable_table *t, uint64_t off, uint8_t want_typ,
+		    struct block_cache_entry **out);
+
+/* Unpin an entry returned by `block_cache_get()`. */
+void block_cache_put(struct reftable_block_cache *cache,
+		     struct block_cache_entry *e);
+
+/*
+ * Drop all cached blocks of the given table. None of them may be in use
+ * anymore.
+ */
+void block_cache_evict_table(struct reftable_block_cache *cache,
+			     struct reftable_table *t);
+
+struct reftable_block_cache_stats *
+block_cache_stats(struct reftable_block_cache *cache);
+
+#endif
@@ -246,9 +246,9 @@ reftable_merged_table_min_update_index(struct reftable_merged_table *mt)
 	return mt->min;
 }
 
-int merged_table_init_iter(struct reftable_merged_table *mt,
-			   struct reftable_iterator *it,
-			   uint8_t typ)
+static int merged_iter_new(struct merged_iter **out,
+			   struct reftable_merged_table *mt,
+			   uint8_t typ, int uncached)
 {
 	struct merged_subiter *subiters = NULL;
 	struct merged_iter *mi = NULL;
@@ -267,7 +267,11 @@ int merged_table_init_iter(struct reftable_merged_table *mt,
 		if (ret < 0)
 			goto out;
 
-		ret = table_init_iter(mt->tables[i], &subiters[i].iter, typ);
+		if (uncached)
+			ret = table_init_uncached_iter(mt->tables[i],
+						       &subiters[i].iter, typ);
+		else
+			ret = table_init_iter(mt->tables[i], &subiters[i].iter, typ);
 		if (ret < 0)
 			goto out;
 	}
@@ -282,7 +286,7 @@ int merged_table_init_iter(struct reftable_merged_table *mt,
 	mi->subiters = subiters;
 	mi->subiters_len = mt->tables_len;
 
-	iterator_from_merged_iter(it, mi);
+	*out = mi;
 	ret = 0;
 
 out:
@@ -298,6 +302,395 @@ int merged_table_init_iter(struct reftable_merged_table *mt,
 	return ret;
 }
 
+int merged_table_init_iter(struct reftable_merged_table *mt,
+			   struct reftable_iterator *it,
+			   uint8_t typ)
+{
+	struct merged_iter *mi;
+	int ret;
+
+	ret = merged_iter_new(&mi, mt, typ, 0);
+	if (ret < 0)
+		return ret;
+
+	iterator_from_merged_iter(it, mi);
+	return 0;
+}
+
+/*
+ * Upper bound for the number of top-level index entries covered by a single
+ * range of the parallel iterator. This limits the number of records that we
+ * buffer per range.
+ */
+#define MERGED_RANGE_MAX_KEYS 64
+
+/*
+ * A range of keys [start, end) that gets merged into a buffer of records by a
+ * separate thread. The range extends to the end of the tables in case it does
+ * not have an end.
+ */
+struct merged_range {
+	struct merged_iter *mi;
+	struct reftable_record start;
+	struct reftable_record end;
+	int has_end;
+
+	struct reftable_record *recs;
+	size_t recs_len, recs_alloc;
+	size_t recs_pos;
+
+	struct reftable_thread *thread;
+	int err;
+};
+
+/*
+ * The parallel iterator splits the keyspace after the seeked-to key into
+ * disjoint ranges and merges up to `nthreads` of them concurrently, while the
+ * caller consumes the ranges in order. Every key is contained in exactly one
+ * range, so each range yields the same records that the serial iterator would
+ * yield for it.
+ */
+struct parallel_merged_iter {
+	/*
+	 * A copy of the merged table that holds its own references to the
+	 * tables, as we create new subiterators after the merged table may
+	 * have already been released due to a reload of the stack.
+	 */
+	struct reftable_merged_table mt;
+	unsigned nthreads;
+
+	/* Used when the keyspace cannot be split. */
+	struct merged_iter *serial;
+	int use_serial;
+
+	struct merged_range *ranges;
+	size_t ranges_len;
+	/* The range that is currently being consumed. */
+	size_t ranges_pos;
+	/* The next range that is to be started. */
+	size_t ranges_next;
+};
+
+static void *merged_range_merge(void *payload)
+{
+	struct merged_range *r = payload;
+	int err, cmp;
+
+	err = merged_iter_seek(r->mi, &r->start);
+	while (!err) {
+		struct reftable_record *rec;
+
+		if (REFTABLE_ALLOC_GROW(r->recs, r->recs_len + 1, r->recs_alloc)) {
+			err = REFTABLE_OUT_OF_MEMORY_ERROR;
+			break;
+		}
+		rec = &r->recs[r->recs_len];
+
+		err = reftable_record_init(rec, REFTABLE_BLOCK_TYPE_REF);
+		if (err < 0)
+			break;
+
+		err = merged_iter_next_entry(r->mi, rec);
+		if (!err && r->has_end) {
+			err = reftable_record_cmp(rec, &r->end, &cmp);
+			if (!err && cmp >= 0)
+				err = 1;
+		}
+		if (err) {
+			reftable_record_release(rec);
+			break;
+		}
+
+		if (r->mi->suppress_deletions && reftable_record_is_deletion(rec)) {
+			reftable_record_release(rec);
+			continue;
+		}
+
+		r->recs_len++;
+	}
+
+	r->err = err > 0 ? 0 : err;
+	return NULL;
+}
+
+static void merged_range_release(struct merged_range *r)
+{
+	reftable_thread_join(r->thread);
+	if (r->mi) {
+		merged_iter_close(r->mi);
+		reftable_free(r->mi);
+	}
+	for (size_t i = 0; i < r->recs_len; i++)
+		reftable_record_release(&r->recs[i]);
+	reftable_free(r->recs);
+	reftable_record_release(&r->start);
+	reftable_record_release(&r->end);
+	memset(r, 0, sizeof(*r));
+}
+
+static void parallel_merged_iter_reset(struct parallel_merged_iter *pi)
+{
+	for (size_t i = pi->ranges_pos; i < pi->ranges_len; i++)
+		merged_range_release(&pi->ranges[i]);
+	REFTABLE_FREE_AND_NULL(pi->ranges);
+	pi->ranges_len = pi->ranges_pos = pi->ranges_next = 0;
+}
+
+static int parallel_merged_iter_start_range(struct parallel_merged_iter *pi)
+{
+	struct merged_range *r;
+	int err;
+
+	if (pi->ranges_next >= pi->ranges_len)
+		return 0;
+	r = &pi->ranges[pi->ranges_next++];
+
+	/*
+	 * The iterator must be created by us given that it changes the
+	 * refcounts of the tables, but it can be used by the thread.
+	 */
+	err = merged_iter_new(&r->mi, &pi->mt, REFTABLE_BLOCK_TYPE_REF, 1);
+	if (err < 0)
+		return err;
+
+	if (reftable_thread_start(&r->thread, merged_range_merge, r) < 0) {
+		r->thread = NULL;
+		merged_range_merge(r);
+	}
+
+	return 0;
+}
+
+static int buf_cmp_void(const void *a, const void *b)
+{
+	return reftable_buf_cmp(a, b);
+}
+
+static int merged_range_set_key(struct reftable_record *rec,
+				struct reftable_buf *key)
+{
+	rec->u.ref.refname = reftable_strdup(key->buf);
+	if (!rec->u.ref.refname)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	return 0;
+}
+
+/*
+ * Split the keyspace starting at `want` into ranges at the keys of the
+ * top-level indices of all tables. Does not set up any ranges in case the
+ * tables are too small to warrant splitting them.
+ */
+static int parallel_merged_iter_split(struct parallel_merged_iter *pi,
+				      struct reftable_record *want)
+{
+	struct reftable_buf want_key = REFTABLE_BUF_INIT;
+	struct reftable_buf *keys = NULL;
+	size_t keys_len = 0, keys_alloc = 0, n = 0, stride;
+	int err;
+
+	err = reftable_record_key(want, &want_key);
+	if (err < 0)
+		goto out;
+
+	for (size_t i = 0; i < pi->mt.tables_len; i++) {
+		err = table_index_keys(pi->mt.tables[i], REFTABLE_BLOCK_TYPE_REF,
+				       &keys, &keys_len, &keys_alloc);
+		if (err < 0)
+			goto out;
+	}
+
+	if (keys_len)
+		qsort(keys, keys_len, sizeof(*keys), buf_cmp_void);
+
+	/* Drop duplicates and keys that come before the seeked-to key. */
+	for (size_t i = 0; i < keys_len; i++) {
+		if (reftable_buf_cmp(&keys[i], &want_key) <= 0 ||
+		    (n && !reftable_buf_cmp(&keys[i], &keys[n - 1]))) {
+			reftable_buf_release(&keys[i]);
+			continue;
+		}
+		REFTABLE_SWAP(keys[n], keys[i]);
+		n++;
+	}
+	keys_len = n;
+
+	if (keys_len < pi->nthreads)
+		goto out;
+
+	stride = keys_len / (4 * pi->nthreads);
+	if (!stride)
+		stride = 1;
+	if (stride > MERGED_RANGE_MAX_KEYS)
+		stride = MERGED_RANGE_MAX_KEYS;
+
+	REFTABLE_CALLOC_ARRAY(pi->ranges, (keys_len + stride - 1) / stride + 1);
+	if (!pi->ranges) {
+		err = REFTABLE_OUT_OF_MEMORY_ERROR;
+		goto out;
+	}
+
+	for (size_t i = 0; i <= keys_len; i += stride) {
+		struct merged_range *r = &pi->ranges[pi->ranges_len++];
+
+		err = reftable_record_init(&r->start, REFTABLE_BLOCK_TYPE_REF);
+		if (!err)
+			err = reftable_record_init(&r->end, REFTABLE_BLOCK_TYPE_REF);
+		if (err < 0)
+			goto out;
+
+		if (!i)
+			err = reftable_record_copy_from(&r->start, want,
+							hash_size(pi->mt.hash_id));
+		else
+			err = merged_range_set_key(&r->start, &keys[i - 1]);
+		if (err < 0)
+			goto out;
+
+		if (i + stride <= keys_len) {
+			err = merged_range_set_key(&r->end, &keys[i + stride - 1]);
+			if (err < 0)
+				goto out;
+			r->has_end = 1;
+		}
+	}
+
+	pi->use_serial = 0;
+
+out:
+	for (size_t i = 0; i < keys_len; i++)
+		reftable_buf_release(&keys[i]);
+	reftable_free(keys);
+	reftable_buf_release(&want_key);
+	return err;
+}
+
+static int parallel_merged_iter_seek(void *p, struct reftable_record *want)
+{
+	struct parallel_merged_iter *pi = p;
+	int err;
+
+	parallel_merged_iter_reset(pi);
+	pi->use_serial = 1;
+
+	if (pi->nthreads > 1 &&
+	    reftable_record_type(want) == REFTABLE_BLOCK_TYPE_REF) {
+		err = parallel_merged_iter_split(pi, want);
+		if (err < 0)
+			return err;
+	}
+
+	if (pi->use_serial)
+		return merged_iter_seek(pi->serial, want);
+
+	for (size_t i = 0; i < pi->nthreads; i++) {
+		err = parallel_merged_iter_start_range(pi);
+		if (err < 0)
+			return err;
+	}
+
+	return 0;
+}
+
+static int parallel_merged_iter_next(void *p, struct reftable_record *rec)
+{
+	struct parallel_merged_iter *pi = p;
+	int err;
+
+	if (pi->use_serial)
+		return merged_iter_next_void(pi->serial, rec);
+
+	while (pi->ranges_pos < pi->ranges_len) {
+		struct merged_range *r = &pi->ranges[pi->ranges_pos];
+
+		if (r->thread) {
+			reftable_thread_join(r->thread);
+			r->thread = NULL;
+		}
+		if (r->err < 0)
+			return r->err;
+
+		if (r->recs_pos < r->recs_len) {
+			REFTABLE_SWAP(*rec, r->recs[r->recs_pos]);
+			r->recs_pos++;
+			return 0;
+		}
+
+		merged_range_release(r);
+		pi->ranges_pos++;
+
+		err = parallel_merged_iter_start_range(pi);
+		if (err < 0)
+			return err;
+	}
+
+	return 1;
+}
+
+static void parallel_merged_iter_close(void *p)
+{
+	struct parallel_merged_iter *pi = p;
+
+	parallel_merged_iter_reset(pi);
+	if (pi->serial) {
+		merged_iter_close(pi->serial);
+		reftable_free(pi->serial);
+	}
+	for (size_t i = 0; i < pi->mt.tables_len; i++)
+		reftable_table_decref(pi->mt.tables[i]);
+	reftable_free(pi->mt.tables);
+}
+
+static struct reftable_iterator_vtable parallel_merged_iter_vtable = {
+	.seek = parallel_merged_iter_seek,
+	.next = parallel_merged_iter_next,
+	.close = parallel_merged_iter_close,
+};
+
+int reftable_merged_table_init_parallel_ref_iterator(struct reftable_merged_table *mt,
+						     struct reftable_iterator *it,
+						     unsigned nthreads)
+{
+	struct parallel_merged_iter *pi;
+	int ret;
+
+	REFTABLE_CALLOC_ARRAY(pi, 1);
+	if (!pi)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	pi->mt = *mt;
+	pi->mt.tables = NULL;
+	pi->mt.tables_len = 0;
+	pi->nthreads = nthreads;
+	pi->use_serial = 1;
+
+	if (mt->tables_len) {
+		REFTABLE_ALLOC_ARRAY(pi->mt.tables, mt->tables_len);
+		if (!pi->mt.tables) {
+			ret = REFTABLE_OUT_OF_MEMORY_ERROR;
+			goto out;
+		}
+	}
+	for (size_t i = 0; i < mt->tables_len; i++) {
+		reftable_table_incref(mt->tables[i]);
+		pi->mt.tables[pi->mt.tables_len++] = mt->tables[i];
+	}
+
+	ret = merged_iter_new(&pi->serial, &pi->mt, REFTABLE_BLOCK_TYPE_REF, 0);
+	if (ret < 0)
+		goto out;
+
+	assert(!it->ops);
+	it->iter_arg = pi;
+	it->ops = &parallel_merged_iter_vtable;
+	ret = 0;
+
+out:
+	if (ret < 0) {
+		parallel_merged_iter_close(pi);
+		reftable_free(pi);
+	}
+	return ret;
+}
+
 int reftable_merged_table_init_ref_iterator(struct reftable_merged_table *mt,
 					    struct reftable_iterator *it)
 {
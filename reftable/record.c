@@ -100,6 +100,36 @@ const unsigned char *reftable_ref_record_val2(const struct reftable_ref_record *
 	}
 }
 
+static int skip_var_int(struct string_view *in)
+{
+	uint64_t val;
+	int n = get_var_int(&val, in);
+	if (n < 0)
+		return n;
+	string_view_consume(in, n);
+	return 0;
+}
+
+static int skip_bytes(struct string_view *in, uint64_t len)
+{
+	if (in->len < len)
+		return -1;
+	string_view_consume(in, len);
+	return 0;
+}
+
+static int skip_string(struct string_view *in)
+{
+	uint64_t tsize = 0;
+	int n;
+
+	n = get_var_int(&tsize, in);
+	if (n <= 0)
+		return -1;
+	string_view_consume(in, n);
+	return skip_bytes(in, tsize);
+}
+
 static int decode_string(struct reftable_buf *dest, struct string_view in)
 {
 	int start_len = in.len;
@@ -436,6 +466,36 @@ static int reftable_ref_record_decode(void *rec, struct reftable_buf key,
 	return err;
 }
 
+static int reftable_ref_record_skip(uint8_t val_type, struct string_view in,
+				    uint32_t hash_size)
+{
+	struct string_view start = in;
+
+	if (skip_var_int(&in) < 0)
+		return REFTABLE_FORMAT_ERROR;
+
+	switch (val_type) {
+	case REFTABLE_REF_VAL1:
+		if (skip_bytes(&in, hash_size) < 0)
+			return REFTABLE_FORMAT_ERROR;
+		break;
+	case REFTABLE_REF_VAL2:
+		if (skip_bytes(&in, 2 * hash_size) < 0)
+			return REFTABLE_FORMAT_ERROR;
+		break;
+	case REFTABLE_REF_SYMREF:
+		if (skip_string(&in) < 0)
+			return REFTABLE_FORMAT_ERROR;
+		break;
+	case REFTABLE_REF_DELETION:
+		break;
+	default:
+		return REFTABLE_FORMAT_ERROR;
+	}
+
+	return start.len - in.len;
+}
+
 static int reftable_ref_record_is_deletion_void(const void *p)
 {
 	return reftable_ref_record_is_deletion(
@@ -464,6 +524,7 @@ static struct reftable_record_vtable reftable_ref_record_vtable = {
 	.val_type = &reftable_ref_record_val_type,
 	.encode = &reftable_ref_record_encode,
 	.decode = &reftable_ref_record_decode,
+	.skip = &reftable_ref_record_skip,
 	.release = &reftable_ref_record_release_void,
 	.is_deletion = &reftable_ref_record_is_deletion_void,
 	.equal = &reftable_ref_record_equal_void,
@@ -613,6 +674,27 @@ static int reftable_obj_record_decode(void *rec, struct reftable_buf key,
 	return start.len - in.len;
 }
 
+static int reftable_obj_record_skip(uint8_t val_type, struct string_view in,
+				    uint32_t hash_size REFTABLE_UNUSED)
+{
+	struct string_view start = in;
+	uint64_t count = val_type;
+	int n;
+
+	if (val_type == 0) {
+		n = get_var_int(&count, &in);
+		if (n < 0)
+			return n;
+		string_view_consume(&in, n);
+	}
+
+	for (uint64_t i = 0; i < count; i++)
+		if (skip_var_int(&in) < 0)
+			return REFTABLE_FORMAT_ERROR;
+
+	return start.len - in.len;
+}
+
 static int not_a_deletion(const void *p REFTABLE_UNUSED)
 {
 	return 0;
@@ -664,6 +746,7 @@ static struct reftable_record_vtable reftable_obj_record_vtable = {
 	.val_type = &reftable_obj_record_val_type,
 	.encode = &reftable_obj_record_encode,
 	.decode = &reftable_obj_record_decode,
+	.skip = &reftable_obj_record_skip,
 	.release = &reftable_obj_record_release,
 	.is_deletion = &not_a_deletion,
 	.equal = &reftable_obj_record_equal_void,
@@ -958,6 +1041,26 @@ static int reftable_log_record_decode(void *rec, struct reftable_buf key,
 	return err;
 }
 
+static int reftable_log_record_skip(uint8_t val_type, struct string_view in,
+				    uint32_t hash_size)
+{
+	struct string_view start = in;
+
+	/* Like `reftable_log_record_decode()`, deletions carry no value. */
+	if (val_type == REFTABLE_LOG_DELETION)
+		return 0;
+
+	if (skip_bytes(&in, 2 * hash_size) < 0 ||
+	    skip_string(&in) < 0 ||
+	    skip_string(&in) < 0 ||
+	    skip_var_int(&in) < 0 ||
+	    skip_bytes(&in, 2) < 0 ||
+	    skip_string(&in) < 0)
+		return REFTABLE_FORMAT_ERROR;
+
+	return start.len - in.len;
+}
+
 static int null_streq(const char *a, const char *b)
 {
 	const char *empty = "";
@@ -1035,6 +1138,7 @@ static struct reftable_record_vtable reftable_log_record_vtable = {
 	.val_type = &reftable_log_record_val_type,
 	.encode = &reftable_log_record_encode,
 	.decode = &reftable_log_record_decode,
+	.skip = &reftable_log_record_skip,
 	.release = &reftable_log_record_release_void,
 	.is_deletion = &reftable_log_record_is_deletion_void,
 	.equal = &reftable_log_record_equal_void,
@@ -1114,6 +1218,18 @@ static int reftable_index_record_decode(void *rec, struct reftable_buf key,
 	return start.len - in.len;
 }
 
+static int reftable_index_record_skip(uint8_t val_type REFTABLE_UNUSED,
+				      struct string_view in,
+				      uint32_t hash_size REFTABLE_UNUSED)
+{
+	struct string_view start = in;
+
+	if (skip_var_int(&in) < 0)
+		return REFTABLE_FORMAT_ERROR;
+
+	return start.len - in.len;
+}
+
 static int reftable_index_record_equal(const void *a, const void *b,
 				       uint32_t hash_size REFTABLE_UNUSED)
 {
@@ -1137,6 +1253,7 @@ static struct reftable_record_vtable reftable_index_record_vtable = {
 	.val_type = &reftable_index_record_val_type,
 	.encode = &reftable_index_record_encode,
 	.decode = &reftable_index_record_decode,
+	.skip = &reftable_index_record_skip,
 	.release = &reftable_index_record_release,
 	.is_deletion = &not_a_deletion,
 	.equal = &reftable_index_record_equal,
@@ -1179,6 +1296,12 @@ int reftable_record_decode(struct reftable_record *rec, struct reftable_buf key,
 						   scratch);
 }
 
+int reftable_record_skip(struct reftable_record *rec, uint8_t extra,
+			 struct string_view src, uint32_t hash_size)
+{
+	return reftable_record_vtable(rec)->skip(extra, src, hash_size);
+}
+
 void reftable_record_release(struct reftable_record *rec)
 {
 	reftable_record_vtable(rec)->release(reftable_record_data(rec));
@@ -40,6 +40,18 @@ int reftable_merged_table_new(struct reftable_merged_table **dest,
 int reftable_merged_table_init_ref_iterator(struct reftable_merged_table *mt,
 					    struct reftable_iterator *it);
 
+/*
+ * Initialize a merged table iterator for reading refs that splits the keys
+ * after the seeked-to key into ranges based on the indices of the tables and
+ * merges up to `nthreads` of these ranges in parallel. This speeds up reading
+ * many refs at the expense of reading ahead, so it should only be used when
+ * the caller intends to read most of the refs after the seeked-to key. Falls
+ * back to merging serially in case the tables are too small to be split.
+ */
+int reftable_merged_table_init_parallel_ref_iterator(struct reftable_merged_table *mt,
+						     struct reftable_iterator *it,
+						     unsigned nthreads);
+
 /* Initialize a merged table iterator for reading logs. */
 int reftable_merged_table_init_log_iterator(struct reftable_merged_table *mt,
 					    struct reftable_iterator *it);
@@ -88,6 +88,16 @@ struct reftable_iterator;
 int reftable_stack_init_ref_iterator(struct reftable_stack *st,
 				     struct reftable_iterator *it);
 
+/*
+ * Initialize an iterator for the merged tables contained in the stack that
+ * reads refs using up to `nthreads` threads. See
+ * `reftable_merged_table_init_parallel_ref_iterator()`. The iterator is valid
+ * until the next reload or write.
+ */
+int reftable_stack_init_parallel_ref_iterator(struct reftable_stack *st,
+					      struct reftable_iterator *it,
+					      unsigned nthreads);
+
 /*
  * Initialize an iterator for the merged tables contained in the stack that can
  * be used to iterate through logs. The iterator is valid until the next reload
@@ -163,6 +173,22 @@ struct reftable_compaction_stats {
 struct reftable_compaction_stats *
 reftable_stack_compaction_stats(struct reftable_stack *st);
 
+/* statistics on the block cache shared by the tables of the stack. */
+struct reftable_block_cache_stats {
+	uint64_t hits; /* lookups served from the cache */
+	uint64_t misses; /* lookups that had to read the block */
+	uint64_t evictions; /* blocks dropped to stay within the budget */
+	uint64_t bytes; /* bytes currently held by cached blocks */
+	uint64_t entries; /* number of currently cached blocks */
+};
+
+/*
+ * return statistics for the block cache up till now, or NULL if the stack
+ * does not use a block cache.
+ */
+struct reftable_block_cache_stats *
+reftable_stack_block_cache_stats(struct reftable_stack *st);
+
 /* Return the hash of the stack. */
 enum reftable_hash reftable_stack_hash_id(struct reftable_stack *st);
 
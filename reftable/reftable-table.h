@@ -21,6 +21,8 @@
  * reftable_merged_table and struct reftable_stack.
  */
 
+struct reftable_block_cache;
+
 /* Metadata for a block type. */
 struct reftable_table_offsets {
 	int is_present;
@@ -51,6 +53,9 @@ struct reftable_table {
 	struct reftable_table_offsets obj_offsets;
 	struct reftable_table_offsets log_offsets;
 
+	/* Cache of decoded blocks shared with the other tables of a stack. */
+	struct reftable_block_cache *block_cache;
+
 	uint64_t refcount;
 };
 
@@ -69,6 +69,12 @@ struct reftable_write_options {
 	 */
 	int (*fsync)(int fd);
 
+	/*
+	 * Maximum number of bytes of decoded blocks that a stack keeps cached
+	 * for its iterators. Zero disables the cache.
+	 */
+	size_t block_cache_size;
+
 	/*
 	 * Callback function to execute whenever the stack is being reloaded.
 	 * This can be used e.g. to discard cached information that relies on
@@ -77,6 +83,18 @@ struct reftable_write_options {
 	 */
 	void (*on_reload)(void *payload);
 	void *on_reload_payload;
+
+	/*
+	 * Optional callback function to execute instead of auto-compacting the
+	 * stack after an addition has been committed. It is only invoked when
+	 * the stack requires compaction, and it allows the caller to compact
+	 * the stack out of band, e.g. in a separate process, so that the
+	 * writer does not have to wait for it. The callback shall return 0
+	 * when it has taken care of the compaction, and a non-zero value to
+	 * make the stack compact itself synchronously instead.
+	 */
+	int (*on_auto_compact)(void *payload);
+	void *on_auto_compact_payload;
 };
 
 /* reftable_block_stats holds statistics for a single block type */
@@ -9,6 +9,7 @@
 #include "stack.h"
 
 #include "system.h"
+#include "blockcache.h"
 #include "constants.h"
 #include "merged.h"
 #include "reftable-error.h"
@@ -141,6 +142,14 @@ int reftable_stack_init_ref_iterator(struct reftable_stack *st,
 				      it, REFTABLE_BLOCK_TYPE_REF);
 }
 
+int reftable_stack_init_parallel_ref_iterator(struct reftable_stack *st,
+					      struct reftable_iterator *it,
+					      unsigned nthreads)
+{
+	return reftable_merged_table_init_parallel_ref_iterator(reftable_stack_merged_table(st),
+								it, nthreads);
+}
+
 int reftable_stack_init_log_iterator(struct reftable_stack *st,
 				     struct reftable_iterator *it)
 {
@@ -213,6 +222,7 @@ void reftable_stack_destroy(struct reftable_stack *st)
 		st->list_fd = -1;
 	}
 
+	block_cache_decref(st->block_cache);
 	REFTABLE_FREE_AND_NULL(st->list_file);
 	REFTABLE_FREE_AND_NULL(st->reftable_dir);
 	reftable_free(st);
@@ -310,6 +320,9 @@ static int reftable_stack_reload_once(struct reftable_stack *st,
 			err = reftable_table_new(&table, &src, name);
 			if (err < 0)
 				goto done;
+
+			if (st->block_cache)
+				table_set_block_cache(table, st->block_cache);
 		}
 
 		new_tables[new_tables_len] = table;
@@ -561,6 +574,12 @@ int reftable_new_stack(struct reftable_stack **dest, const char *dir,
 		goto out;
 	}
 
+	if (opts.block_cache_size) {
+		err = block_cache_new(&p->block_cache, opts.block_cache_size);
+		if (err < 0)
+			goto out;
+	}
+
 	err = reftable_stack_reload_maybe_reuse(p, 1);
 	if (err < 0)
 		goto out;
@@ -836,6 +855,19 @@ int reftable_addition_commit(struct reftable_addition *add)
 	if (err)
 		goto done;
 
+	if (!add->stack->opts.disable_auto_compact &&
+	    add->stack->opts.on_auto_compact) {
+		bool required;
+
+		err = reftable_stack_compaction_required(add->stack, true,
+							 &required);
+		if (err < 0)
+			goto done;
+		if (!required ||
+		    !add->stack->opts.on_auto_compact(add->stack->opts.on_auto_compact_payload))
+			goto done;
+	}
+
 	if (!add->stack->opts.disable_auto_compact) {
 		/*
 		 * Auto-compact the stack to keep the number of tables in
@@ -1704,6 +1736,14 @@ reftable_stack_compaction_stats(struct reftable_stack *st)
 	return &st->stats;
 }
 
+struct reftable_block_cache_stats *
+reftable_stack_block_cache_stats(struct reftable_stack *st)
+{
+	if (!st->block_cache)
+		return NULL;
+	return block_cache_stats(st->block_cache);
+}
+
 int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
 			    struct reftable_ref_record *ref)
 {
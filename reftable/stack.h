@@ -13,6 +13,8 @@
 #include "reftable-writer.h"
 #include "reftable-stack.h"
 
+struct reftable_block_cache;
+
 struct reftable_stack {
 	struct stat list_st;
 	char *list_file;
@@ -26,6 +28,7 @@ struct reftable_stack {
 	size_t tables_len;
 	struct reftable_merged_table *merged;
 	struct reftable_compaction_stats stats;
+	struct reftable_block_cache *block_cache;
 };
 
 int read_lines(const char *filename, char ***lines);
@@ -5,6 +5,7 @@
 #include "reftable-error.h"
 #include "../lockfile.h"
 #include "../tempfile.h"
+#include "../thread-utils.h"
 
 uint32_t reftable_rand(void)
 {
@@ -131,3 +132,36 @@ int flock_commit(struct reftable_flock *l)
 
 	return 0;
 }
+
+struct reftable_thread {
+	pthread_t thread;
+};
+
+int reftable_thread_start(struct reftable_thread **out,
+			  void *(*fn)(void *), void *arg)
+{
+	struct reftable_thread *t;
+
+	if (!HAVE_THREADS)
+		return REFTABLE_API_ERROR;
+
+	t = reftable_malloc(sizeof(*t));
+	if (!t)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+
+	if (pthread_create(&t->thread, NULL, fn, arg)) {
+		reftable_free(t);
+		return REFTABLE_IO_ERROR;
+	}
+
+	*out = t;
+	return 0;
+}
+
+void reftable_thread_join(struct reftable_thread *t)
+{
+	if (!t)
+		return;
+	pthread_join(t->thread, NULL);
+	reftable_free(t);
+}
@@ -108,4 +108,23 @@ int flock_release(struct reftable_flock *l);
  */
 int flock_commit(struct reftable_flock *l);
 
+/*
+ * An implementation-specific thread. Threads are used to parallelize work that
+ * does not touch any state shared with other parts of the library.
+ */
+struct reftable_thread;
+
+/*
+ * Start a new thread that executes `fn` with the given argument. Returns 0 on
+ * success, a reftable error code on error. Callers are expected to fall back
+ * to executing `fn` themselves in case the platform does not support threads.
+ */
+int reftable_thread_start(struct reftable_thread **out,
+			  void *(*fn)(void *), void *arg);
+
+/*
+ * Wait for the thread to finish and release it.
+ */
+void reftable_thread_join(struct reftable_thread *t);
+
 #endif
@@ -10,6 +10,7 @@
 
 #include "system.h"
 #include "block.h"
+#include "blockcache.h"
 #include "blocksource.h"
 #include "constants.h"
 #include "iter.h"
@@ -132,8 +133,15 @@ struct table_iter {
 	uint8_t typ;
 	uint64_t block_off;
 	struct reftable_block block;
+	/*
+	 * The cache entry `block` has been copied from, if any. The block
+	 * data is then owned by the cache and must not be released.
+	 */
+	struct block_cache_entry *cached;
 	struct block_iter bi;
 	int is_finished;
+	/* Bypass the block cache of the table. */
+	int uncached;
 };
 
 static int table_iter_init(struct table_iter *ti, struct reftable_table *t)
@@ -159,7 +167,13 @@ static int table_iter_next_in_block(struct table_iter *ti,
 
 static void table_iter_block_done(struct table_iter *ti)
 {
-	reftable_block_release(&ti->block);
+	if (ti->cached) {
+		block_cache_put(ti->table->block_cache, ti->cached);
+		ti->cached = NULL;
+		memset(&ti->block, 0, sizeof(ti->block));
+	} else {
+		reftable_block_release(&ti->block);
+	}
 	block_iter_reset(&ti->bi);
 }
 
@@ -179,6 +193,31 @@ int table_init_block(struct reftable_table *t, struct reftable_block *block,
 	return err;
 }
 
+/*
+ * Load the block at `off` into the iterator, going through the block cache
+ * of the table if it has one.
+ */
+static int table_iter_read_block(struct table_iter *ti, uint64_t off,
+				 uint8_t want_typ)
+{
+	struct block_cache_entry *e;
+	int err;
+
+	if (!ti->table->block_cache || ti->uncached)
+		return table_init_block(ti->table, &ti->block, off, want_typ);
+
+	table_iter_block_done(ti);
+
+	err = block_cache_get(ti->table->block_cache, ti->table, off,
+			      want_typ, &e);
+	if (err)
+		return err;
+
+	ti->block = e->block;
+	ti->cached = e;
+	return 0;
+}
+
 static void table_iter_close(struct table_iter *ti)
 {
 	table_iter_block_done(ti);
@@ -191,7 +230,7 @@ static int table_iter_next_block(struct table_iter *ti)
 	uint64_t next_block_off = ti->block_off + ti->block.full_block_size;
 	int err;
 
-	err = table_init_block(ti->table, &ti->block, next_block_off, ti->typ);
+	err = table_iter_read_block(ti, next_block_off, ti->typ);
 	if (err > 0)
 		ti->is_finished = 1;
 	if (err)
@@ -241,7 +280,7 @@ static int table_iter_seek_to(struct table_iter *ti, uint64_t off, uint8_t typ)
 {
 	int err;
 
-	err = table_init_block(ti->table, &ti->block, off, typ);
+	err = table_iter_read_block(ti, off, typ);
 	if (err != 0)
 		return err;
 
@@ -315,6 +354,7 @@ static int table_iter_seek_linear(struct table_iter *ti,
 		next.block.zstream = NULL;
 		next.block.uncompressed_data = NULL;
 		next.block.uncompressed_cap = 0;
+		next.cached = NULL;
 
 		err = table_iter_next_block(&next);
 		if (err < 0)
@@ -484,9 +524,9 @@ static void iterator_from_table_iter(struct reftable_iterator *it,
 	it->ops = &table_iter_vtable;
 }
 
-int table_init_iter(struct reftable_table *t,
-		    struct reftable_iterator *it,
-		    uint8_t typ)
+static int table_init_iter_internal(struct reftable_table *t,
+				    struct reftable_iterator *it,
+				    uint8_t typ, int uncached)
 {
 	struct reftable_table_offsets *offs = table_offsets_for(t, typ);
 
@@ -497,6 +537,7 @@ int table_init_iter(struct reftable_table *t,
 			return REFTABLE_OUT_OF_MEMORY_ERROR;
 
 		table_iter_init(ti, t);
+		ti->uncached = uncached;
 		iterator_from_table_iter(it, ti);
 	} else {
 		iterator_set_empty(it);
@@ -505,6 +546,59 @@ int table_init_iter(struct reftable_table *t,
 	return 0;
 }
 
+int table_init_iter(struct reftable_table *t,
+		    struct reftable_iterator *it,
+		    uint8_t typ)
+{
+	return table_init_iter_internal(t, it, typ, 0);
+}
+
+int table_init_uncached_iter(struct reftable_table *t,
+			     struct reftable_iterator *it,
+			     uint8_t typ)
+{
+	return table_init_iter_internal(t, it, typ, 1);
+}
+
+int table_index_keys(struct reftable_table *t, uint8_t typ,
+		     struct reftable_buf **keys, size_t *keys_len,
+		     size_t *keys_alloc)
+{
+	struct reftable_record rec = {
+		.type = REFTABLE_BLOCK_TYPE_INDEX,
+		.u.idx = { .last_key = REFTABLE_BUF_INIT },
+	};
+	struct table_iter ti;
+	int err;
+
+	table_iter_init(&ti, t);
+
+	/*
+	 * The top-level index is stored at the end of the index section, so
+	 * we only see its blocks when iterating from the index offset. The
+	 * iterator stops at the first block that is not an index block.
+	 */
+	err = table_iter_seek_start(&ti, typ, 1);
+	if (err)
+		goto done;
+
+	while (!(err = table_iter_next(&ti, &rec))) {
+		if (REFTABLE_ALLOC_GROW(*keys, *keys_len + 1, *keys_alloc)) {
+			err = REFTABLE_OUT_OF_MEMORY_ERROR;
+			goto done;
+		}
+
+		(*keys)[*keys_len] = (struct reftable_buf) REFTABLE_BUF_INIT;
+		REFTABLE_SWAP((*keys)[*keys_len], rec.u.idx.last_key);
+		(*keys_len)++;
+	}
+
+done:
+	table_iter_close(&ti);
+	reftable_record_release(&rec);
+	return err > 0 ? 0 : err;
+}
+
 int reftable_table_init_ref_iterator(struct reftable_table *t,
 				     struct reftable_iterator *it)
 {
@@ -595,6 +689,16 @@ int reftable_table_new(struct reftable_table **out,
 	return err;
 }
 
+void table_set_block_cache(struct reftable_table *t,
+			   struct reftable_block_cache *cache)
+{
+	if (t->block_cache)
+		block_cache_decref(t->block_cache);
+	if (cache)
+		block_cache_incref(cache);
+	t->block_cache = cache;
+}
+
 void reftable_table_incref(struct reftable_table *t)
 {
 	t->refcount++;
@@ -606,6 +710,10 @@ void reftable_table_decref(struct reftable_table *t)
 		return;
 	if (--t->refcount)
 		return;
+	if (t->block_cache) {
+		block_cache_evict_table(t->block_cache, t);
+		block_cache_decref(t->block_cache);
+	}
 	block_source_close(&t->source);
 	REFTABLE_FREE_AND_NULL(t->name);
 	reftable_free(t);
@@ -20,6 +20,34 @@ int table_init_iter(struct reftable_table *t,
 		    struct reftable_iterator *it,
 		    uint8_t typ);
 
+/*
+ * Initialize an iterator like `table_init_iter()` that does not use the block
+ * cache of the table. Such iterators may be seeked and advanced by a thread
+ * different from the one owning the table. They must still be initialized and
+ * destroyed by the owning thread though, as that changes the refcount of the
+ * table.
+ */
+int table_init_uncached_iter(struct reftable_table *t,
+			     struct reftable_iterator *it,
+			     uint8_t typ);
+
+/*
+ * Append the keys of the top-level index for the given block type to `keys`.
+ * Each key is the last key of a part of the table, so they split the table
+ * into ranges of roughly similar size. Nothing is appended if the table has
+ * no index for the block type.
+ */
+int table_index_keys(struct reftable_table *t, uint8_t typ,
+		     struct reftable_buf **keys, size_t *keys_len,
+		     size_t *keys_alloc);
+
+/*
+ * Make the table share the given block cache with other tables. The table
+ * keeps a reference to the cache.
+ */
+void table_set_block_cache(struct reftable_table *t,
+			   struct reftable_block_cache *cache);
+
 /*
  * Initialize a block by reading from the given table and offset.
  */
@@ -66,6 +66,14 @@ void pack_geometry_init(struct pack_geometry *geometry,
 		if (p->is_cruft)
 			continue;
 
+		if (geometry->midx_incremental && p->multi_pack_index) {
+			ALLOC_GROW(geometry->midx_pack,
+				   geometry->midx_pack_nr + 1,
+				   geometry->midx_pack_alloc);
+			geometry->midx_pack[geometry->midx_pack_nr++] = p;
+			continue;
+		}
+
 		ALLOC_GROW(geometry->pack,
 			   geometry->pack_nr + 1,
 			   geometry->pack_alloc);
@@ -229,4 +237,5 @@ void pack_geometry_release(struct pack_geometry *geometry)
 		return;
 
 	free(geometry->pack);
+	free(geometry->midx_pack);
 }
@@ -189,6 +189,27 @@ static void midx_included_packs(struct string_list *include,
 
 			string_list_insert(include, buf.buf);
 		}
+
+		/*
+		 * Packs in the existing MIDX chain are not part of the
+		 * geometric progression when writing an incremental
+		 * MIDX. List them anyway so that they are not mistaken
+		 * for unknown packs below; git-multi-pack-index(1) skips
+		 * over them since they are already in its base.
+		 */
+		for (i = 0; i < geometry->midx_pack_nr; i++) {
+			struct packed_git *p = geometry->midx_pack[i];
+
+			if (!p->pack_local)
+				continue;
+
+			strbuf_reset(&buf);
+			strbuf_addstr(&buf, pack_basename(p));
+			strbuf_strip_suffix(&buf, ".pack");
+			strbuf_addstr(&buf, ".idx");
+
+			string_list_insert(include, buf.buf);
+		}
 	} else {
 		for_each_string_list_item(item, &existing->non_kept_packs) {
 			if (existing_pack_is_marked_for_deletion(item))
@@ -310,6 +331,9 @@ int write_midx_included_packs(struct repack_write_midx_opts *opts)
 	if (opts->write_bitmaps)
 		strvec_push(&cmd.args, "--bitmap");
 
+	if (opts->incremental)
+		strvec_push(&cmd.args, "--incremental");
+
 	if (preferred)
 		strvec_pushf(&cmd.args, "--preferred-pack=%s",
 			     pack_basename(preferred));
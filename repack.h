@@ -103,7 +103,16 @@ struct pack_geometry {
 	uint32_t pack_nr, pack_alloc;
 	uint32_t split;
 
+	/*
+	 * When writing an incremental MIDX, packs which are already in
+	 * a layer of the existing MIDX are left alone rather than being
+	 * rolled up, and are collected here instead of in 'pack'.
+	 */
+	struct packed_git **midx_pack;
+	uint32_t midx_pack_nr, midx_pack_alloc;
+
 	int split_factor;
+	int midx_incremental;
 };
 
 void pack_geometry_init(struct pack_geometry *geometry,
@@ -128,6 +137,7 @@ struct repack_write_midx_opts {
 	int show_progress;
 	int write_bitmaps;
 	int midx_must_contain_cruft;
+	int incremental;
 };
 
 void midx_snapshot_refs(struct repository *repo, struct tempfile *f);
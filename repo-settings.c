@@ -5,6 +5,7 @@
 #include "midx.h"
 #include "pack-objects.h"
 #include "setup.h"
+#include "thread-utils.h"
 
 static void repo_cfg_bool(struct repository *r, const char *key, int *dest,
 			  int def)
@@ -84,6 +85,9 @@ void prepare_repo_settings(struct repository *r)
 		      &r->settings.pack_use_bitmap_boundary_traversal,
 		      r->settings.pack_use_bitmap_boundary_traversal);
 	repo_cfg_bool(r, "core.usereplacerefs", &r->settings.read_replace_refs, 1);
+	repo_cfg_bool(r, "core.treecache", &r->settings.core_tree_cache, 0);
+	repo_cfg_bool(r, "gc.writetreecache", &r->settings.gc_write_tree_cache, 0);
+	repo_cfg_int(r, "gc.treecachedepth", &r->settings.tree_cache_depth, 2);
 
 	/*
 	 * The GIT_TEST_MULTI_PACK_INDEX variable is special in that
@@ -139,6 +143,43 @@ void prepare_repo_settings(struct repository *r)
 	if (!repo_config_get_ulong(r, "core.deltabasecachelimit", &ulongval))
 		r->settings.delta_base_cache_limit = ulongval;
 
+	if (!repo_config_get_string_tmp(r, "core.deltabasecachepolicy", &strval)) {
+		if (!strcasecmp(strval, "lru"))
+			r->settings.delta_base_cache_policy = DELTA_BASE_CACHE_LRU;
+		else if (!strcasecmp(strval, "segmented"))
+			r->settings.delta_base_cache_policy = DELTA_BASE_CACHE_SEGMENTED;
+		else
+			die("unknown delta base cache policy '%s'", strval);
+	}
+
+	if (!repo_config_get_int(r, "core.deltachainthreads", &value)) {
+		if (value < 0)
+			die("invalid number of threads for core.deltaChainThreads: %d",
+			    value);
+		r->settings.delta_chain_threads = value ? value : online_cpus();
+	}
+
+	if (!repo_config_get_int(r, "core.looseobjectwritethreads", &value)) {
+		if (value < 0)
+			die("invalid number of threads for core.looseObjectWriteThreads: %d",
+			    value);
+		r->settings.loose_object_write_threads = value ? value : online_cpus();
+	}
+
+	if (!repo_config_get_int(r, "core.objectwalkthreads", &value)) {
+		if (value < 0)
+			die("invalid number of threads for core.objectWalkThreads: %d",
+			    value);
+		r->settings.object_walk_threads = value ? value : online_cpus();
+	}
+
+	if (!repo_config_get_int(r, "pack.writebitmapthreads", &value)) {
+		if (value < 0)
+			die("invalid number of threads for pack.writeBitmapThreads: %d",
+			    value);
+		r->settings.bitmap_write_threads = value ? value : online_cpus();
+	}
+
 	if (!repo_config_get_ulong(r, "core.packedgitwindowsize", &ulongval)) {
 		int pgsz_x2 = getpagesize() * 2;
 
@@ -16,6 +16,11 @@ enum fetch_negotiation_setting {
 	FETCH_NEGOTIATION_NOOP,
 };
 
+enum delta_base_cache_policy {
+	DELTA_BASE_CACHE_LRU,
+	DELTA_BASE_CACHE_SEGMENTED,
+};
+
 enum log_refs_config {
 	LOG_REFS_UNSET = -1,
 	LOG_REFS_NONE = 0,
@@ -60,9 +65,17 @@ struct repo_settings {
 	enum fetch_negotiation_setting fetch_negotiation_algorithm;
 
 	int core_multi_pack_index;
+	int core_tree_cache;
+	int tree_cache_depth;
+	int gc_write_tree_cache;
 	int warn_ambiguous_refs; /* lazily loaded via accessor */
 
 	size_t delta_base_cache_limit;
+	enum delta_base_cache_policy delta_base_cache_policy;
+	int delta_chain_threads;
+	int loose_object_write_threads;
+	int object_walk_threads;
+	int bitmap_write_threads;
 	size_t packed_git_window_size;
 	size_t packed_git_limit;
 	unsigned long big_file_threshold;
@@ -76,6 +89,11 @@ struct repo_settings {
 	.fetch_negotiation_algorithm = FETCH_NEGOTIATION_CONSECUTIVE, \
 	.warn_ambiguous_refs = -1, \
 	.delta_base_cache_limit = DEFAULT_DELTA_BASE_CACHE_LIMIT, \
+	.delta_base_cache_policy = DELTA_BASE_CACHE_LRU, \
+	.delta_chain_threads = 1, \
+	.loose_object_write_threads = 1, \
+	.object_walk_threads = 1, \
+	.bitmap_write_threads = 1, \
 	.packed_git_window_size = DEFAULT_PACKED_GIT_WINDOW_SIZE, \
 	.packed_git_limit = DEFAULT_PACKED_GIT_LIMIT, \
 }
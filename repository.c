@@ -280,6 +280,8 @@ int repo_init(struct repository *repo,
 	repo_set_ref_storage_format(repo, format.ref_storage_format);
 	repo->repository_format_worktree_config = format.worktree_config;
 	repo->repository_format_relative_worktrees = format.relative_worktrees;
+	repo->repository_format_packed_refs_overlay = format.packed_refs_overlay;
+	repo->repository_format_packed_refs_version = format.packed_refs_version;
 	repo->repository_format_precious_objects = format.precious_objects;
 
 	/* take ownership of format.partial_clone */
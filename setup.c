@@ -686,6 +686,19 @@ static enum extension_result handle_extension(const char *var,
 	} else if (!strcmp(ext, "relativeworktrees")) {
 		data->relative_worktrees = git_config_bool(var, value);
 		return EXTENSION_OK;
+	} else if (!strcmp(ext, "packedrefsoverlay")) {
+		data->packed_refs_overlay = git_config_bool(var, value);
+		return EXTENSION_OK;
+	} else if (!strcmp(ext, "packedrefsversion")) {
+		int version;
+
+		if (!value)
+			return config_error_nonbool(var);
+		if (strtol_i(value, 10, &version) || version < 1 || version > 2)
+			return error(_("invalid value for '%s': '%s'"),
+				     "extensions.packedrefsversion", value);
+		data->packed_refs_version = version;
+		return EXTENSION_OK;
 	}
 	return EXTENSION_UNKNOWN;
 }
@@ -1947,6 +1960,10 @@ const char *setup_git_directory_gently(int *nongit_ok)
 				repo_fmt.worktree_config;
 			the_repository->repository_format_relative_worktrees =
 				repo_fmt.relative_worktrees;
+			the_repository->repository_format_packed_refs_overlay =
+				repo_fmt.packed_refs_overlay;
+			the_repository->repository_format_packed_refs_version =
+				repo_fmt.packed_refs_version;
 			/* take ownership of repo_fmt.partial_clone */
 			the_repository->repository_format_partial_clone =
 				repo_fmt.partial_clone;
@@ -2047,6 +2064,10 @@ void check_repository_format(struct repository_format *fmt)
 		fmt->worktree_config;
 	the_repository->repository_format_relative_worktrees =
 		fmt->relative_worktrees;
+	the_repository->repository_format_packed_refs_overlay =
+		fmt->packed_refs_overlay;
+	the_repository->repository_format_packed_refs_version =
+		fmt->packed_refs_version;
 	the_repository->repository_format_partial_clone =
 		xstrdup_or_null(fmt->partial_clone);
 	clear_repository_format(&repo_fmt);
@@ -167,6 +167,8 @@ struct repository_format {
 	char *partial_clone; /* value of extensions.partialclone */
 	int worktree_config;
 	int relative_worktrees;
+	int packed_refs_overlay;
+	int packed_refs_version;
 	int is_bare;
 	int hash_algo;
 	int compat_hash_algo;
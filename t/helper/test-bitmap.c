@@ -2,8 +2,13 @@
 
 #include "test-tool.h"
 #include "git-compat-util.h"
+#include "commit.h"
+#include "ewah/ewok.h"
+#include "hex.h"
 #include "pack-bitmap.h"
 #include "setup.h"
+#include "strbuf.h"
+#include "trace.h"
 
 static int bitmap_list_commits(void)
 {
@@ -35,6 +40,193 @@ static int bitmap_dump_pseudo_merge_objects(uint32_t n)
 	return test_bitmap_pseudo_merge_objects(the_repository, n);
 }
 
+/*
+ * Word-at-a-time versions of the bitmap operations, which the bulk and
+ * vectorized implementations in ewah/ are measured against.
+ */
+static void reference_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
+{
+	struct ewah_iterator it;
+	eword_t word;
+	size_t i = 0;
+
+	ewah_iterator_init(&it, other);
+	while (ewah_iterator_next(&word, &it))
+		self->words[i++] |= word;
+}
+
+static size_t reference_ewah_popcount(struct ewah_bitmap *self)
+{
+	struct ewah_iterator it;
+	eword_t word;
+	size_t count = 0;
+
+	ewah_iterator_init(&it, self);
+	while (ewah_iterator_next(&word, &it))
+		count += ewah_bit_popcount64(word);
+	return count;
+}
+
+static size_t reference_popcount(struct bitmap *self)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < self->word_alloc; i++)
+		count += ewah_bit_popcount64(self->words[i]);
+	return count;
+}
+
+static void reference_and_not(struct bitmap *self, struct bitmap *other)
+{
+	size_t nr = self->word_alloc < other->word_alloc ?
+		self->word_alloc : other->word_alloc;
+
+	for (size_t i = 0; i < nr; i++)
+		self->words[i] &= ~other->words[i];
+}
+
+enum speed_op {
+	SPEED_OR_EWAH,
+	SPEED_EWAH_POPCOUNT,
+	SPEED_POPCOUNT,
+	SPEED_AND_NOT,
+	SPEED_OPS_NR,
+};
+
+static const char *speed_op_names[] = {
+	[SPEED_OR_EWAH] = "bitmap_or_ewah",
+	[SPEED_EWAH_POPCOUNT] = "ewah_bitmap_popcount",
+	[SPEED_POPCOUNT] = "bitmap_popcount",
+	[SPEED_AND_NOT] = "bitmap_and_not",
+};
+
+struct speed_data {
+	struct ewah_bitmap **ewah;
+	struct bitmap **inflated;
+	size_t nr;
+	struct bitmap *result;
+	size_t sink;
+};
+
+static void run_speed_op(enum speed_op op, int reference,
+			 struct speed_data *data)
+{
+	switch (op) {
+	case SPEED_OR_EWAH:
+		memset(data->result->words, 0,
+		       st_mult(data->result->word_alloc, sizeof(eword_t)));
+		for (size_t i = 0; i < data->nr; i++) {
+			if (reference)
+				reference_or_ewah(data->result, data->ewah[i]);
+			else
+				bitmap_or_ewah(data->result, data->ewah[i]);
+		}
+		break;
+	case SPEED_EWAH_POPCOUNT:
+		for (size_t i = 0; i < data->nr; i++)
+			data->sink += reference ?
+				reference_ewah_popcount(data->ewah[i]) :
+				ewah_bitmap_popcount(data->ewah[i]);
+		break;
+	case SPEED_POPCOUNT:
+		for (size_t i = 0; i < data->nr; i++)
+			data->sink += reference ?
+				reference_popcount(data->inflated[i]) :
+				bitmap_popcount(data->inflated[i]);
+		break;
+	case SPEED_AND_NOT:
+		for (size_t i = 0; i < data->nr; i++) {
+			if (reference)
+				reference_and_not(data->result, data->inflated[i]);
+			else
+				bitmap_and_not(data->result, data->inflated[i]);
+		}
+		break;
+	default:
+		BUG("unknown speed op %d", op);
+	}
+}
+
+static double time_speed_op(enum speed_op op, int reference,
+			    struct speed_data *data)
+{
+	uint64_t start = getnanotime(), elapsed;
+	size_t passes = 0;
+
+	do {
+		run_speed_op(op, reference, data);
+		passes++;
+		elapsed = getnanotime() - start;
+	} while (elapsed < 1000000000);
+
+	return (double)elapsed / passes / 1000000;
+}
+
+/*
+ * Read commits from stdin and time the bitmap operations on their
+ * bitmaps, comparing the word-at-a-time loops above with the
+ * implementations in ewah/.
+ */
+static int bitmap_speed(void)
+{
+	struct bitmap_index *bitmap_git = prepare_bitmap_git(the_repository);
+	struct speed_data data = { 0 };
+	struct strbuf line = STRBUF_INIT;
+	size_t alloc = 0, words = 0;
+
+	if (!bitmap_git)
+		die("failed to load bitmap indexes");
+
+	while (strbuf_getline(&line, stdin) != EOF) {
+		struct object_id oid;
+		struct commit *commit;
+		struct ewah_bitmap *ewah;
+
+		if (get_oid_hex(line.buf, &oid))
+			die("not an object id: %s", line.buf);
+		commit = lookup_commit(the_repository, &oid);
+		if (!commit)
+			die("not a commit: %s", line.buf);
+		ewah = bitmap_for_commit(bitmap_git, commit);
+		if (!ewah)
+			continue;
+
+		ALLOC_GROW(data.ewah, data.nr + 1, alloc);
+		data.ewah[data.nr++] = ewah;
+	}
+	strbuf_release(&line);
+
+	if (!data.nr)
+		die("none of the given commits have a bitmap");
+
+	ALLOC_ARRAY(data.inflated, data.nr);
+	data.result = bitmap_word_alloc(0);
+	for (size_t i = 0; i < data.nr; i++) {
+		data.inflated[i] = ewah_to_bitmap(data.ewah[i]);
+		words += data.inflated[i]->word_alloc;
+		bitmap_or_ewah(data.result, data.ewah[i]);
+	}
+
+	printf("bitmaps: %"PRIuMAX", words: %"PRIuMAX"\n",
+	       (uintmax_t)data.nr, (uintmax_t)words);
+	for (enum speed_op op = 0; op < SPEED_OPS_NR; op++) {
+		double reference = time_speed_op(op, 1, &data);
+		double optimized = time_speed_op(op, 0, &data);
+
+		printf("%s: %.3f ms reference, %.3f ms optimized (%.2fx)\n",
+		       speed_op_names[op], reference, optimized,
+		       reference / optimized);
+	}
+
+	for (size_t i = 0; i < data.nr; i++)
+		bitmap_free(data.inflated[i]);
+	free(data.inflated);
+	free(data.ewah);
+	bitmap_free(data.result);
+	free_bitmap_index(bitmap_git);
+	return 0;
+}
+
 int cmd__bitmap(int argc, const char **argv)
 {
 	setup_git_directory();
@@ -51,13 +243,16 @@ int cmd__bitmap(int argc, const char **argv)
 		return bitmap_dump_pseudo_merge_commits(atoi(argv[2]));
 	if (argc == 3 && !strcmp(argv[1], "dump-pseudo-merge-objects"))
 		return bitmap_dump_pseudo_merge_objects(atoi(argv[2]));
+	if (argc == 2 && !strcmp(argv[1], "speed"))
+		return bitmap_speed();
 
 	usage("\ttest-tool bitmap list-commits\n"
 	      "\ttest-tool bitmap list-commits-with-offset\n"
 	      "\ttest-tool bitmap dump-hashes\n"
 	      "\ttest-tool bitmap dump-pseudo-merges\n"
 	      "\ttest-tool bitmap dump-pseudo-merge-commits <n>\n"
-	      "\ttest-tool bitmap dump-pseudo-merge-objects <n>");
+	      "\ttest-tool bitmap dump-pseudo-merge-objects <n>\n"
+	      "\ttest-tool bitmap speed <commits");
 
 	return -1;
 }
@@ -0,0 +1,171 @@
+#include "test-tool.h"
+#include "concurrent-oidset.h"
+#include "hash.h"
+#include "oidset.h"
+#include "parse.h"
+#include "thread-utils.h"
+#include "trace.h"
+
+/*
+ * Measure how inserting into and looking up in a concurrent_oidset
+ * scales with the number of threads, compared to a plain oidset that
+ * is guarded by a single mutex.
+ */
+
+enum bench_impl {
+	BENCH_CONCURRENT,
+	BENCH_MUTEX,
+};
+
+static const char *bench_impl_names[] = {
+	[BENCH_CONCURRENT] = "concurrent_oidset",
+	[BENCH_MUTEX] = "oidset+mutex",
+};
+
+struct bench {
+	enum bench_impl impl;
+	struct concurrent_oidset concurrent;
+	struct oidset set;
+	pthread_mutex_t mutex;
+	const struct object_id *oids;
+	size_t nr;
+	int nr_threads;
+	unsigned long found;
+};
+
+struct bench_thread {
+	struct bench *bench;
+	pthread_t thread;
+	int nr;
+	int lookup;
+	unsigned long found;
+};
+
+static void *bench_thread(void *data)
+{
+	struct bench_thread *t = data;
+	struct bench *b = t->bench;
+
+	/*
+	 * Inserting threads each take every nr_threads-th object, but also
+	 * the object of their neighbour, so that half of the inserts hit an
+	 * object that is already there, as in a walk over shared history.
+	 */
+	for (size_t i = t->nr; i < b->nr; i += b->nr_threads) {
+		const struct object_id *oid = &b->oids[i];
+		const struct object_id *other = &b->oids[(i + 1) % b->nr];
+
+		if (t->lookup) {
+			if (b->impl == BENCH_CONCURRENT) {
+				t->found += concurrent_oidset_contains(&b->concurrent, oid);
+			} else {
+				pthread_mutex_lock(&b->mutex);
+				t->found += oidset_contains(&b->set, oid);
+				pthread_mutex_unlock(&b->mutex);
+			}
+		} else if (b->impl == BENCH_CONCURRENT) {
+			concurrent_oidset_insert(&b->concurrent, oid);
+			concurrent_oidset_insert(&b->concurrent, other);
+		} else {
+			pthread_mutex_lock(&b->mutex);
+			oidset_insert(&b->set, oid);
+			oidset_insert(&b->set, other);
+			pthread_mutex_unlock(&b->mutex);
+		}
+	}
+
+	return NULL;
+}
+
+static uint64_t run_threads(struct bench *b, int lookup)
+{
+	struct bench_thread *threads;
+	uint64_t start = getnanotime();
+
+	CALLOC_ARRAY(threads, b->nr_threads);
+	for (int i = 0; i < b->nr_threads; i++) {
+		threads[i].bench = b;
+		threads[i].nr = i;
+		threads[i].lookup = lookup;
+		if (pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i]))
+			die("unable to create thread");
+	}
+	for (int i = 0; i < b->nr_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		b->found += threads[i].found;
+	}
+	free(threads);
+
+	return getnanotime() - start;
+}
+
+static void run_bench(enum bench_impl impl, const struct object_id *oids,
+		      size_t nr, int nr_threads)
+{
+	struct bench b = {
+		.impl = impl,
+		.oids = oids,
+		.nr = nr,
+		.nr_threads = nr_threads,
+	};
+	uint64_t insert_ns, lookup_ns;
+
+	if (impl == BENCH_CONCURRENT)
+		concurrent_oidset_init(&b.concurrent, nr_threads, 0);
+	else
+		oidset_init(&b.set, 0);
+	pthread_mutex_init(&b.mutex, NULL);
+
+	insert_ns = run_threads(&b, 0);
+	lookup_ns = run_threads(&b, 1);
+	if (b.found != nr)
+		die("found %lu of %"PRIuMAX" objects", b.found, (uintmax_t)nr);
+
+	printf("%s: %d threads: insert %.2f Mops/s, lookup %.2f Mops/s\n",
+	       bench_impl_names[impl], nr_threads,
+	       nr * 2 * 1000.0 / insert_ns, nr * 1000.0 / lookup_ns);
+
+	if (impl == BENCH_CONCURRENT)
+		concurrent_oidset_clear(&b.concurrent);
+	else
+		oidset_clear(&b.set);
+	pthread_mutex_destroy(&b.mutex);
+}
+
+int cmd__concurrent_oidset(int argc, const char **argv)
+{
+	const struct git_hash_algo *algo = &hash_algos[GIT_HASH_SHA1];
+	struct object_id *oids;
+	unsigned long nr;
+
+	if (argc < 3 || !git_parse_ulong(argv[1], &nr) || !nr)
+		die("usage: test-tool concurrent-oidset <nr-oids> <nr-threads>...");
+	if (!HAVE_THREADS)
+		die("threads are not supported");
+
+	ALLOC_ARRAY(oids, nr);
+	for (size_t i = 0; i < nr; i++) {
+		uint32_t x = i * 2654435761u + 1;
+
+		memset(&oids[i], 0, sizeof(oids[i]));
+		for (size_t j = 0; j < algo->rawsz; j++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			oids[i].hash[j] = x & 0xff;
+		}
+		oid_set_algo(&oids[i], algo);
+	}
+
+	for (int i = 2; i < argc; i++) {
+		int nr_threads = strtol(argv[i], NULL, 10);
+
+		if (nr_threads < 1)
+			die("invalid number of threads: %s", argv[i]);
+		for (enum bench_impl impl = BENCH_CONCURRENT; impl <= BENCH_MUTEX; impl++)
+			run_bench(impl, oids, nr, nr_threads);
+	}
+
+	free(oids);
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include "test-tool.h"
+#include "hash.h"
+#include "hex.h"
+
+#define NUM_SECONDS 3
+
+enum hex_op {
+	HEX_ENCODE,
+	HEX_ENCODE_BATCH,
+	HEX_DECODE,
+	HEX_DECODE_BATCH,
+};
+
+static const char *hex_op_names[] = {
+	[HEX_ENCODE] = "oid_to_hex_r",
+	[HEX_ENCODE_BATCH] = "oids_to_hex",
+	[HEX_DECODE] = "get_oid_hex_algop",
+	[HEX_DECODE_BATCH] = "get_oids_hex_algop",
+};
+
+static void run_op(enum hex_op op, const struct git_hash_algo *algo,
+		   struct object_id *oids, char *hex, size_t nr)
+{
+	switch (op) {
+	case HEX_ENCODE:
+		for (size_t i = 0; i < nr; i++) {
+			char buf[GIT_MAX_HEXSZ + 1];
+			oid_to_hex_r(buf, &oids[i]);
+			memcpy(hex + i * (algo->hexsz + 1), buf, algo->hexsz);
+		}
+		break;
+	case HEX_ENCODE_BATCH:
+		oids_to_hex(hex, algo->hexsz + 1, oids, nr);
+		break;
+	case HEX_DECODE:
+		for (size_t i = 0; i < nr; i++)
+			if (get_oid_hex_algop(hex + i * (algo->hexsz + 1), &oids[i], algo))
+				die("invalid hex");
+		break;
+	case HEX_DECODE_BATCH:
+		if (get_oids_hex_algop(hex, algo->hexsz + 1, oids, nr, algo) != nr)
+			die("invalid hex");
+		break;
+	}
+}
+
+int cmd__hex_speed(int ac, const char **av)
+{
+	clock_t initial, start, end;
+	unsigned batch_sizes[] = { 1, 16, 256, 4096 };
+	const struct git_hash_algo *algo = NULL;
+
+	if (ac == 2) {
+		for (size_t i = 1; i < GIT_HASH_NALGOS; i++) {
+			if (!strcmp(av[1], hash_algos[i].name)) {
+				algo = &hash_algos[i];
+				break;
+			}
+		}
+	}
+	if (!algo)
+		die("usage: test-tool hex-speed algo_name");
+
+	/* Use this as an offset to make overflow less likely. */
+	initial = clock();
+
+	printf("algo: %s\n", algo->name);
+
+	for (size_t i = 0; i < ARRAY_SIZE(batch_sizes); i++) {
+		size_t nr = batch_sizes[i];
+		struct object_id *oids;
+		char *hex;
+
+		ALLOC_ARRAY(oids, nr);
+		hex = xmallocz(nr * (algo->hexsz + 1));
+		for (size_t j = 0; j < nr; j++) {
+			for (size_t k = 0; k < algo->rawsz; k++)
+				oids[j].hash[k] = (j * 131 + k * 7) & 0xff;
+			oid_set_algo(&oids[j], algo);
+			hex[j * (algo->hexsz + 1) + algo->hexsz] = '\n';
+		}
+		oids_to_hex(hex, algo->hexsz + 1, oids, nr);
+
+		for (enum hex_op op = HEX_ENCODE; op <= HEX_DECODE_BATCH; op++) {
+			unsigned long j;
+			double oids_per_sec;
+
+			start = end = clock() - initial;
+			for (j = 0; ((end - start) / CLOCKS_PER_SEC) < NUM_SECONDS; j++) {
+				run_op(op, algo, oids, hex, nr);
+
+				/*
+				 * Only check elapsed time every 128 iterations to avoid
+				 * dominating the runtime with system calls.
+				 */
+				if (!(j & 127))
+					end = clock() - initial;
+			}
+			oids_per_sec = j * nr / (((double)end - start) / CLOCKS_PER_SEC);
+			printf("batch %u: %s: %lu iters; %0.2f oids/s\n",
+			       batch_sizes[i], hex_op_names[op], j, oids_per_sec);
+		}
+
+		free(oids);
+		free(hex);
+	}
+
+	return 0;
+}
@@ -190,6 +190,42 @@ static int cmd_resolve_ref(struct ref_store *refs, const char **argv)
 	return ref ? 0 : 1;
 }
 
+static struct flag_definition resolve_flags[] = {
+	FLAG_DEF(RESOLVE_REF_READING),
+	FLAG_DEF(RESOLVE_REF_NO_RECURSE),
+	FLAG_DEF(RESOLVE_REF_ALLOW_BAD_NAME),
+	{ NULL, 0 }
+};
+
+static int cmd_read_refs(struct ref_store *refs, const char **argv)
+{
+	int flags = arg_flags(*argv++, "resolve-flags", resolve_flags);
+	struct string_list refnames = STRING_LIST_INIT_DUP;
+	struct ref_read_request *requests;
+	struct strbuf line = STRBUF_INIT;
+
+	while (strbuf_getline(&line, stdin) != EOF)
+		string_list_append(&refnames, line.buf);
+
+	CALLOC_ARRAY(requests, refnames.nr);
+	for (size_t i = 0; i < refnames.nr; i++) {
+		requests[i].refname = refnames.items[i].string;
+		oidcpy(&requests[i].oid, null_oid(the_hash_algo));
+	}
+
+	refs_read_refs(refs, requests, refnames.nr, flags);
+
+	for (size_t i = 0; i < refnames.nr; i++)
+		printf("%s %s 0x%x %d\n", oid_to_hex(&requests[i].oid),
+		       requests[i].refname, requests[i].flags,
+		       requests[i].result);
+
+	free(requests);
+	string_list_clear(&refnames, 0);
+	strbuf_release(&line);
+	return 0;
+}
+
 static int cmd_verify_ref(struct ref_store *refs, const char **argv)
 {
 	const char *refname = notnull(*argv++, "refname");
@@ -314,6 +350,7 @@ static struct command commands[] = {
 	{ "for-each-ref", cmd_for_each_ref },
 	{ "for-each-ref--exclude", cmd_for_each_ref__exclude },
 	{ "resolve-ref", cmd_resolve_ref },
+	{ "read-refs", cmd_read_refs },
 	{ "verify-ref", cmd_verify_ref },
 	{ "for-each-reflog", cmd_for_each_reflog },
 	{ "for-each-reflog-ent", cmd_for_each_reflog_ent },
@@ -1,6 +1,10 @@
 #include "git-compat-util.h"
 #include "hash.h"
 #include "hex.h"
+#include "parse-options.h"
+#include "string-list.h"
+#include "strbuf.h"
+#include "trace.h"
 #include "reftable/system.h"
 #include "reftable/reftable-constants.h"
 #include "reftable/reftable-error.h"
@@ -265,3 +269,77 @@ int cmd__dump_reftable(int argc, const char **argv)
 	}
 	return 0;
 }
+
+static const char *const reftable_read_ref_usage[] = {
+	"test-tool reftable-read-ref [--sha256] [--rounds=<n>] [--block-cache-size=<n>] <stack-dir>",
+	NULL
+};
+
+/*
+ * Look up each reference name given on stdin in the stack, which is the
+ * same point lookup that the reftable backend performs when reading a
+ * single ref. Prints how many of the names were found, and reports the
+ * time per lookup on stderr.
+ */
+int cmd__reftable_read_ref(int argc, const char **argv)
+{
+	struct reftable_write_options opts = { .hash_id = REFTABLE_HASH_SHA1 };
+	struct string_list names = STRING_LIST_INIT_DUP;
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_stack *stack = NULL;
+	struct strbuf line = STRBUF_INIT;
+	uint64_t found = 0, missing = 0, start;
+	unsigned long block_cache_size = 0;
+	int sha256 = 0, rounds = 1, err;
+	struct option options[] = {
+		OPT_BOOL(0, "sha256", &sha256, "use the SHA256 hash format"),
+		OPT_INTEGER(0, "rounds", &rounds, "look up all names <n> times"),
+		OPT_UNSIGNED(0, "block-cache-size", &block_cache_size,
+			      "size of the block cache of the stack"),
+		OPT_END(),
+	};
+
+	argc = parse_options(argc, argv, NULL, options,
+			     reftable_read_ref_usage, 0);
+	if (argc != 1 || rounds < 1)
+		usage_with_options(reftable_read_ref_usage, options);
+	if (sha256)
+		opts.hash_id = REFTABLE_HASH_SHA256;
+	opts.block_cache_size = block_cache_size;
+
+	while (strbuf_getline(&line, stdin) != EOF)
+		string_list_append(&names, line.buf);
+
+	err = reftable_new_stack(&stack, argv[0], &opts);
+	if (err < 0)
+		die("%s: %s", argv[0], reftable_error_str(err));
+
+	start = getnanotime();
+	for (int i = 0; i < rounds; i++) {
+		for (size_t j = 0; j < names.nr; j++) {
+			err = reftable_stack_read_ref(stack, names.items[j].string,
+						      &ref);
+			if (err < 0)
+				die("%s: %s", names.items[j].string,
+				    reftable_error_str(err));
+			if (i)
+				continue;
+			if (err)
+				missing++;
+			else
+				found++;
+		}
+	}
+	if (names.nr)
+		fprintf(stderr, "%"PRIuMAX" ns per lookup\n",
+			(uintmax_t)((getnanotime() - start) / (names.nr * rounds)));
+
+	printf("found: %"PRIuMAX"\nmissing: %"PRIuMAX"\n",
+	       (uintmax_t)found, (uintmax_t)missing);
+
+	reftable_ref_record_release(&ref);
+	reftable_stack_destroy(stack);
+	string_list_clear(&names, 0);
+	strbuf_release(&line);
+	return 0;
+}
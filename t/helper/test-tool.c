@@ -16,6 +16,7 @@ static struct test_cmd cmds[] = {
 	{ "bundle-uri", cmd__bundle_uri },
 	{ "cache-tree", cmd__cache_tree },
 	{ "chmtime", cmd__chmtime },
+	{ "concurrent-oidset", cmd__concurrent_oidset },
 	{ "config", cmd__config },
 	{ "crontab", cmd__crontab },
 	{ "csprng", cmd__csprng },
@@ -39,6 +40,7 @@ static struct test_cmd cmds[] = {
 	{ "hashmap", cmd__hashmap },
 	{ "hash-speed", cmd__hash_speed },
 	{ "hexdump", cmd__hexdump },
+	{ "hex-speed", cmd__hex_speed },
 	{ "json-writer", cmd__json_writer },
 	{ "lazy-init-name-hash", cmd__lazy_init_name_hash },
 	{ "match-trees", cmd__match_trees },
@@ -64,6 +66,7 @@ static struct test_cmd cmds[] = {
 	{ "read-graph", cmd__read_graph },
 	{ "read-midx", cmd__read_midx },
 	{ "ref-store", cmd__ref_store },
+	{ "reftable-read-ref", cmd__reftable_read_ref },
 	{ "rot13-filter", cmd__rot13_filter },
 	{ "regex", cmd__regex },
 	{ "repository", cmd__repository },
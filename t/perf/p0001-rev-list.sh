@@ -14,6 +14,14 @@ test_perf 'rev-list --all --objects' '
 	git rev-list --all --objects >/dev/null
 '
 
+test_perf 'rev-list --all --objects (core.objectWalkThreads=0)' '
+	git -c core.objectWalkThreads=0 rev-list --all --objects >/dev/null
+'
+
+test_perf 'pack-objects --all (core.objectWalkThreads=0)' '
+	git -c core.objectWalkThreads=0 pack-objects --all --stdout </dev/null >/dev/null
+'
+
 test_perf 'rev-list --parents' '
 	git rev-list --parents HEAD >/dev/null
 '
@@ -14,18 +14,35 @@ depth of 50.
 The setting of core.deltaBaseCacheLimit in the source repository is also
 relevant (depending on the size of your test repo), so be sure it is consistent
 between runs.
+
+Each test is run with both values of core.deltaBaseCachePolicy. The
+tree-heavy walks are where the "segmented" policy should shine, as they keep
+coming back to the same small trees while large blobs pass through the cache.
 '
 . ./perf-lib.sh
 
 test_perf_large_repo
 
-# puts mostly trees into the delta base cache
-test_perf 'log --raw' '
-	git log --raw >/dev/null
-'
-
-test_perf 'log -S' '
-	git log --raw -Sfoo >/dev/null
-'
+for policy in lru segmented
+do
+	# puts mostly trees into the delta base cache
+	test_perf "log --raw ($policy)" "
+		git -c core.deltaBaseCachePolicy=$policy log --raw >/dev/null
+	"
+
+	test_perf "log -S ($policy)" "
+		git -c core.deltaBaseCachePolicy=$policy log --raw -Sfoo >/dev/null
+	"
+
+	# walks every tree, but looks at blobs only to diff them
+	test_perf "log -p ($policy)" "
+		git -c core.deltaBaseCachePolicy=$policy log -p -100 >/dev/null
+	"
+
+	test_perf "rev-list --objects ($policy)" "
+		git -c core.deltaBaseCachePolicy=$policy rev-list --objects \\
+			--all >/dev/null
+	"
+done
 
 test_done
@@ -31,25 +31,30 @@ setup_repo () {
 
 test_perf_fsync_cfgs () {
 	local method &&
+	local threads &&
 	local cfg &&
 	for method in none fsync batch writeout-only
 	do
-		case $method in
-		none)
-			cfg="-c core.fsync=none"
-			;;
-		*)
-			cfg="-c core.fsync=loose-object -c core.fsyncMethod=$method"
-		esac &&
+		for threads in 1 0
+		do
+			case $method in
+			none)
+				cfg="-c core.fsync=none"
+				;;
+			*)
+				cfg="-c core.fsync=loose-object -c core.fsyncMethod=$method"
+			esac &&
+			cfg="$cfg -c core.looseObjectWriteThreads=$threads" &&
 
-		# Set GIT_TEST_FSYNC=1 explicitly since fsync is normally
-		# disabled by t/test-lib.sh.
-		if ! test_perf "$1 (fsyncMethod=$method)" \
-						--setup "$2" \
-						"GIT_TEST_FSYNC=1 git $cfg $3"
-		then
-			break
-		fi
+			# Set GIT_TEST_FSYNC=1 explicitly since fsync is normally
+			# disabled by t/test-lib.sh.
+			if ! test_perf "$1 (fsyncMethod=$method, writeThreads=$threads)" \
+							--setup "$2" \
+							"GIT_TEST_FSYNC=1 git $cfg $3"
+			then
+				break 2
+			fi
+		done
 	done
 }
 
@@ -0,0 +1,45 @@
+#!/bin/sh
+
+test_description='Test reads of objects at the end of deep delta chains
+
+We build a single file with a long history, pack it with a deep delta chain
+and then read the deepest object of the chain from a cold process, with and
+without core.deltaChainThreads. Each read has to inflate every delta of the
+chain, which is the work that the threads share.
+'
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success 'create deep delta chain' '
+	mkdir chunks &&
+	for c in $(test_seq 10 73)
+	do
+		test-tool genrandom base$c 65536 >chunks/$c || return 1
+	done &&
+	for i in $(test_seq 10 60)
+	do
+		test-tool genrandom v$i 65536 >chunks/$i &&
+		cat chunks/* >file &&
+		git add file &&
+		git commit -q -m $i || return 1
+	done &&
+	git repack -adf --depth=50 --window=50 &&
+	git verify-pack -v .git/objects/pack/pack-*.idx >verify &&
+	awk "\$2 == \"blob\" && NF == 7 && \$6 > max { max = \$6; oid = \$1 }
+	     END { print oid }" <verify >blob &&
+	test -s blob
+'
+
+for threads in 1 4
+do
+	test_perf "cat-file blob at chain tip, $threads thread(s)" "
+		for i in \$(test_seq 1 20)
+		do
+			git -c core.deltaChainThreads=$threads \
+				cat-file blob \$(cat blob) >/dev/null || return 1
+		done
+	"
+done
+
+test_done
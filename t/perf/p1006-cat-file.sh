@@ -9,4 +9,17 @@ test_perf 'cat-file --batch-check' '
 	git cat-file --batch-all-objects --batch-check
 '
 
+test_perf 'cat-file --batch' '
+	git cat-file --batch-all-objects --batch >/dev/null
+'
+
+test_perf 'cat-file --batch --no-buffer' '
+	git cat-file --batch-all-objects --batch --no-buffer >/dev/null
+'
+
+test_perf 'cat-file --batch from stdin' '
+	git cat-file --batch-all-objects --batch-check="%(objectname)" |
+	git cat-file --batch --buffer >/dev/null
+'
+
 test_done
@@ -30,4 +30,53 @@ test_perf "update-ref --stdin" '
 	git update-ref --stdin <instructions >/dev/null
 '
 
+# Deleting packed references rewrites the whole packed-refs file unless
+# the deletions can be recorded in a packed-refs overlay.
+for count in 10000 100000
+do
+	test_expect_success "setup $count packed refs" "
+		git init refs-$count &&
+		git -C refs-$count config core.repositoryFormatVersion 1 &&
+		git -C refs-$count commit --allow-empty -m base &&
+		for i in \$(test_seq $count)
+		do
+			echo \"create refs/tags/tag-\$i HEAD\" || return 1
+		done >input &&
+		git -C refs-$count update-ref --stdin <input &&
+		git -C refs-$count pack-refs --all &&
+		cp refs-$count/.git/packed-refs refs-$count/packed-refs.orig
+	"
+
+	for overlay in false true
+	do
+		test_perf "update-ref -d, $count packed refs, overlay=$overlay" \
+			--setup "
+				git -C refs-$count config extensions.packedRefsOverlay $overlay &&
+				cp refs-$count/packed-refs.orig refs-$count/.git/packed-refs &&
+				rm -f refs-$count/.git/packed-refs.overlay
+			" "
+			for i in \$(test_seq 100)
+			do
+				git -C refs-$count update-ref -d refs/tags/tag-\$i || return 1
+			done
+		"
+	done
+
+	for version in 1 2
+	do
+		test_perf "lookups, $count packed refs, version $version" \
+			--setup "
+				git -C refs-$count config extensions.packedRefsVersion $version &&
+				cp refs-$count/packed-refs.orig refs-$count/.git/packed-refs &&
+				rm -f refs-$count/.git/packed-refs.overlay &&
+				git -C refs-$count pack-refs
+			" "
+			for i in \$(test_seq 100)
+			do
+				git -C refs-$count rev-parse --verify -q refs/tags/tag-\$i >/dev/null || return 1
+			done
+		"
+	done
+done
+
 test_done
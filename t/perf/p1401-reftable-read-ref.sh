@@ -0,0 +1,47 @@
+#!/bin/sh
+
+test_description="Tests performance of reftable point lookups"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	git init --ref-format=reftable repo &&
+	(
+		cd repo &&
+		git config reftable.blockSize 65536 &&
+		git config reftable.restartInterval 64 &&
+		test_commit initial &&
+		for i in $(test_seq 100000)
+		do
+			echo "create refs/heads/team-$((i % 100))/branch-$i HEAD" || return 1
+		done | git update-ref --stdin &&
+		git pack-refs --all &&
+		git for-each-ref --format="%(refname)" >../existing &&
+		sed "s/\$/-missing/" ../existing >../missing
+	) &&
+	git init --ref-format=reftable repo-default &&
+	(
+		cd repo-default &&
+		test_commit initial &&
+		for i in $(test_seq 100000)
+		do
+			echo "create refs/heads/team-$((i % 100))/branch-$i HEAD" || return 1
+		done | git update-ref --stdin &&
+		git pack-refs --all
+	)
+'
+
+for repo in repo repo-default
+do
+	test_perf "read existing refs ($repo)" "
+		test-tool reftable-read-ref $repo/.git/reftable <existing
+	"
+
+	test_perf "read missing refs ($repo)" "
+		test-tool reftable-read-ref $repo/.git/reftable <missing
+	"
+done
+
+test_done
@@ -0,0 +1,45 @@
+#!/bin/sh
+
+test_description="Tests performance of listing many loose refs"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	git init --ref-format=files repo &&
+	(
+		cd repo &&
+		test_commit initial &&
+		for i in $(test_seq 20000)
+		do
+			echo "create refs/heads/team-$((i % 100))/branch-$i HEAD" || return 1
+		done | git update-ref --stdin &&
+		git symbolic-ref refs/heads/current refs/heads/team-1/branch-1 &&
+
+		# Refs that have been changed too recently are not cached.
+		sleep 2
+	)
+'
+
+for cache in false true
+do
+	test_expect_success "enable loose refs cache: $cache" "
+		git -C repo config core.looseRefsCache $cache &&
+		git -C repo for-each-ref >/dev/null
+	"
+
+	test_perf "for-each-ref (looseRefsCache=$cache)" "
+		git -C repo for-each-ref >/dev/null
+	"
+
+	test_perf "for-each-ref with prefix (looseRefsCache=$cache)" "
+		git -C repo for-each-ref refs/heads/team-42/ >/dev/null
+	"
+
+	test_perf "branch --list (looseRefsCache=$cache)" "
+		git -C repo branch --list >/dev/null
+	"
+done
+
+test_done
@@ -10,4 +10,11 @@ test_perf 'fsck' '
 	git fsck
 '
 
+for threads in 2 4 8 0
+do
+	test_perf "fsck --threads=$threads" "
+		git fsck --threads=$threads
+	"
+done
+
 test_done
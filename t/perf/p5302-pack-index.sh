@@ -47,4 +47,24 @@ test_perf 'index-pack default number of threads' \
 	GIT_DIR=repo.git git index-pack --stdin < $PACK
 '
 
+# A large push: a thin pack of the more recent half of the history,
+# whose bases are found in the full repository through alternates.
+test_expect_success 'create large thin pack' '
+	nr=$(git rev-list --count HEAD) &&
+	printf "HEAD\n^HEAD~%d\n" $((nr / 2)) |
+	git pack-objects --thin --revs --stdout >thin.pack
+'
+
+for t in 1 $threads
+do
+	THREADS=$t
+	export THREADS
+	test_perf "index-pack --fix-thin large pack, $t threads" \
+		--setup 'rm -rf repo.git && git init --bare repo.git &&
+			 echo "$(pwd)/.git/objects" >repo.git/objects/info/alternates' '
+		GIT_DIR=repo.git GIT_FORCE_THREADS=1 \
+		git index-pack --threads=$THREADS --fix-thin --stdin <thin.pack
+	'
+done
+
 test_done
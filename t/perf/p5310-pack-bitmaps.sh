@@ -27,14 +27,16 @@ test_lookup_pack_bitmap () {
 		git tag --message="tag pointing to HEAD" perf-tag HEAD
 	'
 
-	test_perf "enable lookup table: $1" '
-		git config pack.writeBitmapLookupTable '"$1"'
+	test_perf "enable lookup table: $1, roaring: $2" '
+		git config pack.writeBitmapLookupTable '"$1"' &&
+		git config pack.writeBitmapRoaring '"$2"'
 	'
 
 	test_pack_bitmap
 }
 
-test_lookup_pack_bitmap false
-test_lookup_pack_bitmap true
+test_lookup_pack_bitmap false false
+test_lookup_pack_bitmap true false
+test_lookup_pack_bitmap true true
 
 test_done
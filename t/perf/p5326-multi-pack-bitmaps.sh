@@ -31,6 +31,11 @@ test_bitmap () {
 		git multi-pack-index write --bitmap
 	'
 
+	test_perf "setup multi-pack index with threads (lookup=$enabled)" \
+		--setup 'rm -f .git/objects/pack/multi-pack-index*' '
+		git -c pack.writeBitmapThreads=0 multi-pack-index write --bitmap
+	'
+
 	test_expect_success "drop pack bitmap (lookup=$enabled)" '
 		rm -f .git/objects/pack/pack-*.bitmap
 	'
@@ -52,4 +52,27 @@ test_perf 'fetch' '
 	)
 '
 
+test_expect_success 'create many local refs in the child' '
+	(
+		cd child &&
+		head=$(git commit-tree -m local $(git mktree </dev/null)) &&
+		test_seq 100000 |
+		sed "s,.*,update refs/tags/local-& $head," |
+		$MODERN_GIT update-ref --stdin &&
+		$MODERN_GIT pack-refs --all
+	)
+'
+
+test_perf 'fetch with many local refs' '
+	obj=$($MODERN_GIT -C parent rev-parse HEAD) &&
+	(
+		cd child &&
+		$MODERN_GIT for-each-ref --format="option no-deref%0adelete %(refname)" refs/remotes |
+		$MODERN_GIT update-ref --stdin &&
+		rm -vf .git/objects/$(echo $obj | sed "s|^..|&/|") &&
+
+		git fetch
+	)
+'
+
 test_done
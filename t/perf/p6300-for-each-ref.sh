@@ -68,6 +68,17 @@ run_tests () {
 	test_for_each_ref "$1, tags, no sort" --no-sort refs/tags/
 	test_for_each_ref "$1, tags, dereferenced" '--format="%(refname) %(objectname) %(*objectname)"' refs/tags/
 	test_for_each_ref "$1, tags, dereferenced, no sort" --no-sort '--format="%(refname) %(objectname) %(*objectname)"' refs/tags/
+	test_for_each_ref "$1, tags, version sort" --sort=version:refname refs/tags/
+	test_for_each_ref "$1, tags, sorted by taggerdate" --sort=-taggerdate refs/tags/
+	test_for_each_ref "$1, tags, sorted by taggerdate, dereferenced" --sort=-taggerdate '--format="%(refname) %(*objectname) %(*subject)"' refs/tags/
+
+	# Sorting by anything but the refname reads objects with multiple
+	# threads; compare with reading them one by one.
+	test_perf "for-each-ref ($1, tags, sorted by taggerdate, single thread)" "
+		for i in \$(test_seq $test_iteration_count); do
+			GIT_TEST_REF_FILTER_THREADS=1 git for-each-ref --sort=-taggerdate refs/tags/ >/dev/null
+		done
+	"
 
 	test_perf "for-each-ref ($1, tags) + cat-file --batch-check (dereferenced)" "
 		for i in \$(test_seq $test_iteration_count); do
@@ -84,4 +95,11 @@ test_expect_success 'pack refs' '
 '
 run_tests "packed"
 
+test_expect_success 'pack refs with version 2' '
+	git config core.repositoryFormatVersion 1 &&
+	git config extensions.packedRefsVersion 2 &&
+	git pack-refs --all
+'
+run_tests "packed v2"
+
 test_done
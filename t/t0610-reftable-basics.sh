@@ -492,6 +492,71 @@ test_expect_success !CYGWIN 'ref transaction: many concurrent writers' '
 	)
 '
 
+run_and_wait_for_detached () {
+	# We read stdout for the side effect of waiting until detached
+	# auto-compaction processes exit, closing their fd 9.
+	doesnt_matter=$("$@" 9>&1)
+}
+
+test_expect_success 'ref transaction: detached auto-compaction' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		git config set reftable.autoCompactDetach true &&
+		test_commit --no-tag initial &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		run_and_wait_for_detached git update-ref refs/heads/branch HEAD &&
+		test_subcommand git pack-refs --auto --detach <trace.txt &&
+		test_line_count = 1 .git/reftable/tables.list &&
+
+		for i in $(test_seq 10)
+		do
+			run_and_wait_for_detached git update-ref refs/heads/branch-$i HEAD &&
+			test_line_count -lt 3 .git/reftable/tables.list ||
+			return 1
+		done
+	)
+'
+
+concurrent_writes () {
+	for i in $(test_seq "$1")
+	do
+		git update-ref refs/heads/branch-$i HEAD &
+	done &&
+	wait
+}
+
+test_expect_success !CYGWIN 'ref transaction: concurrent writers with detached auto-compaction' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		git config set reftable.lockTimeout 300000 &&
+		git config set reftable.autoCompactDetach true &&
+		test_commit --no-tag initial &&
+
+		head=$(git rev-parse HEAD) &&
+		test_seq -f "$head commit\trefs/heads/branch-%d" 50 >expect &&
+		printf "%s commit\trefs/heads/main\n" "$head" >>expect &&
+
+		run_and_wait_for_detached concurrent_writes 50 &&
+		git for-each-ref --sort=v:refname >actual &&
+		test_cmp expect actual &&
+		git refs verify 2>err &&
+		test_must_be_empty err &&
+
+		# The stack may not be perfectly compacted when compactions
+		# raced with each other, but the next write brings it back
+		# into shape.
+		run_and_wait_for_detached git update-ref refs/heads/final HEAD &&
+		test_line_count -lt 10 .git/reftable/tables.list &&
+		ls .git/reftable >files &&
+		test_grep ! "\.lock\$" files
+	)
+'
+
 test_expect_success 'pack-refs: compacts tables' '
 	test_when_finished "rm -rf repo" &&
 	git init repo &&
@@ -637,6 +702,48 @@ test_expect_success 'ref iterator: missing object IDs are not flagged' '
 	)
 '
 
+test_expect_success 'ref iterator: parallel iteration' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		git config set reftable.blockSize 512 &&
+		test_commit --no-tag initial &&
+		test_seq -f "create refs/heads/branch-%04d HEAD" 2000 |
+		git update-ref --stdin &&
+
+		# Spread updates and deletions over multiple tables.
+		test_commit --no-tag second &&
+		test_seq -f "refs/heads/branch-%04d" 2000 >names &&
+		awk "NR % 7 == 1" names | sed "s/.*/update & HEAD/" >input &&
+		awk "NR % 11 == 3 && NR % 7 != 1" names | sed "s/.*/delete &/" >>input &&
+		test_seq -f "create refs/tags/tag-%04d HEAD" 500 >>input &&
+		GIT_TEST_REFTABLE_AUTOCOMPACTION=false \
+		git update-ref --stdin <input &&
+		GIT_TEST_REFTABLE_AUTOCOMPACTION=false \
+		git branch branch-0100-new &&
+		test_line_count -gt 1 .git/reftable/tables.list &&
+
+		git -c reftable.iteratorThreads=1 for-each-ref >expect &&
+		git -c reftable.iteratorThreads=4 for-each-ref >actual &&
+		test_cmp expect actual &&
+		git -c reftable.iteratorThreads=0 for-each-ref >actual &&
+		test_cmp expect actual &&
+
+		git -c reftable.iteratorThreads=1 for-each-ref --exclude=refs/heads/branch-1 >expect &&
+		git -c reftable.iteratorThreads=4 for-each-ref --exclude=refs/heads/branch-1 >actual &&
+		test_cmp expect actual &&
+
+		git -c reftable.iteratorThreads=1 for-each-ref --start-after=refs/heads/branch-1500 >expect &&
+		git -c reftable.iteratorThreads=4 for-each-ref --start-after=refs/heads/branch-1500 >actual &&
+		test_cmp expect actual &&
+
+		git -c reftable.iteratorThreads=1 for-each-ref refs/tags/ >expect &&
+		git -c reftable.iteratorThreads=4 for-each-ref refs/tags/ >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_expect_success 'basic: commit and list refs' '
 	test_when_finished "rm -rf repo" &&
 	git init repo &&
@@ -1163,4 +1270,28 @@ test_expect_success 'writes do not persist peeled value for invalid tags' '
 	)
 '
 
+test_expect_success 'point lookups find exactly the existing refs' '
+	test_when_finished rm -rf repo &&
+	git init repo &&
+	(
+		cd repo &&
+		git config reftable.restartInterval 4 &&
+		test_commit initial &&
+		for i in $(test_seq 500)
+		do
+			echo "create refs/heads/branch-$i HEAD" || return 1
+		done | git update-ref --stdin &&
+		git pack-refs &&
+		git for-each-ref --format="%(refname)" >existing &&
+		sed "s/\$/-missing/" existing >missing &&
+		cat existing missing >names &&
+		test-tool reftable-read-ref .git/reftable <names >actual 2>err &&
+		cat >expect <<-EOF &&
+		found: 502
+		missing: 502
+		EOF
+		test_cmp expect actual
+	)
+'
+
 test_done
@@ -1277,6 +1277,22 @@ test_expect_success 'cat-file --batch-all-objects --batch-check ignores replace'
 	echo "$orig commit $orig_size" >expect &&
 	test_cmp expect actual
 '
+
+test_expect_success 'cat-file --batch-all-objects --batch streams all objects' '
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objecttype) %(objectsize)" >objects &&
+	while read oid type size
+	do
+		echo "$oid $type $size" &&
+		git --no-replace-objects cat-file $type $oid &&
+		echo || return 1
+	done <objects >expect &&
+	git cat-file --batch-all-objects --batch >actual &&
+	test_cmp expect actual &&
+	git cat-file --batch-all-objects --batch --no-buffer >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'batch-command empty command' '
 	echo "" >cmd &&
 	test_expect_code 128 git cat-file --batch-command <cmd 2>err &&
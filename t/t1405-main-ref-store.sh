@@ -122,4 +122,87 @@ test_expect_success 'delete_ref(refs/heads/foo)' '
 	test_must_fail git rev-parse refs/heads/foo --
 '
 
+test_expect_success 'read_refs() matches resolve_ref()' '
+	git branch packed-branch &&
+	git tag packed-tag &&
+	git pack-refs --all &&
+	git branch loose-branch &&
+	git symbolic-ref refs/heads/sym refs/heads/packed-branch &&
+	git symbolic-ref refs/heads/dangling refs/heads/missing &&
+	cat >input <<-\EOF &&
+	refs/tags/packed-tag
+	refs/heads/loose-branch
+	HEAD
+	refs/heads/missing
+	refs/heads/sym
+	refs/heads/dangling
+	refs/heads/packed-branch
+	refs/heads/bad..name
+	refs/heads/loose-branch
+	refs/heads/new-main
+	EOF
+	while read refname
+	do
+		test_might_fail $RUN resolve-ref "$refname" 0 >out &&
+		read oid resolved flags <out &&
+		if test "$resolved" = "(null)"
+		then
+			result=-1
+		else
+			result=0
+		fi &&
+		echo "$oid $refname $flags $result" || return 1
+	done <input >expected &&
+	$RUN read-refs 0 <input >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'read_refs() in reading mode' '
+	ZERO=$(test_oid zero) &&
+	MAIN=$(git rev-parse new-main) &&
+	PACKED=$(git rev-parse packed-branch) &&
+	cat >input <<-\EOF &&
+	refs/heads/new-main
+	refs/heads/missing
+	refs/heads/dangling
+	refs/heads/sym
+	EOF
+	$RUN read-refs RESOLVE_REF_READING <input >actual &&
+	cut -d" " -f1,2,4 actual >actual.filtered &&
+	cat >expected <<-EOF &&
+	$MAIN refs/heads/new-main 0
+	$ZERO refs/heads/missing -1
+	$ZERO refs/heads/dangling -1
+	$PACKED refs/heads/sym 0
+	EOF
+	test_cmp expected actual.filtered
+'
+
+test_expect_success 'read_refs() with many refs' '
+	MAIN=$(git rev-parse new-main) &&
+	for i in $(test_seq 300)
+	do
+		echo "create refs/heads/many/$i $MAIN" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	git pack-refs --all &&
+	for i in $(test_seq 300 | awk "NR % 50 == 5")
+	do
+		git update-ref refs/heads/many/$i HEAD || return 1
+	done &&
+	for i in $(test_seq 300 | awk "NR % 7 == 1")
+	do
+		echo refs/heads/many/$i &&
+		echo refs/heads/many/${i}x || return 1
+	done >input &&
+	while read refname
+	do
+		test_might_fail $RUN resolve-ref "$refname" 0 >out &&
+		read oid resolved flags <out &&
+		echo "$oid $refname $flags 0" || return 1
+	done <input >expected &&
+	$RUN read-refs 0 <input >actual &&
+	test_cmp expected actual
+'
+
 test_done
@@ -0,0 +1,152 @@
+#!/bin/sh
+
+test_description='packed-refs overlay'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+GIT_TEST_DEFAULT_REF_FORMAT=files
+export GIT_TEST_DEFAULT_REF_FORMAT
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git config core.repositoryFormatVersion 1 &&
+	git config extensions.packedRefsOverlay true &&
+	test_commit A &&
+	test_commit B &&
+	A=$(git rev-parse A) &&
+	B=$(git rev-parse B) &&
+	for i in $(test_seq 300)
+	do
+		echo "create refs/heads/branch-$i $A" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	git pack-refs --all &&
+	test_path_is_missing .git/packed-refs.overlay
+'
+
+test_expect_success 'deleting a packed ref records it in the overlay' '
+	cp .git/packed-refs packed-refs.orig &&
+	git for-each-ref >refs.orig &&
+	git update-ref -d refs/heads/branch-10 &&
+	test_cmp packed-refs.orig .git/packed-refs &&
+	test_grep "^$ZERO_OID refs/heads/branch-10\$" .git/packed-refs.overlay &&
+	test_must_fail git rev-parse --verify refs/heads/branch-10 &&
+	test_must_fail git show-ref --exists refs/heads/branch-10 &&
+	grep -v "refs/heads/branch-10\$" refs.orig >expect &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'overlay is merged into prefix iteration' '
+	git for-each-ref refs/heads/branch-1 refs/heads/branch-10 \
+		refs/heads/branch-100 >actual &&
+	cat >expect <<-EOF &&
+	$A commit	refs/heads/branch-1
+	$A commit	refs/heads/branch-100
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'old values are checked against the overlay' '
+	test_must_fail git update-ref -d refs/heads/branch-10 $A &&
+	git update-ref refs/heads/branch-10 $B "" &&
+	test_cmp_rev refs/heads/branch-10 B
+'
+
+test_expect_success 'deleting more packed refs extends the overlay' '
+	git update-ref -d refs/heads/branch-10 &&
+	git update-ref -d refs/heads/branch-20 &&
+	test_cmp packed-refs.orig .git/packed-refs &&
+	cat >expect <<-EOF &&
+	$ZERO_OID refs/heads/branch-10
+	$ZERO_OID refs/heads/branch-20
+	EOF
+	sed 1d .git/packed-refs.overlay >actual &&
+	test_cmp expect actual &&
+	grep -v "refs/heads/branch-[12]0\$" refs.orig >expect &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'overlay records override packed-refs' '
+	mv .git/packed-refs.overlay overlay.saved &&
+	test_when_finished "mv overlay.saved .git/packed-refs.overlay" &&
+	cat >.git/packed-refs.overlay <<-EOF &&
+	# pack-refs with: peeled fully-peeled sorted
+	$B refs/heads/branch-2
+	$ZERO_OID refs/heads/branch-3
+	$B refs/heads/new
+	EOF
+	test_cmp_rev refs/heads/branch-2 B &&
+	test_must_fail git rev-parse --verify refs/heads/branch-3 &&
+	test_cmp_rev refs/heads/new B &&
+	git for-each-ref --format="%(refname)" refs/heads/branch-2 \
+		refs/heads/branch-3 refs/heads/new >actual &&
+	cat >expect <<-EOF &&
+	refs/heads/branch-2
+	refs/heads/new
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'overlay is ignored without the extension' '
+	mv .git/packed-refs.overlay overlay.saved &&
+	test_when_finished "mv overlay.saved .git/packed-refs.overlay" &&
+	cat >.git/packed-refs.overlay <<-EOF &&
+	# pack-refs with: peeled fully-peeled sorted
+	$ZERO_OID refs/heads/branch-2
+	EOF
+	test_must_fail git rev-parse --verify refs/heads/branch-2 &&
+	test_when_finished "git config extensions.packedRefsOverlay true" &&
+	git config extensions.packedRefsOverlay false &&
+	git rev-parse --verify refs/heads/branch-2
+'
+
+test_expect_success 'pack-refs folds the overlay into packed-refs' '
+	git update-ref -d refs/heads/branch-30 &&
+	test_path_is_file .git/packed-refs.overlay &&
+	git for-each-ref >expect &&
+	git pack-refs &&
+	test_path_is_missing .git/packed-refs.overlay &&
+	test_grep ! "refs/heads/branch-30\$" .git/packed-refs &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'auto-packing folds the overlay' '
+	git update-ref -d refs/heads/branch-40 &&
+	test_path_is_file .git/packed-refs.overlay &&
+	git for-each-ref >expect &&
+	git pack-refs --auto &&
+	test_path_is_missing .git/packed-refs.overlay &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'large transactions rewrite packed-refs' '
+	git update-ref -d refs/heads/branch-50 &&
+	test_path_is_file .git/packed-refs.overlay &&
+	for i in $(test_seq 100 150)
+	do
+		echo "delete refs/heads/branch-$i" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	test_path_is_missing .git/packed-refs.overlay &&
+	test_grep ! "refs/heads/branch-50\$" .git/packed-refs &&
+	test_grep ! "refs/heads/branch-120\$" .git/packed-refs &&
+	test_must_fail git rev-parse --verify refs/heads/branch-50 &&
+	git rev-parse --verify refs/heads/branch-99
+'
+
+test_expect_success 'overlay is folded once it grows too large' '
+	for i in $(test_seq 200 269)
+	do
+		git update-ref -d refs/heads/branch-$i || return 1
+	done &&
+	test_grep ! "refs/heads/branch-200\$" .git/packed-refs &&
+	git for-each-ref --format="%(refname)" "refs/heads/branch-2[0-6]?" >actual &&
+	test_must_be_empty actual
+'
+
+test_done
@@ -0,0 +1,149 @@
+#!/bin/sh
+
+test_description='packed-refs version 2'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+GIT_TEST_DEFAULT_REF_FORMAT=files
+export GIT_TEST_DEFAULT_REF_FORMAT
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git config core.repositoryFormatVersion 1 &&
+	test_commit A &&
+	test_commit B &&
+	git tag -a -m "annotated" annotated A &&
+	A=$(git rev-parse A) &&
+	for i in $(test_seq 300)
+	do
+		echo "create refs/heads/branch-$i $A" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	git pack-refs --all &&
+	test_grep "^# pack-refs with:" .git/packed-refs &&
+	git for-each-ref --format="%(refname) %(objectname) %(*objectname)" >refs.v1 &&
+	git show-ref -d >show-ref.v1 &&
+	git for-each-ref --format="%(refname)" --exclude=refs/heads/branch-1 \
+		--exclude=refs/heads/branch-2 refs/heads/ >exclude.v1
+'
+
+test_expect_success 'invalid extension values are rejected' '
+	test_when_finished "rm -rf invalid" &&
+	git init invalid &&
+	git -C invalid config core.repositoryFormatVersion 1 &&
+	git -C invalid config extensions.packedRefsVersion 3 &&
+	test_must_fail git -C invalid rev-parse --git-dir 2>err &&
+	test_grep "invalid value for .extensions.packedrefsversion." err
+'
+
+test_expect_success 'pack-refs converts packed-refs to version 2' '
+	git config extensions.packedRefsVersion 2 &&
+	git pack-refs &&
+	echo PREF >expect &&
+	test_copy_bytes 4 <.git/packed-refs >actual &&
+	echo >>actual &&
+	test_cmp expect actual &&
+	git for-each-ref --format="%(refname) %(objectname) %(*objectname)" >actual &&
+	test_cmp refs.v1 actual &&
+	git show-ref -d >actual &&
+	test_cmp show-ref.v1 actual
+'
+
+test_expect_success 'references can be looked up' '
+	test_cmp_rev refs/heads/branch-1 A &&
+	test_cmp_rev refs/heads/branch-300 A &&
+	test_cmp_rev annotated^{} A &&
+	git show-ref --exists refs/heads/branch-150 &&
+	test_must_fail git show-ref --exists refs/heads/branch-301 &&
+	test_must_fail git show-ref --exists refs/heads/branch-0 &&
+	test_must_fail git show-ref --exists refs/heads/branch
+'
+
+test_expect_success 'prefixes and exclude patterns' '
+	git for-each-ref --format="%(refname)" refs/heads/branch-10 \
+		refs/heads/branch-100 refs/tags/ >actual &&
+	cat >expect <<-\EOF &&
+	refs/heads/branch-10
+	refs/heads/branch-100
+	refs/tags/A
+	refs/tags/B
+	refs/tags/annotated
+	EOF
+	test_cmp expect actual &&
+	git for-each-ref --format="%(refname)" --exclude=refs/heads/branch-1 \
+		--exclude=refs/heads/branch-2 refs/heads/ >actual &&
+	test_cmp exclude.v1 actual
+'
+
+test_expect_success 'updates keep writing version 2' '
+	git update-ref -d refs/heads/branch-10 &&
+	git update-ref refs/heads/branch-10a B &&
+	git pack-refs --all &&
+	echo PREF >expect &&
+	test_copy_bytes 4 <.git/packed-refs >actual &&
+	echo >>actual &&
+	test_cmp expect actual &&
+	test_must_fail git show-ref --exists refs/heads/branch-10 &&
+	test_cmp_rev refs/heads/branch-10a B &&
+	git refs verify
+'
+
+test_expect_success 'overlay is merged with version 2' '
+	test_config extensions.packedRefsOverlay true &&
+	cp .git/packed-refs packed-refs.orig &&
+	git update-ref -d refs/heads/branch-20 &&
+	test_cmp packed-refs.orig .git/packed-refs &&
+	test_path_is_file .git/packed-refs.overlay &&
+	test_must_fail git show-ref --exists refs/heads/branch-20 &&
+	git for-each-ref --format="%(refname)" refs/heads/branch-2 \
+		refs/heads/branch-20 refs/heads/branch-200 >actual &&
+	cat >expect <<-\EOF &&
+	refs/heads/branch-2
+	refs/heads/branch-200
+	EOF
+	test_cmp expect actual &&
+	git pack-refs &&
+	test_path_is_missing .git/packed-refs.overlay &&
+	test_must_fail git show-ref --exists refs/heads/branch-20
+'
+
+test_expect_success 'auto-packing converts packed-refs' '
+	git config extensions.packedRefsVersion 1 &&
+	git pack-refs &&
+	test_grep "^# pack-refs with:" .git/packed-refs &&
+	git config extensions.packedRefsVersion 2 &&
+	git pack-refs --auto &&
+	echo PREF >expect &&
+	test_copy_bytes 4 <.git/packed-refs >actual &&
+	echo >>actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'corruption is detected' '
+	cp .git/packed-refs packed-refs.good &&
+	test_when_finished "cp packed-refs.good .git/packed-refs" &&
+	size=$(wc -c <.git/packed-refs) &&
+
+	# Flip the last byte of the checksum.
+	test_copy_bytes $(($size - 1)) <packed-refs.good >.git/packed-refs &&
+	printf "\377" >>.git/packed-refs &&
+	test_must_fail git refs verify 2>err &&
+	test_grep "checksum mismatch" err &&
+
+	# Truncate the file into the offset table.
+	test_copy_bytes $(($size - 100)) <packed-refs.good >.git/packed-refs &&
+	test_must_fail git rev-parse refs/heads/branch-1 2>err &&
+	test_grep "packed-refs" err
+'
+
+test_expect_success 'disabling the extension converts packed-refs back' '
+	git config --unset extensions.packedRefsVersion &&
+	git for-each-ref >expect &&
+	git pack-refs &&
+	test_grep "^# pack-refs with:" .git/packed-refs &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_done
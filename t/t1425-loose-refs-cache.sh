@@ -0,0 +1,89 @@
+#!/bin/sh
+
+test_description='loose refs cache'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+GIT_TEST_DEFAULT_REF_FORMAT=files
+export GIT_TEST_DEFAULT_REF_FORMAT
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git config core.looseRefsCache true &&
+	test_commit A &&
+	test_commit B &&
+	A=$(git rev-parse A) &&
+	B=$(git rev-parse B) &&
+	for i in $(test_seq 100)
+	do
+		echo "create refs/heads/dir-$(($i % 3))/branch-$i $A" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	git symbolic-ref refs/heads/sym refs/heads/dir-1/branch-1 &&
+
+	# Refs that have been changed too recently are not cached, as
+	# their timestamps may not change with another modification.
+	sleep 2
+'
+
+test_expect_success 'iterating records loose refs' '
+	git for-each-ref >expect &&
+	test_path_is_file .git/loose-refs-cache &&
+	test_grep "^d .* refs/heads/dir-1/\$" .git/loose-refs-cache &&
+	test_grep "^r $A .* branch-1\$" .git/loose-refs-cache &&
+	test_grep "^f sym\$" .git/loose-refs-cache &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'recorded values are used while files are unchanged' '
+	cp .git/loose-refs-cache cache.orig &&
+	test_when_finished "cp cache.orig .git/loose-refs-cache" &&
+	sed "s/^r $A\(.* branch-1\)\$/r $B\1/" cache.orig >.git/loose-refs-cache &&
+	git for-each-ref --format="%(objectname)" refs/heads/dir-1/branch-1 >actual &&
+	echo $B >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'modified ref files are read again' '
+	test_when_finished "git update-ref refs/heads/dir-1/branch-1 $A" &&
+	echo $B >.git/refs/heads/dir-1/branch-1 &&
+	test-tool chmtime =-30 .git/refs/heads/dir-1/branch-1 &&
+	git for-each-ref --format="%(objectname)" refs/heads/dir-1/branch-1 >actual &&
+	echo $B >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'added and deleted refs are noticed' '
+	git for-each-ref >/dev/null &&
+	git update-ref refs/heads/dir-2/new $B &&
+	git update-ref -d refs/heads/dir-2/branch-2 &&
+	git for-each-ref --format="%(refname)" refs/heads/dir-2/ >actual &&
+	test_grep "refs/heads/dir-2/new" actual &&
+	test_grep ! "refs/heads/dir-2/branch-2\$" actual
+'
+
+test_expect_success 'symbolic refs are resolved every time' '
+	git for-each-ref >/dev/null &&
+	echo $B >.git/refs/heads/dir-1/branch-1 &&
+	git for-each-ref --format="%(objectname)" refs/heads/sym >actual &&
+	echo $B >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'corrupt cache is ignored and rewritten' '
+	git for-each-ref >expect &&
+	echo garbage >.git/loose-refs-cache &&
+	git for-each-ref >actual &&
+	test_cmp expect actual &&
+	test_grep "^# loose-refs snapshot" .git/loose-refs-cache
+'
+
+test_expect_success 'cache is not written without the config' '
+	rm .git/loose-refs-cache &&
+	git -c core.looseRefsCache=false for-each-ref >/dev/null &&
+	test_path_is_missing .git/loose-refs-cache
+'
+
+test_done
@@ -852,6 +852,32 @@ test_expect_success 'fsck errors in packed objects' '
 	! grep corrupt out
 '
 
+test_expect_success 'fsck --threads reports packed objects in pack order' '
+	git cat-file commit HEAD >basis &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		sed "s/</bad$i/" basis >bad$i &&
+		git hash-object --literally -t commit -w bad$i >>bad-oids ||
+		return 1
+	done &&
+	pack=$(git pack-objects .git/objects/pack/pack <bad-oids) &&
+	test_when_finished "rm -f .git/objects/pack/pack-$pack.* bad-oids" &&
+	while read oid
+	do
+		remove_object $oid || return 1
+	done <bad-oids &&
+	test_must_fail git fsck 2>expect &&
+	test_must_fail git fsck --threads=4 2>actual &&
+	test_cmp expect actual &&
+	test_must_fail git fsck --threads=0 2>actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'fsck --threads rejects negative values' '
+	test_must_fail git fsck --threads=-1 2>err &&
+	test_grep "invalid number of threads" err
+'
+
 test_expect_success 'fsck fails on corrupt packfile' '
 	hsh=$(git commit-tree -m mycommit HEAD^{tree}) &&
 	pack=$(echo $hsh | git pack-objects .git/objects/pack/pack) &&
@@ -59,6 +59,18 @@ test_expect_success 'git add: core.fsyncmethod=batch' "
 	test_cmp added_files_oids added_files_actual
 "
 
+test_expect_success 'git add: core.looseObjectWriteThreads' "
+	test_create_unique_files 2 4 files_base_dir3 &&
+	cp files_base_dir3/dir1/* files_base_dir3/dir2/ &&
+	git -c core.looseObjectWriteThreads=4 add -- ./files_base_dir3/ &&
+	git ls-files --stage files_base_dir3/ |
+	test_parse_ls_files_stage_oids >added_files3_oids &&
+	git -c core.looseObjectWriteThreads=1 hash-object files_base_dir3/*/* >expect3 &&
+	test_cmp expect3 added_files3_oids &&
+	git cat-file --batch-check='%(objectname)' <added_files3_oids >added_files3_actual &&
+	test_cmp added_files3_oids added_files3_actual
+"
+
 test_expect_success 'git update-index: core.fsyncmethod=batch' "
 	test_create_unique_files 2 4 files_base_dir2 &&
 	find files_base_dir2 ! -type d -print | xargs git $BATCH_CONFIGURATION update-index --add -- &&
@@ -201,6 +201,17 @@ test_expect_success 'unpack with REF_DELTA (core.fsyncmethod=batch)' '
        check_unpack test-2-${packname_2} obj-list "$BATCH_CONFIGURATION"
 '
 
+THREADS_CONFIGURATION='-c core.looseObjectWriteThreads=4'
+
+test_expect_success 'unpack with REF_DELTA (core.looseObjectWriteThreads)' '
+	check_unpack test-2-${packname_2} obj-list "$THREADS_CONFIGURATION"
+'
+
+test_expect_success 'unpack with REF_DELTA (core.looseObjectWriteThreads, core.fsyncmethod=batch)' '
+	check_unpack test-2-${packname_2} obj-list \
+		"$THREADS_CONFIGURATION $BATCH_CONFIGURATION"
+'
+
 test_expect_success 'pack with OFS_DELTA' '
 	packname_3=$(git pack-objects --progress --delta-base-offset test-3 \
 			<obj-list 2>stderr) &&
@@ -293,6 +293,41 @@ test_expect_success 'too-large packs report the breach' '
 	grep "maximum allowed size (20 bytes)" err
 '
 
+test_expect_success 'index-pack with threads gives the same results' '
+	test_when_finished "rm -rf thin-src thin-dst" &&
+	git init thin-src &&
+	(
+		cd thin-src &&
+		for i in $(test_seq 1 20)
+		do
+			test_seq $i 200 >file$((i % 5)) &&
+			git add . &&
+			git commit -q -m "commit $i" || return 1
+		done
+	) &&
+	git clone --bare --no-local thin-src thin-dst &&
+	git -C thin-src commit --allow-empty -q -m empty &&
+	for i in 1 2 3 4 5
+	do
+		test_seq 1000 >thin-src/file$i || return 1
+	done &&
+	git -C thin-src commit -q -a -m new &&
+	printf "HEAD\n^HEAD~2\n" |
+	git -C thin-src pack-objects --thin --revs --stdout >thin.pack &&
+
+	git -C thin-dst -c pack.threads=1 index-pack --fix-thin --stdin \
+		<thin.pack >expect &&
+	rm thin-dst/objects/pack/pack-$(cut -f2 expect).* &&
+	git -C thin-dst -c pack.threads=4 index-pack --fix-thin --stdin \
+		<thin.pack >actual &&
+	test_cmp expect actual &&
+	rm thin-dst/objects/pack/pack-$(cut -f2 expect).* &&
+	GIT_FORCE_THREADS=1 git -C thin-dst -c pack.threads=1 \
+		index-pack --fix-thin --stdin <thin.pack >actual &&
+	test_cmp expect actual &&
+	git -C thin-dst fsck
+'
+
 # git-index-pack(1) uses the default hash algorithm outside of the repository,
 # and it has no way to tell it otherwise. So we can only run this test with the
 # default hash algorithm, as it would otherwise fail to parse the tree.
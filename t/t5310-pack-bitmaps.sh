@@ -58,17 +58,21 @@ test_expect_success 'name-hash value stability' '
 
 test_bitmap_cases () {
 	writeLookupTable=false
+	writeRoaring=false
+	bitmapEncoding=ewah
 	for i in "$@"
 	do
 		case "$i" in
 		"pack.writeBitmapLookupTable") writeLookupTable=true;;
+		"pack.writeBitmapRoaring") writeRoaring=true bitmapEncoding=roaring;;
 		esac
 	done
 
 	test_expect_success 'setup test repository' '
 		rm -fr * .git &&
 		git init &&
-		git config pack.writeBitmapLookupTable '"$writeLookupTable"'
+		git config pack.writeBitmapLookupTable '"$writeLookupTable"' &&
+		git config pack.writeBitmapRoaring '"$writeRoaring"'
 	'
 	setup_bitmap_history
 
@@ -287,7 +291,7 @@ test_bitmap_cases () {
 		test_must_be_empty actual
 	'
 
-	test_expect_success 'truncated bitmap fails gracefully (ewah)' '
+	test_expect_success 'truncated bitmap fails gracefully ('"$bitmapEncoding"')' '
 		test_config pack.writebitmaphashcache false &&
 		test_config pack.writebitmaplookuptable false &&
 		git repack -ad &&
@@ -298,7 +302,7 @@ test_bitmap_cases () {
 		mv -f $bitmap.tmp $bitmap &&
 		git rev-list --use-bitmap-index --count --all >actual 2>stderr &&
 		test_cmp expect actual &&
-		test_grep corrupt.ewah.bitmap stderr
+		test_grep corrupt.'"$bitmapEncoding"'.bitmap stderr
 	'
 
 	test_expect_success 'truncated bitmap fails gracefully (cache)' '
@@ -607,4 +611,42 @@ test_expect_success 'truncated bitmap fails gracefully (lookup table)' '
 	test_grep corrupted.bitmap.index stderr
 '
 
+test_bitmap_cases "pack.writeBitmapLookupTable" "pack.writeBitmapRoaring"
+
+test_expect_success 'roaring bitmaps are written as version 2' '
+	git repack -adb &&
+	bitmap=$(ls .git/objects/pack/*.bitmap) &&
+	echo " 00 02" >expect &&
+	od -An -tx1 -j4 -N2 $bitmap >actual &&
+	test_cmp expect actual &&
+
+	git rev-list --use-bitmap-index --objects --all >expect.roaring &&
+	git -c pack.writeBitmapRoaring=false repack -adb &&
+	bitmap=$(ls .git/objects/pack/*.bitmap) &&
+	echo " 00 01" >expect &&
+	od -An -tx1 -j4 -N2 $bitmap >actual &&
+	test_cmp expect actual &&
+	git rev-list --use-bitmap-index --objects --all >expect.ewah &&
+	test_cmp expect.ewah expect.roaring
+'
+
+test_expect_success 'bitmaps built with multiple threads are identical' '
+	rm -f .git/objects/pack/*.bitmap &&
+	git -c pack.writeBitmapThreads=1 repack -adb &&
+	cp .git/objects/pack/*.bitmap expect.bitmap &&
+
+	for old_bitmap in without with
+	do
+		if test $old_bitmap = without
+		then
+			rm -f .git/objects/pack/*.bitmap
+		fi &&
+		GIT_TRACE2_EVENT="$(pwd)/trace2" \
+			git -c pack.writeBitmapThreads=4 repack -adb &&
+		grep "\"key\":\"building_bitmaps_threads\",\"value\":\"4\"" trace2 &&
+		test_cmp_bin expect.bitmap .git/objects/pack/*.bitmap &&
+		rm trace2 || return 1
+	done
+'
+
 test_done
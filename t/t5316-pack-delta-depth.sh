@@ -97,6 +97,117 @@ test_expect_success 'packing produces a long delta' '
 	test_cmp expect actual
 '
 
+test_expect_success 'long delta chain can be inflated in parallel' '
+	git init --bare chain.git &&
+	pack=$(git pack-objects --all --window=0 --no-path-walk \
+		</dev/null chain.git/objects/pack/pack) &&
+	echo 9 >expect &&
+	max_chain chain.git/objects/pack/pack-$pack.pack >actual &&
+	test_cmp expect actual &&
+	blob=$(git rev-parse HEAD:file) &&
+	git -C chain.git -c core.deltaChainThreads=4 \
+		cat-file blob $blob >actual &&
+	test_cmp file actual &&
+	git -C chain.git -c core.deltaChainThreads=0 \
+		cat-file blob $blob >actual &&
+	test_cmp file actual
+'
+
+test_expect_success 'delta base cache reports hits and misses' '
+	blob=$(git rev-parse HEAD~1:file) &&
+	test_when_finished "rm -f trace" &&
+	for policy in lru segmented
+	do
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C chain.git -c core.deltaBaseCachePolicy=$policy \
+			cat-file --batch <<-EOF >actual &&
+		$blob
+		$blob
+		EOF
+		git cat-file --batch <<-EOF >expect &&
+		$blob
+		$blob
+		EOF
+		test_cmp expect actual &&
+		grep "\"category\":\"delta-base-cache\",\"name\":\"hits\"" trace &&
+		grep "\"category\":\"delta-base-cache\",\"name\":\"misses\"" trace &&
+		rm trace || return 1
+	done
+'
+
+delta_base_cache_counter () {
+	sed -n "s/.*\"category\":\"delta-base-cache\",\"name\":\"$1\",\"count\":\([0-9]*\).*/\1/p" "$2"
+}
+
+test_expect_success 'setup small and large delta bases' '
+	git init --bare cache.git &&
+	for name in small1 small2 small3 small4 large1 large2
+	do
+		case $name in
+		small*) size=4096 ;;
+		large*) size=40960 ;;
+		esac &&
+		test-tool genrandom $name $size >$name &&
+		cat $name >$name.base &&
+		echo base >>$name.base &&
+		echo "$(git -C cache.git hash-object -w --stdin <$name.base) $name" &&
+		echo "$(git -C cache.git hash-object -w --stdin <$name) $name" || return 1
+	done >objects &&
+	git -C cache.git pack-objects objects/pack/pack <objects &&
+	git -C cache.git prune-packed &&
+
+	# The smaller blob of each pair is a delta against the larger one,
+	# so reading it puts the larger one into the delta base cache.
+	for name in small1 small2 small3 small4
+	do
+		git hash-object $name || return 1
+	done >small &&
+	for name in large1 large2
+	do
+		git hash-object $name || return 1
+	done >large &&
+	git -C cache.git cat-file --batch-check="%(deltabase)" \
+		<small >bases &&
+	git -C cache.git cat-file --batch-check="%(deltabase)" \
+		<large >>bases &&
+	! grep "^$ZERO_OID\$" bases
+'
+
+test_expect_success 'segmented delta base cache keeps hot small bases' '
+	test_when_finished "rm -f trace" &&
+	# Read the small blobs twice, then two large ones that do not fit
+	# into the cache together with them, then the small blobs again.
+	cat small small large small >order &&
+	for policy in lru segmented
+	do
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C cache.git -c core.deltaBaseCacheLimit=64k \
+			-c core.deltaBaseCachePolicy=$policy \
+			cat-file --batch <order >/dev/null &&
+		delta_base_cache_counter hits trace >$policy.hits &&
+		delta_base_cache_counter evictions trace >$policy.evictions &&
+		rm trace || return 1
+	done &&
+	# With "lru", the large bases push out all small ones, so only the
+	# second round of reads hits the cache. With "segmented", the small
+	# bases are protected after their first hit and also hit in the
+	# third round; only the first large base is evicted.
+	echo 4 >expect &&
+	test_cmp expect lru.hits &&
+	echo 8 >expect &&
+	test_cmp expect segmented.hits &&
+	echo 5 >expect &&
+	test_cmp expect lru.evictions &&
+	echo 1 >expect &&
+	test_cmp expect segmented.evictions
+'
+
+test_expect_success 'unknown delta base cache policy' '
+	test_must_fail git -C chain.git -c core.deltaBaseCachePolicy=bogus \
+		cat-file -p $(git rev-parse HEAD:file) 2>err &&
+	test_grep "unknown delta base cache policy" err
+'
+
 test_expect_success '--depth limits depth' '
 	# Avoid --path-walk to avoid breaking delta chains across path
 	# boundaries.
@@ -582,4 +582,32 @@ test_expect_success 'remove one packfile between MIDX bitmap writes' '
 	)
 '
 
+test_expect_success 'MIDX bitmaps built with multiple threads are identical' '
+	git init midx-bitmap-threads &&
+	(
+		cd midx-bitmap-threads &&
+
+		test_commit_bulk --ref=refs/heads/trunk 16 &&
+		for b in 1 2 3 4
+		do
+			git branch side-$b trunk~$b &&
+			test_commit_bulk --ref=refs/heads/side-$b --start=$b$b 8 ||
+			return 1
+		done &&
+		merge=$(git commit-tree -p trunk -p side-1 -m merge trunk^{tree}) &&
+		git update-ref refs/heads/trunk $merge &&
+		git repack -d &&
+
+		git -c pack.writeBitmapThreads=1 multi-pack-index write --bitmap &&
+		cp $midx-$(midx_checksum $objdir).bitmap expect.bitmap &&
+		rm -f $midx* &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace2" \
+			git -c pack.writeBitmapThreads=4 multi-pack-index write --bitmap &&
+		grep "\"key\":\"building_bitmaps_threads\",\"value\":\"4\"" trace2 &&
+		test_cmp_bin expect.bitmap $midx-$(midx_checksum $objdir).bitmap &&
+		git rev-list --test-bitmap trunk
+	)
+'
+
 test_done
@@ -131,4 +131,40 @@ test_expect_success 'relink existing MIDX layer' '
 
 '
 
+test_expect_success 'incremental layer in a partial clone skips promisor commits' '
+	git init promisor-server &&
+	git init promisor-client &&
+	test_when_finished "rm -fr promisor-server promisor-client" &&
+	(
+		cd promisor-client &&
+		test_commit_bulk 3 &&
+		git repack -ad &&
+		git multi-pack-index write --bitmap &&
+
+		git -C ../promisor-server fetch ../promisor-client HEAD:main &&
+		test_commit_bulk -C ../promisor-server --ref=refs/heads/main --start=4 3 &&
+
+		git remote add origin ../promisor-server &&
+		git config remote.origin.promisor true &&
+		ls $packdir/pack-*.pack >packs.before &&
+		git -c fetch.unpackLimit=1 fetch origin main &&
+		ls $packdir/pack-*.pack >packs.after &&
+		for p in $(comm -13 packs.before packs.after)
+		do
+			touch "${p%.pack}.promisor" || return 1
+		done &&
+		git merge --ff-only origin/main &&
+
+		test_commit local &&
+		git repack -d &&
+		git multi-pack-index write --bitmap --incremental &&
+		test_line_count = 2 $midx_chain &&
+
+		test-tool bitmap list-commits >commits &&
+		git rev-list origin/main~3..origin/main >promisor-commits &&
+		! grep -f promisor-commits commits &&
+		git rev-list --test-bitmap HEAD
+	)
+'
+
 test_done
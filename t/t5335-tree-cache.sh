@@ -0,0 +1,104 @@
+#!/bin/sh
+
+test_description='tree-cache of inflated trees near the root'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+. "$TEST_DIRECTORY"/lib-chunk.sh
+
+tree_cache=.git/objects/pack/tree-cache
+
+test_expect_success 'setup' '
+	mkdir -p a/b/c d &&
+	for i in 1 2 3
+	do
+		echo c$i >a/b/c/file &&
+		echo b$i >a/b/file &&
+		echo a$i >a/file &&
+		echo d$i >d/file &&
+		echo $i >file &&
+		git add . &&
+		git commit -m $i || return 1
+	done &&
+	git tag -m tag v1 HEAD~2 &&
+	git config gc.writeTreeCache true
+'
+
+test_expect_success 'gc writes tree-cache' '
+	GIT_TRACE2_EVENT="$(pwd)/trace" git gc &&
+	test_path_is_file $tree_cache &&
+	# root trees of HEAD and v1, plus "a", "d" and "a/b" of each
+	grep "\"key\":\"trees\",\"value\":\"8\"" trace
+'
+
+test_expect_success 'gc.treeCacheDepth limits depth' '
+	test_when_finished "rm -f trace" &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c gc.treeCacheDepth=0 gc &&
+	grep "\"key\":\"trees\",\"value\":\"2\"" trace &&
+	git gc
+'
+
+test_expect_success 'trees are read from the tree-cache' '
+	test_when_finished "rm -f pack-access" &&
+	tree=$(git rev-parse HEAD^{tree}) &&
+	GIT_TRACE_PACK_ACCESS="$(pwd)/pack-access" \
+		git -c core.treeCache=true cat-file -p $tree >actual &&
+	test_path_is_missing pack-access &&
+	GIT_TRACE_PACK_ACCESS="$(pwd)/pack-access" \
+		git -c core.treeCache=false cat-file -p $tree >expect &&
+	test_file_not_empty pack-access &&
+	test_cmp expect actual
+'
+
+test_expect_success 'trees below the maximum depth are read from packs' '
+	test_when_finished "rm -f pack-access" &&
+	tree=$(git rev-parse HEAD:a/b/c) &&
+	GIT_TRACE_PACK_ACCESS="$(pwd)/pack-access" \
+		git -c core.treeCache=true cat-file -p $tree >actual &&
+	test_file_not_empty pack-access
+'
+
+test_expect_success 'reading with tree-cache gives the same results' '
+	for cmd in "ls-tree -r HEAD" "diff-tree -r HEAD~2 HEAD" "log --raw"
+	do
+		git -c core.treeCache=false $cmd >expect &&
+		git -c core.treeCache=true $cmd >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_expect_success 'tree-cache is not reported as garbage' '
+	test_path_is_file $tree_cache &&
+	git count-objects -v >out &&
+	test_grep "^garbage: 0" out
+'
+
+test_expect_success 'tree-cache does not resurrect pruned trees' '
+	test_when_finished "git checkout main && git gc" &&
+	git checkout --orphan orphan &&
+	test_commit --no-tag orphaned &&
+	orphaned=$(git rev-parse HEAD^{tree}) &&
+	git gc &&
+	test_path_is_file $tree_cache &&
+	git checkout main &&
+	git branch -D orphan &&
+	git reflog expire --expire=now --all &&
+	git repack -ad &&
+	git prune --expire=now &&
+	test_must_fail git -c core.treeCache=true cat-file -e $orphaned &&
+	test_must_fail git -c core.treeCache=true ls-tree $orphaned &&
+	test_must_fail git -c core.treeCache=true cat-file -p $orphaned
+'
+
+test_expect_success 'fsck verifies tree-cache' '
+	git fsck &&
+	test_when_finished "git gc" &&
+	corrupt_chunk_file $tree_cache TDAT 0 "39" &&
+	test_must_fail git fsck 2>err &&
+	test_grep "tree-cache file .* has incorrect checksum" err &&
+	test_grep "tree-cache entry for .* has wrong contents" err
+'
+
+test_done
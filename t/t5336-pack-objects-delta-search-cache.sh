@@ -0,0 +1,85 @@
+#!/bin/sh
+
+test_description='pack-objects delta search cache'
+
+. ./test-lib.sh
+
+cache=.git/objects/pack/delta-search-cache
+
+# Print the object and its delta base for each deltified object in
+# the repository.
+delta_pairs () {
+	git verify-pack -v .git/objects/pack/pack-*.idx >verify &&
+	awk "NF == 7 { print \$1, \$7 }" verify | sort
+}
+
+test_expect_success 'setup' '
+	for i in 1 2 3 4 5 6 7 8
+	do
+		test_seq 1 $((i * 100)) >numbers &&
+		test_seq 1 $((i * 50)) | sed "s/$/ bottles/" >bottles &&
+		git add numbers bottles &&
+		git commit -m $i || return 1
+	done &&
+	# Keep the delta search in one window, so that each
+	# object finds its base from the last run.
+	git config pack.threads 1 &&
+	git repack -adf &&
+	delta_pairs >expect &&
+	test_file_not_empty expect
+'
+
+test_expect_success 'no delta search cache is written by default' '
+	git repack -adf &&
+	test_path_is_missing $cache
+'
+
+test_expect_success 'repack writes the delta search cache' '
+	git -c pack.deltaSearchCache=true repack -adf &&
+	test_path_is_file $cache &&
+	delta_pairs >actual &&
+	test_cmp expect actual &&
+	git count-objects -v 2>err &&
+	test_must_be_empty err
+'
+
+test_expect_success 'repack uses the delta search cache' '
+	test_when_finished "rm -f trace" &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c pack.deltaSearchCache=true repack -adf &&
+	test_trace2_data pack-objects delta-search-cache/hits \
+		$(wc -l <expect) <trace &&
+	delta_pairs >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'delta search cache keeps objects not in the pack' '
+	test_when_finished "rm -f trace" &&
+	echo unrelated >unrelated &&
+	git add unrelated &&
+	git commit -m unrelated &&
+	git -c pack.deltaSearchCache=true repack -d &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c pack.deltaSearchCache=true repack -adf &&
+	test_trace2_data pack-objects delta-search-cache/hits \
+		$(wc -l <expect) <trace
+'
+
+test_expect_success 'packing to stdout does not write the cache' '
+	rm -f $cache &&
+	git pack-objects --all --delta-search-cache --stdout \
+		</dev/null >/dev/null &&
+	test_path_is_missing $cache
+'
+
+test_expect_success 'corrupt delta search cache is ignored' '
+	git -c pack.deltaSearchCache=true repack -adf &&
+	rm -f $cache &&
+	echo garbage >$cache &&
+	git -c pack.deltaSearchCache=true repack -adf 2>err &&
+	test_grep "delta search cache file is too small" err &&
+	git -c pack.deltaSearchCache=true repack -adf 2>err &&
+	test_must_be_empty err
+'
+
+test_done
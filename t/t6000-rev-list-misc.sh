@@ -248,4 +248,42 @@ test_expect_success 'rev-list -z --boundary' '
 	test_cmp expect actual
 '
 
+test_expect_success 'rev-list --objects: core.objectWalkThreads' '
+	test_when_finished rm -rf repo &&
+
+	git init repo &&
+	for i in 1 2 3 4 5 6
+	do
+		mkdir -p repo/a$i/b/c repo/d &&
+		echo $i >repo/a$i/b/c/file &&
+		echo $i >repo/d/file$i &&
+		git -C repo add . &&
+		git -C repo commit -m "commit $i" || return 1
+	done &&
+	git -C repo tag -m tag tagged HEAD~2 &&
+
+	git -C repo rev-list --objects --all >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C repo -c core.objectWalkThreads=4 \
+		rev-list --objects --all >actual &&
+	test_cmp expect actual &&
+	grep "\"category\":\"tree-prefetch\",\"key\":\"read\"" trace &&
+
+	git -C repo rev-list --objects --filter=blob:none --all >expect &&
+	git -C repo -c core.objectWalkThreads=4 \
+		rev-list --objects --filter=blob:none --all >actual &&
+	test_cmp expect actual &&
+
+	git -C repo rev-list --objects HEAD~3..HEAD >expect &&
+	git -C repo -c core.objectWalkThreads=4 \
+		rev-list --objects HEAD~3..HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rev-list --objects: invalid core.objectWalkThreads' '
+	test_must_fail git -c core.objectWalkThreads=-1 \
+		rev-list --objects HEAD 2>err &&
+	test_grep "invalid number of threads" err
+'
+
 test_done
@@ -819,4 +819,29 @@ test_expect_success 'start after with packed refs and some loose refs' '
 	)
 '
 
+test_expect_success 'sorting reads objects ahead with multiple threads' '
+	test_when_finished "rm -rf prefetch" &&
+	git init prefetch &&
+	(
+		cd prefetch &&
+		test_commit base &&
+		for i in $(test_seq 40)
+		do
+			test_tick &&
+			git tag -a -m "tag $i" annotated-$i base &&
+			git tag lightweight-$i base || return 1
+		done &&
+		git tag -a -m "nested" nested annotated-1 &&
+		git tag -a -m "blob" blob-tag $(echo blob | git hash-object -w --stdin) &&
+		git pack-refs --include "refs/tags/annotated-1*" &&
+
+		format="%(refname) %(objecttype) %(*objectname) %(*objecttype) %(*subject) %(contents:subject)" &&
+		GIT_TEST_REF_FILTER_THREADS=1 git for-each-ref --sort=-taggerdate \
+			--sort=objectsize --format="$format" >expect &&
+		GIT_TEST_REF_FILTER_THREADS=4 git for-each-ref --sort=-taggerdate \
+			--sort=objectsize --format="$format" >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_done
@@ -445,4 +445,48 @@ test_expect_success '--geometric -l disables writing bitmaps with non-local pack
 	test_path_is_file member/.git/objects/pack/multi-pack-index-*.bitmap
 '
 
+test_expect_success '--geometric with repack.midxIncremental' '
+	git init midx-incremental &&
+	test_when_finished "rm -fr midx-incremental" &&
+	(
+		cd midx-incremental &&
+		git config repack.midxIncremental true &&
+
+		chain=.git/objects/pack/multi-pack-index.d/multi-pack-index-chain &&
+
+		test_commit_bulk --start=1 10 &&
+		git repack --geometric=2 -d --write-midx --write-bitmap-index &&
+		test_line_count = 1 $chain &&
+		test_path_is_missing .git/objects/pack/multi-pack-index &&
+		cp $chain chain.before &&
+		ls .git/objects/pack/pack-*.pack >packs.before &&
+
+		test_commit_bulk --start=11 10 &&
+		git repack --geometric=2 -d --write-midx --write-bitmap-index &&
+		test_line_count = 2 $chain &&
+
+		# The first layer is left alone, and so are the packs
+		# in it.
+		head -n 1 $chain >actual &&
+		test_cmp chain.before actual &&
+		for p in $(cat packs.before)
+		do
+			test_path_is_file $p || return 1
+		done &&
+
+		git rev-list --test-bitmap HEAD &&
+		git rev-list --objects --no-object-names HEAD >expect.raw &&
+		git rev-list --objects --use-bitmap-index HEAD >actual.raw &&
+		sort expect.raw >expect &&
+		sort actual.raw >actual &&
+		test_cmp expect actual &&
+
+		# An all-into-one repack collapses the chain.
+		git repack -ad --write-midx --write-bitmap-index &&
+		test_path_is_file .git/objects/pack/multi-pack-index &&
+		test_path_is_missing $chain &&
+		git rev-list --test-bitmap HEAD
+	)
+'
+
 test_done
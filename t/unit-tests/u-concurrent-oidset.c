@@ -0,0 +1,115 @@
+#include "unit-test.h"
+#include "lib-oid.h"
+#include "concurrent-oidset.h"
+
+#define NR_OIDS 4096
+#define NR_THREADS 8
+
+static struct concurrent_oidset set;
+static struct object_id oids[NR_OIDS];
+
+static void make_oid(struct object_id *oid, unsigned int n)
+{
+	const struct git_hash_algo *algo = &hash_algos[GIT_HASH_SHA1];
+
+	memset(oid, 0, sizeof(*oid));
+	for (size_t i = 0; i < algo->rawsz; i++)
+		oid->hash[i] = (n >> (8 * (i % 4))) * (i + 1);
+	oid_set_algo(oid, algo);
+}
+
+void test_concurrent_oidset__initialize(void)
+{
+	concurrent_oidset_init(&set, NR_THREADS, 0);
+	for (unsigned int i = 0; i < NR_OIDS; i++)
+		make_oid(&oids[i], i);
+}
+
+void test_concurrent_oidset__cleanup(void)
+{
+	concurrent_oidset_clear(&set);
+}
+
+void test_concurrent_oidset__insert_and_contains(void)
+{
+	struct object_id oid;
+
+	cl_parse_any_oid("11", &oid);
+	cl_assert(!concurrent_oidset_contains(&set, &oid));
+	cl_assert_equal_i(concurrent_oidset_insert(&set, &oid), 0);
+	cl_assert(concurrent_oidset_contains(&set, &oid));
+	cl_assert_equal_i(concurrent_oidset_insert(&set, &oid), 1);
+	cl_assert_equal_i(concurrent_oidset_size(&set), 1);
+
+	for (size_t i = 0; i < NR_OIDS; i++)
+		concurrent_oidset_insert(&set, &oids[i]);
+	for (size_t i = 0; i < NR_OIDS; i++)
+		cl_assert(concurrent_oidset_contains(&set, &oids[i]));
+	cl_assert_equal_i(concurrent_oidset_size(&set), NR_OIDS + 1);
+}
+
+void test_concurrent_oidset__flags(void)
+{
+	struct object_id oid;
+
+	cl_parse_any_oid("22", &oid);
+	cl_assert_equal_i(concurrent_oidset_get_flags(&set, &oid), 0);
+	cl_assert_equal_i(concurrent_oidset_set_flags(&set, &oid, 1), 0);
+	cl_assert(concurrent_oidset_contains(&set, &oid));
+	cl_assert_equal_i(concurrent_oidset_set_flags(&set, &oid, 4), 1);
+	cl_assert_equal_i(concurrent_oidset_get_flags(&set, &oid), 5);
+
+	cl_parse_any_oid("33", &oid);
+	cl_assert_equal_i(concurrent_oidset_insert(&set, &oid), 0);
+	cl_assert_equal_i(concurrent_oidset_get_flags(&set, &oid), 0);
+	cl_assert_equal_i(concurrent_oidset_set_flags(&set, &oid, 2), 0);
+	cl_assert_equal_i(concurrent_oidset_insert(&set, &oid), 1);
+	cl_assert_equal_i(concurrent_oidset_get_flags(&set, &oid), 2);
+}
+
+struct insert_thread {
+	pthread_t thread;
+	int nr;
+	unsigned int first;
+};
+
+static void *insert_thread(void *data)
+{
+	struct insert_thread *t = data;
+
+	/* All threads insert all objects, each starting at a different one. */
+	for (size_t i = 0; i < NR_OIDS; i++) {
+		size_t pos = (i + t->nr * NR_OIDS / NR_THREADS) % NR_OIDS;
+
+		if (!(concurrent_oidset_set_flags(&set, &oids[pos], 1) & 1))
+			t->first++;
+	}
+
+	return NULL;
+}
+
+void test_concurrent_oidset__threaded_insert(void)
+{
+	struct insert_thread threads[NR_THREADS];
+	unsigned int first = 0;
+
+	if (!HAVE_THREADS)
+		cl_skip();
+
+	for (int i = 0; i < NR_THREADS; i++) {
+		threads[i].nr = i;
+		threads[i].first = 0;
+		cl_assert_equal_i(pthread_create(&threads[i].thread, NULL,
+						 insert_thread, &threads[i]), 0);
+	}
+	for (int i = 0; i < NR_THREADS; i++) {
+		pthread_join(threads[i].thread, NULL);
+		first += threads[i].first;
+	}
+
+	/* Every object was seen first by exactly one thread. */
+	cl_assert_equal_i(first, NR_OIDS);
+	cl_assert_equal_i(concurrent_oidset_size(&set), NR_OIDS);
+	for (size_t i = 0; i < NR_OIDS; i++)
+		cl_assert_equal_i(concurrent_oidset_get_flags(&set, &oids[i]), 1);
+}
@@ -0,0 +1,171 @@
+#include "unit-test.h"
+#include "ewah/ewok.h"
+
+/*
+ * Build a bitmap of `nr` words that mixes runs of empty and full words
+ * with literal words, so that its EWAH form has runs of each kind and
+ * the bulk word operations see lengths that do not fill a vector.
+ */
+static struct bitmap *sample_bitmap(size_t nr, uint32_t seed)
+{
+	struct bitmap *bitmap = bitmap_word_alloc(nr);
+
+	for (size_t i = 0; i < nr; i++) {
+		seed = seed * 1103515245 + 12345;
+		switch ((i / 5 + seed / 7) % 4) {
+		case 0:
+			bitmap->words[i] = 0;
+			break;
+		case 1:
+			bitmap->words[i] = ~(eword_t)0;
+			break;
+		default:
+			bitmap->words[i] = (eword_t)seed << 32 | (seed * 2654435761u);
+			break;
+		}
+	}
+
+	return bitmap;
+}
+
+static size_t reference_popcount(const eword_t *words, size_t nr)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < nr; i++)
+		for (eword_t w = words[i]; w; w &= w - 1)
+			count++;
+	return count;
+}
+
+void test_ewah__run_iterator(void)
+{
+	struct bitmap *bitmap = sample_bitmap(200, 1);
+	struct ewah_bitmap *ewah = bitmap_to_ewah(bitmap);
+	struct ewah_run_iterator it;
+	struct ewah_run run;
+	size_t next = 0;
+
+	ewah_run_iterator_init(&it, ewah);
+	while (ewah_run_iterator_next(&run, &it)) {
+		cl_assert_equal_i(run.start, next);
+		cl_assert(run.len > 0);
+		for (size_t i = 0; i < run.len; i++) {
+			eword_t word = run.literals ? run.literals[i] : run.fill;
+			cl_assert(word == bitmap->words[run.start + i]);
+		}
+		next = run.start + run.len;
+	}
+	cl_assert_equal_i(next, bitmap->word_alloc);
+
+	ewah_free(ewah);
+	bitmap_free(bitmap);
+}
+
+void test_ewah__conversion_and_popcount(void)
+{
+	for (size_t nr = 1; nr < 40; nr++) {
+		struct bitmap *bitmap = sample_bitmap(nr, nr);
+		struct ewah_bitmap *ewah = bitmap_to_ewah(bitmap);
+		struct bitmap *inflated = ewah_to_bitmap(ewah);
+		size_t expect = reference_popcount(bitmap->words, nr);
+
+		cl_assert(bitmap_equals(inflated, bitmap));
+		cl_assert_equal_i(bitmap_popcount(bitmap), expect);
+		cl_assert_equal_i(ewah_bitmap_popcount(ewah), expect);
+		cl_assert_equal_i(bitmap_is_empty(bitmap), !expect);
+
+		ewah_free(ewah);
+		bitmap_free(inflated);
+		bitmap_free(bitmap);
+	}
+}
+
+void test_ewah__or_and_not(void)
+{
+	for (size_t nr = 1; nr < 40; nr++) {
+		struct bitmap *a = sample_bitmap(nr, 3 * nr);
+		struct bitmap *b = sample_bitmap(nr + nr % 3, 5 * nr);
+		struct ewah_bitmap *ewah = bitmap_to_ewah(b);
+		struct bitmap *or = bitmap_dup(a), *or_ewah = bitmap_dup(a);
+		struct bitmap *and_not = bitmap_dup(a);
+
+		bitmap_or(or, b);
+		bitmap_or_ewah(or_ewah, ewah);
+		bitmap_and_not(and_not, b);
+
+		cl_assert(bitmap_equals(or, or_ewah));
+		for (size_t i = 0; i < or->word_alloc; i++) {
+			eword_t wa = i < a->word_alloc ? a->words[i] : 0;
+			eword_t wb = i < b->word_alloc ? b->words[i] : 0;
+
+			cl_assert(or->words[i] == (wa | wb));
+			if (i < and_not->word_alloc)
+				cl_assert(and_not->words[i] == (wa & ~wb));
+		}
+
+		ewah_free(ewah);
+		bitmap_free(or);
+		bitmap_free(or_ewah);
+		bitmap_free(and_not);
+		bitmap_free(a);
+		bitmap_free(b);
+	}
+}
+
+void test_ewah__and_popcount(void)
+{
+	for (size_t nr = 1; nr < 40; nr++) {
+		struct bitmap *a = sample_bitmap(nr + 7, 7 * nr);
+		struct bitmap *b = sample_bitmap(nr, 11 * nr);
+		struct ewah_bitmap *ewah = bitmap_to_ewah(a);
+		size_t expect = 0;
+
+		/* Only the words that `b` has allocated are considered. */
+		for (size_t i = 0; i < b->word_alloc; i++) {
+			eword_t word = a->words[i] & b->words[i];
+			expect += reference_popcount(&word, 1);
+		}
+		cl_assert_equal_i(ewah_bitmap_and_popcount(ewah, b), expect);
+
+		ewah_free(ewah);
+		bitmap_free(a);
+		bitmap_free(b);
+	}
+}
+
+void test_ewah__is_subset(void)
+{
+	for (size_t nr = 1; nr < 40; nr++) {
+		struct bitmap *super = sample_bitmap(nr, 13 * nr);
+		struct bitmap *sub = bitmap_dup(super);
+		struct ewah_bitmap *ewah;
+
+		for (size_t i = 0; i < nr; i += 3)
+			sub->words[i] &= sub->words[i] >> 1;
+		ewah = bitmap_to_ewah(sub);
+
+		/* bitmap_is_subset() returns non-zero when it is not one. */
+		cl_assert(!bitmap_is_subset(sub, super));
+		cl_assert(ewah_bitmap_is_subset(ewah, super));
+		ewah_free(ewah);
+
+		/* A bit that `super` lacks, within and beyond its words. */
+		bitmap_set(sub, (nr - 1) * BITS_IN_EWORD);
+		super->words[nr - 1] &= ~(eword_t)1;
+		ewah = bitmap_to_ewah(sub);
+		cl_assert(bitmap_is_subset(sub, super));
+		cl_assert(!ewah_bitmap_is_subset(ewah, super));
+		ewah_free(ewah);
+
+		bitmap_unset(sub, (nr - 1) * BITS_IN_EWORD);
+		bitmap_set(sub, (nr + 2) * BITS_IN_EWORD + 5);
+		ewah = bitmap_to_ewah(sub);
+		cl_assert(bitmap_is_subset(sub, super));
+		cl_assert(!ewah_bitmap_is_subset(ewah, super));
+		ewah_free(ewah);
+
+		bitmap_free(sub);
+		bitmap_free(super);
+	}
+}
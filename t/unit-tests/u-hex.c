@@ -0,0 +1,109 @@
+#include "unit-test.h"
+#include "hex.h"
+
+#define MAX_LEN 100
+
+static void fill_bytes(unsigned char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = (i * 167 + 13) & 0xff;
+}
+
+static void scalar_to_hex(char *hex, const unsigned char *binary, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		xsnprintf(hex + 2 * i, 3, "%02x", binary[i]);
+}
+
+void test_hex__bytes_to_hex(void)
+{
+	unsigned char binary[MAX_LEN];
+	char expect[2 * MAX_LEN + 1], actual[2 * MAX_LEN + 1];
+
+	fill_bytes(binary, MAX_LEN);
+	for (size_t len = 0; len <= MAX_LEN; len++) {
+		memset(actual, 'x', sizeof(actual));
+		scalar_to_hex(expect, binary, len);
+		bytes_to_hex(actual, binary, len);
+		cl_assert_equal_strn(actual, expect, 2 * len);
+		cl_assert_equal_i(actual[2 * len], 'x');
+	}
+}
+
+void test_hex__hex_to_bytes_full(void)
+{
+	unsigned char binary[MAX_LEN], actual[MAX_LEN];
+	char hex[2 * MAX_LEN + 1];
+
+	fill_bytes(binary, MAX_LEN);
+	scalar_to_hex(hex, binary, MAX_LEN);
+	for (size_t len = 0; len <= MAX_LEN; len++) {
+		memset(actual, 0, sizeof(actual));
+		cl_assert_equal_i(hex_to_bytes_full(actual, hex, len), 0);
+		cl_assert(!memcmp(actual, binary, len));
+	}
+}
+
+void test_hex__hex_to_bytes_full_uppercase(void)
+{
+	const char *hex = "0123456789ABCDEFabcdef0123456789aBcDeF0123456789ABCDEFabcdef0123";
+	unsigned char expect[32], actual[32];
+
+	cl_assert_equal_i(hex_to_bytes(expect, hex, 32), 0);
+	cl_assert_equal_i(hex_to_bytes_full(actual, hex, 32), 0);
+	cl_assert(!memcmp(actual, expect, 32));
+}
+
+void test_hex__hex_to_bytes_full_rejects_invalid(void)
+{
+	static const char invalid[] = { '/', ':', '@', 'G', '`', 'g', ' ', '\0', (char)0x80, (char)0xc1, (char)0xff };
+	unsigned char binary[MAX_LEN], actual[MAX_LEN];
+	char hex[2 * MAX_LEN + 1];
+
+	fill_bytes(binary, MAX_LEN);
+	scalar_to_hex(hex, binary, MAX_LEN);
+	for (size_t pos = 0; pos < 2 * MAX_LEN; pos++) {
+		char saved = hex[pos];
+
+		for (size_t i = 0; i < ARRAY_SIZE(invalid); i++) {
+			hex[pos] = invalid[i];
+			cl_assert_equal_i(hex_to_bytes_full(actual, hex, MAX_LEN), -1);
+		}
+		hex[pos] = saved;
+	}
+}
+
+void test_hex__oids_batch(void)
+{
+	for (size_t a = 1; a < GIT_HASH_NALGOS; a++) {
+		const struct git_hash_algo *algop = &hash_algos[a];
+		struct object_id oids[5], parsed[5];
+		size_t stride = algop->hexsz + 1;
+		char hex[5 * (GIT_MAX_HEXSZ + 1)];
+
+		for (size_t i = 0; i < ARRAY_SIZE(oids); i++) {
+			memset(&oids[i], 0, sizeof(oids[i]));
+			fill_bytes(oids[i].hash, algop->rawsz);
+			oids[i].hash[0] = i;
+			oid_set_algo(&oids[i], algop);
+		}
+
+		memset(hex, '\n', sizeof(hex));
+		oids_to_hex(hex, stride, oids, ARRAY_SIZE(oids));
+		for (size_t i = 0; i < ARRAY_SIZE(oids); i++) {
+			cl_assert_equal_strn(hex + i * stride, oid_to_hex(&oids[i]),
+					     algop->hexsz);
+			cl_assert_equal_i(hex[i * stride + algop->hexsz], '\n');
+		}
+
+		cl_assert_equal_i(get_oids_hex_algop(hex, stride, parsed,
+						     ARRAY_SIZE(parsed), algop),
+				  ARRAY_SIZE(parsed));
+		for (size_t i = 0; i < ARRAY_SIZE(oids); i++)
+			cl_assert(oideq(&parsed[i], &oids[i]));
+
+		hex[3 * stride + 5] = 'z';
+		cl_assert_equal_i(get_oids_hex_algop(hex, stride, parsed,
+						     ARRAY_SIZE(parsed), algop), 3);
+	}
+}
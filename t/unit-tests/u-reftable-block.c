@@ -456,3 +456,86 @@ void test_reftable_block__iterator(void)
 	block_writer_release(&writer);
 	reftable_buf_release(&data);
 }
+
+void test_reftable_block__seek_prefix_compressed(void)
+{
+	const char *names[] = {
+		"refs/heads/a", "refs/heads/a/b", "refs/heads/a/c",
+		"refs/heads/aa", "refs/heads/ab", "refs/heads/b",
+		"refs/heads/ba", "refs/heads/main", "refs/heads/maint",
+		"refs/heads/mainte", "refs/heads/next", "refs/heads/next-1",
+		"refs/heads/next-10", "refs/heads/next-2", "refs/heads/seen",
+		"refs/tags/v1.0", "refs/tags/v1.0.1", "refs/tags/v2.0",
+	};
+	const char *wants[] = {
+		"", "refs", "refs/heads/", "refs/heads/a/", "refs/heads/a/bb",
+		"refs/heads/ab0", "refs/heads/c", "refs/heads/mai",
+		"refs/heads/maintenance", "refs/heads/next-0", "refs/heads/next-11",
+		"refs/tags/", "refs/tags/v1.0.0", "refs/tags/v3", "refs/z",
+	};
+	struct reftable_block_source source = { 0 };
+	struct block_writer writer = {
+		.last_key = REFTABLE_BUF_INIT,
+	};
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_iterator it = { 0 };
+	struct reftable_block block = { 0 };
+	struct reftable_buf data;
+
+	data.len = 1024;
+	REFTABLE_CALLOC_ARRAY(data.buf, data.len);
+	cl_assert(data.buf != NULL);
+
+	cl_assert_equal_i(block_writer_init(&writer, REFTABLE_BLOCK_TYPE_REF,
+					    (uint8_t *) data.buf, data.len,
+					    0, hash_size(REFTABLE_HASH_SHA1)), 0);
+	writer.restart_interval = 4;
+
+	for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+		struct reftable_record rec = {
+			.type = REFTABLE_BLOCK_TYPE_REF,
+			.u.ref = {
+				.value_type = REFTABLE_REF_SYMREF,
+				.refname = (char *) names[i],
+				.value.symref = (char *) "refs/heads/main",
+			},
+		};
+		cl_assert_equal_i(block_writer_add(&writer, &rec), 0);
+	}
+	cl_assert(block_writer_finish(&writer) > 0);
+
+	block_source_from_buf(&source, &data);
+	cl_assert_equal_i(reftable_block_init(&block, &source, 0, 0, data.len,
+					      REFTABLE_HASH_SIZE_SHA1,
+					      REFTABLE_BLOCK_TYPE_REF), 0);
+	cl_assert_equal_i(reftable_block_init_iterator(&block, &it), 0);
+
+	/*
+	 * Seeking to any key must yield the first record that is greater or
+	 * equal to it, including the ones in the block.
+	 */
+	for (size_t i = 0; i < ARRAY_SIZE(names) + ARRAY_SIZE(wants); i++) {
+		const char *want = i < ARRAY_SIZE(names) ?
+			names[i] : wants[i - ARRAY_SIZE(names)];
+		size_t expect = 0;
+		int err;
+
+		while (expect < ARRAY_SIZE(names) && strcmp(names[expect], want) < 0)
+			expect++;
+
+		cl_assert_equal_i(reftable_iterator_seek_ref(&it, want), 0);
+		for (; expect < ARRAY_SIZE(names); expect++) {
+			cl_assert_equal_i(reftable_iterator_next_ref(&it, &ref), 0);
+			cl_assert_equal_s(ref.refname, names[expect]);
+			cl_assert_equal_s(ref.value.symref, "refs/heads/main");
+		}
+		err = reftable_iterator_next_ref(&it, &ref);
+		cl_assert_equal_i(err, 1);
+	}
+
+	reftable_ref_record_release(&ref);
+	reftable_iterator_destroy(&it);
+	reftable_block_release(&block);
+	block_writer_release(&writer);
+	reftable_buf_release(&data);
+}
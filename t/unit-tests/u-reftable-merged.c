@@ -522,3 +522,151 @@ void test_reftable_merged__default_write_opts(void)
 	reftable_merged_table_free(merged);
 	reftable_buf_release(&buf);
 }
+
+static void check_parallel_iterator(struct reftable_merged_table *mt,
+				    const char *seek, unsigned nthreads)
+{
+	struct reftable_iterator serial = { 0 }, parallel = { 0 };
+	struct reftable_ref_record want = { 0 }, got = { 0 };
+	size_t n = 0;
+	int err;
+
+	cl_assert(!merged_table_init_iter(mt, &serial, REFTABLE_BLOCK_TYPE_REF));
+	cl_assert(!reftable_merged_table_init_parallel_ref_iterator(mt, &parallel,
+								     nthreads));
+	cl_assert(!reftable_iterator_seek_ref(&serial, seek));
+	cl_assert(!reftable_iterator_seek_ref(&parallel, seek));
+
+	while (1) {
+		err = reftable_iterator_next_ref(&serial, &want);
+		cl_assert(err >= 0);
+		cl_assert_equal_i(reftable_iterator_next_ref(&parallel, &got), err);
+		if (err)
+			break;
+		cl_assert(reftable_ref_record_equal(&want, &got,
+						    REFTABLE_HASH_SIZE_SHA1));
+		n++;
+	}
+
+	/* Iterating again after seeking yields the same records. */
+	cl_assert(!reftable_iterator_seek_ref(&parallel, seek));
+	while (!reftable_iterator_next_ref(&parallel, &got))
+		n--;
+	cl_assert_equal_i(n, 0);
+
+	reftable_ref_record_release(&want);
+	reftable_ref_record_release(&got);
+	reftable_iterator_destroy(&serial);
+	reftable_iterator_destroy(&parallel);
+}
+
+void test_reftable_merged__parallel_ref_iterator(void)
+{
+	struct reftable_ref_record r1[1000], r2[150], r3[100];
+	char names1[ARRAY_SIZE(r1)][32], names2[ARRAY_SIZE(r2)][32],
+	     names3[ARRAY_SIZE(r3)][32];
+	struct reftable_ref_record *refs[] = { r1, r2, r3 };
+	size_t sizes[] = { ARRAY_SIZE(r1), ARRAY_SIZE(r2), ARRAY_SIZE(r3) };
+	struct reftable_buf bufs[3] = { REFTABLE_BUF_INIT, REFTABLE_BUF_INIT, REFTABLE_BUF_INIT };
+	struct reftable_block_source *bs = NULL;
+	struct reftable_table **tables = NULL;
+	struct reftable_merged_table *mt;
+	const char *seeks[] = { "", "refs/heads/branch-0500", "refs/heads/branch-0500-new", "zzz" };
+	unsigned threads[] = { 1, 2, 4, 16 };
+
+	/* A large base table. */
+	for (size_t i = 0; i < ARRAY_SIZE(r1); i++) {
+		snprintf(names1[i], sizeof(names1[i]), "refs/heads/branch-%04d", (int)i);
+		r1[i] = (struct reftable_ref_record) {
+			.refname = names1[i],
+			.update_index = 1,
+			.value_type = REFTABLE_REF_VAL1,
+		};
+		cl_reftable_set_hash(r1[i].value.val1, i, REFTABLE_HASH_SHA1);
+	}
+
+	/* Updates and deletions of some of the refs in the base table. */
+	for (size_t i = 0; i < ARRAY_SIZE(r2); i++) {
+		snprintf(names2[i], sizeof(names2[i]), "refs/heads/branch-%04d", (int)(i * 6));
+		r2[i] = (struct reftable_ref_record) {
+			.refname = names2[i],
+			.update_index = 2,
+			.value_type = i % 2 ? REFTABLE_REF_DELETION : REFTABLE_REF_VAL1,
+		};
+		if (!(i % 2))
+			cl_reftable_set_hash(r2[i].value.val1, i + 5000, REFTABLE_HASH_SHA1);
+	}
+
+	/* New refs that sort in between the existing ones. */
+	for (size_t i = 0; i < ARRAY_SIZE(r3); i++) {
+		snprintf(names3[i], sizeof(names3[i]), "refs/heads/branch-%04d-new", (int)(i * 10));
+		r3[i] = (struct reftable_ref_record) {
+			.refname = names3[i],
+			.update_index = 3,
+			.value_type = REFTABLE_REF_VAL1,
+		};
+		cl_reftable_set_hash(r3[i].value.val1, i + 9000, REFTABLE_HASH_SHA1);
+	}
+
+	mt = merged_table_from_records(refs, &bs, &tables, sizes, bufs, 3);
+
+	for (int suppress = 0; suppress < 2; suppress++) {
+		mt->suppress_deletions = suppress;
+		for (size_t i = 0; i < ARRAY_SIZE(seeks); i++)
+			for (size_t j = 0; j < ARRAY_SIZE(threads); j++)
+				check_parallel_iterator(mt, seeks[i], threads[j]);
+	}
+
+	tables_destroy(tables, 3);
+	reftable_merged_table_free(mt);
+	for (size_t i = 0; i < ARRAY_SIZE(bufs); i++)
+		reftable_buf_release(&bufs[i]);
+	reftable_free(bs);
+}
+
+void test_reftable_merged__parallel_ref_iterator_outlives_merged_table(void)
+{
+	struct reftable_ref_record r1[500];
+	char names[ARRAY_SIZE(r1)][32];
+	struct reftable_ref_record *refs[] = { r1 };
+	size_t sizes[] = { ARRAY_SIZE(r1) };
+	struct reftable_buf bufs[1] = { REFTABLE_BUF_INIT };
+	struct reftable_block_source *bs = NULL;
+	struct reftable_table **tables = NULL;
+	struct reftable_merged_table *mt;
+	struct reftable_ref_record ref = { 0 };
+	struct reftable_iterator it = { 0 };
+	size_t n = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(r1); i++) {
+		snprintf(names[i], sizeof(names[i]), "refs/tags/tag-%04d", (int)i);
+		r1[i] = (struct reftable_ref_record) {
+			.refname = names[i],
+			.update_index = 1,
+			.value_type = REFTABLE_REF_VAL1,
+		};
+		cl_reftable_set_hash(r1[i].value.val1, i, REFTABLE_HASH_SHA1);
+	}
+
+	mt = merged_table_from_records(refs, &bs, &tables, sizes, bufs, 1);
+	cl_assert(!reftable_merged_table_init_parallel_ref_iterator(mt, &it, 4));
+
+	/*
+	 * The iterator holds its own references to the tables, like it would
+	 * when the stack gets reloaded while iterating.
+	 */
+	tables_destroy(tables, 1);
+	reftable_merged_table_free(mt);
+
+	cl_assert(!reftable_iterator_seek_ref(&it, ""));
+	while (!reftable_iterator_next_ref(&it, &ref)) {
+		cl_assert_equal_s(ref.refname, names[n]);
+		n++;
+	}
+	cl_assert_equal_i(n, ARRAY_SIZE(r1));
+
+	reftable_ref_record_release(&ref);
+	reftable_iterator_destroy(&it);
+	reftable_buf_release(&bufs[0]);
+	reftable_free(bs);
+}
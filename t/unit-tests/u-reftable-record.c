@@ -189,6 +189,8 @@ void test_reftable_record__ref_record_roundtrip(void)
 		/* decode into a non-zero reftable_record to test for leaks. */
 		m = reftable_record_decode(&out, key, i, dest, REFTABLE_HASH_SIZE_SHA1, &scratch);
 		cl_assert_equal_i(n, m);
+		cl_assert_equal_i(reftable_record_skip(&out, i, dest,
+						       REFTABLE_HASH_SIZE_SHA1), n);
 
 		cl_assert(reftable_ref_record_equal(&in.u.ref,
 						    &out.u.ref,
@@ -349,6 +351,8 @@ void test_reftable_record__log_record_roundtrip(void)
 		m = reftable_record_decode(&out, key, valtype, dest,
 					   REFTABLE_HASH_SIZE_SHA1, &scratch);
 		cl_assert_equal_i(n, m);
+		cl_assert_equal_i(reftable_record_skip(&out, valtype, dest,
+						       REFTABLE_HASH_SIZE_SHA1), n);
 
 		cl_assert(reftable_log_record_equal(&in[i], &out.u.log,
 						    REFTABLE_HASH_SIZE_SHA1) != 0);
@@ -490,6 +494,8 @@ void test_reftable_record__obj_record_roundtrip(void)
 		m = reftable_record_decode(&out, key, extra, dest,
 					   REFTABLE_HASH_SIZE_SHA1, &scratch);
 		cl_assert_equal_i(n, m);
+		cl_assert_equal_i(reftable_record_skip(&out, extra, dest,
+						       REFTABLE_HASH_SIZE_SHA1), n);
 
 		cl_assert(reftable_record_equal(&in, &out,
 						REFTABLE_HASH_SIZE_SHA1) != 0);
@@ -584,6 +590,8 @@ void test_reftable_record__index_record_roundtrip(void)
 	m = reftable_record_decode(&out, key, extra, dest,
 				   REFTABLE_HASH_SIZE_SHA1, &scratch);
 	cl_assert_equal_i(m, n);
+	cl_assert_equal_i(reftable_record_skip(&out, extra, dest,
+					       REFTABLE_HASH_SIZE_SHA1), n);
 
 	cl_assert(reftable_record_equal(&in, &out,
 					REFTABLE_HASH_SIZE_SHA1) != 0);
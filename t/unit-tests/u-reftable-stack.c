@@ -1105,6 +1105,120 @@ void test_reftable_stack__add_performs_auto_compaction(void)
 	clear_dir(dir);
 }
 
+struct auto_compact_arg {
+	size_t calls;
+	int ret;
+};
+
+static int on_auto_compact(void *payload)
+{
+	struct auto_compact_arg *arg = payload;
+	arg->calls++;
+	return arg->ret;
+}
+
+void test_reftable_stack__add_defers_auto_compaction(void)
+{
+	struct auto_compact_arg arg = { 0 };
+	struct reftable_write_options opts = {
+		.on_auto_compact = on_auto_compact,
+		.on_auto_compact_payload = &arg,
+	};
+	struct reftable_write_options compactor_opts = { 0 };
+	struct reftable_stack *st = NULL, *compactor = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	size_t i, n = 20;
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, &opts), 0);
+	cl_assert_equal_i(reftable_new_stack(&compactor, dir, &compactor_opts), 0);
+
+	for (i = 0; i < n; i++) {
+		struct reftable_ref_record ref = {
+			.update_index = reftable_stack_next_update_index(st),
+			.value_type = REFTABLE_REF_SYMREF,
+			.value.symref = (char *) "master",
+		};
+		char buf[128];
+
+		snprintf(buf, sizeof(buf), "branch-%04"PRIuMAX, (uintmax_t)i);
+		ref.refname = buf;
+
+		cl_assert_equal_i(reftable_stack_add(st, write_test_ref,
+						     &ref, 0), 0);
+
+		/*
+		 * The writer must not compact the stack itself, but ask the
+		 * callback to do so whenever there is more than one table.
+		 */
+		cl_assert_equal_i(st->merged->tables_len, i + 1);
+		cl_assert_equal_i(arg.calls, i);
+	}
+
+	/*
+	 * Compact the stack via a separate stack, like a detached process
+	 * would, and verify that the writer continues to see all of its
+	 * references.
+	 */
+	cl_assert_equal_i(reftable_stack_reload(compactor), 0);
+	cl_assert_equal_i(reftable_stack_auto_compact(compactor), 0);
+	cl_assert_equal_i(compactor->merged->tables_len, 1);
+
+	cl_assert_equal_i(reftable_stack_reload(st), 0);
+	cl_assert_equal_i(st->merged->tables_len, 1);
+	for (i = 0; i < n; i++) {
+		struct reftable_ref_record ref = { 0 };
+		char buf[128];
+
+		snprintf(buf, sizeof(buf), "branch-%04"PRIuMAX, (uintmax_t)i);
+		cl_assert_equal_i(reftable_stack_read_ref(st, buf, &ref), 0);
+		reftable_ref_record_release(&ref);
+	}
+
+	reftable_stack_destroy(compactor);
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
+void test_reftable_stack__add_auto_compaction_fallback(void)
+{
+	struct auto_compact_arg arg = {
+		.ret = -1,
+	};
+	struct reftable_write_options opts = {
+		.on_auto_compact = on_auto_compact,
+		.on_auto_compact_payload = &arg,
+	};
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, &opts), 0);
+
+	for (size_t i = 0; i < 2; i++) {
+		struct reftable_ref_record ref = {
+			.update_index = reftable_stack_next_update_index(st),
+			.value_type = REFTABLE_REF_SYMREF,
+			.value.symref = (char *) "master",
+		};
+		char buf[128];
+
+		snprintf(buf, sizeof(buf), "branch-%04"PRIuMAX, (uintmax_t)i);
+		ref.refname = buf;
+
+		cl_assert_equal_i(reftable_stack_add(st, write_test_ref,
+						     &ref, 0), 0);
+	}
+
+	/*
+	 * The stack is compacted synchronously when the callback cannot
+	 * take care of it.
+	 */
+	cl_assert_equal_i(arg.calls, 1);
+	cl_assert_equal_i(st->merged->tables_len, 1);
+
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
 void test_reftable_stack__compaction_with_locked_tables(void)
 {
 	struct reftable_write_options opts = {
@@ -1242,6 +1356,151 @@ void test_reftable_stack__read_across_reload(void)
 	clear_dir(dir);
 }
 
+void test_reftable_stack__block_cache_disabled(void)
+{
+	struct reftable_write_options opts = { 0 };
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, &opts), 0);
+	cl_assert(reftable_stack_block_cache_stats(st) == NULL);
+
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
+void test_reftable_stack__block_cache_hits(void)
+{
+	struct reftable_write_options opts = {
+		.block_cache_size = 1024 * 1024,
+	};
+	struct reftable_block_cache_stats *stats;
+	struct reftable_ref_record rec = { 0 };
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	uint64_t misses;
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, &opts), 0);
+	write_n_ref_tables(st, 3);
+	stats = reftable_stack_block_cache_stats(st);
+	cl_assert(stats != NULL);
+
+	cl_assert_equal_i(reftable_stack_read_ref(st, "refs/heads/branch-0001",
+						  &rec), 0);
+	cl_assert(stats->misses > 0);
+	cl_assert_equal_i(stats->hits, 0);
+	cl_assert_equal_i(stats->entries, stats->misses);
+	misses = stats->misses;
+
+	cl_assert_equal_i(reftable_stack_read_ref(st, "refs/heads/branch-0002",
+						  &rec), 0);
+	cl_assert_equal_s(rec.refname, "refs/heads/branch-0002");
+	cl_assert_equal_i(stats->misses, misses);
+	cl_assert_equal_i(stats->hits, misses);
+	cl_assert_equal_i(stats->evictions, 0);
+
+	/* Compaction drops the blocks of the tables it replaces. */
+	cl_assert_equal_i(reftable_stack_compact_all(st, NULL), 0);
+	cl_assert_equal_i(stats->entries, 0);
+	cl_assert_equal_i(stats->bytes, 0);
+
+	cl_assert_equal_i(reftable_stack_read_ref(st, "refs/heads/branch-0000",
+						  &rec), 0);
+	cl_assert_equal_s(rec.refname, "refs/heads/branch-0000");
+	cl_assert_equal_i(stats->entries, 1);
+
+	reftable_ref_record_release(&rec);
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
+void test_reftable_stack__block_cache_eviction(void)
+{
+	struct reftable_write_options opts = {
+		.block_cache_size = 1,
+	};
+	struct reftable_block_cache_stats *stats;
+	struct reftable_ref_record rec = { 0 };
+	struct reftable_iterator it = { 0 };
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	size_t i;
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, &opts), 0);
+	write_n_ref_tables(st, 4);
+	stats = reftable_stack_block_cache_stats(st);
+
+	/*
+	 * Blocks in use by the iterator must stay around even though they
+	 * exceed the budget of the cache.
+	 */
+	cl_assert_equal_i(reftable_stack_init_ref_iterator(st, &it), 0);
+	cl_assert_equal_i(reftable_iterator_seek_ref(&it, ""), 0);
+	cl_assert(stats->entries > 0);
+	for (i = 0; i < 4; i++) {
+		char name[64];
+
+		cl_assert_equal_i(reftable_iterator_next_ref(&it, &rec), 0);
+		snprintf(name, sizeof(name), "refs/heads/branch-%04"PRIuMAX,
+			 (uintmax_t)i);
+		cl_assert_equal_s(rec.refname, name);
+	}
+	cl_assert(reftable_iterator_next_ref(&it, &rec) > 0);
+	reftable_iterator_destroy(&it);
+
+	cl_assert_equal_i(stats->entries, 0);
+	cl_assert_equal_i(stats->bytes, 0);
+	cl_assert_equal_i(stats->evictions, stats->misses);
+
+	reftable_ref_record_release(&rec);
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
+void test_reftable_stack__block_cache_logs(void)
+{
+	struct reftable_write_options opts = {
+		.block_cache_size = 1024 * 1024,
+	};
+	struct reftable_log_record input = {
+		.refname = (char *) "branch",
+		.update_index = 1,
+		.value_type = REFTABLE_LOG_UPDATE,
+		.value.update = {
+			.new_hash = { 1 },
+			.old_hash = { 2 },
+			.message = (char *) "message\n",
+		},
+	};
+	struct reftable_log_record dest = { 0 };
+	struct write_log_arg arg = {
+		.log = &input,
+		.update_index = 1,
+	};
+	struct reftable_block_cache_stats *stats;
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	uint64_t misses;
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, &opts), 0);
+	cl_assert_equal_i(reftable_stack_add(st, write_test_log, &arg, 0), 0);
+	stats = reftable_stack_block_cache_stats(st);
+
+	cl_assert_equal_i(reftable_stack_read_log(st, "branch", &dest), 0);
+	cl_assert_equal_s(dest.value.update.message, "message\n");
+	misses = stats->misses;
+	cl_assert(misses > 0);
+
+	cl_assert_equal_i(reftable_stack_read_log(st, "branch", &dest), 0);
+	cl_assert_equal_s(dest.value.update.message, "message\n");
+	cl_assert_equal_i(stats->misses, misses);
+	cl_assert(stats->hits > 0);
+
+	reftable_log_record_release(&dest);
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
 void test_reftable_stack__reload_with_missing_table(void)
 {
 	struct reftable_write_options opts = { 0 };
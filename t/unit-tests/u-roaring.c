@@ -0,0 +1,184 @@
+#include "unit-test.h"
+#include "ewah/ewok.h"
+#include "strbuf.h"
+
+#define CHUNK_BITS 65536
+
+/*
+ * Build a bitmap whose chunks exercise each container type: a sparse
+ * chunk (array), a chunk of long runs (run), a dense chunk with no
+ * structure (bitset), an empty chunk, and a short final chunk.
+ */
+static struct bitmap *sample_bitmap(void)
+{
+	struct bitmap *bitmap = bitmap_new();
+
+	for (size_t i = 0; i < CHUNK_BITS; i += 97)
+		bitmap_set(bitmap, i);
+	for (size_t i = 0; i < CHUNK_BITS; i++)
+		if ((i / 1000) % 2)
+			bitmap_set(bitmap, CHUNK_BITS + i);
+	for (size_t i = 0; i < CHUNK_BITS; i++)
+		if ((i * 2654435761u) >> 31 & 1)
+			bitmap_set(bitmap, 2 * CHUNK_BITS + i);
+	for (size_t i = 0; i < 100; i += 3)
+		bitmap_set(bitmap, 4 * CHUNK_BITS + i);
+
+	return bitmap;
+}
+
+static struct bitmap *roaring_to_bitmap(struct roaring_bitmap *roaring)
+{
+	struct bitmap *bitmap = bitmap_word_alloc(0);
+	bitmap_or_roaring(bitmap, roaring);
+	return bitmap;
+}
+
+static int write_strbuf(void *out, const void *buf, size_t len)
+{
+	strbuf_add(out, buf, len);
+	return len;
+}
+
+void test_roaring__container_types(void)
+{
+	struct bitmap *bitmap = sample_bitmap();
+	struct roaring_bitmap *roaring = bitmap_to_roaring(bitmap);
+
+	cl_assert_equal_i(roaring->nr, 4);
+	cl_assert_equal_i(roaring->containers[0].key, 0);
+	cl_assert_equal_i(roaring->containers[0].type, ROARING_ARRAY);
+	cl_assert_equal_i(roaring->containers[1].key, 1);
+	cl_assert_equal_i(roaring->containers[1].type, ROARING_RUN);
+	cl_assert_equal_i(roaring->containers[2].key, 2);
+	cl_assert_equal_i(roaring->containers[2].type, ROARING_BITSET);
+	cl_assert_equal_i(roaring->containers[3].key, 4);
+	cl_assert_equal_i(roaring->containers[3].type, ROARING_ARRAY);
+
+	cl_assert_equal_i(roaring_popcount(roaring), bitmap_popcount(bitmap));
+
+	roaring_free(roaring);
+	bitmap_free(bitmap);
+}
+
+void test_roaring__or_into_bitmap(void)
+{
+	struct bitmap *bitmap = sample_bitmap();
+	struct roaring_bitmap *roaring = bitmap_to_roaring(bitmap);
+	struct bitmap *actual = bitmap_new(), *expect = bitmap_new();
+
+	for (size_t i = 0; i < 5 * CHUNK_BITS; i += 1031) {
+		bitmap_set(actual, i);
+		bitmap_set(expect, i);
+	}
+	bitmap_or(expect, bitmap);
+	bitmap_or_roaring(actual, roaring);
+	cl_assert(bitmap_equals(actual, expect));
+
+	roaring_free(roaring);
+	bitmap_free(actual);
+	bitmap_free(expect);
+	bitmap_free(bitmap);
+}
+
+void test_roaring__ewah_conversion(void)
+{
+	struct bitmap *bitmap = sample_bitmap(), *actual;
+	struct ewah_bitmap *ewah = bitmap_to_ewah(bitmap), *converted;
+	struct roaring_bitmap *roaring = ewah_to_roaring(ewah);
+
+	actual = roaring_to_bitmap(roaring);
+	cl_assert(bitmap_equals(actual, bitmap));
+
+	converted = roaring_to_ewah(roaring);
+	cl_assert(bitmap_equals_ewah(bitmap, converted));
+
+	ewah_free(converted);
+	ewah_free(ewah);
+	roaring_free(roaring);
+	bitmap_free(actual);
+	bitmap_free(bitmap);
+}
+
+void test_roaring__xor(void)
+{
+	struct bitmap *a = sample_bitmap(), *b = bitmap_new(), *actual;
+	struct roaring_bitmap *ra, *rb, *rx;
+
+	/* Overlap some chunks of 'a' and add a chunk of its own. */
+	for (size_t i = 0; i < 2 * CHUNK_BITS; i += 5)
+		bitmap_set(b, CHUNK_BITS + i);
+	for (size_t i = 0; i < 200; i++)
+		bitmap_set(b, 3 * CHUNK_BITS + i);
+
+	ra = bitmap_to_roaring(a);
+	rb = bitmap_to_roaring(b);
+	rx = roaring_xor(ra, rb);
+
+	for (size_t i = 0; i < b->word_alloc; i++)
+		a->words[i] ^= b->words[i];
+	actual = roaring_to_bitmap(rx);
+	cl_assert(bitmap_equals(actual, a));
+
+	/* XORing with itself leaves nothing behind. */
+	roaring_free(rx);
+	rx = roaring_xor(ra, ra);
+	cl_assert_equal_i(rx->nr, 0);
+
+	roaring_free(ra);
+	roaring_free(rb);
+	roaring_free(rx);
+	bitmap_free(actual);
+	bitmap_free(a);
+	bitmap_free(b);
+}
+
+void test_roaring__serialize_round_trip(void)
+{
+	struct bitmap *bitmap = sample_bitmap(), *actual;
+	struct roaring_bitmap *roaring = bitmap_to_roaring(bitmap);
+	struct roaring_bitmap *read = roaring_new();
+	struct strbuf buf = STRBUF_INIT;
+	int written;
+
+	written = roaring_serialize_to(roaring, write_strbuf, &buf);
+	cl_assert_equal_i(written, buf.len);
+	cl_assert_equal_i(roaring_read_mmap(read, buf.buf, buf.len), buf.len);
+
+	actual = roaring_to_bitmap(read);
+	cl_assert(bitmap_equals(actual, bitmap));
+
+	strbuf_release(&buf);
+	roaring_free(roaring);
+	roaring_free(read);
+	bitmap_free(actual);
+	bitmap_free(bitmap);
+}
+
+void test_roaring__read_rejects_corruption(void)
+{
+	struct bitmap *bitmap = sample_bitmap();
+	struct roaring_bitmap *roaring = bitmap_to_roaring(bitmap);
+	struct roaring_bitmap *read;
+	struct strbuf buf = STRBUF_INIT;
+
+	roaring_serialize_to(roaring, write_strbuf, &buf);
+
+	/* Truncated anywhere, including within a container. */
+	for (size_t len = 0; len < buf.len; len += 1021) {
+		read = roaring_new();
+		cl_assert(roaring_read_mmap(read, buf.buf, len) < 0);
+		roaring_free(read);
+	}
+
+	/* The second value of the first (array) container is out of order. */
+	buf.buf[4 + 5 + 2] = buf.buf[4 + 5];
+	buf.buf[4 + 5 + 3] = buf.buf[4 + 5 + 1];
+	read = roaring_new();
+	cl_assert(roaring_read_mmap(read, buf.buf, buf.len) < 0);
+	roaring_free(read);
+
+	strbuf_release(&buf);
+	roaring_free(roaring);
+	bitmap_free(bitmap);
+}
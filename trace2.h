@@ -560,6 +560,11 @@ enum trace2_counter_id {
 	TRACE2_COUNTER_ID_FSYNC_WRITEOUT_ONLY,
 	TRACE2_COUNTER_ID_FSYNC_HARDWARE_FLUSH,
 
+	/* counts delta base cache lookups and evictions */
+	TRACE2_COUNTER_ID_DELTA_BASE_CACHE_HITS,
+	TRACE2_COUNTER_ID_DELTA_BASE_CACHE_MISSES,
+	TRACE2_COUNTER_ID_DELTA_BASE_CACHE_EVICTIONS,
+
 	/* Add additional counter definitions before here. */
 	TRACE2_NUMBER_OF_COUNTERS
 };
@@ -0,0 +1,574 @@
+#include "git-compat-util.h"
+#include "chunk-format.h"
+#include "commit.h"
+#include "csum-file.h"
+#include "dir.h"
+#include "gettext.h"
+#include "hash-lookup.h"
+#include "hex.h"
+#include "lockfile.h"
+#include "object-file.h"
+#include "odb.h"
+#include "oid-array.h"
+#include "oidset.h"
+#include "path.h"
+#include "progress.h"
+#include "refs.h"
+#include "repository.h"
+#include "trace2.h"
+#include "tree-cache.h"
+#include "tree-walk.h"
+#include "write-or-die.h"
+
+#define TREE_CACHE_SIGNATURE 0x54524543 /* "TREC" */
+#define TREE_CACHE_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
+#define TREE_CACHE_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
+#define TREE_CACHE_CHUNKID_OFFSETS 0x544f4646 /* "TOFF" */
+#define TREE_CACHE_CHUNKID_DATA 0x54444154 /* "TDAT" */
+
+#define TREE_CACHE_VERSION 1
+#define TREE_CACHE_HEADER_SIZE 8
+#define TREE_CACHE_FANOUT_SIZE (4 * 256)
+
+struct tree_cache {
+	const unsigned char *data;
+	size_t data_len;
+
+	const struct git_hash_algo *hash_algo;
+	uint32_t num_trees;
+
+	const uint32_t *chunk_oid_fanout;
+	const unsigned char *chunk_oid_lookup;
+	const unsigned char *chunk_offsets;
+	const unsigned char *chunk_data;
+	size_t chunk_data_size;
+};
+
+char *get_tree_cache_filename(struct repository *r)
+{
+	return xstrfmt("%s/pack/tree-cache", repo_get_object_directory(r));
+}
+
+static size_t tree_cache_min_size(const struct git_hash_algo *algop)
+{
+	return TREE_CACHE_HEADER_SIZE + 5 * CHUNK_TOC_ENTRY_SIZE +
+		TREE_CACHE_FANOUT_SIZE + sizeof(uint64_t) + algop->rawsz;
+}
+
+static int tree_cache_read_oid_fanout(const unsigned char *chunk_start,
+				      size_t chunk_size, void *data)
+{
+	struct tree_cache *tc = data;
+	int i;
+
+	if (chunk_size != TREE_CACHE_FANOUT_SIZE)
+		return error(_("tree-cache oid fanout chunk is wrong size"));
+	tc->chunk_oid_fanout = (const uint32_t *)chunk_start;
+	tc->num_trees = ntohl(tc->chunk_oid_fanout[255]);
+
+	for (i = 0; i < 255; i++) {
+		if (ntohl(tc->chunk_oid_fanout[i]) >
+		    ntohl(tc->chunk_oid_fanout[i + 1]))
+			return error(_("tree-cache fanout values out of order"));
+	}
+
+	return 0;
+}
+
+static int tree_cache_read_oid_lookup(const unsigned char *chunk_start,
+				      size_t chunk_size, void *data)
+{
+	struct tree_cache *tc = data;
+	if (chunk_size / tc->hash_algo->rawsz != tc->num_trees)
+		return error(_("tree-cache OID lookup chunk is the wrong size"));
+	tc->chunk_oid_lookup = chunk_start;
+	return 0;
+}
+
+static int tree_cache_read_offsets(const unsigned char *chunk_start,
+				   size_t chunk_size, void *data)
+{
+	struct tree_cache *tc = data;
+	if (chunk_size / sizeof(uint64_t) != (size_t)tc->num_trees + 1)
+		return error(_("tree-cache offsets chunk is the wrong size"));
+	tc->chunk_offsets = chunk_start;
+	return 0;
+}
+
+static struct tree_cache *parse_tree_cache(struct repository *r,
+					   const unsigned char *data,
+					   size_t data_len)
+{
+	struct tree_cache *tc;
+	struct chunkfile *cf = NULL;
+	unsigned char num_chunks;
+
+	if (data_len < tree_cache_min_size(r->hash_algo)) {
+		error(_("tree-cache file is too small"));
+		return NULL;
+	}
+	if (get_be32(data) != TREE_CACHE_SIGNATURE) {
+		error(_("tree-cache signature %X does not match signature %X"),
+		      get_be32(data), TREE_CACHE_SIGNATURE);
+		return NULL;
+	}
+	if (data[4] != TREE_CACHE_VERSION) {
+		error(_("tree-cache version %X does not match version %X"),
+		      data[4], TREE_CACHE_VERSION);
+		return NULL;
+	}
+	if (data[5] != oid_version(r->hash_algo)) {
+		error(_("tree-cache hash version %X does not match version %X"),
+		      data[5], oid_version(r->hash_algo));
+		return NULL;
+	}
+	num_chunks = data[6];
+
+	CALLOC_ARRAY(tc, 1);
+	tc->data = data;
+	tc->data_len = data_len;
+	tc->hash_algo = r->hash_algo;
+
+	cf = init_chunkfile(NULL);
+	if (read_table_of_contents(cf, data, data_len,
+				   TREE_CACHE_HEADER_SIZE, num_chunks, 1))
+		goto cleanup;
+
+	if (read_chunk(cf, TREE_CACHE_CHUNKID_OIDFANOUT,
+		       tree_cache_read_oid_fanout, tc)) {
+		error(_("tree-cache required OID fanout chunk missing or corrupted"));
+		goto cleanup;
+	}
+	if (read_chunk(cf, TREE_CACHE_CHUNKID_OIDLOOKUP,
+		       tree_cache_read_oid_lookup, tc)) {
+		error(_("tree-cache required OID lookup chunk missing or corrupted"));
+		goto cleanup;
+	}
+	if (read_chunk(cf, TREE_CACHE_CHUNKID_OFFSETS,
+		       tree_cache_read_offsets, tc)) {
+		error(_("tree-cache required offsets chunk missing or corrupted"));
+		goto cleanup;
+	}
+	if (pair_chunk(cf, TREE_CACHE_CHUNKID_DATA, &tc->chunk_data,
+		       &tc->chunk_data_size)) {
+		error(_("tree-cache required data chunk missing or corrupted"));
+		goto cleanup;
+	}
+
+	free_chunkfile(cf);
+	return tc;
+
+cleanup:
+	free_chunkfile(cf);
+	free(tc);
+	return NULL;
+}
+
+static struct tree_cache *load_tree_cache(struct repository *r,
+					  const char *filename)
+{
+	struct tree_cache *tc;
+	struct stat st;
+	void *data;
+	size_t data_len;
+	int fd;
+
+	fd = git_open(filename);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	data_len = xsize_t(st.st_size);
+	if (data_len < tree_cache_min_size(r->hash_algo)) {
+		close(fd);
+		error(_("tree-cache file is too small"));
+		return NULL;
+	}
+	data = xmmap(NULL, data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	tc = parse_tree_cache(r, data, data_len);
+	if (!tc)
+		munmap(data, data_len);
+	return tc;
+}
+
+static void free_tree_cache(struct tree_cache *tc)
+{
+	if (!tc)
+		return;
+	munmap((void *)tc->data, tc->data_len);
+	free(tc);
+}
+
+struct tree_cache *prepare_tree_cache(struct repository *r)
+{
+	char *filename;
+
+	if (r->objects->tree_cache_attempted)
+		return r->objects->tree_cache;
+	r->objects->tree_cache_attempted = 1;
+
+	prepare_repo_settings(r);
+	if (!r->settings.core_tree_cache)
+		return NULL;
+
+	filename = get_tree_cache_filename(r);
+	r->objects->tree_cache = load_tree_cache(r, filename);
+	free(filename);
+
+	return r->objects->tree_cache;
+}
+
+void close_tree_cache(struct object_database *o)
+{
+	free_tree_cache(o->tree_cache);
+	o->tree_cache = NULL;
+	o->tree_cache_attempted = 0;
+}
+
+static int tree_cache_entry_at(struct tree_cache *tc, uint32_t pos,
+			    const unsigned char **buf, unsigned long *size)
+{
+	uint64_t start, end;
+
+	start = get_be64(tc->chunk_offsets + st_mult(pos, sizeof(uint64_t)));
+	end = get_be64(tc->chunk_offsets + st_mult(pos + 1, sizeof(uint64_t)));
+	if (start > end || end > tc->chunk_data_size)
+		return error(_("tree-cache offsets for entry %"PRIu32" are out of bounds"),
+			     pos);
+
+	*buf = tc->chunk_data + start;
+	*size = cast_size_t_to_ulong(end - start);
+	return 0;
+}
+
+void *tree_cache_read(struct tree_cache *tc, const struct object_id *oid,
+		      unsigned long *size)
+{
+	const unsigned char *buf;
+	uint32_t pos;
+
+	if (!bsearch_hash(oid->hash, tc->chunk_oid_fanout, tc->chunk_oid_lookup,
+			  tc->hash_algo->rawsz, &pos))
+		return NULL;
+	if (tree_cache_entry_at(tc, pos, &buf, size) < 0)
+		return NULL;
+
+	return xmemdupz(buf, *size);
+}
+
+struct tree_cache_entry {
+	struct object_id oid;
+	unsigned long size;
+};
+
+struct write_tree_cache_context {
+	struct repository *r;
+	struct tree_cache_entry *entries;
+	size_t entries_nr, entries_alloc;
+	struct oidset seen;
+	struct oid_array roots;
+	struct progress *progress;
+	uint64_t progress_cnt;
+};
+
+static int add_ref_root_tree(const struct reference *ref, void *cb_data)
+{
+	struct write_tree_cache_context *ctx = cb_data;
+	struct commit *commit;
+	struct object_id peeled;
+	const struct object_id *oid = ref->oid;
+
+	if (!reference_get_peeled_oid(ctx->r, ref, &peeled))
+		oid = &peeled;
+	commit = lookup_commit_reference_gently(ctx->r, oid, 1);
+	if (!commit || repo_parse_commit(ctx->r, commit))
+		return 0;
+
+	oid_array_append(&ctx->roots, get_commit_tree_oid(commit));
+	return 0;
+}
+
+/*
+ * Record "oid" as a tree to be cached and, if we have not reached the
+ * maximum depth yet, queue its subtrees in "next".
+ */
+static int collect_tree(struct write_tree_cache_context *ctx,
+			const struct object_id *oid,
+			struct oid_array *next)
+{
+	struct tree_desc desc;
+	struct name_entry entry;
+	enum object_type type;
+	unsigned long size;
+	void *buf;
+
+	if (oidset_insert(&ctx->seen, oid))
+		return 0;
+
+	buf = odb_read_object(ctx->r->objects, oid, &type, &size);
+	if (!buf || type != OBJ_TREE) {
+		free(buf);
+		return error(_("unable to read tree %s"), oid_to_hex(oid));
+	}
+
+	ALLOC_GROW(ctx->entries, ctx->entries_nr + 1, ctx->entries_alloc);
+	oidcpy(&ctx->entries[ctx->entries_nr].oid, oid);
+	ctx->entries[ctx->entries_nr].size = size;
+	ctx->entries_nr++;
+	display_progress(ctx->progress, ctx->entries_nr);
+
+	if (next) {
+		init_tree_desc(&desc, oid, buf, size);
+		while (tree_entry(&desc, &entry))
+			if (S_ISDIR(entry.mode))
+				oid_array_append(next, &entry.oid);
+	}
+
+	free(buf);
+	return 0;
+}
+
+static int tree_cache_entry_cmp(const void *va, const void *vb)
+{
+	const struct tree_cache_entry *a = va, *b = vb;
+	return oidcmp(&a->oid, &b->oid);
+}
+
+static int write_tree_cache_chunk_fanout(struct hashfile *f, void *data)
+{
+	struct write_tree_cache_context *ctx = data;
+	size_t i, count = 0;
+
+	for (i = 0; i < 256; i++) {
+		while (count < ctx->entries_nr &&
+		       ctx->entries[count].oid.hash[0] == i)
+			count++;
+		hashwrite_be32(f, count);
+	}
+
+	return 0;
+}
+
+static int write_tree_cache_chunk_oids(struct hashfile *f, void *data)
+{
+	struct write_tree_cache_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->entries_nr; i++)
+		hashwrite(f, ctx->entries[i].oid.hash, f->algop->rawsz);
+
+	return 0;
+}
+
+static int write_tree_cache_chunk_offsets(struct hashfile *f, void *data)
+{
+	struct write_tree_cache_context *ctx = data;
+	uint64_t offset = 0;
+	size_t i;
+
+	for (i = 0; i < ctx->entries_nr; i++) {
+		hashwrite_be64(f, offset);
+		offset += ctx->entries[i].size;
+	}
+	hashwrite_be64(f, offset);
+
+	return 0;
+}
+
+static int write_tree_cache_chunk_data(struct hashfile *f, void *data)
+{
+	struct write_tree_cache_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->entries_nr; i++) {
+		struct tree_cache_entry *e = &ctx->entries[i];
+		enum object_type type;
+		unsigned long size;
+		void *buf;
+
+		buf = odb_read_object(ctx->r->objects, &e->oid, &type, &size);
+		if (!buf || type != OBJ_TREE || size != e->size) {
+			free(buf);
+			return error(_("unable to read tree %s"),
+				     oid_to_hex(&e->oid));
+		}
+		hashwrite(f, buf, size);
+		free(buf);
+
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+	}
+
+	return 0;
+}
+
+int write_tree_cache(struct repository *r, enum tree_cache_write_flags flags)
+{
+	struct write_tree_cache_context ctx = {
+		.r = r,
+		.seen = OIDSET_INIT,
+		.roots = OID_ARRAY_INIT,
+	};
+	struct oid_array next = OID_ARRAY_INIT;
+	struct lock_file lk = LOCK_INIT;
+	struct chunkfile *cf;
+	struct hashfile *f;
+	char *filename = NULL;
+	uint64_t data_size = 0;
+	int depth, level;
+	size_t i;
+	int ret = 0;
+
+	prepare_repo_settings(r);
+	depth = r->settings.tree_cache_depth;
+
+	/*
+	 * Read the trees from where they are stored, not from the cache
+	 * we are about to replace.
+	 */
+	close_tree_cache(r->objects);
+	r->objects->tree_cache_attempted = 1;
+
+	trace2_region_enter("tree-cache", "write", r);
+
+	if (flags & TREE_CACHE_WRITE_PROGRESS)
+		ctx.progress = start_delayed_progress(r,
+			_("Collecting trees for tree-cache"), 0);
+
+	refs_for_each_ref(get_main_ref_store(r), add_ref_root_tree, &ctx);
+	refs_head_ref(get_main_ref_store(r), add_ref_root_tree, &ctx);
+
+	for (level = 0; level <= depth && ctx.roots.nr; level++) {
+		for (i = 0; i < ctx.roots.nr; i++) {
+			if (collect_tree(&ctx, &ctx.roots.oid[i],
+					 level < depth ? &next : NULL)) {
+				ret = -1;
+				goto cleanup;
+			}
+		}
+		oid_array_clear(&ctx.roots);
+		SWAP(ctx.roots, next);
+	}
+	stop_progress(&ctx.progress);
+
+	QSORT(ctx.entries, ctx.entries_nr, tree_cache_entry_cmp);
+	for (i = 0; i < ctx.entries_nr; i++)
+		data_size += ctx.entries[i].size;
+
+	filename = get_tree_cache_filename(r);
+	if (safe_create_leading_directories(r, filename)) {
+		ret = error(_("unable to create leading directories of %s"),
+			    filename);
+		goto cleanup;
+	}
+	hold_lock_file_for_update_mode(&lk, filename, LOCK_DIE_ON_ERROR, 0444);
+	f = hashfd(r->hash_algo, get_lock_file_fd(&lk), get_lock_file_path(&lk));
+
+	cf = init_chunkfile(f);
+	add_chunk(cf, TREE_CACHE_CHUNKID_OIDFANOUT, TREE_CACHE_FANOUT_SIZE,
+		  write_tree_cache_chunk_fanout);
+	add_chunk(cf, TREE_CACHE_CHUNKID_OIDLOOKUP,
+		  st_mult(r->hash_algo->rawsz, ctx.entries_nr),
+		  write_tree_cache_chunk_oids);
+	add_chunk(cf, TREE_CACHE_CHUNKID_OFFSETS,
+		  st_mult(sizeof(uint64_t), st_add(ctx.entries_nr, 1)),
+		  write_tree_cache_chunk_offsets);
+	add_chunk(cf, TREE_CACHE_CHUNKID_DATA, data_size,
+		  write_tree_cache_chunk_data);
+
+	hashwrite_be32(f, TREE_CACHE_SIGNATURE);
+	hashwrite_u8(f, TREE_CACHE_VERSION);
+	hashwrite_u8(f, oid_version(r->hash_algo));
+	hashwrite_u8(f, get_num_chunks(cf));
+	hashwrite_u8(f, 0); /* unused padding byte */
+
+	if (flags & TREE_CACHE_WRITE_PROGRESS)
+		ctx.progress = start_delayed_progress(r,
+			_("Writing out tree-cache"), ctx.entries_nr);
+	ret = write_chunkfile(cf, &ctx);
+	stop_progress(&ctx.progress);
+	free_chunkfile(cf);
+
+	if (ret) {
+		free_hashfile(f);
+		rollback_lock_file(&lk);
+		goto cleanup;
+	}
+
+	finalize_hashfile(f, NULL, FSYNC_COMPONENT_PACK_METADATA,
+			  CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+	if (commit_lock_file(&lk) < 0)
+		ret = error_errno(_("could not write '%s'"), filename);
+
+cleanup:
+	stop_progress(&ctx.progress);
+	trace2_data_intmax("tree-cache", r, "trees", ctx.entries_nr);
+	trace2_region_leave("tree-cache", "write", r);
+	r->objects->tree_cache_attempted = 0;
+	oidset_clear(&ctx.seen);
+	oid_array_clear(&ctx.roots);
+	oid_array_clear(&next);
+	free(ctx.entries);
+	free(filename);
+	return ret;
+}
+
+int verify_tree_cache(struct repository *r)
+{
+	struct tree_cache *tc;
+	struct object_id prev;
+	char *filename = get_tree_cache_filename(r);
+	int errors = 0;
+	uint32_t i;
+
+	if (!file_exists(filename)) {
+		free(filename);
+		return 0;
+	}
+
+	tc = load_tree_cache(r, filename);
+	if (!tc) {
+		free(filename);
+		return 1;
+	}
+
+	if (!hashfile_checksum_valid(r->hash_algo, tc->data, tc->data_len)) {
+		error(_("tree-cache file %s has incorrect checksum"), filename);
+		errors++;
+	}
+
+	for (i = 0; i < tc->num_trees; i++) {
+		struct object_id oid, actual;
+		const unsigned char *buf;
+		unsigned long size;
+
+		oidread(&oid, tc->chunk_oid_lookup + st_mult(i, r->hash_algo->rawsz),
+			r->hash_algo);
+		if (i && oidcmp(&prev, &oid) >= 0) {
+			error(_("tree-cache has out-of-order OID lookup: %s then %s"),
+			      oid_to_hex(&prev), oid_to_hex(&oid));
+			errors++;
+		}
+		oidcpy(&prev, &oid);
+
+		if (tree_cache_entry_at(tc, i, &buf, &size) < 0) {
+			errors++;
+			continue;
+		}
+
+		hash_object_file(r->hash_algo, buf, size, OBJ_TREE, &actual);
+		if (!oideq(&actual, &oid)) {
+			error(_("tree-cache entry for %s has wrong contents"),
+			      oid_to_hex(&oid));
+			errors++;
+		}
+	}
+
+	free_tree_cache(tc);
+	free(filename);
+	return errors;
+}
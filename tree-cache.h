@@ -0,0 +1,59 @@
+#ifndef TREE_CACHE_H
+#define TREE_CACHE_H
+
+struct object_database;
+struct object_id;
+struct repository;
+
+/*
+ * The tree cache is an optional file in the "pack" directory of the
+ * main object source, which stores the fully inflated contents of the
+ * trees that nearly every process ends up reading: the root trees of
+ * all references and their subtrees down to "gc.treeCacheDepth" levels.
+ * Reading such a tree from the cache avoids having to inflate it and
+ * resolve its delta chain every time.
+ *
+ * The file is keyed by object ID and therefore never goes stale. It is
+ * only ever consulted for the contents of an object that has already
+ * been found in a pack or as a loose object, never to decide whether an
+ * object exists, so that trees removed by "git prune" or "git repack"
+ * are not resurrected by a cache that still has them.
+ */
+struct tree_cache;
+
+/*
+ * Load the tree cache of the repository, if "core.treeCache" is
+ * enabled and the file exists. Returns NULL otherwise. Like the
+ * commit-graph, the checksum is only checked by verify_tree_cache().
+ */
+struct tree_cache *prepare_tree_cache(struct repository *r);
+
+/*
+ * Return a newly allocated copy of the contents of tree "oid", or NULL
+ * if it is not in the cache.
+ */
+void *tree_cache_read(struct tree_cache *tc, const struct object_id *oid,
+		      unsigned long *size);
+
+void close_tree_cache(struct object_database *o);
+
+char *get_tree_cache_filename(struct repository *r);
+
+enum tree_cache_write_flags {
+	TREE_CACHE_WRITE_PROGRESS = (1 << 0),
+};
+
+/*
+ * Write a new tree cache holding the trees reachable from all
+ * references, replacing the existing one.
+ */
+int write_tree_cache(struct repository *r, enum tree_cache_write_flags flags);
+
+/*
+ * Check the checksum of the tree cache and that every tree hashes to
+ * the object ID it is stored under. Returns the number of errors
+ * found.
+ */
+int verify_tree_cache(struct repository *r);
+
+#endif /* TREE_CACHE_H */
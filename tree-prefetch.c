@@ -0,0 +1,404 @@
+#include "git-compat-util.h"
+#include "gettext.h"
+#include "object.h"
+#include "odb.h"
+#include "oidmap.h"
+#include "oidset.h"
+#include "repository.h"
+#include "thread-utils.h"
+#include "trace2.h"
+#include "tree-prefetch.h"
+#include "tree-walk.h"
+
+/* Limit on the tree data that has been read, but not taken yet. */
+#define TREE_PREFETCH_MAX_BYTES (128 * 1024 * 1024)
+
+enum tree_prefetch_state {
+	TREE_PREFETCH_QUEUED,
+	TREE_PREFETCH_READING,
+	TREE_PREFETCH_READY,
+	/* Taken by the caller, or could not be read. */
+	TREE_PREFETCH_DONE,
+};
+
+struct tree_prefetch_entry {
+	struct oidmap_entry ent;
+	enum tree_prefetch_state state;
+	void *buf;
+	unsigned long size;
+};
+
+struct tree_prefetch_worker {
+	struct tree_prefetch *tp;
+	pthread_t thread;
+
+	/*
+	 * The subtrees discovered by this worker. The worker pops from the
+	 * top, so that it walks depth first; others steal from the bottom,
+	 * where the trees closest to the roots are.
+	 *
+	 * The owner pushes while holding tp->mutex; the mutex of a worker
+	 * is never held while taking tp->mutex.
+	 */
+	pthread_mutex_t mutex;
+	struct tree_prefetch_entry **stack;
+	size_t bottom, top, alloc;
+};
+
+struct tree_prefetch {
+	struct repository *repo;
+	struct tree_prefetch_worker *workers;
+	int nr_workers;
+
+	/* Protects everything below, as well as the state of all entries. */
+	pthread_mutex_t mutex;
+	/* Signalled when there is work, or when the limit allows reading. */
+	pthread_cond_t work;
+	/* Signalled when an entry has been read, or the limit is reached. */
+	pthread_cond_t ready;
+
+	/*
+	 * The trees that are queued, being read or waiting to be taken.
+	 * Entries are dropped once the caller is done with them, and only
+	 * their object ID is kept in "done", so that every tree is still
+	 * read at most once.
+	 */
+	struct oidmap entries;
+	struct oidset done;
+
+	/* Root trees given by the caller, in order. */
+	struct tree_prefetch_entry **roots;
+	size_t roots_nr, roots_alloc, roots_next;
+
+	size_t nr_queued;
+	size_t bytes;
+	int shutdown;
+
+	unsigned long nr_read, nr_taken;
+};
+
+/* Must be called with tp->mutex held. */
+static struct tree_prefetch_entry *queue_entry(struct tree_prefetch *tp,
+					       const struct object_id *oid)
+{
+	struct tree_prefetch_entry *e;
+
+	if (oidmap_get(&tp->entries, oid) || oidset_contains(&tp->done, oid))
+		return NULL;
+
+	CALLOC_ARRAY(e, 1);
+	oidcpy(&e->ent.oid, oid);
+	e->state = TREE_PREFETCH_QUEUED;
+	oidmap_put(&tp->entries, e);
+	tp->nr_queued++;
+
+	return e;
+}
+
+static struct tree_prefetch_entry *pop_entry(struct tree_prefetch_worker *w)
+{
+	struct tree_prefetch *tp = w->tp;
+	struct tree_prefetch_entry *e = NULL;
+	int self = w - tp->workers;
+
+	pthread_mutex_lock(&w->mutex);
+	if (w->top > w->bottom)
+		e = w->stack[--w->top];
+	pthread_mutex_unlock(&w->mutex);
+
+	for (int i = 1; !e && i < tp->nr_workers; i++) {
+		struct tree_prefetch_worker *victim =
+			&tp->workers[(self + i) % tp->nr_workers];
+
+		pthread_mutex_lock(&victim->mutex);
+		if (victim->top > victim->bottom)
+			e = victim->stack[victim->bottom++];
+		pthread_mutex_unlock(&victim->mutex);
+	}
+
+	pthread_mutex_lock(&tp->mutex);
+	if (!e && tp->roots_next < tp->roots_nr)
+		e = tp->roots[tp->roots_next++];
+	if (e)
+		tp->nr_queued--;
+	pthread_mutex_unlock(&tp->mutex);
+
+	return e;
+}
+
+static void push_entries(struct tree_prefetch_worker *w,
+			 struct tree_prefetch_entry **entries, size_t nr)
+{
+	if (!nr)
+		return;
+
+	pthread_mutex_lock(&w->mutex);
+	if (w->bottom == w->top) {
+		w->bottom = w->top = 0;
+	} else if (w->bottom && w->top + nr > w->alloc) {
+		memmove(w->stack, w->stack + w->bottom,
+			st_mult(w->top - w->bottom, sizeof(*w->stack)));
+		w->top -= w->bottom;
+		w->bottom = 0;
+	}
+	ALLOC_GROW(w->stack, w->top + nr, w->alloc);
+	/* Push in reverse, so that the first subtree is read first. */
+	while (nr)
+		w->stack[w->top++] = entries[--nr];
+	pthread_mutex_unlock(&w->mutex);
+}
+
+static void read_entry(struct tree_prefetch_worker *w,
+		       struct tree_prefetch_entry *e)
+{
+	struct tree_prefetch *tp = w->tp;
+	struct object_info oi = OBJECT_INFO_INIT;
+	struct tree_prefetch_entry **subtrees = NULL;
+	size_t subtrees_nr = 0, subtrees_alloc = 0;
+	struct object_id *oids = NULL;
+	size_t oids_nr = 0, oids_alloc = 0;
+	enum object_type type;
+	unsigned long size;
+	void *buf = NULL;
+
+	oi.typep = &type;
+	oi.sizep = &size;
+	oi.contentp = &buf;
+
+	/*
+	 * Never fetch missing objects or reprepare the object database from
+	 * here; the caller will notice and deal with missing trees.
+	 */
+	if (odb_read_object_info_extended(tp->repo->objects, &e->ent.oid, &oi,
+					  OBJECT_INFO_LOOKUP_REPLACE |
+					  OBJECT_INFO_QUICK |
+					  OBJECT_INFO_SKIP_FETCH_OBJECT) ||
+	    type != OBJ_TREE)
+		FREE_AND_NULL(buf);
+
+	if (buf) {
+		struct tree_desc desc;
+		struct name_entry entry;
+
+		if (!init_tree_desc_gently(&desc, &e->ent.oid, buf, size, 0)) {
+			while (tree_entry_gently(&desc, &entry)) {
+				if (!S_ISDIR(entry.mode))
+					continue;
+				ALLOC_GROW(oids, oids_nr + 1, oids_alloc);
+				oidcpy(&oids[oids_nr++], &entry.oid);
+			}
+		}
+	}
+
+	pthread_mutex_lock(&tp->mutex);
+	for (size_t i = 0; i < oids_nr; i++) {
+		struct tree_prefetch_entry *sub = queue_entry(tp, &oids[i]);
+		if (!sub)
+			continue;
+		ALLOC_GROW(subtrees, subtrees_nr + 1, subtrees_alloc);
+		subtrees[subtrees_nr++] = sub;
+	}
+	/*
+	 * Push the subtrees while still holding the mutex, so that idle
+	 * workers never see them counted in nr_queued before they can be
+	 * popped, which would make them spin.
+	 */
+	push_entries(w, subtrees, subtrees_nr);
+	if (subtrees_nr)
+		pthread_cond_broadcast(&tp->work);
+	if (buf) {
+		e->buf = buf;
+		e->size = size;
+		e->state = TREE_PREFETCH_READY;
+		tp->bytes += size;
+		tp->nr_read++;
+	} else {
+		e->state = TREE_PREFETCH_DONE;
+	}
+	pthread_cond_broadcast(&tp->ready);
+	pthread_mutex_unlock(&tp->mutex);
+
+	free(subtrees);
+	free(oids);
+}
+
+static void *tree_prefetch_thread(void *data)
+{
+	struct tree_prefetch_worker *w = data;
+	struct tree_prefetch *tp = w->tp;
+
+	while (1) {
+		struct tree_prefetch_entry *e;
+
+		pthread_mutex_lock(&tp->mutex);
+		while (!tp->shutdown &&
+		       (!tp->nr_queued || tp->bytes >= TREE_PREFETCH_MAX_BYTES))
+			pthread_cond_wait(&tp->work, &tp->mutex);
+		if (tp->shutdown) {
+			pthread_mutex_unlock(&tp->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&tp->mutex);
+
+		e = pop_entry(w);
+		if (!e)
+			continue;
+
+		pthread_mutex_lock(&tp->mutex);
+		if (e->state != TREE_PREFETCH_QUEUED) {
+			/* Given up on by the caller; we held the last reference. */
+			oidmap_remove(&tp->entries, &e->ent.oid);
+			free(e);
+			pthread_mutex_unlock(&tp->mutex);
+			continue;
+		}
+		e->state = TREE_PREFETCH_READING;
+		pthread_mutex_unlock(&tp->mutex);
+
+		read_entry(w, e);
+	}
+
+	return NULL;
+}
+
+struct tree_prefetch *tree_prefetch_start(struct repository *r, int nr_threads)
+{
+	struct tree_prefetch *tp;
+	int nr_started = 0;
+
+	if (!HAVE_THREADS || nr_threads < 1)
+		return NULL;
+
+	CALLOC_ARRAY(tp, 1);
+	tp->repo = r;
+	oidmap_init(&tp->entries, 0);
+	oidset_init(&tp->done, 0);
+	pthread_mutex_init(&tp->mutex, NULL);
+	pthread_cond_init(&tp->work, NULL);
+	pthread_cond_init(&tp->ready, NULL);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(tp->workers, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		struct tree_prefetch_worker *w = &tp->workers[i];
+
+		w->tp = tp;
+		pthread_mutex_init(&w->mutex, NULL);
+	}
+	for (; nr_started < nr_threads; nr_started++) {
+		if (pthread_create(&tp->workers[nr_started].thread, NULL,
+				   tree_prefetch_thread, &tp->workers[nr_started])) {
+			warning(_("unable to start threads for prefetching trees"));
+			break;
+		}
+	}
+
+	/*
+	 * Workers look at nr_workers when stealing. They only do so after
+	 * they have seen queued work under the mutex, which cannot happen
+	 * before we return, so publishing it here is enough.
+	 */
+	pthread_mutex_lock(&tp->mutex);
+	tp->nr_workers = nr_started;
+	pthread_mutex_unlock(&tp->mutex);
+
+	if (!nr_started) {
+		tree_prefetch_finish(tp);
+		return NULL;
+	}
+	return tp;
+}
+
+void tree_prefetch_add(struct tree_prefetch *tp, const struct object_id *oid)
+{
+	struct tree_prefetch_entry *e;
+
+	pthread_mutex_lock(&tp->mutex);
+	e = queue_entry(tp, oid);
+	if (e) {
+		ALLOC_GROW(tp->roots, tp->roots_nr + 1, tp->roots_alloc);
+		tp->roots[tp->roots_nr++] = e;
+		pthread_cond_signal(&tp->work);
+	}
+	pthread_mutex_unlock(&tp->mutex);
+}
+
+void *tree_prefetch_take(struct tree_prefetch *tp, const struct object_id *oid,
+			 unsigned long *size)
+{
+	struct tree_prefetch_entry *e;
+	void *buf = NULL;
+
+	pthread_mutex_lock(&tp->mutex);
+	e = oidmap_get(&tp->entries, oid);
+	/*
+	 * Wait for a tree that is being read, or that is queued and will
+	 * be read soon. But do not wait for queued trees once the workers
+	 * are stalled on the memory limit; the trees they have read may
+	 * not be needed any time soon.
+	 */
+	while (e && (e->state == TREE_PREFETCH_READING ||
+		     (e->state == TREE_PREFETCH_QUEUED &&
+		      tp->bytes < TREE_PREFETCH_MAX_BYTES)))
+		pthread_cond_wait(&tp->ready, &tp->mutex);
+
+	if (e && e->state == TREE_PREFETCH_READY) {
+		buf = e->buf;
+		*size = e->size;
+		e->buf = NULL;
+		tp->bytes -= e->size;
+		tp->nr_taken++;
+		pthread_cond_broadcast(&tp->work);
+	}
+	if (e) {
+		oidset_insert(&tp->done, oid);
+		if (e->state == TREE_PREFETCH_QUEUED) {
+			/* Still on a stack; the worker popping it frees it. */
+			e->state = TREE_PREFETCH_DONE;
+		} else {
+			oidmap_remove(&tp->entries, oid);
+			free(e);
+		}
+	}
+	pthread_mutex_unlock(&tp->mutex);
+
+	return buf;
+}
+
+void tree_prefetch_finish(struct tree_prefetch *tp)
+{
+	struct oidmap_iter iter;
+	struct tree_prefetch_entry *e;
+
+	if (!tp)
+		return;
+
+	pthread_mutex_lock(&tp->mutex);
+	tp->shutdown = 1;
+	pthread_cond_broadcast(&tp->work);
+	pthread_mutex_unlock(&tp->mutex);
+
+	for (int i = 0; i < tp->nr_workers; i++)
+		pthread_join(tp->workers[i].thread, NULL);
+
+	trace2_data_intmax("tree-prefetch", tp->repo, "read", tp->nr_read);
+	trace2_data_intmax("tree-prefetch", tp->repo, "taken", tp->nr_taken);
+
+	oidmap_iter_init(&tp->entries, &iter);
+	while ((e = oidmap_iter_next(&iter)))
+		free(e->buf);
+	oidmap_clear(&tp->entries, 1);
+	oidset_clear(&tp->done);
+
+	for (int i = 0; i < tp->nr_workers; i++) {
+		pthread_mutex_destroy(&tp->workers[i].mutex);
+		free(tp->workers[i].stack);
+	}
+	free(tp->workers);
+	free(tp->roots);
+	pthread_mutex_destroy(&tp->mutex);
+	pthread_cond_destroy(&tp->work);
+	pthread_cond_destroy(&tp->ready);
+	disable_obj_read_lock();
+	free(tp);
+}
@@ -0,0 +1,45 @@
+#ifndef TREE_PREFETCH_H
+#define TREE_PREFETCH_H
+
+struct object_id;
+struct repository;
+
+/*
+ * A tree prefetcher reads trees in the background, ahead of a caller
+ * that walks them in its own order. The caller hands it the root trees
+ * it is going to visit; a pool of threads reads these, discovers their
+ * subtrees and reads those in turn. Every tree is read at most once.
+ *
+ * Each thread keeps its own stack of trees to read, so that it walks
+ * the trees it discovered depth first, and takes work from the other
+ * threads when it runs out. The amount of tree data that has been read
+ * but not yet taken by the caller is bounded.
+ *
+ * The prefetcher enables the object read lock while it is running.
+ * The caller must hold obj_read_lock() around anything that may touch
+ * the object database and does not take the lock itself.
+ */
+struct tree_prefetch;
+
+/*
+ * Start a prefetcher with the given number of threads. Returns NULL if
+ * no thread could be started.
+ */
+struct tree_prefetch *tree_prefetch_start(struct repository *r, int nr_threads);
+
+/* Queue a root tree to be read, unless it has been queued before. */
+void tree_prefetch_add(struct tree_prefetch *tp, const struct object_id *oid);
+
+/*
+ * Return the contents of tree "oid" if it has been read, waiting for a
+ * thread that is currently reading it. Ownership of the buffer passes
+ * to the caller. Returns NULL if the tree is not available, in which
+ * case the caller has to read it itself.
+ */
+void *tree_prefetch_take(struct tree_prefetch *tp, const struct object_id *oid,
+			 unsigned long *size);
+
+/* Stop all threads and release all trees that were not taken. */
+void tree_prefetch_finish(struct tree_prefetch *tp);
+
+#endif /* TREE_PREFETCH_H */
@@ -54,6 +54,27 @@ static void find_better_matching_suffix(const char *tagname, const char *suffix,
 		}
 }
 
+static int swap_matching_suffixes(const struct suffix_match *match1,
+				  const struct suffix_match *match2,
+				  int *diff)
+{
+	if (match1->conf_pos == -1 && match2->conf_pos == -1)
+		return 0;
+	if (match1->conf_pos == match2->conf_pos)
+		/* Found the same suffix in both, e.g. "-rc" in "v1.0-rcX"
+		 * and "v1.0-rcY": the caller should decide based on "X"
+		 * and "Y". */
+		return 0;
+
+	if (match1->conf_pos >= 0 && match2->conf_pos >= 0)
+		*diff = match1->conf_pos - match2->conf_pos;
+	else if (match1->conf_pos >= 0)
+		*diff = -1;
+	else /* if (match2->conf_pos >= 0) */
+		*diff = 1;
+	return 1;
+}
+
 /*
  * off is the offset of the first different character in the two strings
  * s1 and s2. If either s1 or s2 contains a prerelease suffix containing
@@ -92,21 +113,65 @@ static int swap_prereleases(const char *s1,
 		find_better_matching_suffix(s2, suffix, suffix_len, start,
 					    i, &match2);
 	}
-	if (match1.conf_pos == -1 && match2.conf_pos == -1)
-		return 0;
-	if (match1.conf_pos == match2.conf_pos)
-		/* Found the same suffix in both, e.g. "-rc" in "v1.0-rcX"
-		 * and "v1.0-rcY": the caller should decide based on "X"
-		 * and "Y". */
-		return 0;
+	return swap_matching_suffixes(&match1, &match2, diff);
+}
 
-	if (match1.conf_pos >= 0 && match2.conf_pos >= 0)
-		*diff = match1.conf_pos - match2.conf_pos;
-	else if (match1.conf_pos >= 0)
-		*diff = -1;
-	else /* if (match2.conf_pos >= 0) */
-		*diff = 1;
-	return 1;
+/*
+ * Same as find_better_matching_suffix() for all configured suffixes in
+ * turn, but using the suffixes found in a key by version_key_init(). As
+ * they are sorted in the order of preference, the first one that covers
+ * the offset is the best match.
+ */
+static void find_best_key_suffix(const struct version_key *key, int off,
+				 struct suffix_match *match)
+{
+	for (size_t i = 0; i < key->suffixes_nr; i++) {
+		const struct suffix_match *m = &key->suffixes[i];
+
+		if (m->start > off)
+			break;
+		if (m->start + m->len >= off) {
+			*match = *m;
+			return;
+		}
+	}
+}
+
+static int swap_prereleases_key(const struct version_key *k1,
+				const struct version_key *k2,
+				int off,
+				int *diff)
+{
+	struct suffix_match match1 = { -1, off, -1 };
+	struct suffix_match match2 = { -1, off, -1 };
+
+	find_best_key_suffix(k1, off, &match1);
+	find_best_key_suffix(k2, off, &match2);
+	return swap_matching_suffixes(&match1, &match2, diff);
+}
+
+static void read_prereleases(void)
+{
+	const char *const newk = "versionsort.suffix";
+	const char *const oldk = "versionsort.prereleasesuffix";
+	const struct string_list *newl;
+	const struct string_list *oldl;
+	int new, old;
+
+	if (initialized)
+		return;
+
+	new = repo_config_get_string_multi(the_repository, newk, &newl);
+	old = repo_config_get_string_multi(the_repository, oldk, &oldl);
+
+	if (!new && !old)
+		warning("ignoring %s because %s is set", oldk, newk);
+	if (!new)
+		prereleases = newl;
+	else if (!old)
+		prereleases = oldl;
+
+	initialized = 1;
 }
 
 /*
@@ -114,9 +179,13 @@ static int swap_prereleases(const char *s1,
  * returning less than, equal to or greater than zero if S1 is less
  * than, equal to or greater than S2 (for more info, see the texinfo
  * doc).
+ *
+ * If K1 and K2 are given, they are the keys of S1 and S2 and are used
+ * to look up prerelease suffixes.
  */
-
-int versioncmp(const char *s1, const char *s2)
+static int compare_versions(const char *s1, const char *s2,
+			    const struct version_key *k1,
+			    const struct version_key *k2)
 {
 	const unsigned char *p1 = (const unsigned char *) s1;
 	const unsigned char *p2 = (const unsigned char *) s2;
@@ -162,26 +231,14 @@ int versioncmp(const char *s1, const char *s2)
 		state += (c1 == '0') + (isdigit (c1) != 0);
 	}
 
-	if (!initialized) {
-		const char *const newk = "versionsort.suffix";
-		const char *const oldk = "versionsort.prereleasesuffix";
-		const struct string_list *newl;
-		const struct string_list *oldl;
-		int new = repo_config_get_string_multi(the_repository, newk, &newl);
-		int old = repo_config_get_string_multi(the_repository, oldk, &oldl);
-
-		if (!new && !old)
-			warning("ignoring %s because %s is set", oldk, newk);
-		if (!new)
-			prereleases = newl;
-		else if (!old)
-			prereleases = oldl;
-
-		initialized = 1;
+	read_prereleases();
+	if (prereleases) {
+		int off = (const char *) p1 - s1 - 1;
+		int swap = k1 ? swap_prereleases_key(k1, k2, off, &diff) :
+				swap_prereleases(s1, s2, off, &diff);
+		if (swap)
+			return diff;
 	}
-	if (prereleases && swap_prereleases(s1, s2, (const char *) p1 - s1 - 1,
-					    &diff))
-		return diff;
 
 	state = result_type[state * 3 + (((c2 == '0') + (isdigit (c2) != 0)))];
 
@@ -200,3 +257,61 @@ int versioncmp(const char *s1, const char *s2)
 		return state;
 	}
 }
+
+int versioncmp(const char *s1, const char *s2)
+{
+	return compare_versions(s1, s2, NULL, NULL);
+}
+
+static int suffix_match_cmp(const void *a_, const void *b_)
+{
+	const struct suffix_match *a = a_, *b = b_;
+
+	/* Earlier matches first, then longer ones, then configuration order. */
+	if (a->start != b->start)
+		return a->start < b->start ? -1 : 1;
+	if (a->len != b->len)
+		return a->len > b->len ? -1 : 1;
+	return a->conf_pos < b->conf_pos ? -1 : a->conf_pos > b->conf_pos;
+}
+
+void version_key_init(struct version_key *key, const char *s)
+{
+	size_t len = strlen(s), alloc = 0;
+
+	memset(key, 0, sizeof(*key));
+	key->s = s;
+
+	read_prereleases();
+	if (!prereleases)
+		return;
+
+	for (size_t i = 0; i <= len; i++) {
+		for (size_t j = 0; j < prereleases->nr; j++) {
+			const char *suffix = prereleases->items[j].string;
+			struct suffix_match *m;
+
+			if (!starts_with(s + i, suffix))
+				continue;
+
+			ALLOC_GROW(key->suffixes, key->suffixes_nr + 1, alloc);
+			m = &key->suffixes[key->suffixes_nr++];
+			m->conf_pos = j;
+			m->start = i;
+			m->len = strlen(suffix);
+		}
+	}
+
+	QSORT(key->suffixes, key->suffixes_nr, suffix_match_cmp);
+}
+
+void version_key_release(struct version_key *key)
+{
+	FREE_AND_NULL(key->suffixes);
+	key->suffixes_nr = 0;
+}
+
+int versioncmp_key(const struct version_key *k1, const struct version_key *k2)
+{
+	return compare_versions(k1->s, k2->s, k1, k2);
+}
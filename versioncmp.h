@@ -3,4 +3,23 @@
 
 int versioncmp(const char *s1, const char *s2);
 
+/*
+ * A string prepared for repeated comparisons with versioncmp_key(),
+ * e.g. when sorting. The occurrences of the configured prerelease
+ * suffixes are searched for once when initializing the key instead of
+ * on every comparison. The key does not copy the string, which thus
+ * needs to stay around for as long as the key is used.
+ */
+struct version_key {
+	const char *s;
+	struct suffix_match *suffixes;
+	size_t suffixes_nr;
+};
+
+void version_key_init(struct version_key *key, const char *s);
+void version_key_release(struct version_key *key);
+
+/* Same as versioncmp(), but for prepared keys. */
+int versioncmp_key(const struct version_key *k1, const struct version_key *k2);
+
 #endif /* VERSIONCMP_H */